@@ -0,0 +1,19 @@
+#ifndef RABBIT_HEARTBEAT_H
+#define RABBIT_HEARTBEAT_H
+
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+// the worker is alive, sent once per heartbeat interval
+struct Heartbeat {
+};
+
+inline void to_json(json &j, const struct Heartbeat &) {
+    j = json::object();
+}
+
+inline void from_json(const json &, struct Heartbeat &) {
+}
+
+#endif //RABBIT_HEARTBEAT_H
@@ -1,8 +1,18 @@
 #ifndef RABBIT_MESSAGE_H
 #define RABBIT_MESSAGE_H
 
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <nlohmann/json.hpp>
+#include "Client.h"
+#include "Heartbeat.h"
+#include "TaskBatch.h"
+#include "TaskReject.h"
+#include "TaskRequest.h"
+#include "TaskResult.h"
+#include "TaskSteal.h"
+#include "Worker.h"
 
 using json = nlohmann::json;
 
@@ -14,6 +24,14 @@ enum MessageType {
     RegisterWorker,
     TaskRequest,
     TaskResult,
+    TaskBatchRequest,
+    TaskBatchResult,
+    TaskSteal,
+    TaskReturn,
+    Heartbeat,
+    TaskCancel,
+    TaskReject,
+    TaskGraph,
     Invalid = -1
 };
 
@@ -23,12 +41,29 @@ NLOHMANN_JSON_SERIALIZE_ENUM(MessageType, {
     { RegisterWorker, "registerWorker" },
     { TaskRequest, "request" },
     { TaskResult, "result" },
+    { TaskBatchRequest, "batchRequest" },
+    { TaskBatchResult, "batchResult" },
+    { TaskSteal, "steal" },
+    { TaskReturn, "return" },
+    { Heartbeat, "heartbeat" },
+    { TaskCancel, "cancel" },
+    { TaskReject, "reject" },
+    { TaskGraph, "graph" },
     { Invalid, nullptr },
 })
 
+// Binary is the normal format, Json is kept for debugging.
+// Receivers detect the format of every message by its first byte
+enum class WireFormat {
+    Binary,
+    Json,
+};
+
 struct Message {
     MessageType action;
+    // payload encoded in the format of the message
     std::string data;
+    WireFormat format = WireFormat::Json;
 };
 
 inline void to_json(nlohmann::json &j, const Message &m) {
@@ -39,6 +74,719 @@ inline void to_json(nlohmann::json &j, const Message &m) {
 inline void from_json(const nlohmann::json &j, Message &m) {
     j.at("action").get_to(m.action);
     j.at("data").get_to(m.data);
+    m.format = WireFormat::Json;
+}
+
+// Binary envelope:
+//   u8 magic, u8 version, u8 action, u32 payload size, payload
+// Payload fields follow each other: integers are little endian, strings and opaque
+// data are u32 size followed by the bytes. Fields added by later versions go to the end,
+// decoders ignore what they do not know
+namespace wire {
+    const uint8_t MAGIC = 0xB7; // never the first byte of a JSON text
+    const uint8_t VERSION = 1;
+    const size_t ENVELOPE_SIZE = 7;
+
+    class Writer {
+    public:
+        explicit Writer(size_t reserve = 64) {
+            out.reserve(reserve);
+        }
+
+        void u8(uint8_t value) {
+            out.push_back(static_cast<char>(value));
+        }
+
+        void u32(uint32_t value) {
+            char bytes[4] = {static_cast<char>(value), static_cast<char>(value >> 8),
+                             static_cast<char>(value >> 16), static_cast<char>(value >> 24)};
+            out.append(bytes, 4);
+        }
+
+        void i32(int32_t value) {
+            u32(static_cast<uint32_t>(value));
+        }
+
+        void i64(int64_t value) {
+            u32(static_cast<uint32_t>(value));
+            u32(static_cast<uint32_t>(static_cast<uint64_t>(value) >> 32));
+        }
+
+        void bytes(const char *data, size_t size) {
+            u32(static_cast<uint32_t>(size));
+            out.append(data, size);
+        }
+
+        void str(const std::string &value) {
+            bytes(value.data(), value.size());
+        }
+
+        // the size of the payload must be known before it is written
+        void envelope(MessageType action, size_t payloadSize) {
+            u8(MAGIC);
+            u8(VERSION);
+            u8(static_cast<uint8_t>(action));
+            u32(static_cast<uint32_t>(payloadSize));
+        }
+
+        std::string &result() {
+            return out;
+        }
+
+    private:
+        std::string out;
+    };
+
+    class Reader {
+    public:
+        Reader(const char *data, size_t size) : p(reinterpret_cast<const uint8_t *>(data)), end(p + size) {}
+
+        uint8_t u8() {
+            if (!need(1)) return 0;
+            return *p++;
+        }
+
+        uint32_t u32() {
+            if (!need(4)) return 0;
+            uint32_t value = p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+            p += 4;
+            return value;
+        }
+
+        int32_t i32() {
+            return static_cast<int32_t>(u32());
+        }
+
+        int64_t i64() {
+            uint64_t low = u32();
+            return static_cast<int64_t>(low | static_cast<uint64_t>(u32()) << 32);
+        }
+
+        std::string str() {
+            const char *data;
+            size_t size;
+            if (!bytes(data, size)) return {};
+            return {data, size};
+        }
+
+        // length-prefixed field without copying, data points into the buffer
+        bool bytes(const char *&data, size_t &size) {
+            size = u32();
+            if (!need(size)) return false;
+            data = reinterpret_cast<const char *>(p);
+            p += size;
+            return true;
+        }
+
+        bool ok() const {
+            return valid;
+        }
+
+        size_t remaining() const {
+            return end - p;
+        }
+
+    private:
+        const uint8_t *p;
+        const uint8_t *end;
+        bool valid = true;
+
+        bool need(size_t size) {
+            if (!valid || static_cast<size_t>(end - p) < size) {
+                valid = false;
+                return false;
+            }
+            return true;
+        }
+    };
+}
+
+inline size_t encodedSize(const std::string &id, const std::string &func, size_t dataSize) {
+    return 16 + id.size() + func.size() + dataSize;
+}
+
+inline void encodeFields(wire::Writer &writer, const struct TaskRequest &request) {
+    writer.str(request.id);
+    writer.str(request.func);
+    writer.i32(request.cores);
+    writer.str(request.data);
+}
+
+// deadline and timeout were added later and are only written when set: after the data of a
+// single request, after all items of a batch. Priority came after them and follows them the
+// same way, limits are written (as zeros) whenever a priority is
+const size_t LIMITS_SIZE = 12;
+const size_t PRIORITY_SIZE = 4;
+
+inline bool hasPriority(const struct TaskRequest &request) {
+    return request.priority != 0;
+}
+
+inline bool hasLimits(const struct TaskRequest &request) {
+    return request.deadline != 0 || request.timeout != 0 || hasPriority(request);
+}
+
+inline void encodeLimits(wire::Writer &writer, const struct TaskRequest &request) {
+    writer.i64(request.deadline);
+    writer.i32(request.timeout);
+}
+
+inline void decodeLimits(wire::Reader &reader, int64_t &deadline, int &timeout) {
+    if (reader.remaining() < LIMITS_SIZE) {
+        deadline = 0;
+        timeout = 0;
+        return;
+    }
+    deadline = reader.i64();
+    timeout = reader.i32();
+}
+
+inline void decodePriority(wire::Reader &reader, int &priority) {
+    priority = reader.remaining() < PRIORITY_SIZE ? 0 : reader.i32();
+}
+
+inline std::string encodePayload(const struct TaskRequest &request) {
+    bool limits = hasLimits(request);
+    bool priority = hasPriority(request);
+    wire::Writer writer(encodedSize(request.id, request.func, request.data.size()) + (limits ? LIMITS_SIZE : 0) +
+                        (priority ? PRIORITY_SIZE : 0));
+    encodeFields(writer, request);
+    if (limits) {
+        encodeLimits(writer, request);
+    }
+    if (priority) {
+        writer.i32(request.priority);
+    }
+    return std::move(writer.result());
+}
+
+// Binary TaskRequest message written straight from the fields, data is copied once
+inline std::string packTaskRequest(const std::string &id, const std::string &func, int cores,
+                                   const std::string &data) {
+    size_t payloadSize = encodedSize(id, func, data.size());
+    wire::Writer writer(wire::ENVELOPE_SIZE + payloadSize);
+    writer.envelope(MessageType::TaskRequest, payloadSize);
+    writer.str(id);
+    writer.str(func);
+    writer.i32(cores);
+    writer.str(data);
+    return std::move(writer.result());
+}
+
+inline bool decodeFields(wire::Reader &reader, struct TaskRequest &request) {
+    request.id = reader.str();
+    request.func = reader.str();
+    request.cores = reader.i32();
+    request.data = reader.str();
+    return reader.ok();
+}
+
+inline bool decodePayload(wire::Reader &reader, struct TaskRequest &request) {
+    if (!decodeFields(reader, request)) return false;
+    decodeLimits(reader, request.deadline, request.timeout);
+    decodePriority(reader, request.priority);
+    return reader.ok();
+}
+
+inline void encodeFields(wire::Writer &writer, const struct TaskResult &result) {
+    writer.str(result.id);
+    writer.i32(result.status);
+    writer.str(result.data);
+}
+
+inline std::string encodePayload(const struct TaskResult &result) {
+    wire::Writer writer(result.id.size() + result.data.size() + 12);
+    encodeFields(writer, result);
+    return std::move(writer.result());
+}
+
+inline bool decodePayload(wire::Reader &reader, struct TaskResult &result) {
+    result.id = reader.str();
+    result.status = reader.i32();
+    result.data = reader.str();
+    return reader.ok();
+}
+
+// Batches are u32 count followed by the fields of every item
+inline std::string encodePayload(const struct TaskBatchRequest &batch) {
+    size_t size = 4;
+    bool limits = false;
+    bool priority = false;
+    for (const auto &request: batch.tasks) {
+        size += encodedSize(request.id, request.func, request.data.size());
+        limits = limits || hasLimits(request);
+        priority = priority || hasPriority(request);
+    }
+    if (limits) {
+        size += batch.tasks.size() * LIMITS_SIZE;
+    }
+    if (priority) {
+        size += batch.tasks.size() * PRIORITY_SIZE;
+    }
+    wire::Writer writer(size);
+    writer.u32(static_cast<uint32_t>(batch.tasks.size()));
+    for (const auto &request: batch.tasks) {
+        encodeFields(writer, request);
+    }
+    if (limits) {
+        for (const auto &request: batch.tasks) {
+            encodeLimits(writer, request);
+        }
+    }
+    if (priority) {
+        for (const auto &request: batch.tasks) {
+            writer.i32(request.priority);
+        }
+    }
+    return std::move(writer.result());
+}
+
+inline bool decodePayload(wire::Reader &reader, struct TaskBatchRequest &batch) {
+    uint32_t count = reader.u32();
+    // every item takes at least 16 bytes, a corrupted count must not allocate gigabytes
+    if (!reader.ok() || count > reader.remaining() / 16) return false;
+    batch.tasks.resize(count);
+    for (auto &request: batch.tasks) {
+        if (!decodeFields(reader, request)) return false;
+    }
+    for (auto &request: batch.tasks) {
+        decodeLimits(reader, request.deadline, request.timeout);
+    }
+    for (auto &request: batch.tasks) {
+        decodePriority(reader, request.priority);
+    }
+    return reader.ok();
+}
+
+// a graph is written as a batch
+inline std::string encodePayload(const struct TaskGraph &graph) {
+    struct TaskBatchRequest batch{graph.tasks};
+    return encodePayload(batch);
+}
+
+inline bool decodePayload(wire::Reader &reader, struct TaskGraph &graph) {
+    struct TaskBatchRequest batch;
+    if (!decodePayload(reader, batch)) return false;
+    graph.tasks = std::move(batch.tasks);
+    return true;
+}
+
+inline std::string encodePayload(const struct TaskBatchResult &batch) {
+    size_t size = 4;
+    for (const auto &result: batch.results) {
+        size += result.id.size() + result.data.size() + 12;
+    }
+    wire::Writer writer(size);
+    writer.u32(static_cast<uint32_t>(batch.results.size()));
+    for (const auto &result: batch.results) {
+        encodeFields(writer, result);
+    }
+    return std::move(writer.result());
+}
+
+inline bool decodePayload(wire::Reader &reader, struct TaskBatchResult &batch) {
+    uint32_t count = reader.u32();
+    if (!reader.ok() || count > reader.remaining() / 12) return false;
+    batch.results.resize(count);
+    for (auto &result: batch.results) {
+        if (!decodePayload(reader, result)) return false;
+    }
+    return true;
+}
+
+inline std::string encodePayload(const struct TaskSteal &steal) {
+    wire::Writer writer(4);
+    writer.i32(steal.count);
+    return std::move(writer.result());
+}
+
+inline bool decodePayload(wire::Reader &reader, struct TaskSteal &steal) {
+    steal.count = reader.i32();
+    return reader.ok();
+}
+
+inline std::string encodePayload(const struct TaskReturn &taskReturn) {
+    wire::Writer writer;
+    writer.u32(static_cast<uint32_t>(taskReturn.ids.size()));
+    for (const auto &id: taskReturn.ids) {
+        writer.str(id);
+    }
+    return std::move(writer.result());
+}
+
+inline bool decodePayload(wire::Reader &reader, struct TaskReturn &taskReturn) {
+    uint32_t count = reader.u32();
+    if (!reader.ok() || count > reader.remaining() / 4) return false;
+    taskReturn.ids.resize(count);
+    for (auto &id: taskReturn.ids) {
+        id = reader.str();
+    }
+    return reader.ok();
+}
+
+inline std::string encodePayload(const struct TaskCancel &cancel) {
+    wire::Writer writer;
+    writer.u32(static_cast<uint32_t>(cancel.ids.size()));
+    for (const auto &id: cancel.ids) {
+        writer.str(id);
+    }
+    return std::move(writer.result());
+}
+
+inline bool decodePayload(wire::Reader &reader, struct TaskCancel &cancel) {
+    uint32_t count = reader.u32();
+    if (!reader.ok() || count > reader.remaining() / 4) return false;
+    cancel.ids.resize(count);
+    for (auto &id: cancel.ids) {
+        id = reader.str();
+    }
+    return reader.ok();
+}
+
+inline std::string encodePayload(const struct TaskReject &reject) {
+    wire::Writer writer;
+    writer.u32(static_cast<uint32_t>(reject.ids.size()));
+    for (const auto &id: reject.ids) {
+        writer.str(id);
+    }
+    writer.i32(reject.retryAfter);
+    writer.str(reject.reason);
+    return std::move(writer.result());
+}
+
+inline bool decodePayload(wire::Reader &reader, struct TaskReject &reject) {
+    uint32_t count = reader.u32();
+    if (!reader.ok() || count > reader.remaining() / 4) return false;
+    reject.ids.resize(count);
+    for (auto &id: reject.ids) {
+        id = reader.str();
+    }
+    reject.retryAfter = reader.i32();
+    reject.reason = reader.str();
+    return reader.ok();
+}
+
+inline std::string encodePayload(const struct Heartbeat &) {
+    return {};
+}
+
+inline bool decodePayload(wire::Reader &, struct Heartbeat &) {
+    return true;
+}
+
+inline std::string encodePayload(const Worker &worker) {
+    wire::Writer writer;
+    writer.str(worker.id);
+    writer.i32(worker.cores);
+    writer.i32(worker.usedCores);
+    writer.i32(worker.prefetch);
+    if (!worker.queues.empty()) {
+        writer.u32(static_cast<uint32_t>(worker.queues.size()));
+        for (const auto &queue: worker.queues) {
+            writer.str(queue);
+        }
+    }
+    return std::move(writer.result());
+}
+
+inline bool decodePayload(wire::Reader &reader, Worker &worker) {
+    worker.id = reader.str();
+    worker.cores = reader.i32();
+    worker.usedCores = reader.i32();
+    // added after the first version of the format
+    worker.prefetch = reader.remaining() >= 4 ? reader.i32() : 0;
+    worker.queues.clear();
+    if (reader.remaining() >= 4) {
+        uint32_t count = reader.u32();
+        if (!reader.ok() || count > reader.remaining() / 4) return false;
+        worker.queues.resize(count);
+        for (auto &queue: worker.queues) {
+            queue = reader.str();
+        }
+    }
+    worker.connection = nullptr;
+    return reader.ok();
+}
+
+inline std::string encodePayload(const Client &client) {
+    wire::Writer writer;
+    writer.str(client.id);
+    return std::move(writer.result());
+}
+
+inline bool decodePayload(wire::Reader &reader, Client &client) {
+    client.id = reader.str();
+    client.connection = nullptr;
+    return reader.ok();
+}
+
+// Builds a message from an already encoded payload
+inline std::string packMessage(MessageType action, const std::string &payload, WireFormat format) {
+    if (format == WireFormat::Json) {
+        return json(Message{action, payload, WireFormat::Json}).dump();
+    }
+    wire::Writer writer(wire::ENVELOPE_SIZE + payload.size());
+    writer.envelope(action, payload.size());
+    writer.result().append(payload);
+    return std::move(writer.result());
+}
+
+template<typename T>
+std::string packMessage(MessageType action, const T &value, WireFormat format = WireFormat::Binary) {
+    if (format == WireFormat::Json) {
+        return packMessage(action, json(value).dump(), format);
+    }
+    return packMessage(action, encodePayload(value), format);
+}
+
+// Parses the envelope of a message in either format.
+// Returns false if the message is malformed
+inline bool unpackMessage(const char *data, size_t size, Message &message) {
+    if (size > 0 && static_cast<uint8_t>(data[0]) == wire::MAGIC) {
+        wire::Reader reader(data, size);
+        reader.u8();
+        if (reader.u8() != wire::VERSION) {
+            return false;
+        }
+        message.action = static_cast<MessageType>(reader.u8());
+        message.data = reader.str();
+        message.format = WireFormat::Binary;
+        return reader.ok();
+    }
+
+    try {
+        message = json::parse(data, data + size).template get<Message>();
+    } catch (json::exception &e) {
+        return false;
+    }
+    return true;
+}
+
+// Decodes the payload of a message in the format it came in.
+// Returns false if the payload is malformed
+template<typename T>
+bool unpackPayload(const Message &message, T &value) {
+    if (message.format == WireFormat::Binary) {
+        wire::Reader reader(message.data.data(), message.data.size());
+        return decodePayload(reader, value);
+    }
+    try {
+        json::parse(message.data).get_to(value);
+    } catch (json::exception &e) {
+        return false;
+    }
+    return true;
+}
+
+// Message read in place: the payload is not copied out of the receive buffer.
+// A JSON message is converted to the binary payload, so readers handle one format
+struct MessageView {
+    MessageType action = MessageType::Invalid;
+    // format the message came in
+    WireFormat format = WireFormat::Binary;
+
+    const char *payload() const {
+        return converted ? convertedPayload.data() : raw;
+    }
+
+    size_t payloadSize() const {
+        return converted ? convertedPayload.size() : rawSize;
+    }
+
+    const char *raw = nullptr;
+    size_t rawSize = 0;
+    bool converted = false;
+    std::string convertedPayload;
+};
+
+// data must outlive the view
+inline bool unpackMessage(const char *data, size_t size, MessageView &view) {
+    if (size > 0 && static_cast<uint8_t>(data[0]) == wire::MAGIC) {
+        wire::Reader reader(data, size);
+        reader.u8();
+        if (reader.u8() != wire::VERSION) {
+            return false;
+        }
+        view.action = static_cast<MessageType>(reader.u8());
+        view.format = WireFormat::Binary;
+        view.converted = false;
+        return reader.bytes(view.raw, view.rawSize);
+    }
+
+    Message message;
+    if (!unpackMessage(data, size, message)) {
+        return false;
+    }
+    view.action = message.action;
+    view.format = WireFormat::Json;
+    view.converted = true;
+
+    auto convert = [&](auto &value) {
+        if (!unpackPayload(message, value)) return false;
+        view.convertedPayload = encodePayload(value);
+        return true;
+    };
+    switch (message.action) {
+        case MessageType::RegisterClient: {
+            Client client;
+            return convert(client);
+        }
+        case MessageType::RegisterWorker: {
+            Worker worker;
+            return convert(worker);
+        }
+        case MessageType::TaskRequest: {
+            struct TaskRequest request;
+            return convert(request);
+        }
+        case MessageType::TaskResult: {
+            struct TaskResult result;
+            return convert(result);
+        }
+        case MessageType::TaskBatchRequest: {
+            struct TaskBatchRequest batch;
+            return convert(batch);
+        }
+        case MessageType::TaskBatchResult: {
+            struct TaskBatchResult batch;
+            return convert(batch);
+        }
+        case MessageType::TaskSteal: {
+            struct TaskSteal steal;
+            return convert(steal);
+        }
+        case MessageType::TaskReturn: {
+            struct TaskReturn taskReturn;
+            return convert(taskReturn);
+        }
+        case MessageType::Heartbeat: {
+            struct Heartbeat heartbeat;
+            return convert(heartbeat);
+        }
+        case MessageType::TaskCancel: {
+            struct TaskCancel cancel;
+            return convert(cancel);
+        }
+        case MessageType::TaskReject: {
+            struct TaskReject reject;
+            return convert(reject);
+        }
+        case MessageType::TaskGraph: {
+            struct TaskGraph graph;
+            return convert(graph);
+        }
+        default:
+            return false;
+    }
+}
+
+template<typename T>
+bool unpackPayload(const MessageView &view, T &value) {
+    wire::Reader reader(view.payload(), view.payloadSize());
+    return decodePayload(reader, value);
+}
+
+// Fields the broker routes a task by, data stays in the message buffer
+struct TaskRequestHeader {
+    std::string id;
+    std::string func;
+    int cores;
+    const char *data;
+    size_t dataSize;
+    int64_t deadline = 0;
+    int timeout = 0;
+    int priority = 0;
+};
+
+inline bool readHeader(wire::Reader &reader, TaskRequestHeader &header) {
+    header.id = reader.str();
+    header.func = reader.str();
+    header.cores = reader.i32();
+    return reader.bytes(header.data, header.dataSize);
+}
+
+inline bool unpackHeader(const MessageView &view, TaskRequestHeader &header) {
+    wire::Reader reader(view.payload(), view.payloadSize());
+    if (!readHeader(reader, header)) return false;
+    decodeLimits(reader, header.deadline, header.timeout);
+    decodePriority(reader, header.priority);
+    return reader.ok();
+}
+
+// what follows the items of a batch
+inline void readTrailer(wire::Reader &reader, std::vector<TaskRequestHeader> &headers) {
+    for (auto &header: headers) {
+        decodeLimits(reader, header.deadline, header.timeout);
+    }
+    for (auto &header: headers) {
+        decodePriority(reader, header.priority);
+    }
+}
+
+struct TaskResultHeader {
+    std::string id;
+    int status;
+    const char *data;
+    size_t dataSize;
+};
+
+inline bool readHeader(wire::Reader &reader, TaskResultHeader &header) {
+    header.id = reader.str();
+    header.status = reader.i32();
+    return reader.bytes(header.data, header.dataSize);
+}
+
+inline bool unpackHeader(const MessageView &view, TaskResultHeader &header) {
+    wire::Reader reader(view.payload(), view.payloadSize());
+    return readHeader(reader, header);
+}
+
+inline void readTrailer(wire::Reader &, std::vector<TaskResultHeader> &) {
+}
+
+// Headers of every item of a batch, or of the single item of a plain message
+template<typename Header>
+bool unpackHeaders(const MessageView &view, std::vector<Header> &headers) {
+    headers.clear();
+    if (view.action != MessageType::TaskBatchRequest && view.action != MessageType::TaskBatchResult &&
+        view.action != MessageType::TaskGraph) {
+        headers.emplace_back();
+        return unpackHeader(view, headers.back());
+    }
+    wire::Reader reader(view.payload(), view.payloadSize());
+    uint32_t count = reader.u32();
+    if (!reader.ok() || count > reader.remaining() / 12) return false;
+    headers.resize(count);
+    for (auto &header: headers) {
+        if (!readHeader(reader, header)) return false;
+    }
+    readTrailer(reader, headers);
+    return reader.ok();
+}
+
+// TaskBatchResult written straight from the headers, data is copied once
+inline std::string packResultBatch(const std::vector<TaskResultHeader> &results, WireFormat format) {
+    if (format == WireFormat::Json) {
+        struct TaskBatchResult batch;
+        batch.results.reserve(results.size());
+        for (const auto &result: results) {
+            batch.results.push_back({result.id, std::string(result.data, result.dataSize), result.status});
+        }
+        return packMessage(MessageType::TaskBatchResult, batch, format);
+    }
+    size_t payloadSize = 4;
+    for (const auto &result: results) {
+        payloadSize += result.id.size() + result.dataSize + 12;
+    }
+    wire::Writer writer(wire::ENVELOPE_SIZE + payloadSize);
+    writer.envelope(MessageType::TaskBatchResult, payloadSize);
+    writer.u32(static_cast<uint32_t>(results.size()));
+    for (const auto &result: results) {
+        writer.str(result.id);
+        writer.i32(result.status);
+        writer.bytes(result.data, result.dataSize);
+    }
+    return std::move(writer.result());
 }
 
 #endif //RABBIT_MESSAGE_H
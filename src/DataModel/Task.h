@@ -33,6 +33,8 @@ struct Task {
     TaskStatus status;
     std::string worker_hash_id;
     std::string client_hash_id;
+    // higher goes first, see TaskQueue
+    int priority = 0;
 };
 
 inline void to_json(json &j, const Task &t) {
@@ -43,7 +45,8 @@ inline void to_json(json &j, const Task &t) {
              {"cores",          t.cores},
              {"status",         t.status},
              {"worker_hash_id", t.worker_hash_id},
-             {"client_hash_id", t.client_hash_id}};
+             {"client_hash_id", t.client_hash_id},
+             {"priority",       t.priority}};
 }
 
 inline void from_json(const json &j, Task &t) {
@@ -55,6 +58,7 @@ inline void from_json(const json &j, Task &t) {
     j.at("status").get_to(t.status);
     j.at("worker_hash_id").get_to(t.worker_hash_id);
     j.at("client_hash_id").get_to(t.client_hash_id);
+    t.priority = j.value("priority", 0);
 }
 
 #endif //RABBIT_TASKS_H
@@ -0,0 +1,51 @@
+#ifndef RABBIT_TASKBATCH_H
+#define RABBIT_TASKBATCH_H
+
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "TaskRequest.h"
+#include "TaskResult.h"
+
+using json = nlohmann::json;
+
+// many tasks in one message, the broker queues them at once
+struct TaskBatchRequest {
+    std::vector<struct TaskRequest> tasks;
+};
+
+inline void to_json(json &j, const struct TaskBatchRequest &batch) {
+    j = json{{"tasks", batch.tasks}};
+}
+
+inline void from_json(const json &j, struct TaskBatchRequest &batch) {
+    j.at("tasks").get_to(batch.tasks);
+}
+
+// Tasks that may take the outputs of each other: {"$ref": "id"} anywhere in the JSON data of a
+// task stands for the output of the task with that id in the same graph. Only the results of
+// tasks nothing refers to go back to the client
+struct TaskGraph {
+    std::vector<struct TaskRequest> tasks;
+};
+
+inline void to_json(json &j, const struct TaskGraph &graph) {
+    j = json{{"tasks", graph.tasks}};
+}
+
+inline void from_json(const json &j, struct TaskGraph &graph) {
+    j.at("tasks").get_to(graph.tasks);
+}
+
+struct TaskBatchResult {
+    std::vector<struct TaskResult> results;
+};
+
+inline void to_json(json &j, const struct TaskBatchResult &batch) {
+    j = json{{"results", batch.results}};
+}
+
+inline void from_json(const json &j, struct TaskBatchResult &batch) {
+    j.at("results").get_to(batch.results);
+}
+
+#endif //RABBIT_TASKBATCH_H
@@ -0,0 +1,30 @@
+#ifndef RABBIT_TASKREJECT_H
+#define RABBIT_TASKREJECT_H
+
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+// the broker did not accept these tasks, nothing was created for them. retryAfter - ms until
+// the client may send them again, 0 - once one of its results arrives, -1 - not in this size
+struct TaskReject {
+    std::vector<std::string> ids;
+    int retryAfter;
+    std::string reason;
+};
+
+inline void to_json(json &j, const struct TaskReject &reject) {
+    j = json{{"ids",        reject.ids},
+             {"retryAfter", reject.retryAfter},
+             {"reason",     reject.reason}};
+}
+
+inline void from_json(const json &j, struct TaskReject &reject) {
+    j.at("ids").get_to(reject.ids);
+    j.at("retryAfter").get_to(reject.retryAfter);
+    j.at("reason").get_to(reject.reason);
+}
+
+#endif //RABBIT_TASKREJECT_H
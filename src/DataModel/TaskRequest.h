@@ -1,6 +1,7 @@
 #ifndef RABBIT_TASKREQUEST_H
 #define RABBIT_TASKREQUEST_H
 
+#include <cstdint>
 #include <string>
 #include <nlohmann/json.hpp>
 
@@ -11,6 +12,12 @@ struct TaskRequest {
     std::string func;
     std::string data;
     int cores;
+    // milliseconds since the epoch when the result stops being useful, 0 - none
+    int64_t deadline = 0;
+    // milliseconds one attempt may run before the task is tried elsewhere, 0 - no limit
+    int timeout = 0;
+    // higher goes first, 0 - the lowest
+    int priority = 0;
 };
 
 inline void to_json(json &j, const struct TaskRequest &tr) {
@@ -18,6 +25,9 @@ inline void to_json(json &j, const struct TaskRequest &tr) {
              {"func",  tr.func},
              {"data",  tr.data},
              {"cores", tr.cores}};
+    if (tr.deadline != 0) j["deadline"] = tr.deadline;
+    if (tr.timeout != 0) j["timeout"] = tr.timeout;
+    if (tr.priority != 0) j["priority"] = tr.priority;
 }
 
 inline void from_json(const json &j, struct TaskRequest &tr) {
@@ -25,6 +35,9 @@ inline void from_json(const json &j, struct TaskRequest &tr) {
     j.at("func").get_to(tr.func);
     j.at("data").get_to(tr.data);
     j.at("cores").get_to(tr.cores);
+    tr.deadline = j.value("deadline", int64_t(0));
+    tr.timeout = j.value("timeout", 0);
+    tr.priority = j.value("priority", 0);
 }
 
 #endif //RABBIT_TASKREQUEST_H
@@ -6,6 +6,15 @@
 
 using json = nlohmann::json;
 
+// TaskResult::status: the worker sends RESULT_DONE or RESULT_FAILED (data is the error), the broker
+// sends the timeouts when it gives up on a task
+const int RESULT_DONE = 1;
+const int RESULT_TIMED_OUT = 2;
+const int RESULT_DEADLINE_EXCEEDED = 3;
+const int RESULT_FAILED = 4;
+// not sent by anyone: RabbitClient reports a task the broker rejected with it
+const int RESULT_REJECTED = 5;
+
 struct TaskResult {
     std::string id;
     std::string data;
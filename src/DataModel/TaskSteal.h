@@ -0,0 +1,50 @@
+#ifndef RABBIT_TASKSTEAL_H
+#define RABBIT_TASKSTEAL_H
+
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+// the server asks a worker to give back up to count tasks it has not started yet
+struct TaskSteal {
+    int count;
+};
+
+inline void to_json(json &j, const struct TaskSteal &steal) {
+    j = json{{"count", steal.count}};
+}
+
+inline void from_json(const json &j, struct TaskSteal &steal) {
+    j.at("count").get_to(steal.count);
+}
+
+// the answer to TaskSteal, these tasks will not run on the worker. May be empty
+struct TaskReturn {
+    std::vector<std::string> ids;
+};
+
+inline void to_json(json &j, const struct TaskReturn &taskReturn) {
+    j = json{{"ids", taskReturn.ids}};
+}
+
+inline void from_json(const json &j, struct TaskReturn &taskReturn) {
+    j.at("ids").get_to(taskReturn.ids);
+}
+
+// the task got its result elsewhere or was given up: the worker drops it if it has not
+// started it and does not send the result otherwise
+struct TaskCancel {
+    std::vector<std::string> ids;
+};
+
+inline void to_json(json &j, const struct TaskCancel &cancel) {
+    j = json{{"ids", cancel.ids}};
+}
+
+inline void from_json(const json &j, struct TaskCancel &cancel) {
+    j.at("ids").get_to(cancel.ids);
+}
+
+#endif //RABBIT_TASKSTEAL_H
@@ -2,6 +2,7 @@
 #define RABBIT_WORKER_H
 
 #include <string>
+#include <vector>
 #include <nlohmann/json.hpp>
 #include "protocol/Connection.h"
 
@@ -12,18 +13,32 @@ struct Worker {
     int cores;
     int usedCores;
     STIP::Connection *connection;
+    // tasks the worker accepts into its local queue while its cores are busy
+    int prefetch = 0;
+    // tasks sent to it beyond its free cores that are still waiting there
+    int prefetched = 0;
+    // a steal request to it is waiting for the answer
+    bool stealing = false;
+    // tasks taken back from it and given to other workers
+    int stolen = 0;
+    // queues it takes tasks from, the server's default queue if none
+    std::vector<std::string> queues;
 };
 
 inline void to_json(json &j, const Worker &w) {
     j = json{{"id",        w.id},
              {"cores",     w.cores},
-             {"usedCores", w.usedCores}};
+             {"usedCores", w.usedCores},
+             {"prefetch",  w.prefetch}};
+    if (!w.queues.empty()) j["queues"] = w.queues;
 }
 
 inline void from_json(const json &j, Worker &w) {
     j.at("id").get_to(w.id);
     j.at("cores").get_to(w.cores);
     j.at("usedCores").get_to(w.usedCores);
+    w.prefetch = j.value("prefetch", 0);
+    w.queues = j.value("queues", std::vector<std::string>());
 }
 
 #endif //RABBIT_WORKER_H
@@ -51,6 +51,9 @@ namespace STIP {
             do {
                 response = connection->getPacket(result);
             } while (result && response.header.command != Command::CONNECTION_SYN_ACK);
+            if (result) {
+                connection->setPathToken(response.header.session_id);
+            }
 
             return result;
         });
@@ -98,6 +98,29 @@ std::string promptMatrixDeterminantTask() {
     return data.dump();
 }
 
+std::vector<struct TaskRequest> promptSimpleMathBatch(int cores) {
+    int taskCount;
+    std::cout << "Enter task count:" << std::endl;
+    std::cout << "> ";
+    std::cin >> taskCount;
+    if (std::cin.fail() || taskCount <= 0) {
+        std::cin.clear();
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        throw std::runtime_error("Invalid input for task count.");
+    }
+
+    std::mt19937 gen(std::random_device{}());
+    std::uniform_int_distribution<> distrib(0, 99);
+    std::vector<struct TaskRequest> tasks;
+    tasks.reserve(taskCount);
+    for (int i = 0; i < taskCount; ++i) {
+        json data = {{"a", distrib(gen)}, {"b", distrib(gen)}};
+        // the server gives ids to tasks without one, random ids could collide in a big batch
+        tasks.push_back({"", "simpleMath", data.dump(), cores});
+    }
+    return tasks;
+}
+
 void *receiverThread(void *arg) {
     auto *client = static_cast<RabbitClient *>(arg);
     client->receiveResutls();
@@ -112,6 +135,8 @@ void *senderThread(void *arg) {
         std::cout << "1 - simple math" << std::endl;
         std::cout << "2 - matrix determinant" << std::endl;
         std::cout << "3 - matrix multiplication" << std::endl;
+        std::cout << "4 - batch of simple math tasks" << std::endl;
+        std::cout << "5 - determinant of a matrix product, in one graph" << std::endl;
         std::cout << "0 - exit console" << std::endl;
         std::cout << "> ";
 
@@ -148,6 +173,19 @@ void *senderThread(void *arg) {
                     requestFunc = "matrixMultiplication";
                     break;
 
+                case 4:
+                    client->sendTasks(promptSimpleMathBatch(cores));
+                    continue;
+
+                case 5: {
+                    // the product goes to the determinant on the server, only the determinant comes back
+                    std::string product = std::to_string(rand());
+                    json determinant = json::array({{{"$ref", product}}});
+                    client->sendGraph({{product, "matrixMultiplication", promptMatrixMultiplicationTask(), cores},
+                                       {std::to_string(rand()), "determinant", determinant.dump(), cores}});
+                    continue;
+                }
+
                 case 0:
                     return nullptr;
 
@@ -156,7 +194,7 @@ void *senderThread(void *arg) {
                     continue;
             }
 
-            TaskRequest tr{std::to_string(rand()), requestFunc, requestParams, cores};
+            struct TaskRequest tr{std::to_string(rand()), requestFunc, requestParams, cores};
             client->sendTask(tr);
         } catch (const std::runtime_error &e) {
             std::cout << "Error: " << e.what() << std::endl;
@@ -181,6 +219,20 @@ int main(int argc, const char *argv[]) {
             .default_value(12345)
             .action([](const std::string &value) { return std::stoi(value); });
 
+    program.add_argument("--json")
+            .help("Send JSON messages instead of binary, for debugging")
+            .default_value(false)
+            .implicit_value(true);
+    program.add_argument("--task-timeout")
+            .help("Milliseconds an attempt of a task may run before the server tries it elsewhere, 0 - no limit")
+            .default_value(0)
+            .action([](const std::string &value) { return std::stoi(value); });
+
+    program.add_argument("--priority")
+            .help("Priority of the tasks, 0-7, higher goes first")
+            .default_value(0)
+            .action([](const std::string &value) { return std::stoi(value); });
+
     try {
         program.parse_args(argc, argv);
     } catch (const std::runtime_error &err) {
@@ -193,6 +245,11 @@ int main(int argc, const char *argv[]) {
     auto host = program.get<std::string>("--host");
     int port = program.get<int>("--port");
     RabbitClient client(id, host, port);
+    if (program.get<bool>("--json")) {
+        client.setWireFormat(WireFormat::Json);
+    }
+    client.setTaskTimeout(program.get<int>("--task-timeout"));
+    client.setTaskPriority(program.get<int>("--priority"));
     client.init();
 
     pthread_t receiverThreadId, senderThreadId;
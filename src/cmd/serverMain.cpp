@@ -1,6 +1,7 @@
 #include "rabbitCore/server/RabbitServer.h"
 #include <argparse/argparse.hpp>
 #include <iostream>
+#include <sstream>
 
 int main(int argc, const char *argv[]) {
     argparse::ArgumentParser program("RabbitServer");
@@ -12,6 +13,152 @@ int main(int argc, const char *argv[]) {
             .default_value(12345)
             .action([](const std::string &value) { return std::stoi(value); });
 
+    program.add_argument("-t", "--threads")
+            .help("Executor threads, 0 - one per hardware thread")
+            .default_value(0)
+            .action([](const std::string &value) { return std::stoi(value); });
+
+    program.add_argument("--max-bypass")
+            .help("Times the oldest pending task may be bypassed by smaller ones, 0 - unlimited")
+            .default_value(1000)
+            .action([](const std::string &value) { return std::stoi(value); });
+
+    program.add_argument("--max-wait")
+            .help("Milliseconds the oldest pending task may wait before it blocks smaller ones, 0 - unlimited")
+            .default_value(0)
+            .action([](const std::string &value) { return std::stoi(value); });
+
+    program.add_argument("--data-dir")
+            .help("Directory for the task log and snapshots")
+            .default_value(std::string("."));
+
+    program.add_argument("--commit-interval")
+            .help("Milliseconds task log records are grouped for one disk flush. Submitting does not wait for it, "
+                  "tasks accepted in the last interval before a crash are lost")
+            .default_value(2)
+            .action([](const std::string &value) { return std::stoi(value); });
+
+    program.add_argument("--report-interval")
+            .help("Milliseconds between tasks.md refreshes, 0 - never")
+            .default_value(1000)
+            .action([](const std::string &value) { return std::stoi(value); });
+
+    program.add_argument("--keep-finished")
+            .help("Finished tasks kept in memory, older ones are evicted, 0 - all")
+            .default_value(0)
+            .action([](const std::string &value) { return std::stoi(value); });
+
+    program.add_argument("--finished-ttl")
+            .help("Seconds a finished task is kept in memory, 0 - forever")
+            .default_value(0)
+            .action([](const std::string &value) { return std::stoi(value); });
+
+    program.add_argument("--archive")
+            .help("File evicted tasks are appended to as json lines")
+            .default_value(std::string(""));
+
+    program.add_argument("--placement")
+            .help("Worker for a new task: most-free or best-fit")
+            .default_value(std::string("most-free"));
+
+    program.add_argument("--batch-window")
+            .help("Microseconds results for one client are collected into one message, 0 - send each at once")
+            .default_value(1000)
+            .action([](const std::string &value) { return std::stoi(value); });
+
+    program.add_argument("--batch-bytes")
+            .help("Result data that makes a batch go out before its window ends")
+            .default_value(1 << 20)
+            .action([](const std::string &value) { return std::stoi(value); });
+
+    program.add_argument("--worker-timeout")
+            .help("Milliseconds without a message after which a worker is dropped and its tasks requeued, 0 - never")
+            .default_value(10000)
+            .action([](const std::string &value) { return std::stoi(value); });
+
+    program.add_argument("--speculate-percentile")
+            .help("A running task gets a backup copy on another worker once it runs longer than this "
+                  "percentile of its function's recent durations, 0 - never")
+            .default_value(0)
+            .action([](const std::string &value) { return std::stoi(value); });
+    program.add_argument("--speculate-min-samples")
+            .help("Durations a function needs before its percentile is used")
+            .default_value(20)
+            .action([](const std::string &value) { return std::stoi(value); });
+
+    program.add_argument("--rate-limit")
+            .help("Tasks per second a client may submit, more are rejected, 0 - no limit")
+            .default_value(0)
+            .action([](const std::string &value) { return std::stoi(value); });
+    program.add_argument("--burst")
+            .help("Tasks a client may submit at once, --rate-limit if 0")
+            .default_value(0)
+            .action([](const std::string &value) { return std::stoi(value); });
+    program.add_argument("--max-outstanding")
+            .help("Tasks of a client that may wait for a result, more are rejected, 0 - no limit")
+            .default_value(0)
+            .action([](const std::string &value) { return std::stoi(value); });
+
+    program.add_argument("--cache-mb")
+            .help("Megabytes of task results kept to answer identical tasks, 0 - no cache")
+            .default_value(0)
+            .action([](const std::string &value) { return std::stoi(value); });
+
+    program.add_argument("--cache-ttl")
+            .help("Seconds a cached result is used, 0 - until evicted")
+            .default_value(0)
+            .action([](const std::string &value) { return std::stoi(value); });
+
+    program.add_argument("--cache-policy")
+            .help("Comma separated func=seconds or func=off, overrides --cache-ttl for single functions. "
+                  "Results of an off function are not reused, not even by identical running tasks")
+            .default_value(std::string(""));
+
+    program.add_argument("--client-weights")
+            .help("Comma separated client=weight. Queued tasks of the same priority are shared between clients "
+                  "in proportion to their weights, 1 by default")
+            .default_value(std::string(""));
+
+    program.add_argument("--split")
+            .help("Comma separated functions that take and return a JSON array element by element. Their tasks "
+                  "are split into parts that run on many workers")
+            .default_value(std::string(""));
+
+    program.add_argument("--tile")
+            .help("Rows and columns of a tile. A matrixMultiplication bigger than one tile runs as tiles on many "
+                  "workers, 0 - not tiled")
+            .default_value(0)
+            .action([](const std::string &value) { return std::stoi(value); });
+
+    program.add_argument("--tile-cache-mb")
+            .help("Megabytes of matrix panels a worker keeps for the tiles it gets")
+            .default_value(256)
+            .action([](const std::string &value) { return std::stoi(value); });
+
+    program.add_argument("--queues")
+            .help("Comma separated named queues besides the default one. A worker takes tasks only from the "
+                  "queues it subscribes to, the default one if none")
+            .default_value(std::string(""));
+
+    program.add_argument("--exchanges")
+            .help("Comma separated name=type, the type is direct, fanout or topic")
+            .default_value(std::string(""));
+
+    program.add_argument("--bindings")
+            .help("Comma separated exchange:key=queue. A topic key is dot separated words, * stands for one "
+                  "word and # for any number of them")
+            .default_value(std::string(""));
+
+    program.add_argument("--route-exchange")
+            .help("Exchange tasks are published to with their function as the routing key. A task no binding "
+                  "matches goes to the default queue")
+            .default_value(std::string(""));
+
+    program.add_argument("--json")
+            .help("Send JSON messages instead of binary, for debugging")
+            .default_value(false)
+            .implicit_value(true);
+
     try {
         program.parse_args(argc, argv);
     } catch (const std::runtime_error &err) {
@@ -21,9 +168,144 @@ int main(int argc, const char *argv[]) {
     }
 
     int port = program.get<int>("--port");
-    RabbitServer server(port);
+    RabbitServer server(port, program.get<int>("--threads"));
+
+    StarvationPolicy policy;
+    policy.maxBypass = program.get<int>("--max-bypass");
+    policy.maxWait = std::chrono::milliseconds(program.get<int>("--max-wait"));
+    server.setStarvationPolicy(policy);
+
+    std::stringstream weights(program.get<std::string>("--client-weights"));
+    std::string weight;
+    while (std::getline(weights, weight, ',')) {
+        size_t eq = weight.find('=');
+        if (eq == std::string::npos) {
+            std::cout << "Bad client weight: " << weight << std::endl;
+            std::cout << program;
+            return 0;
+        }
+        server.setClientWeight(weight.substr(0, eq), std::stoi(weight.substr(eq + 1)));
+    }
+
+    ScatterOptions scatter;
+    std::stringstream splittable(program.get<std::string>("--split"));
+    std::string func;
+    while (std::getline(splittable, func, ',')) {
+        if (!func.empty()) scatter.functions.insert(func);
+    }
+    server.setScatter(scatter);
+
+    TilingOptions tiling;
+    tiling.tile = program.get<int>("--tile");
+    tiling.workerCacheBytes = static_cast<size_t>(program.get<int>("--tile-cache-mb")) << 20;
+    server.setTiling(tiling);
+
+    RoutingOptions routing;
+    std::stringstream queues(program.get<std::string>("--queues"));
+    std::string queue;
+    while (std::getline(queues, queue, ',')) {
+        if (!queue.empty()) routing.queues.push_back(queue);
+    }
+    std::stringstream exchanges(program.get<std::string>("--exchanges"));
+    std::string exchange;
+    while (std::getline(exchanges, exchange, ',')) {
+        size_t eq = exchange.find('=');
+        std::string type = eq == std::string::npos ? "" : exchange.substr(eq + 1);
+        ExchangeOptions options{exchange.substr(0, eq)};
+        if (type == "fanout") {
+            options.type = ExchangeType::Fanout;
+        } else if (type == "topic") {
+            options.type = ExchangeType::Topic;
+        } else if (type != "direct") {
+            std::cout << "Bad exchange: " << exchange << std::endl;
+            std::cout << program;
+            return 0;
+        }
+        routing.exchanges.push_back(options);
+    }
+    std::stringstream bindings(program.get<std::string>("--bindings"));
+    std::string binding;
+    while (std::getline(bindings, binding, ',')) {
+        size_t colon = binding.find(':');
+        size_t eq = binding.rfind('=');
+        if (colon == std::string::npos || eq == std::string::npos || eq < colon) {
+            std::cout << "Bad binding: " << binding << std::endl;
+            std::cout << program;
+            return 0;
+        }
+        routing.bindings.push_back({binding.substr(0, colon), binding.substr(colon + 1, eq - colon - 1),
+                                    binding.substr(eq + 1)});
+    }
+    routing.entry = program.get<std::string>("--route-exchange");
+    try {
+        server.setRouting(routing);
+    } catch (const std::invalid_argument &err) {
+        std::cout << err.what() << std::endl;
+        std::cout << program;
+        return 0;
+    }
+
+    TaskLogOptions storage;
+    storage.directory = program.get<std::string>("--data-dir");
+    storage.commitInterval = std::chrono::milliseconds(program.get<int>("--commit-interval"));
+
+    std::string placement = program.get<std::string>("--placement");
+    if (placement == "best-fit") {
+        server.setWorkerSelection(WorkerSelection::BestFit);
+    } else if (placement != "most-free") {
+        std::cout << "Unknown placement: " << placement << std::endl;
+        std::cout << program;
+        return 0;
+    }
+
+    RetentionPolicy retention;
+    retention.maxFinished = program.get<int>("--keep-finished");
+    retention.maxAge = std::chrono::seconds(program.get<int>("--finished-ttl"));
+    retention.archiveFile = program.get<std::string>("--archive");
+    server.setRetentionPolicy(retention);
 
-    server.init();
+    server.setResultBatching(std::chrono::microseconds(program.get<int>("--batch-window")),
+                             program.get<int>("--batch-bytes"));
+
+    ResultCacheOptions cache;
+    cache.maxBytes = static_cast<size_t>(program.get<int>("--cache-mb")) << 20;
+    cache.defaults.ttl = std::chrono::seconds(program.get<int>("--cache-ttl"));
+    std::stringstream policies(program.get<std::string>("--cache-policy"));
+    std::string item;
+    while (std::getline(policies, item, ',')) {
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) {
+            std::cout << "Bad cache policy: " << item << std::endl;
+            std::cout << program;
+            return 0;
+        }
+        CachePolicy function;
+        std::string value = item.substr(eq + 1);
+        if (value == "off") {
+            function.cacheable = false;
+        } else {
+            function.ttl = std::chrono::seconds(std::stoi(value));
+        }
+        cache.functions[item.substr(0, eq)] = function;
+    }
+    server.setResultCache(cache);
+    server.setWorkerTimeout(std::chrono::milliseconds(program.get<int>("--worker-timeout")));
+
+    SpeculationPolicy speculation;
+    speculation.percentile = program.get<int>("--speculate-percentile");
+    speculation.minSamples = program.get<int>("--speculate-min-samples");
+    server.setSpeculation(speculation);
+
+    AdmissionOptions admission;
+    admission.rate = program.get<int>("--rate-limit");
+    admission.burst = program.get<int>("--burst");
+    admission.maxOutstanding = program.get<int>("--max-outstanding");
+    server.setAdmission(admission);
+
+    if (program.get<bool>("--json")) {
+        server.setWireFormat(WireFormat::Json);
+    }
+    server.init(storage, std::chrono::milliseconds(program.get<int>("--report-interval")));
     server.startPolling();
 
     return 0;
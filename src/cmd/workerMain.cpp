@@ -1,6 +1,7 @@
 #include "rabbitCore/worker/RabbitWorker.h"
 #include <argparse/argparse.hpp>
 #include <iostream>
+#include <sstream>
 
 int main(int argc, const char *argv[]) {
     argparse::ArgumentParser program("RabbitWorker");
@@ -22,6 +23,25 @@ int main(int argc, const char *argv[]) {
             .default_value(4)
             .action([](const std::string &value) { return std::stoi(value); });
 
+    program.add_argument("--prefetch")
+            .help("Tasks the server may queue on this worker while its cores are busy, 0 - none")
+            .default_value(2)
+            .action([](const std::string &value) { return std::stoi(value); });
+
+    program.add_argument("--queues")
+            .help("Comma separated queues of the server this worker takes tasks from, the default one if none")
+            .default_value(std::string(""));
+
+    program.add_argument("--heartbeat")
+            .help("Milliseconds between heartbeats to the server, 0 - none")
+            .default_value(1000)
+            .action([](const std::string &value) { return std::stoi(value); });
+
+    program.add_argument("--json")
+            .help("Send JSON messages instead of binary, for debugging")
+            .default_value(false)
+            .implicit_value(true);
+
     try {
         program.parse_args(argc, argv);
     } catch (const std::runtime_error &err) {
@@ -36,6 +56,18 @@ int main(int argc, const char *argv[]) {
     int cores = program.get<int>("--cores");
 
     RabbitWorker worker(id, host, port, cores);
+    if (program.get<bool>("--json")) {
+        worker.setWireFormat(WireFormat::Json);
+    }
+    worker.setPrefetch(program.get<int>("--prefetch"));
+    std::vector<std::string> queues;
+    std::stringstream names(program.get<std::string>("--queues"));
+    std::string queue;
+    while (std::getline(names, queue, ',')) {
+        if (!queue.empty()) queues.push_back(queue);
+    }
+    worker.setQueues(queues);
+    worker.setHeartbeat(std::chrono::milliseconds(program.get<int>("--heartbeat")));
     worker.init();
 
     std::cout << "Worker [" << id << "] started on [" << host << ":" << port << "]" << std::endl;
@@ -15,16 +15,22 @@ namespace STIP {
         MSG_RESPONSE_RESEND = 6,
 
         MSG_KILLED = 7,
+        MSG_INIT_RESPONSE_BUSY = 8,
 
 
         PING_ASK = 10,
         PING_ANSWER = 11,
 
+        PATH_PROBE = 12,
+        PATH_PROBE_ANSWER = 13,
+
 
         CONNECTION_SYN = 100,
         CONNECTION_SYN_ACK = 101,
         CONNECTION_ACK = 102,
         CONNECTION_FIN = 103,
+        CONNECTION_PATH_JOIN = 104,
+        CONNECTION_PATH_JOIN_ACK = 105,
     };
 
     inline std::ostream& operator<<(std::ostream & os, const Command &command) {
@@ -53,12 +59,21 @@ namespace STIP {
             case Command::MSG_KILLED:
                 os << "MSG_KILLED";
                 break;
+            case Command::MSG_INIT_RESPONSE_BUSY:
+                os << "MSG_INIT_RESPONSE_BUSY";
+                break;
             case Command::PING_ASK:
                 os << "PING_ASK";
                 break;
             case Command::PING_ANSWER:
                 os << "PING_ANSWER";
                 break;
+            case Command::PATH_PROBE:
+                os << "PATH_PROBE";
+                break;
+            case Command::PATH_PROBE_ANSWER:
+                os << "PATH_PROBE_ANSWER";
+                break;
             case Command::CONNECTION_SYN:
                 os << "CONNECTION_SYN";
                 break;
@@ -71,6 +86,12 @@ namespace STIP {
             case Command::CONNECTION_FIN:
                 os << "CONNECTION_FIN";
                 break;
+            case Command::CONNECTION_PATH_JOIN:
+                os << "CONNECTION_PATH_JOIN";
+                break;
+            case Command::CONNECTION_PATH_JOIN_ACK:
+                os << "CONNECTION_PATH_JOIN_ACK";
+                break;
         }
         os << " (" << static_cast<int>(command) << ")";
         return os;
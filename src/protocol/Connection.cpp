@@ -3,15 +3,29 @@
 #include "protocol/Session.h"
 #include "protocol/errors/STIP_errors.h"
 #include <future>
+#include <random>
 
 
 namespace STIP {
 
+    namespace {
+        int64_t nowNs() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    }
+
     Connection::Connection(udp::endpoint &endpoint, udp::socket *socket) {
         this->endpoint = endpoint;
         this->socket = socket;
         this->connectionStatus = 100;
         this->sessionManager = new SessionManager();
+
+        paths.add(socket, endpoint);
+        paths.activate(0);
+        sendScheduler.setPaths(&paths);
+        std::random_device rd;
+        pathToken = rd();
     }
 
 
@@ -29,7 +43,7 @@ namespace STIP {
     STIP_PACKET Connection::getPacket(bool &result) {
         std::unique_lock<std::mutex> lock(mtx);
         countPacketWaiting++;
-        cv.wait(lock, [this] { return !packetQueue.empty() || cancelPacketWaitingFlag; });
+        cv.wait(lock, [this] { return !packetQueue.empty() || cancelPacketWaitingFlag || stopped; });
         countPacketWaiting--;
         if (packetQueue.empty()) {
             result = false;
@@ -53,6 +67,8 @@ namespace STIP {
     Connection::~Connection() {
         // remove connection from manager
 
+        closePaths();
+
         // stop main thread
         if (mainThread.joinable()) {
             mainThread.join();
@@ -96,16 +112,39 @@ namespace STIP {
 
 
     bool Connection::sendMessage(void *data, size_t size) {
+        return sendMessage(data, size, size > BULK_MESSAGE_THRESHOLD ? Priority::BULK : Priority::NORMAL);
+    }
+
+    bool Connection::sendMessage(void *data, size_t size, Priority priority) {
         uint32_t session_id = sessionManager->generateSessionId();
-        auto *session = new SendMessageSession(session_id, data, size, socket, endpoint);
+        auto *session = new SendMessageSession(session_id, data, size, socket, endpoint, priority, &sendScheduler);
+        session->setChecksumEnabled(checksumEnabled);
+        session->setPaths(&paths);
+        if (paths.activeCount() > 1) {
+            probePaths();
+        }
         sessionManager->addSession(session);
 
 
         // Send init
         bool totalResult = true;
+        bool initPending = true;
+        acquireSendWindow(size);
         try {
             bool resultTimout = false;
-            bool initSendResult = session->initSendWrappedTimout(resultTimout, 2000, 3);
+            bool initSendResult = false;
+            for (int attempt = 0;; attempt++) {
+                initSendResult = session->initSendWrappedTimout(resultTimout, 2000, 3);
+                if (resultTimout || !session->isReceiverBusy()) break;
+                if (attempt == BUSY_RETRY_COUNT) {
+                    throw STIP::errors::STIPException("Receiver has no free buffer for message");
+                }
+                // back off until the receiver advertises enough space
+                waitPeerWindow(std::chrono::milliseconds(std::min(50 << attempt, 1000)));
+            }
+            releaseSendWindow(size);
+            initPending = false;
+
             if (resultTimout) {
                 throw STIP::errors::STIPTimeoutException("No response for init message");
             }
@@ -151,6 +190,9 @@ namespace STIP {
             std::cerr << e.what() << std::endl;
             totalResult = false;
         }
+        if (initPending) {
+            releaseSendWindow(size);
+        }
 
 
 
@@ -160,24 +202,234 @@ namespace STIP {
     }
 
 
+    void Connection::acquireSendWindow(size_t size) {
+        std::unique_lock<std::mutex> lock(flowMtx);
+        // a lone message is always let through, the receiver answers busy if it can't take it
+        flowCv.wait(lock, [this, size] {
+            return pendingInitBytes == 0 || pendingInitBytes + size <= peerWindow;
+        });
+        pendingInitBytes += size;
+    }
+
+    void Connection::releaseSendWindow(size_t size) {
+        std::lock_guard<std::mutex> lock(flowMtx);
+        pendingInitBytes -= size;
+        flowCv.notify_all();
+    }
+
+    void Connection::waitPeerWindow(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(flowMtx);
+        // pending bytes already include the message that waits
+        flowCv.wait_for(lock, timeout, [this] { return pendingInitBytes <= peerWindow; });
+    }
+
+    void Connection::updatePeerWindow(size_t window) {
+        std::lock_guard<std::mutex> lock(flowMtx);
+        peerWindow = window;
+        flowCv.notify_all();
+    }
+
+    void Connection::setChecksumEnabled(bool enabled) {
+        checksumEnabled = enabled;
+    }
+
+    void Connection::setReceiveWindow(size_t bytes) {
+        receiveWindow->setLimit(bytes);
+    }
+
     bool Connection::sendMessage(const std::string &message) {
         return sendMessage((void *) message.c_str(), message.size());
     }
 
+    bool Connection::sendMessage(const std::string &message, Priority priority) {
+        return sendMessage((void *) message.c_str(), message.size(), priority);
+    }
+
     ReceiveMessageSession *Connection::receiveMessage() {
         std::unique_lock<std::mutex> lock(messageMtx);
 
-        while (messageQueue.empty() && isRunning) {
+        auto ready = [this]() -> std::queue<ReceiveMessageSession *> * {
+            for (auto &queue: messageQueues) {
+                if (!queue.empty()) return &queue;
+            }
+            return nullptr;
+        };
+
+        while (ready() == nullptr && isRunning) {
             messageCv.wait(lock);
         }
-        if (messageQueue.empty()) {
+        auto *queue = ready();
+        if (queue == nullptr) {
             return nullptr;
         }
-        ReceiveMessageSession *message = messageQueue.front();
-        messageQueue.pop();
+        ReceiveMessageSession *message = queue->front();
+        queue->pop();
         return message;
     }
 
+    void Connection::pushMessage(ReceiveMessageSession *session) {
+        std::lock_guard<std::mutex> lock(messageMtx);
+        messageQueues[static_cast<int>(session->getPriority())].push(session);
+        messageCv.notify_one();
+    }
+
+
+    void Connection::completeReceiveSession(ReceiveMessageSession *session) {
+        // the application owns the session from now on, the connection must not touch it again
+        sessionManager->deleteSession(session);
+        completedSessions.insert(session->getId());
+        completedOrder.push(session->getId());
+        if (completedOrder.size() > MAX_COMPLETED_SESSIONS) {
+            completedSessions.erase(completedOrder.front());
+            completedOrder.pop();
+        }
+
+        if (session->isStreaming()) {
+            // reader already has it, let it finish
+            session->finish();
+            return;
+        }
+
+        session->dispatched = true;
+        pushMessage(session);
+#ifdef STIP_PROTOCOL_DEBUG
+        std::cout << "Message received, should be notified" << std::endl;
+#endif
+    }
+
+    void Connection::answerAllReceived(uint32_t session_id) {
+        STIP_PACKET packet[1] = {};
+        packet[0].header.command = Command::MSG_RESPONSE_ALL_RECEIVED;
+        packet[0].header.session_id = session_id;
+        ReceiveWindow::writeAdvertisement(packet[0], receiveWindow->available());
+        socket->send_to(boost::asio::buffer(packet, packet[0].header.size), endpoint);
+    }
+
+    void Connection::answerBusy(uint32_t session_id) {
+        STIP_PACKET packet[1] = {};
+        packet[0].header.command = Command::MSG_INIT_RESPONSE_BUSY;
+        packet[0].header.session_id = session_id;
+        ReceiveWindow::writeAdvertisement(packet[0], receiveWindow->available());
+        socket->send_to(boost::asio::buffer(packet, packet[0].header.size), endpoint);
+    }
+
+    void Connection::setStreamingReceive(bool enabled) {
+        streamingReceive = enabled;
+    }
+
+    size_t Connection::addPath(const udp::endpoint &localEndpoint, std::chrono::milliseconds timeout) {
+        auto pathSocket = std::make_unique<udp::socket>(socket->get_executor(), localEndpoint);
+        udp::socket *raw = pathSocket.get();
+        size_t index = paths.add(raw, endpoint);
+        if (index == MAX_PATHS) {
+            throw STIP::errors::STIPException("Too many paths");
+        }
+        {
+            std::lock_guard<std::mutex> lock(pathMtx);
+            pathSockets.push_back(std::move(pathSocket));
+            pathThreads.emplace_back(&Connection::pathReceiveProcess, this, raw);
+        }
+
+        STIP_PACKET packet[1] = {};
+        packet[0].header.command = Command::CONNECTION_PATH_JOIN;
+        packet[0].header.session_id = pathToken;
+        packet[0].header.packet_id = index;
+        packet[0].header.size = sizeof(STIP_HEADER) + sizeof(int64_t);
+
+        const int attempts = 3;
+        for (int i = 0; i < attempts; i++) {
+            int64_t sent = nowNs();
+            memcpy(packet[0].data, &sent, sizeof(int64_t));
+            raw->send_to(boost::asio::buffer(packet, packet[0].header.size), endpoint);
+
+            std::unique_lock<std::mutex> lock(pathMtx);
+            if (pathCv.wait_for(lock, timeout / attempts, [this, index] { return paths.getStats(index).active; })) {
+                return index;
+            }
+        }
+        throw STIP::errors::STIPTimeoutException("No response for path join");
+    }
+
+    bool Connection::registerPath(size_t index, udp::socket *pathSocket, const udp::endpoint &remoteEndpoint) {
+        // path 0 is the one the connection was established on
+        if (index == 0 || !paths.set(index, pathSocket, remoteEndpoint)) {
+            return false;
+        }
+        paths.activate(index);
+        return true;
+    }
+
+    uint32_t Connection::getPathToken() const {
+        return pathToken;
+    }
+
+    void Connection::setPathToken(uint32_t token) {
+        pathToken = token;
+    }
+
+    size_t Connection::getPathCount() {
+        return paths.activeCount();
+    }
+
+    PathStats Connection::getPathStats(size_t index) {
+        return paths.getStats(index);
+    }
+
+    void Connection::pathReceiveProcess(udp::socket *pathSocket) {
+        while (true) {
+            STIP_PACKET packet[1];
+            boost::system::error_code error;
+            udp::endpoint remote_endpoint;
+            pathSocket->receive_from(boost::asio::buffer(packet), remote_endpoint, 0, error);
+            if (error && error != boost::asio::error::message_size) {
+                return;
+            }
+            if (remote_endpoint != endpoint) {
+                continue;
+            }
+            addPacket(packet[0]);
+        }
+    }
+
+    void Connection::probePaths() {
+        {
+            std::lock_guard<std::mutex> lock(pathMtx);
+            auto now = std::chrono::steady_clock::now();
+            if (now - lastProbe < std::chrono::milliseconds(PATH_PROBE_INTERVAL_MS)) {
+                return;
+            }
+            lastProbe = now;
+        }
+
+        for (size_t i = 0; i < MAX_PATHS; i++) {
+            if (!paths.getStats(i).active) continue;
+            STIP_PACKET packet[1] = {};
+            packet[0].header.command = Command::PATH_PROBE;
+            packet[0].header.packet_id = i;
+            packet[0].header.size = sizeof(STIP_HEADER) + sizeof(int64_t);
+            int64_t sent = nowNs();
+            memcpy(packet[0].data, &sent, sizeof(int64_t));
+            paths.send(i, packet, packet[0].header.size, false);
+        }
+    }
+
+    void Connection::closePaths() {
+        std::vector<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> lock(pathMtx);
+            for (auto &pathSocket: pathSockets) {
+                boost::system::error_code error;
+                // wakes the receiving thread
+                pathSocket->shutdown(udp::socket::shutdown_both, error);
+                pathSocket->close(error);
+            }
+            threads.swap(pathThreads);
+        }
+        for (auto &thread: threads) {
+            thread.join();
+        }
+    }
+
 
     void Connection::processThread() {
 #ifdef STIP_PROTOCOL_DEBUG
@@ -193,6 +445,14 @@ namespace STIP {
             std::cout << "Size: " << packet.header.size << std::endl;
             std::cout << "Session id: " << packet.header.session_id << std::endl;
 #endif
+            size_t advertised = 0;
+            if ((packet.header.command == Command::MSG_INIT_RESPONSE_SUCCESS ||
+                 packet.header.command == Command::MSG_INIT_RESPONSE_BUSY ||
+                 packet.header.command == Command::MSG_RESPONSE_ALL_RECEIVED) &&
+                ReceiveWindow::readAdvertisement(packet, advertised)) {
+                updatePeerWindow(advertised);
+            }
+
             ReceiveMessageSession *tempReceiveSession;
             switch (packet.header.command) {
                 ReceiveMessageSession *tempMsgSession;
@@ -200,8 +460,12 @@ namespace STIP {
                 uint32_t session_id;
                 case Command::MSG_INIT_REQUEST :
                     // check if session exists
+                    if (completedSessions.count(packet.header.session_id)) {
+                        continue;
+                    }
                     if (sessionManager->getSession(packet.header.session_id) != nullptr) {
-                        std::cout << "Session already exist" << std::endl;
+                        // init response was lost, session answers it again
+                        sessionManager->getSession(packet.header.session_id)->processIncomingPacket(packet);
                         continue;
                     }
 
@@ -212,13 +476,26 @@ namespace STIP {
 //                    packet_counts = *(size_t *) packet.data;
                     packet_counts = packet.header.packet_id;
 
+                    if (!receiveWindow->tryReserve(*(size_t *) packet.data)) {
+                        answerBusy(packet.header.session_id);
+                        break;
+                    }
+
                     tempMsgSession = new ReceiveMessageSession(packet.header.session_id,
                                                                *(size_t *) packet.data,
                                                                packet_counts,
-                                                               socket, endpoint);
+                                                               socket, endpoint,
+                                                               streamingReceive,
+                                                               receiveWindow);
                     sessionManager->addSession(tempMsgSession);
                     tempMsgSession->processIncomingPacket(packet);
                     session_id = packet.header.session_id;
+
+                    if (tempMsgSession->isStreaming()) {
+                        // consumer starts reading before the whole message arrives
+                        tempMsgSession->dispatched = true;
+                        pushMessage(tempMsgSession);
+                    }
 //                    sessionKiller.registerSessionTimeout(
 //                            packet.header.session_id,
 //                            20000,
@@ -243,15 +520,24 @@ namespace STIP {
                     sessionKiller.resetSessionTimeout(packet.header.session_id);
 
                     if (tempReceiveSession->getStatus() == 5) {
-                        if (tempReceiveSession->dispatched) break;
-                        tempReceiveSession->dispatched = true;
-                        std::lock_guard<std::mutex> lock(messageMtx);
+                        completeReceiveSession(tempReceiveSession);
+                    }
+                    break;
 
-                        messageQueue.push(tempReceiveSession);
-#ifdef STIP_PROTOCOL_DEBUG
-                        std::cout << "Message received, should be notified" << std::endl;
-#endif
-                        messageCv.notify_one();
+                case Command::MSG_REQUEST_ALL_RECEIVED:
+                    tempReceiveSession = dynamic_cast<ReceiveMessageSession *>(sessionManager->getSession(
+                            packet.header.session_id));
+                    if (tempReceiveSession == nullptr) {
+                        if (completedSessions.count(packet.header.session_id)) {
+                            // message was already handed to the application
+                            answerAllReceived(packet.header.session_id);
+                        }
+                        break;
+                    }
+
+                    tempReceiveSession->processIncomingPacket(packet);
+                    if (tempReceiveSession->getStatus() == 5) {
+                        completeReceiveSession(tempReceiveSession);
                     }
                     break;
 
@@ -261,9 +547,34 @@ namespace STIP {
                     if (tempReceiveSession==nullptr) break;
                     sessionKiller.deleteSessionTimeout(packet.header.session_id);
                     sessionManager->deleteSession(tempReceiveSession);
+                    if (tempReceiveSession->isStreaming() && tempReceiveSession->dispatched) {
+                        // session is owned by the reader now
+                        tempReceiveSession->abort();
+                        break;
+                    }
                     delete tempReceiveSession;
                     break;
 
+                case Command::CONNECTION_PATH_JOIN_ACK:
+                case Command::PATH_PROBE_ANSWER:
+                    if (packet.header.size >= (int) (sizeof(STIP_HEADER) + sizeof(int64_t))) {
+                        int64_t sent;
+                        memcpy(&sent, packet.data, sizeof(int64_t));
+                        paths.onRtt(packet.header.packet_id, (double) (nowNs() - sent) / 1e6);
+                    }
+                    if (packet.header.command == Command::CONNECTION_PATH_JOIN_ACK) {
+                        std::lock_guard<std::mutex> lock(pathMtx);
+                        paths.activate(packet.header.packet_id);
+                        pathCv.notify_all();
+                    }
+                    break;
+
+                case Command::PATH_PROBE:
+                    // answered on the same path with the sender's timestamp
+                    packet.header.command = Command::PATH_PROBE_ANSWER;
+                    paths.send(packet.header.packet_id, &packet, packet.header.size, false);
+                    break;
+
                 case Command::PING_ASK:
                     // ping
 #ifdef STIP_PROTOCOL_DEBUG
@@ -299,8 +610,22 @@ namespace STIP {
         if (!isRunning) {
             return;
         }
-        isRunning = false;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            isRunning = false;
+            stopped = true;
+        }
         cv.notify_all();
+        {
+            // receiveMessage returns nullptr once the queued messages are taken
+            std::lock_guard<std::mutex> lock(messageMtx);
+            messageCv.notify_all();
+        }
+        closePaths();
+    }
+
+    const udp::endpoint &Connection::getEndpoint() const {
+        return endpoint;
     }
 
 
@@ -319,15 +644,41 @@ namespace STIP {
 
     ConnectionManager::~ConnectionManager() {
 //    std::lock_guard<std::mutex> lock(mtx);
+        // extra paths map several endpoints to the same connection
+        std::set<Connection *> unique;
         for (auto &pair: connections) {
-            delete pair.second;
+            unique.insert(pair.second);
+        }
+        for (auto *connection: unique) {
+            delete connection;
         }
     }
 
     void ConnectionManager::remove(const udp::endpoint &endpoint) {
         std::lock_guard<std::mutex> lock(mtx);
 //    delete connections[endpoint];
-        connections.erase(endpoint);
+        auto it = connections.find(endpoint);
+        if (it == connections.end()) {
+            return;
+        }
+        Connection *connection = it->second;
+        for (auto pair = connections.begin(); pair != connections.end();) {
+            if (pair->second == connection) {
+                pair = connections.erase(pair);
+            } else {
+                ++pair;
+            }
+        }
+    }
+
+    Connection *ConnectionManager::findByPathToken(uint32_t token) {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (auto &pair: connections) {
+            if (pair.second->getPathToken() == token) {
+                return pair.second;
+            }
+        }
+        return nullptr;
     }
 
     bool ConnectionManager::check(const udp::endpoint &endpoint) {
@@ -2,7 +2,10 @@
 #define RABBIT_CONNECTION_H
 
 
+#include <array>
+#include <memory>
 #include <queue>
+#include <set>
 #include <unordered_map>
 #include <condition_variable>
 #include <mutex>
@@ -12,6 +15,9 @@
 #include "protocol/STIP.h"
 #include "protocol/Session.h"
 #include "protocol/SessionKiller.h"
+#include "protocol/SendScheduler.h"
+#include "protocol/ReceiveWindow.h"
+#include "protocol/PathSet.h"
 
 using boost::asio::ip::udp;
 
@@ -34,6 +40,8 @@ namespace STIP {
         SessionManager *sessionManager = nullptr;
         SessionKiller sessionKiller;
         bool isRunning = false;
+        // set by stopProcessing, getPacket no longer waits. Unlike isRunning it is false before the handshake
+        bool stopped = false;
 
         /// \brief Обработка пакетов
         ///
@@ -44,10 +52,85 @@ namespace STIP {
         int countPacketWaiting = 0;
         bool cancelPacketWaitingFlag = false;
 
-        // message
-        std::queue<ReceiveMessageSession *> messageQueue;
+        // flow control: free reassembly space we advertise and the one peer advertised to us
+        static const int BUSY_RETRY_COUNT = 10;
+        std::shared_ptr<ReceiveWindow> receiveWindow = std::make_shared<ReceiveWindow>();
+        std::mutex flowMtx;
+        std::condition_variable flowCv;
+        size_t peerWindow = SIZE_MAX;
+        size_t pendingInitBytes = 0;
+
+        /// \brief Ожидание кредита на отправку
+        ///
+        /// Ждет, пока сообщения, еще не принятые получателем, вместе с новым
+        /// не поместятся в объявленное им окно
+        ///
+        /// \param size - размер нового сообщения
+        void acquireSendWindow(size_t size);
+
+        /// \brief Возврат кредита после ответа на инициализацию
+        ///
+        /// \param size - размер сообщения
+        void releaseSendWindow(size_t size);
+
+        void waitPeerWindow(std::chrono::milliseconds timeout);
+
+        void updatePeerWindow(size_t window);
+
+        void answerBusy(uint32_t session_id);
+
+        // message, one queue per priority class
+        std::array<std::queue<ReceiveMessageSession *>, PRIORITY_COUNT> messageQueues;
+        SendScheduler sendScheduler;
         std::mutex messageMtx;
         std::condition_variable messageCv;
+        bool streamingReceive = false;
+        bool checksumEnabled = true;
+
+        // sessions already handed to the application, remembered to answer late "all received" requests
+        static const size_t MAX_COMPLETED_SESSIONS = 4096;
+        std::set<uint32_t> completedSessions;
+        std::queue<uint32_t> completedOrder;
+
+        /// \brief Завершение приема сообщения
+        ///
+        /// Убирает сессию из SessionManager и передает ее приложению
+        ///
+        /// \param session - сессия приема
+        void completeReceiveSession(ReceiveMessageSession *session);
+
+        /// \brief Передача принятого сообщения в очередь его класса приоритета
+        ///
+        /// \param session - сессия приема
+        void pushMessage(ReceiveMessageSession *session);
+
+        /// \brief Подтверждение приема уже переданного приложению сообщения
+        ///
+        /// \param session_id - идентификатор сессии
+        void answerAllReceived(uint32_t session_id);
+
+        // multipath: path 0 is socket/endpoint, extra sockets are owned by the connection
+        static const int PATH_PROBE_INTERVAL_MS = 1000;
+        PathSet paths;
+        uint32_t pathToken = 0;
+        std::mutex pathMtx;
+        std::condition_variable pathCv;
+        std::vector<std::unique_ptr<udp::socket>> pathSockets;
+        std::vector<std::thread> pathThreads;
+        std::chrono::steady_clock::time_point lastProbe;
+
+        /// \brief Прием пакетов с дополнительного сокета пути
+        ///
+        /// \param pathSocket - сокет пути
+        void pathReceiveProcess(udp::socket *pathSocket);
+
+        /// \brief Замер RTT всех путей
+        ///
+        /// Отправляет PATH_PROBE по каждому активному пути, не чаще раза в PATH_PROBE_INTERVAL_MS
+        void probePaths();
+
+        /// \brief Закрытие сокетов путей и остановка их потоков
+        void closePaths();
 
     public:
         /// \brief Connection конструктор
@@ -75,6 +158,16 @@ namespace STIP {
         ///
         /// \param data - указатель на данные
         /// \param size - размер данных в байтах
+        /// \param priority - класс приоритета потока
+        /// \return результат отправки
+        bool sendMessage(void *data, size_t size, Priority priority);
+
+        /// \brief Отправка сообщения
+        ///
+        /// Сообщения больше BULK_MESSAGE_THRESHOLD отправляются в потоке BULK, остальные в NORMAL
+        ///
+        /// \param data - указатель на данные
+        /// \param size - размер данных в байтах
         /// \return результат отправки
         bool sendMessage(void *data, size_t size);
 
@@ -86,14 +179,76 @@ namespace STIP {
         /// \return результат отправки
         bool sendMessage(const std::string &message);
 
+        bool sendMessage(const std::string &message, Priority priority);
+
         /// \brief Получение пакета из очереди
         ///
         /// Если очередь пуста, ждет пока не появится пакет.
-        /// Возвращает первый пакет из очереди и удаляет его из очереди
+        /// Сообщения более приоритетного класса возвращаются раньше,
+        /// внутри класса - в порядке завершения приема
         ///
         /// \return
         ReceiveMessageSession *receiveMessage();
 
+        /// \brief Включение потокового приема
+        ///
+        /// В потоковом режиме receiveMessage возвращает сессию сразу после инициализации сообщения,
+        /// а данные читаются по порядку через ReceiveMessageSession::nextChunk по мере прихода частей
+        ///
+        /// \param enabled - включить или выключить потоковый режим
+        void setStreamingReceive(bool enabled);
+
+        /// \brief Размер окна приема
+        ///
+        /// Сколько байт могут занимать принимаемые, но еще не удаленные приложением сообщения.
+        /// Свободное место объявляется отправителю в ответах на инициализацию и подтверждениях,
+        /// сообщение, которое не помещается, получает MSG_INIT_RESPONSE_BUSY
+        ///
+        /// \param bytes - размер окна в байтах
+        void setReceiveWindow(size_t bytes);
+
+        /// \brief Контрольные суммы частей отправляемых сообщений
+        ///
+        /// По умолчанию каждая часть несет CRC32C, получатель отбрасывает части
+        /// с неверной суммой и запрашивает их заново
+        ///
+        /// \param enabled - считать ли CRC32C
+        void setChecksumEnabled(bool enabled);
+
+        /// \brief Добавление пути для чередования частей
+        ///
+        /// Открывает новый сокет на локальном адресе (другой порт или другой интерфейс)
+        /// и присоединяет его к соединению у собеседника. Части сообщений распределяются
+        /// между всеми путями, у каждого пути своя статистика потерь и RTT
+        ///
+        /// \param localEndpoint - локальный адрес нового сокета
+        /// \param timeout - время ожидания подтверждения
+        /// \return номер пути
+        size_t addPath(const udp::endpoint &localEndpoint,
+                       std::chrono::milliseconds timeout = std::chrono::milliseconds(2000));
+
+        /// \brief Регистрация пути, присоединенного собеседником
+        ///
+        /// \param index - номер пути у собеседника
+        /// \param pathSocket - сокет, на который пришел запрос
+        /// \param remoteEndpoint - адрес собеседника на этом пути
+        /// \return false, если номер пути недопустим
+        bool registerPath(size_t index, udp::socket *pathSocket, const udp::endpoint &remoteEndpoint);
+
+        /// \brief Токен соединения, по которому присоединяются новые пути
+        uint32_t getPathToken() const;
+
+        void setPathToken(uint32_t token);
+
+        /// \brief Количество активных путей
+        size_t getPathCount();
+
+        /// \brief Статистика пути
+        ///
+        /// \param index - номер пути
+        /// \return отправленные и потерянные части, сглаженные потери и RTT
+        PathStats getPathStats(size_t index);
+
         /// \brief Добавление пакета в очередь обработки
         ///
         /// Добавляет пакет в очередь для данного соединения.
@@ -130,10 +285,14 @@ namespace STIP {
         /// \brief Остановка обработки пакетов
         ///
         /// Посылает сигнал на остановку,
-        /// помечает флаг isRunning как false
+        /// помечает флаг isRunning как false.
+        /// Ожидающий receiveMessage возвращает nullptr
         ///
         void stopProcessing();
 
+        /// \brief Адрес собеседника на основном пути
+        const udp::endpoint &getEndpoint() const;
+
         /// \brief Connection деструктор
         ///
         /// Останавливает поток обработки пакетов,
@@ -191,9 +350,15 @@ namespace STIP {
         /// \return возвращает указатель на соединение, если соединение есть в списке, иначе nullptr
         Connection *getConnection(const udp::endpoint &endpoint);
 
+        /// \brief Поиск соединения по токену путей
+        ///
+        /// \param token - токен соединения
+        /// \return указатель на соединение или nullptr
+        Connection *findByPathToken(uint32_t token);
+
         /// \brief Удаление соединения
         ///
-        /// Удаляет соединение из списка соединений
+        /// Удаляет соединение из списка соединений вместе с адресами его дополнительных путей
         ///
         /// \param endpoint - адрес и порт соединения
         void remove(const udp::endpoint &endpoint);
@@ -0,0 +1,278 @@
+#include "Crc32c.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define STIP_CRC32C_X86
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#define STIP_CRC32C_TARGET __attribute__((target("sse4.2")))
+#define STIP_CRC32C_FOLD_TARGET __attribute__((target("sse4.2,pclmul")))
+#elif defined(_M_X64)
+#define STIP_CRC32C_X86
+#include <intrin.h>
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#define STIP_CRC32C_TARGET
+#define STIP_CRC32C_FOLD_TARGET
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define STIP_CRC32C_ARM
+#include <arm_acle.h>
+#endif
+
+namespace STIP {
+
+    namespace {
+
+        const uint32_t POLY = 0x82F63B78; // reflected Castagnoli polynomial
+
+        // slicing-by-8 tables
+        struct Tables {
+            uint32_t t[8][256];
+
+            Tables() {
+                for (uint32_t i = 0; i < 256; i++) {
+                    uint32_t c = i;
+                    for (int k = 0; k < 8; k++) {
+                        c = (c & 1) ? (c >> 1) ^ POLY : c >> 1;
+                    }
+                    t[0][i] = c;
+                }
+                for (uint32_t i = 0; i < 256; i++) {
+                    for (int s = 1; s < 8; s++) {
+                        t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xFF];
+                    }
+                }
+            }
+        };
+
+        const Tables &tables() {
+            static const Tables instance;
+            return instance;
+        }
+
+        uint32_t updateSoftware(uint32_t crc, const unsigned char *p, size_t size, unsigned char *dst) {
+            const Tables &tb = tables();
+            while (size >= 8) {
+                uint64_t v;
+                memcpy(&v, p, 8);
+                if (dst) {
+                    memcpy(dst, &v, 8);
+                    dst += 8;
+                }
+                v ^= crc;
+                crc = tb.t[7][v & 0xFF] ^ tb.t[6][(v >> 8) & 0xFF] ^ tb.t[5][(v >> 16) & 0xFF] ^
+                      tb.t[4][(v >> 24) & 0xFF] ^ tb.t[3][(v >> 32) & 0xFF] ^ tb.t[2][(v >> 40) & 0xFF] ^
+                      tb.t[1][(v >> 48) & 0xFF] ^ tb.t[0][v >> 56];
+                p += 8;
+                size -= 8;
+            }
+            while (size--) {
+                if (dst) *dst++ = *p;
+                crc = (crc >> 8) ^ tb.t[0][(crc ^ *p++) & 0xFF];
+            }
+            return crc;
+        }
+
+#if defined(STIP_CRC32C_X86)
+        bool detectHardware() {
+#if defined(_M_X64)
+            int info[4];
+            __cpuid(info, 1);
+            return (info[2] & (1 << 20)) != 0;
+#else
+            return __builtin_cpu_supports("sse4.2");
+#endif
+        }
+
+        bool detectCarrylessMultiply() {
+#if defined(_M_X64)
+            int info[4];
+            __cpuid(info, 1);
+            return (info[2] & (1 << 1)) != 0;
+#else
+            return __builtin_cpu_supports("pclmul");
+#endif
+        }
+
+        // x^n mod P, bit-reflected into the upper half of a 64-bit word as pclmulqdq expects it
+        uint64_t foldConstant(size_t n) {
+            const uint32_t poly = 0x1EDC6F41; // Castagnoli polynomial, normal bit order
+            uint32_t r = 1;
+            for (size_t i = 0; i < n; i++) {
+                r = (r & 0x80000000u) ? (r << 1) ^ poly : r << 1;
+            }
+            uint64_t k = 0;
+            for (int e = 0; e < 32; e++) {
+                if (r & (1u << e)) k |= uint64_t(1) << (63 - e);
+            }
+            return k;
+        }
+
+        // constants folding a 128-bit block forward over `bytes` bytes
+        __m128i foldBy(size_t bytes) {
+            return _mm_set_epi64x((long long) foldConstant(8 * bytes - 1),
+                                  (long long) foldConstant(64 + 8 * bytes - 1));
+        }
+
+        const int FOLD_LANES = 8;
+        const size_t FOLD_BLOCK = 16 * FOLD_LANES;
+
+        struct FoldConstants {
+            __m128i forward = foldBy(FOLD_BLOCK);
+            // folds lane i onto the last lane at the end
+            __m128i tail[FOLD_LANES - 1];
+
+            FoldConstants() {
+                for (int i = 0; i < FOLD_LANES - 1; i++) {
+                    tail[i] = foldBy(16 * (FOLD_LANES - 1 - i));
+                }
+            }
+        };
+
+        STIP_CRC32C_FOLD_TARGET
+        inline __m128i fold(__m128i acc, __m128i k, __m128i next) {
+            return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(acc, k, 0x00),
+                                               _mm_clmulepi64_si128(acc, k, 0x11)), next);
+        }
+
+        // folds 128-byte blocks with carry-less multiplication, eight independent accumulators
+        // hide the pclmulqdq latency; the result is reduced to a crc with two crc32 instructions,
+        // the tail is left to the caller
+        STIP_CRC32C_FOLD_TARGET
+        uint32_t updateFold(uint32_t crc, const unsigned char *&src, size_t &size, unsigned char *&destination) {
+            static const FoldConstants k;
+            // local copies, stores through dst must not force reloading the caller's pointers
+            const unsigned char *p = src;
+            unsigned char *dst = destination;
+            size_t left = size;
+            auto load = [&](int lane) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * lane));
+                if (dst) _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16 * lane), v);
+                return v;
+            };
+            auto advance = [&]() {
+                p += FOLD_BLOCK;
+                if (dst) dst += FOLD_BLOCK;
+                left -= FOLD_BLOCK;
+            };
+
+            // accumulators are spelled out so they stay in registers without unrolling flags
+            __m128i x0 = _mm_xor_si128(load(0), _mm_cvtsi32_si128((int) crc));
+            __m128i x1 = load(1), x2 = load(2), x3 = load(3);
+            __m128i x4 = load(4), x5 = load(5), x6 = load(6), x7 = load(7);
+            advance();
+
+            const __m128i forward = k.forward;
+            while (left >= FOLD_BLOCK) {
+                x0 = fold(x0, forward, load(0));
+                x1 = fold(x1, forward, load(1));
+                x2 = fold(x2, forward, load(2));
+                x3 = fold(x3, forward, load(3));
+                x4 = fold(x4, forward, load(4));
+                x5 = fold(x5, forward, load(5));
+                x6 = fold(x6, forward, load(6));
+                x7 = fold(x7, forward, load(7));
+                advance();
+            }
+
+            src = p;
+            destination = dst;
+            size = left;
+
+            __m128i r = x7;
+            r = fold(x0, k.tail[0], r);
+            r = fold(x1, k.tail[1], r);
+            r = fold(x2, k.tail[2], r);
+            r = fold(x3, k.tail[3], r);
+            r = fold(x4, k.tail[4], r);
+            r = fold(x5, k.tail[5], r);
+            r = fold(x6, k.tail[6], r);
+            uint64_t c = _mm_crc32_u64(0, (uint64_t) _mm_cvtsi128_si64(r));
+            return (uint32_t) _mm_crc32_u64(c, (uint64_t) _mm_extract_epi64(r, 1));
+        }
+
+        STIP_CRC32C_TARGET
+        uint32_t updateHardware(uint32_t crc, const unsigned char *p, size_t size, unsigned char *dst) {
+            static const bool carryless = detectCarrylessMultiply();
+            if (carryless && size >= 256) {
+                crc = updateFold(crc, p, size, dst);
+            }
+            uint64_t c = crc;
+            while (size >= 8) {
+                uint64_t v;
+                memcpy(&v, p, 8);
+                if (dst) {
+                    memcpy(dst, &v, 8);
+                    dst += 8;
+                }
+                c = _mm_crc32_u64(c, v);
+                p += 8;
+                size -= 8;
+            }
+            auto c32 = static_cast<uint32_t>(c);
+            while (size--) {
+                if (dst) *dst++ = *p;
+                c32 = _mm_crc32_u8(c32, *p++);
+            }
+            return c32;
+        }
+#elif defined(STIP_CRC32C_ARM)
+        uint32_t updateHardware(uint32_t crc, const unsigned char *p, size_t size, unsigned char *dst) {
+            while (size >= 8) {
+                uint64_t v;
+                memcpy(&v, p, 8);
+                if (dst) {
+                    memcpy(dst, &v, 8);
+                    dst += 8;
+                }
+                crc = __crc32cd(crc, v);
+                p += 8;
+                size -= 8;
+            }
+            while (size--) {
+                if (dst) *dst++ = *p;
+                crc = __crc32cb(crc, *p++);
+            }
+            return crc;
+        }
+
+        bool detectHardware() {
+            return true;
+        }
+#else
+        uint32_t updateHardware(uint32_t crc, const unsigned char *p, size_t size, unsigned char *dst) {
+            return updateSoftware(crc, p, size, dst);
+        }
+
+        bool detectHardware() {
+            return false;
+        }
+#endif
+
+        uint32_t update(uint32_t crc, const void *src, size_t size, void *dst) {
+            static const bool hardware = detectHardware();
+            auto *p = static_cast<const unsigned char *>(src);
+            auto *d = static_cast<unsigned char *>(dst);
+            return ~(hardware ? updateHardware(~crc, p, size, d) : updateSoftware(~crc, p, size, d));
+        }
+
+    }
+
+    uint32_t crc32c(const void *data, size_t size, uint32_t crc) {
+        return update(crc, data, size, nullptr);
+    }
+
+    uint32_t crc32cCopy(void *dst, const void *src, size_t size, uint32_t crc) {
+        return update(crc, src, size, dst);
+    }
+
+    uint32_t crc32cSoftware(const void *data, size_t size, uint32_t crc) {
+        return ~updateSoftware(~crc, static_cast<const unsigned char *>(data), size, nullptr);
+    }
+
+    bool crc32cHardwareSupported() {
+        return detectHardware();
+    }
+
+} // STIP
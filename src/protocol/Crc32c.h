@@ -0,0 +1,39 @@
+#ifndef RABBIT_CRC32C_H
+#define RABBIT_CRC32C_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace STIP {
+
+    /// \brief CRC32C (Castagnoli) от блока данных
+    ///
+    /// Использует SSE4.2 (или CRC-инструкции ARMv8), если процессор их поддерживает,
+    /// иначе табличную реализацию
+    ///
+    /// \param data - данные
+    /// \param size - размер данных
+    /// \param crc - crc предыдущего блока, чтобы считать по частям
+    /// \return crc
+    uint32_t crc32c(const void *data, size_t size, uint32_t crc = 0);
+
+    /// \brief Копирование с подсчетом CRC32C
+    ///
+    /// Копирует блок и считает его crc за один проход, данные читаются один раз
+    ///
+    /// \param dst - куда копировать
+    /// \param src - откуда копировать
+    /// \param size - размер данных
+    /// \param crc - crc предыдущего блока
+    /// \return crc скопированных данных
+    uint32_t crc32cCopy(void *dst, const void *src, size_t size, uint32_t crc = 0);
+
+    /// \brief Табличная реализация, для проверки и сравнения скорости
+    uint32_t crc32cSoftware(const void *data, size_t size, uint32_t crc = 0);
+
+    /// \brief Доступна ли аппаратная реализация на этом процессоре
+    bool crc32cHardwareSupported();
+
+} // STIP
+
+#endif //RABBIT_CRC32C_H
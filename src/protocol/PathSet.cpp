@@ -0,0 +1,138 @@
+#include "PathSet.h"
+
+#include <algorithm>
+
+namespace STIP {
+
+    namespace {
+        // smoothing factors for loss (per sent part) and rtt (per sample)
+        const double LOSS_GAIN = 1.0 / 64;
+        const double RTT_GAIN = 1.0 / 8;
+    }
+
+    size_t PathSet::add(udp::socket *socket, const udp::endpoint &endpoint) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (count == MAX_PATHS) {
+            return MAX_PATHS;
+        }
+        paths[count].socket = socket;
+        paths[count].endpoint = endpoint;
+        return count++;
+    }
+
+    bool PathSet::set(size_t index, udp::socket *socket, const udp::endpoint &endpoint) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (index >= MAX_PATHS) {
+            return false;
+        }
+        paths[index].socket = socket;
+        paths[index].endpoint = endpoint;
+        count = std::max(count, index + 1);
+        return true;
+    }
+
+    void PathSet::activate(size_t index) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (index < count && paths[index].socket != nullptr) {
+            paths[index].stats.active = true;
+        }
+    }
+
+    size_t PathSet::activeCount() {
+        std::lock_guard<std::mutex> lock(mtx);
+        size_t active = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (paths[i].stats.active) active++;
+        }
+        return active;
+    }
+
+    int PathSet::weight(const Path &path, double minRtt) const {
+        double w = 100 * (1 - path.stats.lossRate);
+        // without samples on every path rtt is ignored
+        if (minRtt > 0 && path.stats.rttMs > 0) {
+            w *= minRtt / path.stats.rttMs;
+        }
+        return std::max(1, static_cast<int>(w));
+    }
+
+    size_t PathSet::pick() {
+        std::lock_guard<std::mutex> lock(mtx);
+        double minRtt = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (!paths[i].stats.active) continue;
+            if (paths[i].stats.rttMs == 0) {
+                minRtt = 0;
+                break;
+            }
+            minRtt = minRtt == 0 ? paths[i].stats.rttMs : std::min(minRtt, paths[i].stats.rttMs);
+        }
+
+        size_t best = 0;
+        int total = 0;
+        bool found = false;
+        for (size_t i = 0; i < count; i++) {
+            if (!paths[i].stats.active) continue;
+            int w = weight(paths[i], minRtt);
+            paths[i].credit += w;
+            total += w;
+            if (!found || paths[i].credit > paths[best].credit) {
+                best = i;
+                found = true;
+            }
+        }
+        if (!found) {
+            return 0;
+        }
+        paths[best].credit -= total;
+        return best;
+    }
+
+    void PathSet::send(size_t index, const void *packet, size_t size, bool dataPart) {
+        udp::socket *socket;
+        udp::endpoint endpoint;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (index >= count || !paths[index].stats.active) {
+                index = 0;
+            }
+            Path &path = paths[index];
+            if (dataPart) {
+                path.stats.sentParts++;
+                path.stats.lossRate -= path.stats.lossRate * LOSS_GAIN;
+            }
+            socket = path.socket;
+            endpoint = path.endpoint;
+        }
+        boost::system::error_code error;
+        socket->send_to(boost::asio::buffer(packet, size), endpoint, 0, error);
+    }
+
+    void PathSet::onLost(size_t index) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (index >= count) {
+            return;
+        }
+        PathStats &stats = paths[index].stats;
+        stats.lostParts++;
+        stats.lossRate += (1 - stats.lossRate) * LOSS_GAIN;
+    }
+
+    void PathSet::onRtt(size_t index, double rttMs) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (index >= count) {
+            return;
+        }
+        PathStats &stats = paths[index].stats;
+        stats.rttMs = stats.rttMs == 0 ? rttMs : stats.rttMs + (rttMs - stats.rttMs) * RTT_GAIN;
+    }
+
+    PathStats PathSet::getStats(size_t index) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (index >= count) {
+            return {};
+        }
+        return paths[index].stats;
+    }
+
+} // STIP
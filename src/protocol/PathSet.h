@@ -0,0 +1,94 @@
+#ifndef RABBIT_PATHSET_H
+#define RABBIT_PATHSET_H
+
+#include <array>
+#include <mutex>
+#include <boost/asio.hpp>
+
+#include "protocol/STIP.h"
+
+using boost::asio::ip::udp;
+
+namespace STIP {
+
+    // path 0 is the socket the connection was established on
+    static const size_t MAX_PATHS = 8;
+
+    /// \brief Состояние одного пути
+    struct PathStats {
+        bool active = false;
+        size_t sentParts = 0;
+        size_t lostParts = 0;
+        double lossRate = 0;   // сглаженная доля потерянных частей
+        double rttMs = 0;      // сглаженное RTT, 0 пока нет замеров
+    };
+
+    /// \brief Набор путей соединения
+    ///
+    /// Путь - пара из локального сокета и адреса собеседника. Части сообщений
+    /// распределяются между активными путями пропорционально (1 - потери) / RTT
+    class PathSet {
+    public:
+        /// \brief Добавление пути
+        ///
+        /// Путь не используется, пока не будет активирован
+        ///
+        /// \param socket - локальный сокет пути
+        /// \param endpoint - адрес собеседника на этом пути
+        /// \return номер пути или MAX_PATHS, если мест нет
+        size_t add(udp::socket *socket, const udp::endpoint &endpoint);
+
+        /// \brief Установка пути с номером, который выбрал собеседник
+        ///
+        /// \param index - номер пути
+        /// \param socket - локальный сокет пути
+        /// \param endpoint - адрес собеседника на этом пути
+        /// \return false, если номер вне допустимого диапазона
+        bool set(size_t index, udp::socket *socket, const udp::endpoint &endpoint);
+
+        void activate(size_t index);
+
+        /// \brief Количество активных путей
+        size_t activeCount();
+
+        /// \brief Выбор пути для следующей части
+        ///
+        /// Плавный взвешенный round robin
+        ///
+        /// \return номер активного пути
+        size_t pick();
+
+        /// \brief Отправка пакета по пути
+        ///
+        /// \param index - номер пути, неактивный путь заменяется основным
+        /// \param packet - пакет
+        /// \param size - размер пакета
+        /// \param dataPart - учитывать ли пакет в статистике отправленных частей
+        void send(size_t index, const void *packet, size_t size, bool dataPart = true);
+
+        /// \brief Учет потерянной части, отправленной по пути
+        void onLost(size_t index);
+
+        /// \brief Учет замера RTT
+        void onRtt(size_t index, double rttMs);
+
+        PathStats getStats(size_t index);
+
+    private:
+        struct Path {
+            udp::socket *socket = nullptr;
+            udp::endpoint endpoint;
+            PathStats stats;
+            int credit = 0;
+        };
+
+        std::mutex mtx;
+        std::array<Path, MAX_PATHS> paths;
+        size_t count = 0;
+
+        int weight(const Path &path, double minRtt) const;
+    };
+
+} // STIP
+
+#endif //RABBIT_PATHSET_H
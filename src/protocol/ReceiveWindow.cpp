@@ -0,0 +1,51 @@
+#include "ReceiveWindow.h"
+
+#include <cstring>
+
+namespace STIP {
+
+    ReceiveWindow::ReceiveWindow(size_t limit) {
+        this->limit = limit;
+    }
+
+    bool ReceiveWindow::tryReserve(size_t size) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (used + size > limit && used != 0) {
+            return false;
+        }
+        used += size;
+        return true;
+    }
+
+    void ReceiveWindow::release(size_t size) {
+        std::lock_guard<std::mutex> lock(mtx);
+        used = size > used ? 0 : used - size;
+    }
+
+    size_t ReceiveWindow::available() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return used >= limit ? 0 : limit - used;
+    }
+
+    void ReceiveWindow::setLimit(size_t limit) {
+        std::lock_guard<std::mutex> lock(mtx);
+        this->limit = limit;
+    }
+
+    void ReceiveWindow::writeAdvertisement(STIP_PACKET &packet, size_t window) {
+        uint64_t value = window;
+        memcpy(packet.data, &value, sizeof(uint64_t));
+        packet.header.size = sizeof(STIP_HEADER) + sizeof(uint64_t);
+    }
+
+    bool ReceiveWindow::readAdvertisement(const STIP_PACKET &packet, size_t &window) {
+        if (packet.header.size < static_cast<int>(sizeof(STIP_HEADER) + sizeof(uint64_t))) {
+            return false;
+        }
+        uint64_t value;
+        memcpy(&value, packet.data, sizeof(uint64_t));
+        window = value;
+        return true;
+    }
+
+} // STIP
@@ -0,0 +1,61 @@
+#ifndef RABBIT_RECEIVEWINDOW_H
+#define RABBIT_RECEIVEWINDOW_H
+
+#include <mutex>
+
+#include "protocol/STIP.h"
+
+namespace STIP {
+
+    // 512 MB of reassembly buffers per connection by default
+    static const size_t DEFAULT_RECEIVE_WINDOW = 512ull * 1024 * 1024;
+
+    class ReceiveWindow {
+    public:
+        explicit ReceiveWindow(size_t limit = DEFAULT_RECEIVE_WINDOW);
+
+        /// \brief Резервирование места под сообщение
+        ///
+        /// Сообщение больше всего окна принимается только когда ничего больше не зарезервировано,
+        /// иначе такое сообщение нельзя было бы принять никогда
+        ///
+        /// \param size - размер сообщения
+        /// \return true, если место зарезервировано
+        bool tryReserve(size_t size);
+
+        /// \brief Освобождение места
+        ///
+        /// \param size - сколько байт освободить
+        void release(size_t size);
+
+        /// \brief Свободное место для сборки сообщений
+        ///
+        /// \return размер окна, который объявляется отправителю
+        size_t available();
+
+        void setLimit(size_t limit);
+
+        /// \brief Запись объявления окна в ответный пакет
+        ///
+        /// Окно записывается в начало данных пакета, размер пакета увеличивается
+        ///
+        /// \param packet - ответный пакет без данных
+        /// \param window - свободное место у получателя
+        static void writeAdvertisement(STIP_PACKET &packet, size_t window);
+
+        /// \brief Чтение объявления окна из пакета
+        ///
+        /// \param packet - ответ получателя
+        /// \param window - свободное место у получателя
+        /// \return false, если получатель не объявил окно
+        static bool readAdvertisement(const STIP_PACKET &packet, size_t &window);
+
+    private:
+        std::mutex mtx;
+        size_t limit;
+        size_t used = 0;
+    };
+
+} // STIP
+
+#endif //RABBIT_RECEIVEWINDOW_H
@@ -10,11 +10,16 @@
 namespace STIP {
     static const int MAX_UDP_SIZE = 65507 - 8 - 20 - 8;
 
+    // header flags
+    static const uint32_t HEADER_FLAG_CRC32C = 1; // checksum field holds CRC32C of the packet data
+
     struct STIP_HEADER {
         Command command;
         uint32_t session_id;
         int size;
         uint32_t packet_id;
+        uint32_t flags;
+        uint32_t checksum;
 
         // generate session id
     };
@@ -22,6 +27,18 @@ namespace STIP {
 
     static const int MAX_STIP_DATA_SIZE = MAX_UDP_SIZE - sizeof(STIP_HEADER);
 
+    // priority class of a logical stream, lower value is served first
+    enum class Priority : uint8_t {
+        CONTROL = 0,
+        NORMAL = 1,
+        BULK = 2,
+    };
+
+    static const int PRIORITY_COUNT = 3;
+
+    // messages bigger than this go to the bulk stream unless priority is set explicitly
+    static const size_t BULK_MESSAGE_THRESHOLD = 1024 * 1024;
+
     struct STIP_PACKET {
         STIP_HEADER header;
         char data[MAX_STIP_DATA_SIZE];
@@ -1,6 +1,6 @@
 #ifndef RABBIT_CLIENTVERSION_H
 #define RABBIT_CLIENTVERSION_H
 
-#define STIP_PROTOCOL_VERSION 2
+#define STIP_PROTOCOL_VERSION 3
 
 #endif //RABBIT_CLIENTVERSION_H
@@ -0,0 +1,129 @@
+#include "SendScheduler.h"
+#include "protocol/Session.h"
+
+namespace STIP {
+
+    SendScheduler::SendScheduler(std::array<int, PRIORITY_COUNT> weights) {
+        this->weights = weights;
+    }
+
+    void SendScheduler::setWeights(std::array<int, PRIORITY_COUNT> weights) {
+        std::lock_guard<std::mutex> lock(mtx);
+        this->weights = weights;
+    }
+
+    void SendScheduler::setPaths(PathSet *paths) {
+        std::lock_guard<std::mutex> lock(mtx);
+        this->paths = paths;
+    }
+
+    void SendScheduler::sendParts(SendMessageSession *session, Priority priority) {
+        Job job = {session, 0, static_cast<uint32_t>(session->getPacketCount()), false, 0};
+        if (job.end == 0) {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(mtx);
+        if (!isRunning) {
+            isRunning = true;
+            mainThread = std::thread(&SendScheduler::processThread, this);
+        }
+        queues[static_cast<int>(priority)].push_back(&job);
+        cv.notify_one();
+        doneCv.wait(lock, [&job] { return job.done; });
+    }
+
+    bool SendScheduler::hasJobs() const {
+        for (auto &queue: queues) {
+            if (!queue.empty()) return true;
+        }
+        return false;
+    }
+
+    void SendScheduler::processThread() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (isRunning) {
+            cv.wait(lock, [this] { return hasJobs() || !isRunning; });
+
+            for (int p = 0; p < PRIORITY_COUNT && isRunning; p++) {
+                // every pass starts from the control class again, new control parts wait one slice at most
+                for (int sent = 0; sent < weights[p] && !queues[p].empty(); sent++) {
+                    Job *job = queues[p].front();
+                    queues[p].pop_front();
+                    uint32_t packet_id = job->next++;
+                    // counted before any wait, so the job can't be finished and freed meanwhile
+                    job->inflight++;
+
+                    size_t activePaths = paths == nullptr ? 1 : paths->activeCount();
+                    if (activePaths > 1) {
+                        dispatch(lock, job, packet_id, activePaths);
+                    } else {
+                        lock.unlock();
+                        job->session->sendPart(packet_id);
+                        lock.lock();
+                        finishPart(job);
+                    }
+
+                    if (job->next < job->end) {
+                        queues[p].push_back(job);
+                    }
+                }
+            }
+        }
+    }
+
+    void SendScheduler::dispatch(std::unique_lock<std::mutex> &lock, Job *job, uint32_t packet_id,
+                                 size_t activePaths) {
+        cv.wait(lock, [this, activePaths] { return inflight < PATH_QUEUE_DEPTH * activePaths || !isRunning; });
+        size_t path = paths->pick();
+        while (pathThreads.size() <= path) {
+            pathThreads.emplace_back(&SendScheduler::pathThread, this, pathThreads.size());
+        }
+        inflight++;
+        pathQueues[path].push_back({job, packet_id});
+        pathCv.notify_all();
+    }
+
+    void SendScheduler::finishPart(Job *job) {
+        job->inflight--;
+        if (job->next == job->end && job->inflight == 0) {
+            job->done = true;
+            doneCv.notify_all();
+        }
+    }
+
+    void SendScheduler::pathThread(size_t path) {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (isRunning) {
+            pathCv.wait(lock, [this, path] { return !pathQueues[path].empty() || !isRunning; });
+            while (!pathQueues[path].empty()) {
+                PathTask task = pathQueues[path].front();
+                pathQueues[path].pop_front();
+
+                lock.unlock();
+                task.job->session->sendPart(task.packet_id, path);
+                lock.lock();
+
+                inflight--;
+                finishPart(task.job);
+                cv.notify_all();
+            }
+        }
+    }
+
+    SendScheduler::~SendScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            isRunning = false;
+            cv.notify_all();
+            pathCv.notify_all();
+        }
+        if (mainThread.joinable()) {
+            mainThread.join();
+        }
+        for (auto &thread: pathThreads) {
+            thread.join();
+        }
+    }
+
+} // STIP
@@ -0,0 +1,97 @@
+#ifndef RABBIT_SENDSCHEDULER_H
+#define RABBIT_SENDSCHEDULER_H
+
+#include <array>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+#include "protocol/STIP.h"
+#include "protocol/PathSet.h"
+
+namespace STIP {
+
+    class SendMessageSession;
+
+    class SendScheduler {
+    public:
+        /// \brief Конструктор
+        ///
+        /// \param weights - сколько частей подряд отправляет каждый класс приоритета за один круг
+        explicit SendScheduler(std::array<int, PRIORITY_COUNT> weights = {8, 4, 1});
+
+        /// \brief Отправка всех частей сообщения
+        ///
+        /// Ставит сообщение в очередь своего класса приоритета.
+        /// Части разных сообщений чередуются взвешенным round robin между классами
+        /// и по кругу внутри класса. Ждет, пока все части не будут отправлены
+        ///
+        /// \param session - сессия отправки
+        /// \param priority - класс приоритета
+        void sendParts(SendMessageSession *session, Priority priority);
+
+        void setWeights(std::array<int, PRIORITY_COUNT> weights);
+
+        /// \brief Пути соединения
+        ///
+        /// Если активных путей больше одного, части раздаются потокам путей,
+        /// каждый путь собирает и отправляет свои части параллельно с остальными
+        ///
+        /// \param paths - набор путей соединения
+        void setPaths(PathSet *paths);
+
+        /// \brief Деструктор
+        ///
+        /// Останавливает поток отправки
+        ~SendScheduler();
+
+    private:
+        struct Job {
+            SendMessageSession *session;
+            uint32_t next;
+            uint32_t end;
+            bool done;
+            uint32_t inflight;
+        };
+
+        struct PathTask {
+            Job *job;
+            uint32_t packet_id;
+        };
+
+        // parts handed to path threads but not sent yet, per active path
+        static const size_t PATH_QUEUE_DEPTH = 4;
+
+        std::array<std::deque<Job *>, PRIORITY_COUNT> queues;
+        std::array<int, PRIORITY_COUNT> weights;
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::condition_variable doneCv;
+        std::condition_variable pathCv;
+        std::thread mainThread;
+        bool isRunning = false;
+
+        PathSet *paths = nullptr;
+        std::array<std::deque<PathTask>, MAX_PATHS> pathQueues;
+        std::vector<std::thread> pathThreads;
+        size_t inflight = 0;
+
+        void processThread();
+
+        void pathThread(size_t path);
+
+        /// \brief Передача части потоку пути
+        ///
+        /// Ждет, пока у потоков путей не освободится место
+        void dispatch(std::unique_lock<std::mutex> &lock, Job *job, uint32_t packet_id, size_t activePaths);
+
+        void finishPart(Job *job);
+
+        bool hasJobs() const;
+    };
+
+} // STIP
+
+#endif //RABBIT_SENDSCHEDULER_H
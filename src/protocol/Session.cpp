@@ -1,4 +1,6 @@
 #include "Session.h"
+#include "Crc32c.h"
+#include <algorithm>
 #include <boost/asio.hpp>
 
 namespace STIP {
@@ -9,14 +11,14 @@ namespace STIP {
 
 // ------------------------------------------------ PingSession.h ------------------------------------------------
 
-    void PingSession::processIncomingPacket(STIP_PACKET packet) {
+    void PingSession::processIncomingPacket(const STIP_PACKET &packet) {
         if (packet.header.command != Command::PING_ANSWER) {
             return;
         }
 #ifdef STIP_PROTOCOL_DEBUG
         std::cout << "PingSession processIncomingPacket" << std::endl;
 #endif
-        answer = *(uint32_t *) packet.data;
+        answer = *(const uint32_t *) packet.data;
         isAnswered = true;
         cv.notify_one();
     }
@@ -51,7 +53,8 @@ namespace STIP {
 
 // ------------------------------------------------ MessageSession.h ------------------------------------------------
 
-    void SendMessageSession::processIncomingPacket(STIP_PACKET packet) {
+    void SendMessageSession::processIncomingPacket(const STIP_PACKET &packet) {
+        std::lock_guard<std::mutex> lock(mtx);
         switch (packet.header.command) {
             case Command::MSG_INIT_RESPONSE_SUCCESS:
 //            std::cout << "MessageSession processIncomingPacket" << std::endl;
@@ -61,6 +64,11 @@ namespace STIP {
                 cv.notify_all();
                 break;
 
+            case Command::MSG_INIT_RESPONSE_BUSY: // no buffer space at receiver, retry later
+                status = SendMessageStatuses::INIT_RESPONSE_BUSY;
+                cv.notify_all();
+                break;
+
             case Command::MSG_INIT_RESPONSE_FAILURE : // BAD
 //            std::cout << "MessageSession processIncomingPacket" << std::endl;
 //            std::cout << "Message: " << packet.data << std::endl;
@@ -96,16 +104,17 @@ namespace STIP {
         packet[0].header.packet_id = packet_counts; // means packets count in this case
 
         memcpy(packet[0].data, &size, sizeof(size_t));
-        packet[0].header.size = sizeof(STIP_HEADER) + sizeof(size_t);
+        packet[0].data[sizeof(size_t)] = static_cast<char>(priority);
+        packet[0].header.size = sizeof(STIP_HEADER) + sizeof(size_t) + 1;
 
+        std::unique_lock<std::mutex> lock(mtx);
         status = SendMessageStatuses::INIT_REQUEST_SENT;
         socket->send_to(boost::asio::buffer(packet, packet[0].header.size), endpoint);
 
-        std::unique_lock<std::mutex> lock(mtx);
-        status = SendMessageStatuses::INIT;
         cv.wait(lock, [this] {
             return status == SendMessageStatuses::INIT_RESPONSE_SUCCESS ||
-                   status == SendMessageStatuses::INIT_RESPONSE_FAILURE || _cancaled;
+                   status == SendMessageStatuses::INIT_RESPONSE_FAILURE ||
+                   status == SendMessageStatuses::INIT_RESPONSE_BUSY || _cancaled;
         });
         return status == SendMessageStatuses::INIT_RESPONSE_SUCCESS;
     }
@@ -150,6 +159,11 @@ namespace STIP {
 
     bool SendMessageSession::sendData() {
         status = SendMessageStatuses::DATA_REQEUST_SENT;
+        if (scheduler != nullptr) {
+            scheduler->sendParts(this, priority);
+            return true;
+        }
+
         for (int i = 0; i < packet_counts; i++) {
             sendPart(i);
         }
@@ -157,16 +171,46 @@ namespace STIP {
         return true;
     }
 
-    void SendMessageSession::sendPart(uint32_t packet_id) {
-        STIP_PACKET packet[1] = {};
+    size_t SendMessageSession::getPacketCount() const {
+        return packet_counts;
+    }
+
+    void SendMessageSession::setChecksumEnabled(bool enabled) {
+        checksumEnabled = enabled;
+    }
+
+    bool SendMessageSession::isReceiverBusy() const {
+        return status == SendMessageStatuses::INIT_RESPONSE_BUSY;
+    }
+
+    void SendMessageSession::setPaths(PathSet *paths) {
+        this->paths = paths;
+        partPaths.reset(new std::atomic<uint8_t>[packet_counts]());
+    }
+
+    void SendMessageSession::sendPart(uint32_t packet_id, size_t path) {
+        // only the header is zeroed, the data area is overwritten right away
+        STIP_PACKET packet[1];
+        packet[0].header = {};
         packet[0].header.command = Command::MSG_SEND_DATA_PART;
         packet[0].header.session_id = id;
         packet[0].header.packet_id = packet_id;
 
-        size_t partSize = (packet_id == packet_counts - 1) ? size % MAX_STIP_DATA_SIZE : MAX_STIP_DATA_SIZE;
-        memcpy(packet[0].data, (void *) ((char *) data + packet_id * MAX_STIP_DATA_SIZE), partSize);
+        size_t partSize = std::min<size_t>(size - (size_t) packet_id * MAX_STIP_DATA_SIZE, MAX_STIP_DATA_SIZE);
+        const char *part = (const char *) data + packet_id * MAX_STIP_DATA_SIZE;
+        if (checksumEnabled) {
+            packet[0].header.checksum = crc32cCopy(packet[0].data, part, partSize);
+            packet[0].header.flags |= HEADER_FLAG_CRC32C;
+        } else {
+            memcpy(packet[0].data, part, partSize);
+        }
         packet[0].header.size = sizeof(STIP_HEADER) + partSize;
 
+        if (paths != nullptr) {
+            partPaths[packet_id] = static_cast<uint8_t>(path);
+            paths->send(path, packet, packet[0].header.size);
+            return;
+        }
         socket->send_to(boost::asio::buffer(packet, packet[0].header.size), endpoint);
     }
 
@@ -237,13 +281,19 @@ namespace STIP {
         cv.notify_all();
     }
 
-    void SendMessageSession::doResend(STIP_PACKET &packet) {
+    void SendMessageSession::doResend(const STIP_PACKET &packet) {
         uint32_t resend_counts = packet.header.packet_id;
 //        uint32_t parts_indexes[resend_counts];
 
         // parse uint32_t array from packet.data
         for (int i = 0; i < resend_counts; i++) {
-            uint32_t parts_index = *(uint32_t *) (packet.data + i * sizeof(uint32_t));
+            uint32_t parts_index = *(const uint32_t *) (packet.data + i * sizeof(uint32_t));
+            if (parts_index >= packet_counts) continue;
+            if (paths != nullptr) {
+                paths->onLost(partPaths[parts_index]);
+                sendPart(parts_index, paths->pick());
+                continue;
+            }
             sendPart(parts_index);
         }
     }
@@ -262,6 +312,9 @@ namespace STIP {
 
 
     std::string ReceiveMessageSession::getDataAsString() {
+        if (data == nullptr) {
+            return {};
+        }
         std::string result = static_cast<const char *>(data);
         result.resize(size);
         return result;
@@ -271,8 +324,29 @@ namespace STIP {
         return {data, size};
     }
 
-    void ReceiveMessageSession::processIncomingPacket(STIP_PACKET packet) {
+    bool ReceiveMessageSession::copyVerified(void *destination, const STIP_PACKET &packet, size_t partSize) {
+        if (!(packet.header.flags & HEADER_FLAG_CRC32C)) {
+            memcpy(destination, packet.data, partSize);
+            return true;
+        }
+        // corrupted part stays unreceived and is asked again with the resend list
+        if (crc32cCopy(destination, packet.data, partSize) != packet.header.checksum) {
+            corruptedParts++;
+#ifdef STIP_PROTOCOL_DEBUG
+            std::cout << "Corrupted part " << packet.header.packet_id << " in session " << id << std::endl;
+#endif
+            return false;
+        }
+        return true;
+    }
+
+    size_t ReceiveMessageSession::getCorruptedParts() const {
+        return corruptedParts;
+    }
+
+    void ReceiveMessageSession::processIncomingPacket(const STIP_PACKET &packet) {
         STIP_PACKET packet_response[1] = {};
+        size_t partSize;
         switch (packet.header.command) {
             case Command::MSG_INIT_REQUEST:
                 if (packet.header.session_id != id) {
@@ -280,16 +354,28 @@ namespace STIP {
                 }
 
                 if (status == -1) {
-                    size = *(size_t *) packet.data;
+                    std::lock_guard<std::mutex> lock(mtx);
+                    size = *(const size_t *) packet.data;
                     packet_counts = (size + MAX_STIP_DATA_SIZE - 1) / MAX_STIP_DATA_SIZE;
-                    data = malloc(size);
+                    if (!streaming && data == nullptr) {
+                        data = malloc(size);
+                    }
                     receivedParts.resize(packet_counts);
+                    // the priority follows the size, a short packet keeps the default one
+                    if (packet.header.size > static_cast<int>(sizeof(STIP_HEADER) + sizeof(size_t)) &&
+                        static_cast<uint8_t>(packet.data[sizeof(size_t)]) < PRIORITY_COUNT) {
+                        priority = static_cast<Priority>(packet.data[sizeof(size_t)]);
+                    }
+                    if (streaming) {
+                        streamParts.resize(packet_counts, nullptr);
+                        streamPartSizes.resize(packet_counts, 0);
+                    }
                     status = 1;
                 }
 
                 packet_response[0].header.command = Command::MSG_INIT_RESPONSE_SUCCESS;
                 packet_response[0].header.session_id = id;
-                packet_response[0].header.size = sizeof(STIP_HEADER);
+                ReceiveWindow::writeAdvertisement(packet_response[0], advertisedWindow());
                 socket->send_to(boost::asio::buffer(packet_response, packet_response[0].header.size), endpoint);
                 break;
             case Command::MSG_SEND_DATA_PART:
@@ -299,9 +385,33 @@ namespace STIP {
                 if (receivedParts[packet.header.packet_id]) {
                     return;
                 }
-                memcpy((void *) ((char *) data + packet.header.packet_id * MAX_STIP_DATA_SIZE), packet.data,
-                       packet.header.size - sizeof(STIP_HEADER));
-                receivedParts[packet.header.packet_id] = true;
+                partSize = packet.header.size - sizeof(STIP_HEADER);
+                if (packet.header.size < (int) sizeof(STIP_HEADER) ||
+                    (size_t) packet.header.packet_id * MAX_STIP_DATA_SIZE + partSize > size) {
+                    return;
+                }
+                if (streaming) {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    char *part = new char[partSize];
+                    if (!copyVerified(part, packet, partSize)) {
+                        delete[] part;
+                        return;
+                    }
+                    streamParts[packet.header.packet_id] = part;
+                    streamPartSizes[packet.header.packet_id] = partSize;
+                    receivedParts[packet.header.packet_id] = true;
+
+                    while (contiguousParts < packet_counts && receivedParts[contiguousParts]) {
+                        contiguousParts++;
+                    }
+                    cv.notify_all();
+                } else {
+                    if (!copyVerified((char *) data + packet.header.packet_id * MAX_STIP_DATA_SIZE, packet,
+                                      partSize)) {
+                        return;
+                    }
+                    receivedParts[packet.header.packet_id] = true;
+                }
 
                 if (0 == countUnreceivedParts()) {
                     status = 5;
@@ -322,7 +432,7 @@ namespace STIP {
                     status = 5;
                     packet_response[0].header.command = Command::MSG_RESPONSE_ALL_RECEIVED;
                     packet_response[0].header.session_id = id;
-                    packet_response[0].header.size = sizeof(STIP_HEADER);
+                    ReceiveWindow::writeAdvertisement(packet_response[0], advertisedWindow());
                     socket->send_to(boost::asio::buffer(packet_response, packet_response[0].header.size), endpoint);
                 } else {
                     packet_response[0].header.command = Command::MSG_RESPONSE_RESEND;
@@ -351,6 +461,73 @@ namespace STIP {
         return status;
     }
 
+    Priority ReceiveMessageSession::getPriority() const {
+        return priority;
+    }
+
+    bool ReceiveMessageSession::nextChunk(StreamChunk &chunk) {
+        std::unique_lock<std::mutex> lock(mtx);
+        if (!streaming) {
+            return false;
+        }
+
+        // consumer moved past the previous chunk, it's safe to release it
+        if (readCursor > 0 && streamParts[readCursor - 1] != nullptr) {
+            delete[] streamParts[readCursor - 1];
+            streamParts[readCursor - 1] = nullptr;
+
+            size_t released = std::min(reservedBytes, streamPartSizes[readCursor - 1]);
+            reservedBytes -= released;
+            if (window) window->release(released);
+        }
+
+        cv.wait(lock, [this] {
+            return aborted || readCursor < contiguousParts || (finished && readCursor >= packet_counts);
+        });
+        if (aborted || readCursor >= contiguousParts) {
+            return false;
+        }
+
+        chunk.data = streamParts[readCursor];
+        chunk.size = streamPartSizes[readCursor];
+        chunk.offset = readCursor * MAX_STIP_DATA_SIZE;
+        readCursor++;
+        return true;
+    }
+
+    void ReceiveMessageSession::abort() {
+        std::lock_guard<std::mutex> lock(mtx);
+        aborted = true;
+        cv.notify_all();
+    }
+
+    void ReceiveMessageSession::finish() {
+        std::lock_guard<std::mutex> lock(mtx);
+        finished = true;
+        cv.notify_all();
+    }
+
+    bool ReceiveMessageSession::isStreaming() const {
+        return streaming;
+    }
+
+    size_t ReceiveMessageSession::getSize() const {
+        return size;
+    }
+
+    ReceiveMessageSession::~ReceiveMessageSession() {
+        for (char *part: streamParts) {
+            delete[] part;
+        }
+        free(data);
+        if (window) window->release(reservedBytes);
+    }
+
+    size_t ReceiveMessageSession::advertisedWindow() {
+        // without a window the receiver doesn't limit the sender
+        return window ? window->available() : SIZE_MAX;
+    }
+
     uint32_t ReceiveMessageSession::countUnreceivedParts() const {
         return std::count(receivedParts.begin(), receivedParts.end(), false);
     }
@@ -9,7 +9,12 @@
 
 #include "protocol/STIP.h"
 #include "protocol/STIPVersion.h"
+#include "protocol/SendScheduler.h"
+#include "protocol/ReceiveWindow.h"
+#include "protocol/PathSet.h"
+#include <atomic>
 #include <vector>
+#include <memory>
 //using namespace std;
 using boost::asio::ip::udp;
 
@@ -22,7 +27,7 @@ namespace STIP {
         /// Помечает, что пакет с данными получен
         ///
         /// \param packet пакет
-        virtual void processIncomingPacket(STIP_PACKET packet) = 0;
+        virtual void processIncomingPacket(const STIP_PACKET &packet) = 0;
 
         /// \brief Полуение идентификатора сессии
         ///
@@ -56,7 +61,7 @@ namespace STIP {
         /// Процесс обработки входящего пакетов
         ///
         /// \param packet - пакет
-        void processIncomingPacket(STIP_PACKET packet) override;
+        void processIncomingPacket(const STIP_PACKET &packet) override;
 
         /// \brief Ответ сервера на пинг
         ///
@@ -100,6 +105,8 @@ namespace STIP {
         DATA_RESPONSE_RESEND = 5,
         DATA_RESPONSE_SUCCESS = 6,
         DATA_RESPONSE_FAILURE = 7,
+
+        INIT_RESPONSE_BUSY = 8,
     };
 
 
@@ -114,12 +121,17 @@ namespace STIP {
         /// \param size - размер данных
         /// \param socket - указатель на сокет
         /// \param endpoint - указатель на конечную точку
-        explicit SendMessageSession(uint32_t id, void *data, uint32_t size, udp::socket *socket,
-                                    udp::endpoint &endpoint) {
+        /// \param priority - класс приоритета потока
+        /// \param scheduler - планировщик отправки соединения, без него части отправляются подряд
+        explicit SendMessageSession(uint32_t id, void *data, size_t size, udp::socket *socket,
+                                    udp::endpoint &endpoint, Priority priority = Priority::NORMAL,
+                                    SendScheduler *scheduler = nullptr) {
             status = SendMessageStatuses::INIT; // -1
             this->id = id;
             this->data = data;
             this->size = size;
+            this->priority = priority;
+            this->scheduler = scheduler;
 
             this->socket = socket;
             this->endpoint = endpoint;
@@ -132,7 +144,7 @@ namespace STIP {
         /// Процесс обработки входящего пакетов
         ///
         /// \param packet - пакет
-        void processIncomingPacket(STIP_PACKET packet) override;
+        void processIncomingPacket(const STIP_PACKET &packet) override;
 
 //    void sendAnswer(udp::socket &socket, udp::endpoint &endpoint, void *data, size_t size);
         /// \brief Инициализация отправки
@@ -175,7 +187,29 @@ namespace STIP {
 
         void cancel();
 
+        size_t getPacketCount() const;
+
+        /// \brief Получатель отказал в инициализации из-за нехватки буфера
+        ///
+        /// \return true, если на последний запрос инициализации пришел MSG_INIT_RESPONSE_BUSY
+        bool isReceiverBusy() const;
+
+        /// \brief Подсчет CRC32C для каждой части
+        ///
+        /// \param enabled - добавлять ли контрольную сумму в заголовок частей
+        void setChecksumEnabled(bool enabled);
+
+        /// \brief Пути соединения для отправки частей
+        ///
+        /// Запоминается, по какому пути ушла каждая часть, чтобы учитывать потери пути
+        /// при запросе перепосылки
+        ///
+        /// \param paths - набор путей соединения
+        void setPaths(PathSet *paths);
+
     private:
+        friend class SendScheduler;
+
         std::mutex mtx;
         std::condition_variable cv;
         bool _cancaled = false;
@@ -184,6 +218,11 @@ namespace STIP {
         size_t size = 0;
         size_t packet_counts = 0;
         SendMessageStatuses status = SendMessageStatuses::INIT;
+        Priority priority = Priority::NORMAL;
+        SendScheduler *scheduler = nullptr;
+        bool checksumEnabled = false;
+        PathSet *paths = nullptr;
+        std::unique_ptr<std::atomic<uint8_t>[]> partPaths;
 
         udp::socket *socket = nullptr;
         udp::endpoint endpoint;
@@ -194,9 +233,10 @@ namespace STIP {
         /// Копирование части данных в пакет, отправка пакета
         ///
         /// \param packet_id - идентификатор пакета
-        void sendPart(uint32_t packet_id);
+        /// \param path - номер пути, если заданы пути соединения
+        void sendPart(uint32_t packet_id, size_t path = 0);
 
-        void doResend(STIP_PACKET &packet);
+        void doResend(const STIP_PACKET &packet);
 
         /// \brief Спрашиваем у сервера получил ли тот все пакеты
         void askAllReceived();
@@ -204,27 +244,63 @@ namespace STIP {
 
 // ------------------------------------------------ ReceiveMessageSession.h ------------------------------------------------
 
+    /// \brief Непрерывный кусок принятого сообщения
+    ///
+    /// Указатель действителен до следующего вызова nextChunk или удаления сессии
+    struct StreamChunk {
+        const char *data = nullptr;
+        size_t size = 0;
+        size_t offset = 0;
+    };
+
     class ReceiveMessageSession : public Session {
     public:
+        /// \brief Конструктор
+        ///
+        /// Создание сессии приема сообщения.
+        /// В потоковом режиме данные хранятся по частям и отдаются через nextChunk,
+        /// иначе под сообщение сразу выделяется один буфер
+        ///
+        /// \param id - идентификатор сессии
+        /// \param size - размер сообщения
+        /// \param packet_counts - количество частей
+        /// \param socket - указатель на сокет
+        /// \param endpoint - конечная точка
+        /// \param streaming - потоковый режим приема
+        /// \param window - окно приема соединения, место под сообщение в нем уже зарезервировано
         explicit ReceiveMessageSession(uint32_t id, size_t size, size_t packet_counts, udp::socket *socket,
-                                       udp::endpoint &endpoint) {
+                                       udp::endpoint &endpoint, bool streaming = false,
+                                       std::shared_ptr<ReceiveWindow> window = nullptr) {
             status = -1;
             this->id = id;
             this->size = size;
             this->packet_counts = packet_counts;
+            this->streaming = streaming;
+            this->window = std::move(window);
+            reservedBytes = this->window ? size : 0;
             receivedParts.resize(packet_counts, false);
-            data = malloc(size);
+            if (streaming) {
+                streamParts.resize(packet_counts, nullptr);
+            } else {
+                data = malloc(size);
+            }
 
             this->socket = socket;
             this->endpoint = endpoint;
         }
 
+        /// \brief Деструктор
+        ///
+        /// Освобождает буфер сообщения и еще не прочитанные части,
+        /// возвращает место в окно приема
+        ~ReceiveMessageSession();
+
         /// \brief Обработка входящего пакета ?
         ///
         /// Проверка команды пакета
         ///
         /// \param packet - пакет
-        void processIncomingPacket(STIP_PACKET packet) override;
+        void processIncomingPacket(const STIP_PACKET &packet) override;
 
 //    void sendAnswer(udp::socket &socket, udp::endpoint &endpoint, void *data, size_t size);
 
@@ -243,6 +319,37 @@ namespace STIP {
         /// \return указатель и размер
         std::pair<void *, size_t> getData();
 
+        /// \brief Класс приоритета, с которым отправитель послал сообщение
+        Priority getPriority() const;
+
+        /// \brief Получение следующего куска сообщения по порядку
+        ///
+        /// Только для потокового режима. Ждет, пока не придет следующая по порядку часть.
+        /// Часть, выданная предыдущим вызовом, освобождается и ее место возвращается в окно приема
+        ///
+        /// \param chunk - кусок данных и его смещение в сообщении
+        /// \return false, если сообщение прочитано целиком или прием прерван
+        bool nextChunk(StreamChunk &chunk);
+
+        /// \brief Прерывание потокового чтения
+        ///
+        /// Будит поток, ожидающий в nextChunk
+        void abort();
+
+        /// \brief Сессия больше не используется соединением
+        ///
+        /// После этого nextChunk вернет false, когда все части будут прочитаны,
+        /// и сессию можно удалять
+        void finish();
+
+        bool isStreaming() const;
+
+        /// \brief Размер сообщения в байтах
+        size_t getSize() const;
+
+        /// \brief Сколько частей отброшено из-за несовпадения контрольной суммы
+        size_t getCorruptedParts() const;
+
         bool dispatched = false;
     private:
         std::mutex mtx;
@@ -257,6 +364,30 @@ namespace STIP {
         size_t packet_counts = 0;
 
         std::vector<bool> receivedParts;
+        Priority priority = Priority::NORMAL;
+
+        std::shared_ptr<ReceiveWindow> window;
+        size_t reservedBytes = 0;
+        size_t corruptedParts = 0;
+
+        /// \brief Копирование части в буфер сборки с проверкой контрольной суммы
+        ///
+        /// \param destination - место части в буфере
+        /// \param packet - пакет с частью
+        /// \param partSize - размер части
+        /// \return false, если контрольная сумма не совпала и часть надо запросить заново
+        bool copyVerified(void *destination, const STIP_PACKET &packet, size_t partSize);
+
+        size_t advertisedWindow();
+
+        // streaming
+        bool streaming = false;
+        bool aborted = false;
+        bool finished = false;
+        std::vector<char *> streamParts;
+        std::vector<size_t> streamPartSizes;
+        size_t contiguousParts = 0;
+        size_t readCursor = 0;
 
         udp::socket *socket = nullptr;
         udp::endpoint endpoint;
@@ -37,54 +37,122 @@ void RabbitClient::init() {
     if (connection) {
         // Create Client object to send
         Client clientInfo = {id, connection};
-        nlohmann::json clientJson;
-        to_json(clientJson, clientInfo);
-        Message message = {
-                MessageType::RegisterClient,
-                clientJson.dump()
-        };
-
-        nlohmann::json messageJson;
-        to_json(messageJson, message);
-        std::string msg = messageJson.dump();
-        connection->sendMessage(msg);
+        connection->sendMessage(packMessage(MessageType::RegisterClient, clientInfo, wireFormat),
+                                STIP::Priority::CONTROL);
     } else {
         std::cerr << "Error: Failed to connect to server." << std::endl;
     }
 }
 
-void RabbitClient::receiveResutls() {
+bool RabbitClient::receiveResults(std::vector<struct TaskResult> &results) {
     for (;;) {
         STIP::ReceiveMessageSession *received = connection->receiveMessage();
-        auto message = json::parse(received->getDataAsString()).template get<struct Message>();
-        auto item = json::parse(message.data);
-        struct TaskResult result;
-
-        try {
-            result = item.template get<struct TaskResult>();
-        } catch (json::exception &e) {
-            std::cerr << "Error parsing task: " << e.what() << std::endl;
-            continue;
+        if (received == nullptr) return false;
+        auto rawMessage = received->getData();
+        Message message;
+        bool parsed = unpackMessage(static_cast<char *>(rawMessage.first), rawMessage.second, message);
+        delete received;
+
+        if (parsed && message.action == MessageType::TaskReject) {
+            struct TaskReject reject;
+            if (unpackPayload(message, reject)) {
+                std::string reason = reject.reason + ", retry after " + std::to_string(reject.retryAfter) + " ms";
+                for (auto &rejectedId: reject.ids) {
+                    results.push_back({std::move(rejectedId), reason, RESULT_REJECTED});
+                }
+                return true;
+            }
+        } else if (parsed && message.action == MessageType::TaskBatchResult) {
+            struct TaskBatchResult batch;
+            if (unpackPayload(message, batch)) {
+                results.insert(results.end(), std::make_move_iterator(batch.results.begin()),
+                               std::make_move_iterator(batch.results.end()));
+                return true;
+            }
+        } else if (parsed) {
+            struct TaskResult result;
+            if (unpackPayload(message, result)) {
+                results.push_back(std::move(result));
+                return true;
+            }
         }
+        std::cerr << "Error parsing task result" << std::endl;
+    }
+}
 
-        json data = json::parse(result.data);
-        std::string pretty = data.dump(2);
-        int count = std::count(pretty.begin(), pretty.end(), '\n');
-
-        if (count > PRETTY_MAX_LINES_THR) {
-            pretty = data.dump();
+void RabbitClient::receiveResutls() {
+    std::vector<struct TaskResult> results;
+    while (receiveResults(results)) {
+        for (const auto &result: results) {
+            printResult(result);
         }
+        results.clear();
+    }
+}
 
-        std::cout << pretty << std::endl;
+void RabbitClient::printResult(const struct TaskResult &result) {
+    if (result.status != RESULT_DONE) {
+        std::cerr << "Task " << result.id << " failed: " << result.data << std::endl;
+        return;
     }
+    json data;
+    try {
+        data = json::parse(result.data);
+    } catch (json::exception &e) {
+        std::cerr << "Error parsing task result: " << e.what() << std::endl;
+        return;
+    }
+    std::string pretty = data.dump(2);
+    int count = std::count(pretty.begin(), pretty.end(), '\n');
+
+    if (count > PRETTY_MAX_LINES_THR) {
+        pretty = data.dump();
+    }
+
+    std::cout << pretty << std::endl;
 }
 
 void RabbitClient::sendTask(struct TaskRequest t) {
-    json task = t;
-    Message m = {
-            MessageType::TaskRequest,
-            task.dump()
-    };
-    json message = m;
-    connection->sendMessage(message.dump());
+    if (t.timeout == 0) {
+        t.timeout = taskTimeout;
+    }
+    if (t.priority == 0) {
+        t.priority = taskPriority;
+    }
+    connection->sendMessage(packMessage(MessageType::TaskRequest, t, wireFormat));
+}
+
+void RabbitClient::sendTasks(const std::vector<struct TaskRequest> &tasks) {
+    struct TaskBatchRequest batch{tasks};
+    applyDefaults(batch.tasks);
+    connection->sendMessage(packMessage(MessageType::TaskBatchRequest, batch, wireFormat));
+}
+
+void RabbitClient::sendGraph(const std::vector<struct TaskRequest> &tasks) {
+    struct TaskGraph graph{tasks};
+    applyDefaults(graph.tasks);
+    connection->sendMessage(packMessage(MessageType::TaskGraph, graph, wireFormat));
+}
+
+void RabbitClient::applyDefaults(std::vector<struct TaskRequest> &tasks) const {
+    for (auto &task: tasks) {
+        if (task.timeout == 0) {
+            task.timeout = taskTimeout;
+        }
+        if (task.priority == 0) {
+            task.priority = taskPriority;
+        }
+    }
+}
+
+void RabbitClient::setWireFormat(WireFormat format) {
+    wireFormat = format;
+}
+
+void RabbitClient::setTaskTimeout(int milliseconds) {
+    taskTimeout = milliseconds;
+}
+
+void RabbitClient::setTaskPriority(int priority) {
+    taskPriority = priority;
 }
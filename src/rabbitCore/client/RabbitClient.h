@@ -5,6 +5,8 @@
 #include "protocol/Connection.h"
 #include <nlohmann/json.hpp>
 #include "DataModel/TaskRequest.h"
+#include "DataModel/TaskResult.h"
+#include "DataModel/Message.h"
 #include "client/STIPClient.h"
 
 using boost::asio::ip::udp;
@@ -18,7 +20,28 @@ public:
 
     void receiveResutls();
 
-    void sendTask(TaskRequest t);
+    // Blocks until the next message and appends every result it carries. Tasks the server
+    // rejected come back with RESULT_REJECTED and the reason as data.
+    // Returns false once the connection is closed
+    bool receiveResults(std::vector<struct TaskResult> &results);
+
+    void sendTask(struct TaskRequest t);
+
+    // all tasks go in one message
+    void sendTasks(const std::vector<struct TaskRequest> &tasks);
+
+    // Tasks that refer to the outputs of others with {"$ref": "id"}, see TaskGraph. Only the
+    // tasks nothing refers to get a result
+    void sendGraph(const std::vector<struct TaskRequest> &tasks);
+
+    // JSON messages are slower, but readable in a packet dump
+    void setWireFormat(WireFormat format);
+
+    // timeout of a task that does not set its own, in ms. 0 - none
+    void setTaskTimeout(int milliseconds);
+
+    // priority of a task that does not set its own, higher goes first
+    void setTaskPriority(int priority);
 
     ~RabbitClient() {
         delete server_socket;
@@ -37,6 +60,15 @@ private:
     udp::endpoint *server_endpoint;
 
     boost::asio::io_context io_context;
+
+    WireFormat wireFormat = WireFormat::Binary;
+    int taskTimeout = 0;
+    int taskPriority = 0;
+
+    static void printResult(const struct TaskResult &result);
+
+    // timeout and priority of the client for tasks without their own
+    void applyDefaults(std::vector<struct TaskRequest> &tasks) const;
 };
 
 #endif //RABBIT_RabbitClient_H
@@ -5,18 +5,72 @@
 #include "RabbitServer.h"
 #include "TaskRequest.h"
 #include "TaskResult.h"
+#include <algorithm>
+#include <unordered_set>
+#include <optional>
 #include <queue>
 #include <iomanip> // For std::put_time
 
 using namespace STIP;
 using boost::asio::ip::udp;
 
-RabbitServer::RabbitServer(int port) {
+RabbitServer::RabbitServer(int port, size_t threads) : executor(threads) {
     this->port = port;
-    taskService = TaskService();
+    createQueues();
 }
 
-void RabbitServer::init() {
+void RabbitServer::init(const TaskLogOptions &storage, std::chrono::milliseconds reportInterval) {
+    // tasks the previous run did not finish are dispatched again once workers connect
+    std::vector<Task> unfinished = taskService.open(storage, reportInterval);
+    // the split is not remembered, a parent is split again and its parts get the same ids
+    std::unordered_set<std::string> parts = dropParts();
+    for (auto &task: unfinished) {
+        if (parts.count(task.id) != 0) {
+            continue;
+        }
+        task.worker_hash_id = "";
+        if (task.cores > TaskQueue::MAX_CORES) {
+            // stored before the bound was checked, no queue takes it
+            task.status = TaskStatus::Failed;
+            taskService.updateTask(task);
+            continue;
+        }
+        task.status = TaskStatus::Queued;
+        taskService.updateTask(task);
+        // the queue does not keep inputs, they are sent from the task service
+        task.input.clear();
+        if (scatter.splittable(task.func) || tiling.tileable(task.func)) {
+            recoveredParents.push_back(std::move(task));
+        } else {
+            queueFor(task).enqueue(task);
+        }
+    }
+    if (queuedTasks() + recoveredParents.size() > 0) {
+        std::cout << "Recovered " << queuedTasks() + recoveredParents.size() << " unfinished tasks, "
+                  << parts.size() << " parts of split tasks dropped" << std::endl;
+    }
+
+    userDBService.startReport(reportInterval);
+    for (size_t i = 0; i < queues.size(); i++) {
+        queues[i]->startReport(reportInterval, i == 0 ? "queue.md" : "queue-" + router.queues()[i] + ".md");
+    }
+    resultCache.startReport(reportInterval);
+    heartbeats.start(workerTimeout, [this](const std::string &id) {
+        workerSilent(id);
+    });
+    taskWatch.start(speculation, [this](const std::string &id, TaskWatch::Action action) {
+        onWatch(id, action);
+    });
+
+    resultBatcher.start(batchWindow, batchBytes, wireFormat,
+                        [this](const std::string &clientId, const char *data, size_t size) {
+                            Client client = userDBService.findClientByID(clientId);
+                            client.connection->sendMessage(const_cast<char *>(data), size);
+                        }, [this](std::function<void()> job) {
+                            // a client that is slow to answer holds an executor thread, not the timer
+                            executor.submit(std::move(job));
+                        });
+
     server_socket = new udp::socket(io_context, udp::endpoint(udp::v4(), port));
     udp::socket::receive_buffer_size bigbufsize(INT_MAX);
     server_socket->set_option(bigbufsize);
@@ -24,18 +78,33 @@ void RabbitServer::init() {
 
 void RabbitServer::startPolling() {
     STIPServer server(*server_socket);
+    stipServer = &server;
     std::cout << "Server started on port " << port << std::endl;
 
-    std::vector<std::thread> threadsProcessors;
+    std::cout << "Executor threads: " << executor.threadCount() << std::endl;
+
     for (;;) {
         Connection *connection = server.acceptConnection();
         if (connection == nullptr) break;
 
         std::cout << "Connection accepted" << std::endl;
-        threadsProcessors.emplace_back(&RabbitServer::processConnection, this, connection);
+        reapConnectionThreads();
+
+        auto finished = std::make_shared<std::atomic<bool>>(false);
+        std::thread thread([this, connection, finished]() {
+            processConnection(connection);
+            *finished = true;
+        });
+        connectionThreads.push_back({std::move(thread), finished});
     }
 
     std::cout << "Server thread finished" << std::endl;
+    heartbeats.close();
+    taskWatch.close();
+    // the batcher posts to the executor, once closed it sends results itself
+    resultBatcher.close();
+    executor.shutdown();
+    taskService.close();
 
     // hard stopping
     server_socket->close();
@@ -45,22 +114,104 @@ void RabbitServer::startPolling() {
     exit(0);
 }
 
-void RabbitServer::processConnection(STIP::Connection *connection) {
-    auto receiveMessage = connection->receiveMessage();
-    json request = json::parse(receiveMessage->getDataAsString());
+void RabbitServer::setStarvationPolicy(const StarvationPolicy &policy) {
+    starvation = policy;
+    for (auto &queue: queues) {
+        queue->setStarvationPolicy(policy);
+    }
+}
 
-#ifdef SERVER_ARCH_DEBUG
-    std::cout << "Received message: " << request.dump() << std::endl;
-#endif
+void RabbitServer::setClientWeight(const std::string &client, int weight) {
+    clientWeights[client] = weight;
+    for (auto &queue: queues) {
+        queue->setClientWeight(client, weight);
+    }
+}
 
-    Message message;
-    json data;
+void RabbitServer::setRouting(const RoutingOptions &options) {
+    router.configure(options);
+    createQueues();
+}
 
-    try {
-        message = request.template get<Message>();
-        data = json::parse(message.data);
-    } catch (json::exception &e) {
-        std::cerr << "Error parsing message: " << e.what() << std::endl;
+void RabbitServer::createQueues() {
+    while (queues.size() < router.queues().size()) {
+        auto queue = std::make_unique<TaskQueue>();
+        queue->setStarvationPolicy(starvation);
+        for (const auto &[client, weight]: clientWeights) {
+            queue->setClientWeight(client, weight);
+        }
+        queues.push_back(std::move(queue));
+    }
+}
+
+void RabbitServer::setWireFormat(WireFormat format) {
+    wireFormat = format;
+}
+
+void RabbitServer::setResultCache(const ResultCacheOptions &options) {
+    resultCache.configure(options);
+}
+
+void RabbitServer::setResultBatching(std::chrono::microseconds window, size_t maxBytes) {
+    batchWindow = window;
+    batchBytes = maxBytes;
+}
+
+void RabbitServer::setWorkerTimeout(std::chrono::milliseconds timeout) {
+    workerTimeout = timeout;
+}
+
+void RabbitServer::setSpeculation(const SpeculationPolicy &policy) {
+    speculation = policy;
+}
+
+void RabbitServer::setAdmission(const AdmissionOptions &options) {
+    admission.configure(options);
+}
+
+void RabbitServer::setTiling(const TilingOptions &options) {
+    tiling.configure(options);
+}
+
+void RabbitServer::setScatter(const ScatterOptions &options) {
+    scatter.configure(options);
+}
+
+void RabbitServer::setWorkerSelection(WorkerSelection selection) {
+    workerSelection = selection;
+}
+
+void RabbitServer::setRetentionPolicy(const RetentionPolicy &policy) {
+    taskService.setRetentionPolicy(policy);
+}
+
+void RabbitServer::reapConnectionThreads() {
+    for (auto it = connectionThreads.begin(); it != connectionThreads.end();) {
+        if (*it->finished) {
+            it->thread.join();
+            it = connectionThreads.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool RabbitServer::unpackReceived(const Received &received, MessageView &view) {
+    auto rawMessage = received->getData();
+    bool parsed = unpackMessage(static_cast<char *>(rawMessage.first), rawMessage.second, view);
+    if (!parsed) {
+        std::cerr << logTime() << "Error parsing message" << std::endl;
+    }
+    return parsed;
+}
+
+void RabbitServer::processConnection(STIP::Connection *connection) {
+    Received receiveMessage(connection->receiveMessage());
+    if (receiveMessage == nullptr) return;
+
+    MessageView message;
+    if (!unpackReceived(receiveMessage, message)) {
+        closeConnection(connection);
         return;
     }
 
@@ -69,16 +220,16 @@ void RabbitServer::processConnection(STIP::Connection *connection) {
             std::cout << logTime() << "Received Client registration request\n";
             Client client;
 
-            try {
-                client = data.template get<Client>();
-                client.connection = connection;
-                std::cout << logTime() << "Client registered: " << client.id << std::endl;
-            } catch (json::exception &e) {
-                std::cerr << logTime() << "Error parsing client: " << e.what() << std::endl;
+            if (!unpackPayload(message, client)) {
+                std::cerr << logTime() << "Error parsing client" << std::endl;
                 break;
             }
+            client.connection = connection;
+            std::cout << logTime() << "Client registered: " << client.id << std::endl;
 
             userDBService.addClient(client);
+            // frees the reassembly buffer and its share of the receive window
+            receiveMessage.reset();
 
             try {
                 processClient(client);
@@ -95,16 +246,18 @@ void RabbitServer::processConnection(STIP::Connection *connection) {
             std::cout << logTime() << "Received Worker registration request\n";
             Worker worker;
 
-            try {
-                worker = data.template get<Worker>();
-                worker.connection = connection;
-                std::cout << logTime() << "Worker registered: " << worker.id << " (Cores: " << worker.cores << ")\n";
-            } catch (json::exception &e) {
-                std::cerr << logTime() << "Error parsing worker: " << e.what() << std::endl;
+            if (!unpackPayload(message, worker)) {
+                std::cerr << logTime() << "Error parsing worker" << std::endl;
                 break;
             }
+            worker.connection = connection;
+            worker.queues = subscribedQueues(worker);
+            std::cout << logTime() << "Worker registered: " << worker.id << " (Cores: " << worker.cores << ")\n";
 
             userDBService.addWorker(worker);
+            heartbeats.touch(worker.id);
+            receiveMessage.reset();
+            splitRecovered();
 
             try {
                 processWorker(worker);
@@ -112,7 +265,10 @@ void RabbitServer::processConnection(STIP::Connection *connection) {
                 std::cerr << "Error processing worker: " << e.what() << std::endl;
             }
 
-            userDBService.removeWorker(worker);
+            {
+                std::lock_guard<std::mutex> lock(connectionsMutex);
+                dropWorker(worker);
+            }
             std::cout << logTime() << "Worker disconnected: " << worker.id << std::endl;
             break;
         }
@@ -122,72 +278,120 @@ void RabbitServer::processConnection(STIP::Connection *connection) {
             break;
     }
 
-    delete connection;
-    delete receiveMessage;
-    delete connection;
+    closeConnection(connection);
 }
 
-void RabbitServer::processWorker(Worker &worker) {
-    checkTaskQueue(worker);
-
-    for (;;) {
-        auto receiveMessage = worker.connection->receiveMessage();
-        json request = json::parse(receiveMessage->getDataAsString()); // TODO change parse
+void RabbitServer::closeConnection(STIP::Connection *connection) {
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    stipServer->closeConnection(connection);
+}
 
-#ifdef SERVER_ARCH_DEBUG
-        std::cout << "Received message: " << request.dump() << std::endl;
-#endif
+bool RabbitServer::dropWorker(const Worker &worker) {
+    if (!userDBService.removeWorker(worker)) {
+        return false;
+    }
+    heartbeats.forget(worker.id);
+    tiling.dropWorker(worker.id);
 
-        Message message;
-        json data;
+    std::vector<Task> requeued = taskService.unassignWorker(worker.id);
+    taskWatch.dropWorker(worker.id);
+    for (const auto &task: requeued) {
+        taskWatch.requeued(task.id);
+    }
+    if (requeued.empty()) {
+        return true;
+    }
+    requeuedTasks += requeued.size();
+    std::cout << logTime() << requeued.size() << " unfinished tasks of worker " << worker.id
+              << " queued again (requeued in total: " << requeuedTasks << ")" << std::endl;
+    enqueueTasks(requeued);
+    executor.submit([this]() {
+        retryPendingTasks();
+    });
+    return true;
+}
 
-        try {
-            message = request.template get<Message>();
-            data = json::parse(message.data);
-        } catch (json::exception &e) {
-            std::cerr << "Error parsing message: " << e.what() << std::endl;
-            continue;
+std::unordered_set<std::string> RabbitServer::dropParts() {
+    std::vector<Task> headers = taskService.headers();
+    std::unordered_map<std::string, std::string> funcs;
+    for (const auto &header: headers) {
+        funcs.emplace(header.id, header.func);
+    }
+    std::unordered_set<std::string> parts;
+    for (const auto &header: headers) {
+        size_t hash = header.id.rfind('#');
+        if (hash == std::string::npos) continue;
+        auto parent = funcs.find(header.id.substr(0, hash));
+        // parts run the function of their parent, tiles their own
+        if (parent != funcs.end() && (header.func == parent->second || header.func == Tiling::FUNCTION)) {
+            taskService.removeTask(header.id);
+            parts.insert(header.id);
         }
+    }
+    return parts;
+}
 
-        switch (message.action) {
-            case MessageType::TaskResult: {
-                std::cout << logTime() << "Received TaskResult from worker: " << worker.id << std::endl;
-                struct TaskResult result;
-                try {
-                    result = data.template get<struct TaskResult>();
-                } catch (json::exception &e) {
-                    std::cerr << logTime() << "Error parsing task: " << e.what() << std::endl;
-                    continue;
-                }
+void RabbitServer::splitRecovered() {
+    std::vector<Task> tasks;
+    {
+        std::lock_guard<std::mutex> lock(recoveredMutex);
+        tasks.swap(recoveredParents);
+    }
+    if (tasks.empty()) {
+        return;
+    }
+    executor.submit([this, tasks = std::move(tasks)]() mutable {
+        processTaskBatch(tasks);
+    });
+}
 
-                Task task = taskService.findTaskByID(result.id);
+void RabbitServer::workerSilent(const std::string &id) {
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    Worker worker;
+    try {
+        worker = userDBService.findWorkerByID(id);
+    } catch (std::exception &e) {
+        return;
+    }
+    std::cerr << logTime() << "Worker " << id << " is not responding, dropped" << std::endl;
+    dropWorker(worker);
+    // a result that is still on its way is lost with the connection, the task runs again elsewhere
+    worker.connection->stopProcessing();
+}
 
-#ifdef SERVER_ARCH_DEBUG
-                std::cout << json(task).dump() << std::endl;
-#endif
+void RabbitServer::processWorker(Worker &worker) {
+    checkTaskQueue(worker);
 
-                task.status = TaskStatus::Ready;
-                std::cout << logTime() << "Task marked as Ready: " << result.id << std::endl;
-                task.output = result.data;
+    for (;;) {
+        Received receiveMessage(worker.connection->receiveMessage());
+        if (receiveMessage == nullptr) break;
+        heartbeats.touch(worker.id);
 
-                taskService.updateTask(task);
-                userDBService.modifyWorkerUsedCores(task.worker_hash_id, task.cores, false);
+        MessageView message;
+        if (!unpackReceived(receiveMessage, message)) continue;
 
-                Client client = userDBService.findClientByID(task.client_hash_id);
-                Message result_message = {
-                        MessageType::TaskResult,
-                        message.data
-                };
+        switch (message.action) {
+            case MessageType::Heartbeat:
+                break;
 
-                try {
-                    client.connection->sendMessage(json(result_message).dump());
-                } catch (json::exception &e) {
-                    std::cerr << logTime() << "Error sending task result to client: " << e.what() << std::endl;
-                    continue;
-                }
+            case MessageType::TaskResult:
+            case MessageType::TaskBatchResult: {
+                std::cout << logTime() << "Received TaskResult from worker: " << worker.id << std::endl;
+                executor.submit([this, worker, receiveMessage, message = std::move(message)]() {
+                    processTaskResult(worker, receiveMessage, message);
+                });
+                break;
+            }
 
-                std::cout << logTime() << "Sent TaskResult to client: " << client.id << std::endl;
-                checkTaskQueue(worker);
+            case MessageType::TaskReturn: {
+                struct TaskReturn taskReturn;
+                if (!unpackPayload(message, taskReturn)) {
+                    std::cerr << logTime() << "Error parsing returned tasks" << std::endl;
+                    break;
+                }
+                executor.submit([this, worker, taskReturn = std::move(taskReturn)]() {
+                    processTaskReturn(worker, taskReturn.ids);
+                });
                 break;
             }
 
@@ -198,163 +402,1083 @@ void RabbitServer::processWorker(Worker &worker) {
     }
 }
 
-void RabbitServer::processClient(Client &client) {
-    std::vector<std::thread> threads;
+void RabbitServer::processTaskResult(const Worker &worker, const Received &received, const MessageView &view) {
+    std::vector<TaskResultHeader> results;
+    if (!unpackHeaders(view, results)) {
+        std::cerr << logTime() << "Error parsing task result" << std::endl;
+        return;
+    }
 
-    for (;;) {
-        auto receiveMessage = client.connection->receiveMessage();
+    // a single result may reach the client byte for byte, straight from the receive buffer
+    auto rawMessage = received->getData();
+    const char *raw = view.action == MessageType::TaskResult ? static_cast<char *>(rawMessage.first) : nullptr;
+
+    int releasedCores = 0;
+    int finished = 0;
+    for (const auto &result: results) {
+        Task task;
+        bool accepted;
+        try {
+            // the output is copied once, into the task service
+            accepted = taskService.finishTask(result.id,
+                                              result.status == RESULT_DONE ? TaskStatus::Ready : TaskStatus::Failed,
+                                              std::string(result.data, result.dataSize), task, worker.id);
+        } catch (std::exception &e) {
+            std::cerr << logTime() << "Error finishing task " << result.id << ": " << e.what() << std::endl;
+            continue;
+        }
 
 #ifdef SERVER_ARCH_DEBUG
-        std::cout << "Received message: " << receiveMessage->getDataAsString() << std::endl;
+        std::cout << json(task).dump() << std::endl;
 #endif
 
-        std::cout << "start converting" << std::endl;
-        auto rawMessage = receiveMessage->getData();
-        char *payload = static_cast<char *>(rawMessage.first);
+        TaskWatch::Copies copies;
+        if (accepted) {
+            taskWatch.finish(result.id, worker.id, copies);
+        }
+        // cores of a task taken back from this worker were released when it was taken,
+        // cores of a cancelled copy when it was cancelled
+        if (task.worker_hash_id == worker.id || copies.backup == worker.id) {
+            releasedCores += task.cores;
+            finished++;
+        }
+        if (!accepted) {
+            // only the first result of a task reaches the client
+            duplicateResults++;
+            std::cerr << logTime() << "Dropped a second result of task " << result.id << " from worker "
+                      << worker.id << std::endl;
+            continue;
+        }
+        cancelCopies(task, worker.id, copies);
+        if (gatherPart(task, result) || flowResult(task, result.status, result.data, result.dataSize)) {
+            continue;
+        }
+        resultBatcher.add(task.client_hash_id, received, result, raw, rawMessage.second);
+        admission.release(task.client_hash_id);
+        completeFlight(task, received, result);
+    }
+    std::cout << logTime() << results.size() << " tasks marked as Ready" << std::endl;
 
-        std::cout << "start parsing" << std::endl;
-        json request = json::parse(payload, payload + rawMessage.second);
+    try {
+        userDBService.releaseCores(worker.id, releasedCores, finished);
+    } catch (std::exception &e) {
+        // the worker was dropped, its tasks are queued again
+        std::cerr << logTime() << "Late results from worker " << worker.id << ": " << e.what() << std::endl;
+        return;
+    }
 
-        Message message;
-        json data;
+    Worker current = worker;
+    checkTaskQueue(current);
+}
 
-        try {
-            std::cout << "Loaded to request" << std::endl;
-            message = request.template get<Message>();
-            data = json::parse(message.data);
-            std::cout << "Loaded to data1" << std::endl;
-        } catch (json::exception &e) {
-            std::cerr << "Error parsing message: " << e.what() << std::endl;
-            continue;
-        }
+void RabbitServer::processClient(Client &client) {
+    for (;;) {
+        Received receiveMessage(client.connection->receiveMessage());
+        if (receiveMessage == nullptr) break;
+
+        MessageView message;
+        if (!unpackReceived(receiveMessage, message)) continue;
 
         switch (message.action) {
             case MessageType::TaskRequest: {
                 std::cout << logTime() << "Received TaskRequest from client: " << client.id << std::endl;
-                struct TaskRequest tRequest;
+                TaskRequestHeader tRequest;
 
-                try {
-                    std::cout << "Loaded to data2" << std::endl;
-                    tRequest = data.template get<struct TaskRequest>();
-                    std::cout << "Loaded to taskRequest" << std::endl;
-                    std::cout << logTime() << "Task " << tRequest.id << " added (Cores: " << tRequest.cores << ")";
-                    std::cout << std::endl;
-                } catch (json::exception &e) {
-                    std::cerr << logTime() << "Error parsing task: " << e.what() << std::endl;
+                if (!unpackHeader(message, tRequest)) {
+                    std::cerr << logTime() << "Error parsing task" << std::endl;
+                    break;
+                }
+                if (const char *problem = checkCores(tRequest.cores)) {
+                    rejectTasks(client, {tRequest.id}, {false, -1, problem});
+                    break;
+                }
+                // nothing is created for a task over the client's limits
+                Admission::Decision admitted = admission.admit(client.id, 1);
+                if (!admitted.admitted) {
+                    rejectTasks(client, {tRequest.id}, admitted);
                     break;
                 }
+                std::cout << logTime() << "Task " << tRequest.id << " added (Cores: " << tRequest.cores << ")";
+                std::cout << std::endl;
 
+                // the input is copied once, into the task service. The task passed on for
+                // dispatch carries only the routing fields
                 Task task = {
                         tRequest.id,
                         tRequest.func,
-                        tRequest.data,
+                        "",
                         "",
                         tRequest.cores,
                         TaskStatus::Queued,
                         "",
                         client.id
                 };
+                task.priority = tRequest.priority;
+                Task stored = task;
+                stored.input.assign(tRequest.data, tRequest.dataSize);
 
+                // a message without an id can not go to the worker as is, it gets the generated one
+                Received relay = tRequest.id.empty() ? nullptr : receiveMessage;
+
+                bool added = false;
                 try {
-                    taskService.addTask(task);
-                    threads.emplace_back([this, task]() mutable {
-                        this->processTask(task);
+                    std::optional<ResultCache::Key> cacheKey;
+                    if (answerFromCache(client.id, stored, cacheKey)) {
+                        break;
+                    }
+                    task.id = taskService.addTask(std::move(stored));
+                    added = true;
+                    // identical tasks that wait for a leader follow its limits
+                    watchTask(task.id, task.func, tRequest.deadline, tRequest.timeout);
+                    if (cacheKey && !singleflight.join(*cacheKey, task.id, client.id)) {
+                        coalescedTasks++;
+                        std::cout << logTime() << "Task " << task.id << " waits for an identical task" << std::endl;
+                        break;
+                    }
+                    executor.submit([this, task = std::move(task), relay]() mutable {
+                        this->processTask(task, relay);
                     });
                 } catch (std::exception &e) {
                     std::cerr << logTime() << "Error processing task: " << e.what() << std::endl;
+                    if (!added) {
+                        admission.release(client.id);
+                    }
                 }
                 break;
             }
 
+            case MessageType::TaskBatchRequest: {
+                std::vector<TaskRequestHeader> requests;
+                if (!unpackHeaders(message, requests)) {
+                    std::cerr << logTime() << "Error parsing task batch" << std::endl;
+                    break;
+                }
+                std::cout << logTime() << "Received " << requests.size() << " tasks from client: " << client.id
+                          << std::endl;
+
+                // the batch is taken or refused as a whole
+                Admission::Decision admitted = {true, 0, ""};
+                for (const auto &request: requests) {
+                    if (const char *problem = checkCores(request.cores)) {
+                        admitted = {false, -1, problem};
+                        break;
+                    }
+                }
+                if (admitted.admitted) {
+                    admitted = admission.admit(client.id, requests.size());
+                }
+                if (!admitted.admitted) {
+                    std::vector<std::string> ids;
+                    ids.reserve(requests.size());
+                    for (const auto &request: requests) {
+                        ids.push_back(request.id);
+                    }
+                    rejectTasks(client, ids, admitted);
+                    break;
+                }
+
+                // admitted tasks not answered from the cache, released if the batch is refused
+                size_t unanswered = 0;
+                std::vector<Task> stored;
+                std::vector<std::optional<ResultCache::Key>> cacheKeys;
+                std::vector<const TaskRequestHeader *> limits;
+                stored.reserve(requests.size());
+                try {
+                    for (const auto &request: requests) {
+                        Task task = {request.id, request.func, std::string(request.data, request.dataSize), "",
+                                     request.cores, TaskStatus::Queued, "", client.id, request.priority};
+                        std::optional<ResultCache::Key> cacheKey;
+                        if (!answerFromCache(client.id, task, cacheKey)) {
+                            stored.push_back(std::move(task));
+                            cacheKeys.push_back(cacheKey);
+                            limits.push_back(&request);
+                        }
+                    }
+                    if (stored.empty()) {
+                        break;
+                    }
+
+                    std::vector<Task> tasks;
+                    tasks.reserve(stored.size());
+                    for (const auto &task: stored) {
+                        tasks.push_back({"", task.func, "", "", task.cores, TaskStatus::Queued, "", client.id,
+                                         task.priority});
+                    }
+                    unanswered = stored.size();
+                    std::vector<std::string> ids = taskService.addTasks(std::move(stored));
+                    unanswered = 0;
+                    size_t leaders = 0;
+                    for (size_t i = 0; i < ids.size(); i++) {
+                        watchTask(ids[i], tasks[i].func, limits[i]->deadline, limits[i]->timeout);
+                        // tasks identical to one in flight only wait for its result
+                        if (cacheKeys[i] && !singleflight.join(*cacheKeys[i], ids[i], client.id)) {
+                            coalescedTasks++;
+                            continue;
+                        }
+                        if (leaders != i) {
+                            tasks[leaders] = std::move(tasks[i]);
+                        }
+                        tasks[leaders++].id = std::move(ids[i]);
+                    }
+                    tasks.resize(leaders);
+                    if (tasks.empty()) {
+                        break;
+                    }
+                    executor.submit([this, tasks = std::move(tasks)]() mutable {
+                        this->processTaskBatch(tasks);
+                    });
+                } catch (std::exception &e) {
+                    std::cerr << logTime() << "Error processing task batch: " << e.what() << std::endl;
+                    admission.release(client.id, unanswered);
+                }
+                break;
+            }
+
+            case MessageType::TaskGraph: {
+                std::vector<TaskRequestHeader> requests;
+                if (!unpackHeaders(message, requests)) {
+                    std::cerr << logTime() << "Error parsing task graph" << std::endl;
+                    break;
+                }
+                std::cout << logTime() << "Received a graph of " << requests.size() << " tasks from client: "
+                          << client.id << std::endl;
+                processGraph(client, requests);
+                break;
+            }
+
             default:
                 std::cerr << logTime() << "Unknown action: " << message.action << std::endl;
                 break;
         }
     }
-    for (auto &thread: threads) {
-        if (thread.joinable()) thread.join();
+}
+
+void RabbitServer::processGraph(const Client &client, const std::vector<TaskRequestHeader> &requests) {
+    std::vector<std::string> ids;
+    ids.reserve(requests.size());
+    for (const auto &request: requests) {
+        ids.push_back(request.id);
+    }
+    for (const auto &request: requests) {
+        if (const char *problem = checkCores(request.cores)) {
+            rejectTasks(client, ids, {false, -1, problem});
+            return;
+        }
+    }
+    Admission::Decision admitted = admission.admit(client.id, requests.size());
+    if (!admitted.admitted) {
+        rejectTasks(client, ids, admitted);
+        return;
+    }
+
+    std::vector<Dataflow::Node> nodes;
+    nodes.reserve(requests.size());
+    for (const auto &request: requests) {
+        nodes.push_back({request.id, std::string(request.data, request.dataSize)});
+    }
+    std::vector<std::string> ready;
+    std::string error = dataflow.add(nodes, ready);
+    std::unordered_set<std::string> released(ready.begin(), ready.end());
+    if (error.empty()) {
+        // tasks that wait for others are stored as Created, the dataflow queues them
+        std::vector<Task> stored;
+        stored.reserve(nodes.size());
+        for (size_t i = 0; i < requests.size(); i++) {
+            stored.push_back({requests[i].id, requests[i].func, std::move(nodes[i].input), "", requests[i].cores,
+                              released.count(requests[i].id) != 0 ? TaskStatus::Queued : TaskStatus::Created, "",
+                              client.id, requests[i].priority});
+        }
+        try {
+            taskService.addTasks(std::move(stored));
+        } catch (std::exception &e) {
+            dataflow.forget(nodes);
+            error = e.what();
+        }
+    }
+    if (!error.empty()) {
+        std::cerr << logTime() << "Graph rejected: " << error << std::endl;
+        admission.release(client.id, requests.size());
+        rejectTasks(client, ids, {false, -1, error.c_str()});
+        return;
+    }
+
+    std::vector<Task> tasks;
+    tasks.reserve(ready.size());
+    for (const auto &request: requests) {
+        watchTask(request.id, request.func, request.deadline, request.timeout);
+    }
+    for (const auto &request: requests) {
+        if (released.count(request.id) != 0) {
+            tasks.push_back({request.id, request.func, "", "", request.cores, TaskStatus::Queued, "", client.id,
+                             request.priority});
+        }
+    }
+    executor.submit([this, tasks = std::move(tasks)]() mutable {
+        this->processTaskBatch(tasks);
+    });
+}
+
+bool RabbitServer::flowResult(const Task &task, int status, const char *data, size_t size) {
+    Dataflow::Completion completion = dataflow.complete(task.id, status == RESULT_DONE, data, size);
+    if (!completion.tracked) {
+        return false;
+    }
+    releaseTasks(completion.released);
+
+    std::string reason = "task " + task.id + " it depends on failed";
+    for (const auto &id: completion.blocked) {
+        Task blocked;
+        try {
+            if (!taskService.finishTask(id, TaskStatus::Failed, reason, blocked)) {
+                continue;
+            }
+        } catch (std::exception &e) {
+            continue;
+        }
+        TaskWatch::Copies copies;
+        taskWatch.finish(id, "", copies);
+        // its own dependents fail the same way, a sink reaches the client
+        answerClient(blocked, RESULT_FAILED, reason);
+    }
+
+    if (completion.sink) {
+        return false;
     }
+    // only its dependents needed the output
+    admission.release(task.client_hash_id);
+    return true;
+}
+
+void RabbitServer::releaseTasks(const std::vector<std::string> &ids) {
+    if (ids.empty()) {
+        return;
+    }
+    std::vector<Task> tasks;
+    tasks.reserve(ids.size());
+    for (const auto &id: ids) {
+        try {
+            Task stored = taskService.findTaskByID(id);
+            if (stored.status != TaskStatus::Created) {
+                // failed by its deadline meanwhile
+                continue;
+            }
+            stored.input = dataflow.wire(id, stored.input);
+            stored.status = TaskStatus::Queued;
+            taskService.updateTask(stored);
+            tasks.push_back({id, stored.func, "", "", stored.cores, TaskStatus::Queued, "", stored.client_hash_id,
+                             stored.priority});
+        } catch (std::exception &e) {
+            std::cerr << logTime() << "Error releasing task " << id << ": " << e.what() << std::endl;
+        }
+    }
+    std::cout << logTime() << tasks.size() << " tasks got their inputs" << std::endl;
+    processTaskBatch(tasks);
 }
 
 void RabbitServer::checkTaskQueue(Worker &worker) {
+#ifdef SERVER_ARCH_DEBUG
     userDBService.printLog();
-    std::cout << logTime() << "Checking task queue for worker " << worker.id << std::endl;
-    std::cout << logTime() << "Worker " << worker.id << " has " << worker.cores - worker.usedCores
-              << " free cores " << "(cores: " << worker.cores << ", used: " << worker.usedCores << ")\n";
+#endif
+    // everything the worker can take now goes out in one message
+    std::vector<std::string> ids;
+    std::vector<TaskQueue *> subscribed;
+    // the biggest worker of each queue, a task bigger than that never holds cores back
+    std::vector<int> maxCores;
+    for (const auto &name: worker.queues) {
+        int index = router.queueIndex(name);
+        if (index == -1) continue;
+        subscribed.push_back(queues[index].get());
+        maxCores.push_back(userDBService.maxCores(name));
+    }
+    bool tiles = subscribes(worker, Tiling::FUNCTION);
+    // the queues of the worker take turns, the one after the last dequeued goes first
+    size_t next = 0;
+    for (;;) {
+        // the worker copy of the caller may be stale, cores were released after it was taken
+        try {
+            worker = userDBService.findWorkerByID(worker.id);
+        } catch (std::exception &e) {
+            return;
+        }
+        int freeCores = worker.cores - worker.usedCores;
+        std::cout << logTime() << "Worker " << worker.id << " has " << freeCores
+                  << " free cores " << "(cores: " << worker.cores << ", used: " << worker.usedCores << ")\n";
+
+        // cores are taken while the task is still in the queue, so a concurrent dispatcher
+        // cannot take them for something else in between
+        // tiles go to the worker that holds their panels, ahead of the queue
+        std::string tile;
+        if (tiles && tiling.take(worker.id, freeCores, [this, &worker](int cores) {
+            return userDBService.reserveCores(worker.id, cores);
+        }, tile)) {
+            ids.push_back(std::move(tile));
+            continue;
+        }
 
-    Task pendingTask;
-    if (pendingTasks.tryDequeue(pendingTask, worker.cores - worker.usedCores)) {
+        Task pendingTask;
+        bool dequeued = false;
+        for (size_t i = 0; i < subscribed.size() && !dequeued; i++) {
+            size_t at = (next + i) % subscribed.size();
+            dequeued = subscribed[at]->tryDequeue(pendingTask, freeCores, [this, &worker](const Task &task) {
+                return userDBService.reserveCores(worker.id, task.cores);
+            }, maxCores[at]);
+            next = at + 1;
+        }
+        for (size_t i = 0; i < subscribed.size() && !dequeued && worker.prefetched < worker.prefetch; i++) {
+            size_t at = (next + i) % subscribed.size();
+            // the cores are busy, the task waits in the local queue of the worker instead of here
+            dequeued = subscribed[at]->tryDequeue(pendingTask, worker.cores, [this, &worker](const Task &task) {
+                return userDBService.reserveCores(worker.id, task.cores, true);
+            }, maxCores[at]);
+            next = at + 1;
+        }
+        if (!dequeued) {
+            break;
+        }
         std::cout << logTime() << "Assigning pending task " << pendingTask.id << " to worker "
                   << worker.id << "\n";
+        ids.push_back(std::move(pendingTask.id));
+    }
+    if (ids.empty()) {
+        if (worker.cores > worker.usedCores) {
+            stealFor(worker);
+        }
+        return;
+    }
+
+    assignTasks(worker, ids);
+    if (ids.empty()) {
+        return;
+    }
+    sendTasks(worker, ids);
+    std::cout << logTime() << ids.size() << " tasks sent to worker " << worker.id << std::endl;
+}
+
+void RabbitServer::assignTasks(const Worker &worker, std::vector<std::string> &ids) {
+    std::vector<Task> answered = taskService.assignTasks(ids, worker.id);
+    if (answered.empty()) {
+        return;
+    }
+    int cores = 0;
+    for (const auto &task: answered) {
+        cores += task.cores;
+    }
+    userDBService.releaseCores(worker.id, cores, static_cast<int>(answered.size()));
+}
 
-        struct TaskRequest taskRequest = {
-                pendingTask.id,
-                pendingTask.func,
-                pendingTask.input,
-                pendingTask.cores
-        };
+void RabbitServer::sendTasks(const Worker &worker, const std::vector<std::string> &ids) {
+    for (const auto &id: ids) {
+        taskWatch.started(id, worker.id);
+        scatter.started(id);
+    }
+    sendRequests(worker, ids);
+}
 
-        Message message = {
-                MessageType::TaskRequest,
-                json(taskRequest).dump()
-        };
+void RabbitServer::sendRequests(const Worker &worker, const std::vector<std::string> &ids) {
+    std::vector<std::string> plain;
+    struct TaskBatchRequest tiles;
+    std::shared_ptr<std::mutex> tileLock;
+    std::unique_lock<std::mutex> sending;
+    for (const auto &id: ids) {
+        struct TaskRequest tile;
+        if (tiling.isTile(id)) {
+            if (!tileLock) {
+                tileLock = tiling.sendLock(worker.id);
+                sending = std::unique_lock<std::mutex>(*tileLock);
+            }
+            if (tiling.request(id, worker.id, tile)) {
+                tiles.tasks.push_back(std::move(tile));
+                continue;
+            }
+        }
+        plain.push_back(id);
+    }
+    if (tiles.tasks.size() == 1) {
+        worker.connection->sendMessage(packMessage(MessageType::TaskRequest, tiles.tasks[0], wireFormat));
+    } else if (!tiles.tasks.empty()) {
+        worker.connection->sendMessage(packMessage(MessageType::TaskBatchRequest, tiles, wireFormat));
+    }
+    if (sending.owns_lock()) {
+        sending.unlock();
+    }
 
-        // update worker
-        userDBService.modifyWorkerUsedCores(worker.id, pendingTask.cores, true);
+    if (plain.size() == 1) {
+        worker.connection->sendMessage(taskService.packTaskRequest(plain[0], wireFormat));
+    } else if (!plain.empty()) {
+        worker.connection->sendMessage(taskService.packTaskBatch(plain, wireFormat));
+    }
+}
 
-        pendingTask.worker_hash_id = worker.id;
-        pendingTask.status = TaskStatus::SentToWorker;
-        taskService.updateTask(pendingTask);
+void RabbitServer::processTaskBatch(std::vector<Task> &tasks) {
+    // tasks split into parts leave the batch, their parts are dispatched already
+    tasks.erase(std::remove_if(tasks.begin(), tasks.end(), [this](const Task &task) {
+        return scatterTask(task) || tileTask(task);
+    }), tasks.end());
+    dispatchTasks(tasks);
+}
 
+void RabbitServer::dispatchTasks(std::vector<Task> &tasks) {
+    std::vector<std::pair<Worker, std::vector<std::string>>> assigned;
+    size_t dispatched = 0;
+    for (; dispatched < tasks.size(); dispatched++) {
+        Task &task = tasks[dispatched];
+        Worker worker = reserveWorker(task);
+        if (worker.id.empty()) {
+            break;
+        }
+        auto it = std::find_if(assigned.begin(), assigned.end(), [&worker](const auto &entry) {
+            return entry.first.id == worker.id;
+        });
+        if (it == assigned.end()) {
+            it = assigned.insert(assigned.end(), {worker, {}});
+        }
+        it->second.push_back(task.id);
+    }
+
+    for (auto &entry: assigned) {
+        assignTasks(entry.first, entry.second);
+        if (entry.second.empty()) {
+            continue;
+        }
+        sendTasks(entry.first, entry.second);
+        std::cout << logTime() << entry.second.size() << " tasks sent to worker " << entry.first.id << std::endl;
+    }
+
+    if (dispatched == tasks.size()) {
+        return;
+    }
+    std::vector<Task> rest(std::make_move_iterator(tasks.begin() + dispatched),
+                           std::make_move_iterator(tasks.end()));
+    enqueueTasks(rest);
+    std::cout << logTime() << rest.size() << " tasks added to queue.\n";
+    retryPendingTasks();
+}
+
+bool RabbitServer::answerFromCache(const std::string &clientId, const Task &stored,
+                                   std::optional<ResultCache::Key> &key) {
+    if (!resultCache.cacheable(stored.func)) {
+        return false;
+    }
+    key = ResultCache::keyOf(stored.func, stored.input.data(), stored.input.size());
+    std::string output;
+    if (!resultCache.lookup(*key, stored.input.size(), output)) {
+        return false;
+    }
+
+    // the task is still recorded, finished at once
+    auto owner = std::make_shared<std::string>(output);
+    std::string id = taskService.addTask(stored);
+    Task task;
+    taskService.finishTask(id, TaskStatus::Ready, std::move(output), task);
+    resultBatcher.add(clientId, owner, {id, RESULT_DONE, owner->data(), owner->size()});
+    admission.release(clientId);
+    std::cout << logTime() << "Task " << id << " answered from the cache" << std::endl;
+    return true;
+}
+
+void RabbitServer::completeFlight(const Task &task, const std::shared_ptr<void> &owner,
+                                  const TaskResultHeader &result) {
+    Singleflight::Flight flight;
+    if (!singleflight.complete(task.id, flight)) {
+        return;
+    }
+    std::string output(result.data, result.dataSize);
+    // a task the broker gave up on fails for every waiter too, but is not remembered
+    bool done = result.status == RESULT_DONE;
+    if (done) {
+        resultCache.insert(flight.key, task.func, output);
+    }
+
+    for (const auto &waiter: flight.waiters) {
+        Task finished;
         try {
-            json message_json = message;
-            std::string strToSend = json(message_json).dump();
-            worker.connection->sendMessage(strToSend);
-        } catch (json::exception &e) {
-            std::cerr << logTime() << "[checkTaskQueue] Error sending task to worker: " << e.what() << std::endl;
+            if (!taskService.finishTask(waiter.id, done ? TaskStatus::Ready : TaskStatus::Failed, output,
+                                        finished)) {
+                continue;
+            }
+        } catch (std::exception &e) {
+            std::cerr << logTime() << "Error finishing task " << waiter.id << ": " << e.what() << std::endl;
+            continue;
+        }
+        // the data stays in the leader's message, only the id differs
+        resultBatcher.add(waiter.clientId, owner, {waiter.id, result.status, result.data, result.dataSize});
+        admission.release(waiter.clientId);
+    }
+    if (!flight.waiters.empty()) {
+        std::cout << logTime() << "Result of task " << task.id << " sent for " << flight.waiters.size()
+                  << " identical tasks (coalesced in total: " << coalescedTasks << ")" << std::endl;
+    }
+}
+
+void RabbitServer::watchTask(const std::string &id, const std::string &func, int64_t deadline, int timeout) {
+    auto steadyDeadline = TaskWatch::Clock::time_point::max();
+    if (deadline != 0) {
+        // the client's clock is in unix time, the watch runs on the monotonic one
+        auto left = std::chrono::milliseconds(deadline) -
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::system_clock::now().time_since_epoch());
+        steadyDeadline = TaskWatch::Clock::now() + left;
+    }
+    std::chrono::milliseconds attempt(timeout);
+    if (taskWatch.needed(steadyDeadline, attempt)) {
+        taskWatch.watch(id, func, steadyDeadline, attempt);
+    }
+}
+
+void RabbitServer::onWatch(const std::string &id, TaskWatch::Action action) {
+    executor.submit([this, id, action]() {
+        try {
+            switch (action) {
+                case TaskWatch::Action::Backup:
+                    launchBackup(id);
+                    break;
+                case TaskWatch::Action::Expire:
+                    expireTask(id, RESULT_DEADLINE_EXCEEDED, "deadline exceeded");
+                    break;
+                case TaskWatch::Action::TimeOut:
+                    expireTask(id, RESULT_TIMED_OUT, "timed out");
+                    break;
+            }
+        } catch (std::exception &e) {
+            std::cerr << logTime() << "Error watching task " << id << ": " << e.what() << std::endl;
+        }
+    });
+}
+
+void RabbitServer::launchBackup(const std::string &id) {
+    // the input is sent from the task service, the copy is not needed
+    Task task;
+    if (!taskService.findTaskHeader(id, task) || task.status != TaskStatus::SentToWorker) {
+        return;
+    }
+    Worker backup;
+    for (int queue: router.route(task.func)) {
+        backup = userDBService.reserveSpareCores(task.cores, task.worker_hash_id, router.queues()[queue]);
+        if (!backup.id.empty()) break;
+    }
+    if (backup.id.empty()) {
+        return;
+    }
+    if (!taskWatch.addBackup(id, backup.id)) {
+        userDBService.releaseCores(backup.id, task.cores, 0);
+        return;
+    }
+    speculativeTasks++;
+    std::cout << logTime() << "Task " << id << " is slow on worker " << task.worker_hash_id
+              << ", backup copy sent to worker " << backup.id << " (backups in total: " << speculativeTasks
+              << ")" << std::endl;
+    sendRequests(backup, {id});
+}
+
+void RabbitServer::expireTask(const std::string &id, int status, const std::string &reason) {
+    Task task;
+    if (!taskService.finishTask(id, TaskStatus::Failed, reason, task)) {
+        return;
+    }
+    TaskWatch::Copies copies;
+    taskWatch.finish(id, "", copies);
+    cancelCopies(task, "", copies);
+    failParts(scatter.abandon(id));
+    failTiles(tiling.abandon(id));
+    std::cerr << logTime() << "Task " << id << " failed: " << reason << std::endl;
+    answerClient(task, status, reason);
+}
+
+void RabbitServer::answerClient(const Task &task, int status, std::string output) {
+    if (flowResult(task, status, output.data(), output.size())) {
+        return;
+    }
+    auto owner = std::make_shared<std::string>(std::move(output));
+    TaskResultHeader result = {task.id, status, owner->data(), owner->size()};
+    resultBatcher.add(task.client_hash_id, owner, result);
+    admission.release(task.client_hash_id);
+    completeFlight(task, owner, result);
+}
+
+bool RabbitServer::scatterTask(const Task &task) {
+    if (!scatter.splittable(task.func)) {
+        return false;
+    }
+    Task stored = taskService.findTaskByID(task.id);
+    std::vector<Scatter::Part> parts = scatter.split(task.func, stored.input, userDBService.workerCount());
+    if (parts.empty()) {
+        return false;
+    }
+    stored.input.clear();
+
+    std::vector<std::string> ids;
+    std::vector<Task> partTasks;
+    ids.reserve(parts.size());
+    partTasks.reserve(parts.size());
+    for (size_t i = 0; i < parts.size(); i++) {
+        ids.push_back(Scatter::partID(task.id, i));
+    }
+    scatter.track(task.id, task.func, ids, parts);
+    for (size_t i = 0; i < parts.size(); i++) {
+        partTasks.push_back({ids[i], task.func, std::move(parts[i].input), "", task.cores, TaskStatus::Queued, "",
+                             task.client_hash_id, task.priority});
+    }
+    try {
+        taskService.addTasks(std::move(partTasks));
+    } catch (std::exception &e) {
+        // an id of a part is taken, the task runs whole
+        std::cerr << logTime() << "Task " << task.id << " not split: " << e.what() << std::endl;
+        for (const auto &id: scatter.abandon(task.id)) {
+            scatter.settled(id);
+        }
+        return false;
+    }
+
+    scatteredTasks++;
+    std::cout << logTime() << "Task " << task.id << " split into " << ids.size() << " parts (split in total: "
+              << scatteredTasks << ")" << std::endl;
+    std::vector<Task> headers;
+    headers.reserve(ids.size());
+    for (auto &id: ids) {
+        headers.push_back({std::move(id), task.func, "", "", task.cores, TaskStatus::Queued, "", task.client_hash_id,
+                           task.priority});
+    }
+    dispatchTasks(headers);
+    return true;
+}
+
+bool RabbitServer::tileTask(const Task &task) {
+    if (!tiling.tileable(task.func)) {
+        return false;
+    }
+    Task stored = taskService.findTaskByID(task.id);
+    std::vector<Tiling::Tile> tiles = tiling.split(task.id, stored.input, task.cores);
+    if (tiles.empty()) {
+        return false;
+    }
+    stored.input.clear();
+
+    std::vector<Task> tileTasks;
+    tileTasks.reserve(tiles.size());
+    for (auto &tile: tiles) {
+        tileTasks.push_back({std::move(tile.id), Tiling::FUNCTION, std::move(tile.input), "", task.cores,
+                             TaskStatus::Queued, "", task.client_hash_id, task.priority});
+    }
+    try {
+        taskService.addTasks(std::move(tileTasks));
+    } catch (std::exception &e) {
+        std::cerr << logTime() << "Task " << task.id << " not tiled: " << e.what() << std::endl;
+        for (const auto &id: tiling.abandon(task.id)) {
+            tiling.settled(id);
+        }
+        return false;
+    }
+
+    tiledTasks++;
+    std::cout << logTime() << "Task " << task.id << " split into " << tiles.size() << " tiles (tiled in total: "
+              << tiledTasks << ")" << std::endl;
+    // every worker with free cores takes its share, the rest go as cores free up
+    for (;;) {
+        size_t left = tiling.pending();
+        Worker worker = findFreeWorker(Tiling::FUNCTION, task.cores);
+        if (left == 0 || worker.id.empty()) {
+            break;
+        }
+        checkTaskQueue(worker);
+        if (tiling.pending() == left) {
+            break;
+        }
+    }
+    return true;
+}
+
+bool RabbitServer::gatherPart(const Task &part, const TaskResultHeader &result) {
+    Scatter::Gathered gathered;
+    bool done = result.status == RESULT_DONE;
+    Scatter::State state = scatter.complete(part.id, done, result.data, result.dataSize, gathered);
+    bool tile = false;
+    if (state == Scatter::State::NotPart) {
+        state = tiling.complete(part.id, done, result.data, result.dataSize, gathered);
+        tile = true;
+    }
+    switch (state) {
+        case Scatter::State::NotPart:
+            return false;
+        case Scatter::State::Pending:
+        case Scatter::State::Abandoned:
+            return true;
+        case Scatter::State::Done:
+            finishParent(gathered.parent, RESULT_DONE, std::move(gathered.output));
+            return true;
+        case Scatter::State::Failed:
+            if (tile) {
+                failTiles(gathered.remaining);
+            } else {
+                failParts(gathered.remaining);
+            }
+            finishParent(gathered.parent, result.status == RESULT_DONE ? RESULT_FAILED : result.status,
+                         std::move(gathered.output));
+            return true;
+    }
+    return true;
+}
+
+void RabbitServer::finishParent(const std::string &id, int status, std::string output) {
+    Task parent;
+    try {
+        if (!taskService.finishTask(id, status == RESULT_DONE ? TaskStatus::Ready : TaskStatus::Failed, output,
+                                    parent)) {
             return;
         }
+    } catch (std::exception &e) {
+        std::cerr << logTime() << "Error finishing task " << id << ": " << e.what() << std::endl;
+        return;
+    }
+    TaskWatch::Copies copies;
+    taskWatch.finish(id, "", copies);
+    std::cout << logTime() << "Parts of task " << id << " gathered" << std::endl;
+    answerClient(parent, status, std::move(output));
+}
+
+void RabbitServer::failParts(const std::vector<std::string> &ids) {
+    failRemaining(ids, [this](const std::string &id) { scatter.settled(id); });
+}
+
+void RabbitServer::failTiles(const std::vector<std::string> &ids) {
+    failRemaining(ids, [this](const std::string &id) { tiling.settled(id); });
+}
+
+void RabbitServer::failRemaining(const std::vector<std::string> &ids,
+                                 const std::function<void(const std::string &)> &settled) {
+    for (const auto &id: ids) {
+        Task part;
+        try {
+            if (!taskService.finishTask(id, TaskStatus::Failed, "", part)) {
+                // its result is in, the gatherer drops it
+                continue;
+            }
+        } catch (std::exception &e) {
+            continue;
+        }
+        settled(id);
+        cancelCopies(part, "", {});
+    }
+}
+
+void RabbitServer::cancelCopies(const Task &task, const std::string &winner, const TaskWatch::Copies &copies) {
+    std::vector<std::string> losers;
+    for (const auto &id: {task.worker_hash_id, copies.backup}) {
+        if (!id.empty() && id != winner && std::find(losers.begin(), losers.end(), id) == losers.end()) {
+            losers.push_back(id);
+        }
+    }
+    for (const auto &id: losers) {
+        Worker loser;
+        try {
+            userDBService.releaseCores(id, task.cores, 1);
+            loser = userDBService.findWorkerByID(id);
+        } catch (std::exception &e) {
+            // the worker is gone with the copy
+            continue;
+        }
+        struct TaskCancel cancel = {{task.id}};
+        loser.connection->sendMessage(packMessage(MessageType::TaskCancel, cancel, wireFormat));
+        std::cout << logTime() << "Copy of task " << task.id << " on worker " << id << " cancelled" << std::endl;
+    }
+}
+
+const char *RabbitServer::checkCores(int cores) {
+    if (cores < 1) {
+        return "a task needs at least one core";
+    }
+    int largest = userDBService.maxCores();
+    if (cores > TaskQueue::MAX_CORES || (largest > 0 && cores > largest)) {
+        return "a task needs more cores than any worker has";
+    }
+    return nullptr;
+}
+
+void RabbitServer::rejectTasks(const Client &client, const std::vector<std::string> &ids,
+                               const Admission::Decision &decision) {
+    struct TaskReject reject = {ids, decision.retryAfter, decision.reason};
+    std::cerr << logTime() << ids.size() << " tasks of client " << client.id << " rejected: " << decision.reason
+              << " (rejected in total: " << admission.rejected() << ")" << std::endl;
+    client.connection->sendMessage(packMessage(MessageType::TaskReject, reject, wireFormat));
+}
+
+void RabbitServer::stealFor(const Worker &thief) {
+    Worker victim = userDBService.beginSteal(thief.id);
+    if (victim.id.empty()) {
+        return;
+    }
+    // half of what waits there, the victim keeps the rest for its own cores
+    struct TaskSteal steal = {(victim.prefetched + 1) / 2};
+    std::cout << logTime() << "Worker " << thief.id << " is idle, asking worker " << victim.id << " for "
+              << steal.count << " tasks" << std::endl;
+    victim.connection->sendMessage(packMessage(MessageType::TaskSteal, steal, wireFormat));
+}
+
+void RabbitServer::processTaskReturn(const Worker &worker, const std::vector<std::string> &ids) {
+    std::vector<Task> returned;
+    int cores = 0;
+    int backups = 0;
+    for (const auto &id: ids) {
+        Task task;
+        try {
+            if (!taskService.unassignTask(id, worker.id, task)) {
+                // a backup copy is not queued again, the primary still runs
+                if (taskWatch.dropBackup(id, worker.id)) {
+                    cores += task.cores;
+                    backups++;
+                }
+                continue;
+            }
+        } catch (std::exception &e) {
+            std::cerr << logTime() << "Error returning task " << id << ": " << e.what() << std::endl;
+            continue;
+        }
+        taskWatch.requeued(id);
+        cores += task.cores;
+        returned.push_back(std::move(task));
+    }
+    userDBService.endSteal(worker.id, cores, static_cast<int>(returned.size()) + backups);
+    if (returned.empty()) {
+        return;
+    }
+
+    stolenTasks += returned.size();
+    std::cout << logTime() << "Took back " << returned.size() << " tasks from worker " << worker.id
+              << " (stolen in total: " << stolenTasks << ", duplicate results: " << duplicateResults << ")"
+              << std::endl;
+    enqueueTasks(returned);
+    retryPendingTasks();
+}
+
+void RabbitServer::retryPendingTasks() {
+    for (size_t i = 0; i < queues.size(); i++) {
+        if (queues[i]->size() == 0) continue;
+        const std::string &queue = router.queues()[i];
+        Worker freeWorker = userDBService.findMostFreeWorker(1, queue);
+        if (freeWorker.id.empty()) {
+            freeWorker = userDBService.findWorkerWithCredit(queue);
+        }
+        if (!freeWorker.id.empty()) {
+            checkTaskQueue(freeWorker);
+        }
+    }
+}
+
+TaskQueue &RabbitServer::queueFor(const Task &task) {
+    std::vector<int> routed = router.route(task.func);
+    int best = routed[0];
+    if (routed.size() > 1) {
+        // a task has one result, a fanout offers it to the pool that gets to it first
+        bool staffed = false;
+        for (int queue: routed) {
+            bool workers = userDBService.workerCount(router.queues()[queue]) != 0;
+            if ((workers && !staffed) || (workers == staffed && queues[queue]->size() < queues[best]->size())) {
+                best = queue;
+                staffed = workers;
+            }
+        }
+    }
+    return *queues[best];
+}
+
+void RabbitServer::enqueueTasks(const std::vector<Task> &tasks) {
+    std::unordered_map<TaskQueue *, std::vector<Task>> routed;
+    for (const auto &task: tasks) {
+        routed[&queueFor(task)].push_back(task);
+    }
+    for (auto &[queue, batch]: routed) {
+        queue->enqueue(batch);
+    }
+}
+
+size_t RabbitServer::queuedTasks() {
+    size_t total = 0;
+    for (auto &queue: queues) {
+        total += queue->size();
+    }
+    return total;
+}
+
+Worker RabbitServer::reserveWorker(const Task &task) {
+    for (int queue: router.route(task.func)) {
+        Worker worker = userDBService.reserveCores(task.cores, workerSelection, router.queues()[queue]);
+        if (!worker.id.empty()) {
+            return worker;
+        }
+    }
+    return {};
+}
+
+Worker RabbitServer::findFreeWorker(const std::string &func, int cores) {
+    Worker best;
+    for (int queue: router.route(func)) {
+        Worker worker = userDBService.findMostFreeWorker(cores, router.queues()[queue]);
+        if (!worker.id.empty() && (best.id.empty() || worker.cores - worker.usedCores > best.cores - best.usedCores)) {
+            best = worker;
+        }
+    }
+    return best;
+}
 
-        std::cout << logTime() << "Task " << pendingTask.id << " sent to worker " << worker.id << std::endl;
+std::vector<std::string> RabbitServer::subscribedQueues(const Worker &worker) {
+    std::vector<std::string> subscribed;
+    for (const auto &queue: worker.queues) {
+        if (router.queueIndex(queue) == -1) {
+            std::cerr << logTime() << "Worker " << worker.id << " asked for unknown queue " << queue << std::endl;
+        } else if (std::find(subscribed.begin(), subscribed.end(), queue) == subscribed.end()) {
+            subscribed.push_back(queue);
+        }
+    }
+    if (subscribed.empty()) {
+        subscribed.emplace_back(Router::DEFAULT_QUEUE);
+    }
+    return subscribed;
+}
+
+bool RabbitServer::subscribes(const Worker &worker, const std::string &func) {
+    for (int queue: router.route(func)) {
+        const std::string &name = router.queues()[queue];
+        if (std::find(worker.queues.begin(), worker.queues.end(), name) != worker.queues.end()) {
+            return true;
+        }
     }
+    return false;
 }
 
 
-void RabbitServer::processTask(Task &task) {
+void RabbitServer::processTask(Task &task, const Received &relay) {
+#ifdef SERVER_ARCH_DEBUG
     userDBService.printLog();
-    Worker worker = userDBService.findMostFreeWorker(task.cores);
-    std::cout << logTime() << "Found worker: " << worker.id << " (Cores: " << worker.cores << ")\n";
+#endif
+    if (scatterTask(task) || tileTask(task)) {
+        return;
+    }
+    Worker worker = reserveWorker(task);
 
     if (worker.id.empty()) {
-        pendingTasks.enqueue(task);
+        queueFor(task).enqueue(task);
         std::cout << logTime() << "Task " << task.id << " added to queue.\n";
+
+        retryPendingTasks();
         return;
     }
+    std::cout << logTime() << "Found worker: " << worker.id << " (Cores: " << worker.cores << ")\n";
 
+    // the task may have expired since it was added, then it is not sent
+    std::vector<std::string> ids = {task.id};
+    assignTasks(worker, ids);
+    if (ids.empty()) {
+        return;
+    }
     task.worker_hash_id = worker.id;
     task.status = TaskStatus::SentToWorker;
-    taskService.updateTask(task);
-
-    // update worker
-    userDBService.modifyWorkerUsedCores(worker.id, task.cores, true);
-    struct TaskRequest taskRequest = {
-            task.id,
-            task.func,
-            task.input,
-            task.cores
-    };
-
-    Message message = {
-            MessageType::TaskRequest,
-            json(taskRequest).dump()
-    };
-
-    try {
-        std::string strToSend = json(message).dump();
-        worker.connection->sendMessage(strToSend);
-    } catch (json::exception &e) {
-        std::cerr << logTime() << "[processTask] Error sending task to worker: " << e.what() << std::endl;
-        return;
+    taskWatch.started(task.id, worker.id);
+
+    if (relay) {
+        // the client message goes to the worker byte for byte, straight from the receive buffer
+        auto rawMessage = relay->getData();
+        worker.connection->sendMessage(rawMessage.first, rawMessage.second);
+    } else {
+        worker.connection->sendMessage(taskService.packTaskRequest(task.id, wireFormat));
     }
 
     std::cout << logTime() << "Task " << task.id << " sent to worker " << worker.id << std::endl;
@@ -3,24 +3,83 @@
 
 #include <boost/asio.hpp>
 #include "protocol/Connection.h"
+#include "server/STIPServer.h"
+#include "DataModel/Message.h"
 #include "services/TaskService/TaskService.h"
 #include "services/UserDBService/UserDBService.h"
 #include "services/TaskQueue/TaskQueue.h"
+#include "services/ResultBatcher/ResultBatcher.h"
+#include "services/ResultCache/ResultCache.h"
+#include "services/Singleflight/Singleflight.h"
+#include "services/HeartbeatMonitor/HeartbeatMonitor.h"
+#include "services/TaskWatch/TaskWatch.h"
+#include "services/Admission/Admission.h"
+#include "services/Scatter/Scatter.h"
+#include "services/Tiling/Tiling.h"
+#include "services/Dataflow/Dataflow.h"
+#include "services/Router/Router.h"
+#include "utils/Executor.h"
 #include <nlohmann/json.hpp>
+#include <list>
+#include <memory>
+#include <optional>
+#include <unordered_set>
 
 using boost::asio::ip::udp;
 using json = nlohmann::json;
 
 class RabbitServer {
 public:
-    RabbitServer(int port);
+    // threads = 0 means one executor thread per hardware thread
+    explicit RabbitServer(int port, size_t threads = 0);
 
-    void init();
+    // storage - where the task log lives, tasks.md, users.md and queue.md are refreshed once per reportInterval
+    void init(const TaskLogOptions &storage = {},
+              std::chrono::milliseconds reportInterval = std::chrono::milliseconds(1000));
 
     void startPolling();
 
     void processConnection(STIP::Connection *connection);
 
+    void setStarvationPolicy(const StarvationPolicy &policy);
+
+    // queued tasks of the same priority are shared between clients in proportion to their weights, 1 by default
+    void setClientWeight(const std::string &client, int weight);
+
+    void setRetentionPolicy(const RetentionPolicy &policy);
+
+    void setWorkerSelection(WorkerSelection selection);
+
+    // format of messages the server creates, forwarded payloads keep their own
+    void setWireFormat(WireFormat format);
+
+    // identical tasks are answered from the cache without a worker, off by default
+    void setResultCache(const ResultCacheOptions &options);
+
+    // results for one client finished within window go out as one message. Must be called before init
+    void setResultBatching(std::chrono::microseconds window, size_t maxBytes);
+
+    // a worker silent for timeout is dropped and its tasks are queued again, 0 - never.
+    // Must be called before init
+    void setWorkerTimeout(std::chrono::milliseconds timeout);
+
+    // rate and outstanding task limits of every client, none by default. Must be called before init
+    void setAdmission(const AdmissionOptions &options);
+
+    // tasks of splittable functions run in parts on many workers, none by default
+    void setScatter(const ScatterOptions &options);
+
+    // matrixMultiplication tasks run as tiles on many workers, not tiled by default
+    void setTiling(const TilingOptions &options);
+
+    // Named queues and the exchanges tasks are routed through by function, every task goes to
+    // the default queue if not set. Must be called before init, throws std::invalid_argument
+    // for a binding to an unknown exchange or queue
+    void setRouting(const RoutingOptions &options);
+
+    // slow tasks get a backup copy on another worker, off by default. Must be called before init
+    void setSpeculation(const SpeculationPolicy &policy);
+
     ~RabbitServer() {
         delete server_socket;
     }
@@ -32,19 +91,213 @@ private:
 
     TaskService taskService;
     UserDBService userDBService;
-    TaskQueue pendingTasks;
+    Router router;
+    // one per queue of the router, in its order. Not changed after init, so read without a lock
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    StarvationPolicy starvation;
+    std::unordered_map<std::string, int> clientWeights;
+    WorkerSelection workerSelection = WorkerSelection::MostFree;
+    WireFormat wireFormat = WireFormat::Binary;
+
+    std::atomic<uint64_t> stolenTasks{0};
+    std::atomic<uint64_t> duplicateResults{0};
+    std::atomic<uint64_t> coalescedTasks{0};
+    std::atomic<uint64_t> requeuedTasks{0};
+    std::atomic<uint64_t> speculativeTasks{0};
+    std::atomic<uint64_t> scatteredTasks{0};
+    std::atomic<uint64_t> tiledTasks{0};
+
+    ResultBatcher resultBatcher;
+    std::chrono::microseconds batchWindow{1000};
+    size_t batchBytes = 1 << 20;
+
+    ResultCache resultCache;
+    // identical tasks in flight share one computation, the leader's key also caches the result
+    Singleflight singleflight;
+
+    HeartbeatMonitor heartbeats;
+    std::chrono::milliseconds workerTimeout{10000};
+
+    // deadlines, timeouts and backup copies of running tasks
+    TaskWatch taskWatch;
+    SpeculationPolicy speculation;
+
+    // every task the broker accepts takes a token of its client and counts as outstanding
+    // until the client gets its result
+    Admission admission;
+
+    Scatter scatter;
+
+    Tiling tiling;
+
+    Dataflow dataflow;
+
+    // recovered tasks of splittable functions, split again once a worker is there to take the parts
+    std::vector<Task> recoveredParents;
+    std::mutex recoveredMutex;
+
+    // message handling and task dispatch run here, connection threads only read
+    Executor executor;
+
+    STIP::STIPServer *stipServer = nullptr;
+    // held while a connection is stopped or closed, so the heartbeat monitor and
+    // the connection thread do not both touch it
+    std::mutex connectionsMutex;
+
+    struct ConnectionThread {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> finished;
+    };
+    std::list<ConnectionThread> connectionThreads;
+
+    // joins threads of connections that already disconnected
+    void reapConnectionThreads();
 
     udp::resolver *resolver;
     udp::endpoint *server_endpoint;
 
     void processWorker(Worker &worker);
 
+    // Removes the parts and tiles of tasks the previous run split, by their ids and functions.
+    // Returns their ids
+    std::unordered_set<std::string> dropParts();
+
+    void splitRecovered();
+
+    // Removes the worker and queues its unfinished tasks again. false if it was already removed
+    bool dropWorker(const Worker &worker);
+
+    // called by the heartbeat monitor, the connection thread of the worker finishes after that
+    void workerSilent(const std::string &id);
+
+    void closeConnection(STIP::Connection *connection);
+
     void processClient(Client &client);
 
-    void processTask(Task &task);
+    // received message, kept alive while its bytes are forwarded
+    using Received = std::shared_ptr<STIP::ReceiveMessageSession>;
+
+    // relay - the client message of the task, sent to the worker as is when not empty
+    void processTask(Task &task, const Received &relay = nullptr);
+
+    // Tasks that refer to the outputs of others are stored until those are done, the rest are
+    // dispatched. A graph that is not valid is rejected as a whole
+    void processGraph(const Client &client, const std::vector<TaskRequestHeader> &requests);
+
+    // A task of a graph got its result: the tasks that waited for it are dispatched or, if it
+    // failed, fail too. false if the result goes to the client, true if only other tasks needed it
+    bool flowResult(const Task &task, int status, const char *data, size_t size);
+
+    // waiting tasks get the outputs they refer to and are dispatched
+    void releaseTasks(const std::vector<std::string> &ids);
+
+    // tasks of splittable functions are split, the rest are dispatched
+    void processTaskBatch(std::vector<Task> &tasks);
+
+    // tasks that fit go out in one message per worker, the rest are queued together
+    void dispatchTasks(std::vector<Task> &tasks);
+
+    // Records the tasks as sent to the worker, which has their cores reserved. Tasks that got a
+    // result in the meantime are removed from ids and their cores are given back
+    void assignTasks(const Worker &worker, std::vector<std::string> &ids);
+
+    // the tasks must already be assigned to the worker
+    void sendTasks(const Worker &worker, const std::vector<std::string> &ids);
+
+    // tiles carry the panels the worker lacks, other tasks their stored input
+    void sendRequests(const Worker &worker, const std::vector<std::string> &ids);
+
+    void processTaskResult(const Worker &worker, const Received &received, const MessageView &view);
+
+    // reads the envelope in place, the view points into the received buffer
+    static bool unpackReceived(const Received &received, MessageView &view);
 
     void checkTaskQueue(Worker &worker);
 
+    // queues of the router that have no TaskQueue yet get one
+    void createQueues();
+
+    // Of the queues a task of the function is routed to, the one with the shortest backlog among
+    // those with workers
+    TaskQueue &queueFor(const Task &task);
+
+    // each task waits in the queue it is routed to
+    void enqueueTasks(const std::vector<Task> &tasks);
+
+    size_t queuedTasks();
+
+    // takes the cores of the task on a worker of a queue it is routed to, empty id if none has them
+    Worker reserveWorker(const Task &task);
+
+    // the worker of a queue the function is routed to with the most free cores, at least cores
+    Worker findFreeWorker(const std::string &func, int cores);
+
+    // the queues the worker asked for that are declared, the default queue if none is
+    std::vector<std::string> subscribedQueues(const Worker &worker);
+
+    bool subscribes(const Worker &worker, const std::string &func);
+
+    // cores or prefetch credit may have been released between a failed reservation and the enqueue
+    void retryPendingTasks();
+
+    // Answers the task from the cache. On a miss key is set if the result of the function may be reused
+    bool answerFromCache(const std::string &clientId, const Task &stored, std::optional<ResultCache::Key> &key);
+
+    // the result of a leading task goes to the cache and to the tasks waiting for it
+    void completeFlight(const Task &task, const std::shared_ptr<void> &owner, const TaskResultHeader &result);
+
+    // deadline - unix time in ms, 0 if none. timeout - ms per attempt, 0 if none
+    void watchTask(const std::string &id, const std::string &func, int64_t deadline, int timeout);
+
+    void onWatch(const std::string &id, TaskWatch::Action action);
+
+    // starts a copy of the running task on another worker with free cores, if there is one
+    void launchBackup(const std::string &id);
+
+    // the broker gives up on the task, the client gets status and reason instead of a result
+    void expireTask(const std::string &id, int status, const std::string &reason);
+
+    // the result goes to the client and to identical tasks waiting for it
+    void answerClient(const Task &task, int status, std::string output);
+
+    // Splits the stored task into parts and dispatches them. false if it is not split, the
+    // task is then dispatched whole as before
+    bool scatterTask(const Task &task);
+
+    // Splits a product into tiles and hands them to workers with free cores. false if it is not
+    // tiled, it then runs whole
+    bool tileTask(const Task &task);
+
+    // false if the task is not a part or a tile, its result is handled as usual then
+    bool gatherPart(const Task &part, const TaskResultHeader &result);
+
+    // the task that was split gets its gathered output or the error of a part
+    void finishParent(const std::string &id, int status, std::string output);
+
+    // remaining parts of a failed task are finished and cancelled on their workers
+    void failParts(const std::vector<std::string> &ids);
+
+    void failTiles(const std::vector<std::string> &ids);
+
+    void failRemaining(const std::vector<std::string> &ids, const std::function<void(const std::string &)> &settled);
+
+    // Cores of every copy of the task except the winner's are released and the workers are told
+    // to drop them. task.worker_hash_id is the worker the task was assigned to
+    void cancelCopies(const Task &task, const std::string &winner, const TaskWatch::Copies &copies);
+
+    // nullptr if the task may be created, otherwise why not: it needs no cores or more than any
+    // worker has. While no worker is registered only TaskQueue::MAX_CORES bounds the request
+    const char *checkCores(int cores);
+
+    // the tasks are not created, the client may send them again after decision.retryAfter
+    void rejectTasks(const Client &client, const std::vector<std::string> &ids, const Admission::Decision &decision);
+
+    // asks the most loaded worker to give back tasks it has not started, so the idle thief gets them
+    void stealFor(const Worker &thief);
+
+    // the worker answered a steal request, the tasks go back to the queue
+    void processTaskReturn(const Worker &worker, const std::vector<std::string> &ids);
+
     static std::string logTime();
 };
 
@@ -1,4 +1,5 @@
 #include "RabbitWorker.h"
+#include <algorithm>
 #include <utility>
 #include "protocol/STIP.h"
 #include "protocol/Connection.h"
@@ -41,51 +42,125 @@ void RabbitWorker::init() {
     mapping["simpleMath"] = &RabbitWorker::simpleMathHandler;
     mapping["determinant"] = &RabbitWorker::determinantHandler;
     mapping["matrixMultiplication"] = &RabbitWorker::matrixMultiplicationHandler;
+    mapping["matrixTile"] = &RabbitWorker::matrixTileHandler;
 
     // Register worker
     if (connection) {
         std::cout << "RabbitWorker::init - Connection established" << std::endl;
 
-        Worker worker = {id, cores, 0, nullptr};
-        nlohmann::json workerJson;
-        to_json(workerJson, worker);
-        Message message = {
-                MessageType::RegisterWorker,
-                workerJson.dump()
-        };
-
-        nlohmann::json messageJson;
-        to_json(messageJson, message);
-
-        std::string msg = messageJson.dump();
-        connection->sendMessage(msg);
+        Worker worker = {id, cores, 0, nullptr, prefetch};
+        worker.queues = queues;
+        connection->sendMessage(packMessage(MessageType::RegisterWorker, worker, wireFormat),
+                                STIP::Priority::CONTROL);
         std::cout << "RabbitWorker::init - Worker registered with server" << std::endl;
+
+        if (heartbeatInterval.count() > 0) {
+            heartbeatThread = std::thread(&RabbitWorker::sendHeartbeats, this);
+        }
     } else {
         std::cerr << "RabbitWorker::init - Error: Failed to connect to server." << std::endl;
     }
 }
 
+void RabbitWorker::setWireFormat(WireFormat format) {
+    wireFormat = format;
+}
+
+void RabbitWorker::setPrefetch(int count) {
+    prefetch = count;
+}
+
+void RabbitWorker::setQueues(const std::vector<std::string> &names) {
+    queues = names;
+}
+
+void RabbitWorker::setHeartbeat(std::chrono::milliseconds interval) {
+    heartbeatInterval = interval;
+}
+
+void RabbitWorker::sendHeartbeats() {
+    struct Heartbeat heartbeat;
+    std::string message = packMessage(MessageType::Heartbeat, heartbeat, wireFormat);
+    std::unique_lock<std::mutex> lock(heartbeatMutex);
+    while (!heartbeatCv.wait_for(lock, heartbeatInterval, [this] { return stopping; })) {
+        lock.unlock();
+        if (!connection->sendMessage(message, STIP::Priority::CONTROL)) {
+            std::cerr << "RabbitWorker::sendHeartbeats - Server did not answer" << std::endl;
+        }
+        lock.lock();
+    }
+}
+
+void RabbitWorker::stopHeartbeats() {
+    {
+        std::lock_guard<std::mutex> lock(heartbeatMutex);
+        stopping = true;
+    }
+    heartbeatCv.notify_all();
+    if (heartbeatThread.joinable()) {
+        heartbeatThread.join();
+    }
+}
+
 void RabbitWorker::startPolling() {
     std::cout << "RabbitWorker::startPolling - Polling started" << std::endl;
     for (;;) {
         STIP::ReceiveMessageSession *received = connection->receiveMessage();
-
-#ifdef SERVER_ARCH_DEBUG
-        std::cout << "RabbitWorker::startPolling - Received message: " << received->getDataAsString() << std::endl;
-#endif
-
-        json request = json::parse(received->getDataAsString());
-        Message message = request.get<Message>();
-        json messageData = json::parse(message.data);
+        if (received == nullptr) break;
+
+        auto rawMessage = received->getData();
+        Message message;
+        bool parsed = unpackMessage(static_cast<char *>(rawMessage.first), rawMessage.second, message);
+        delete received;
+        if (!parsed) {
+            std::cerr << "RabbitWorker::startPolling - Error parsing message" << std::endl;
+            continue;
+        }
 
         switch (message.action) {
             case MessageType::TaskRequest: {
                 std::cout << "RabbitWorker::startPolling - Received task request" << std::endl;
-                struct TaskRequest task = messageData.get<struct TaskRequest>();
-                json data = json::parse(task.data);
+                struct TaskRequest task;
+                if (!unpackPayload(message, task)) {
+                    std::cerr << "RabbitWorker::startPolling - Error parsing task" << std::endl;
+                    break;
+                }
 
                 // Call a separate function to handle the task asynchronously
-                handleTaskRequest(task.id, task.func, data, task.cores);
+                handleTaskRequest(std::move(task));
+                break;
+            }
+
+            case MessageType::TaskBatchRequest: {
+                struct TaskBatchRequest batch;
+                if (!unpackPayload(message, batch)) {
+                    std::cerr << "RabbitWorker::startPolling - Error parsing task batch" << std::endl;
+                    break;
+                }
+                std::cout << "RabbitWorker::startPolling - Received " << batch.tasks.size() << " tasks" << std::endl;
+                for (auto &task: batch.tasks) {
+                    handleTaskRequest(std::move(task));
+                }
+                break;
+            }
+
+            case MessageType::TaskSteal: {
+                struct TaskSteal steal;
+                if (!unpackPayload(message, steal)) {
+                    std::cerr << "RabbitWorker::startPolling - Error parsing steal request" << std::endl;
+                    break;
+                }
+                giveBackTasks(steal.count);
+                break;
+            }
+
+            case MessageType::TaskCancel: {
+                struct TaskCancel cancel;
+                if (!unpackPayload(message, cancel)) {
+                    std::cerr << "RabbitWorker::startPolling - Error parsing cancel request" << std::endl;
+                    break;
+                }
+                cancelTasks(cancel.ids);
                 break;
             }
 
@@ -96,19 +171,128 @@ void RabbitWorker::startPolling() {
     }
 }
 
-void RabbitWorker::handleTaskRequest(const std::string &request_id, const std::string &func, const json &data,
-                                     int taskCores) {
-    if (mapping.find(func) == mapping.end()) {
-        std::cout << "RabbitWorker::handleTaskRequest - Function not found: " << func << std::endl;
-        return;
+bool RabbitWorker::runTask(const struct TaskRequest &task, struct TaskResult &result) {
+    auto handler = mapping.find(task.func);
+    if (handler == mapping.end()) {
+        std::cout << "RabbitWorker::runTask - Function not found: " << task.func << std::endl;
+        result = {task.id, "function not found: " + task.func, RESULT_FAILED};
+        return false;
+    }
+
+    try {
+        result = {task.id, (this->*handler->second)(task.id, json::parse(task.data), task.cores), RESULT_DONE};
+    } catch (std::exception &e) {
+        std::cerr << "RabbitWorker::runTask - Task " << task.id << " failed: " << e.what() << std::endl;
+        result = {task.id, e.what(), RESULT_FAILED};
+        return false;
+    }
+    return true;
+}
+
+void RabbitWorker::handleTaskRequest(struct TaskRequest task) {
+    if (task.func == "matrixTile") {
+        loadPanels(task);
     }
+    std::lock_guard<std::mutex> lock(schedulerMutex);
+    waiting.push_back(std::move(task));
+    startWaiting();
+}
 
-    // Create a new thread for each task request
-    std::thread taskThread([this, request_id, func, data, taskCores]() {
-        (this->*mapping[func])(request_id, data, taskCores);
-    });
+void RabbitWorker::startWaiting() {
+    // in arrival order, a task bigger than the worker runs alone
+    while (!waiting.empty() && (usedCores + waiting.front().cores <= cores || usedCores == 0)) {
+        usedCores += waiting.front().cores;
+        running.insert(waiting.front().id);
+
+        // Create a new thread for each task request
+        std::thread taskThread([this, task = std::move(waiting.front())]() {
+            struct TaskResult result;
+            runTask(task, result);
+            finishTask(task, std::move(result));
+        });
+        taskThread.detach();
+        waiting.pop_front();
+    }
+}
 
-    taskThread.detach();
+void RabbitWorker::giveBackTasks(int count) {
+    struct TaskReturn taskReturn;
+    {
+        std::lock_guard<std::mutex> lock(schedulerMutex);
+        // the newest tasks would start last here
+        while (!waiting.empty() && static_cast<int>(taskReturn.ids.size()) < count) {
+            taskReturn.ids.push_back(std::move(waiting.back().id));
+            waiting.pop_back();
+        }
+    }
+    {
+        // a tile given back takes its panels again when it is sent anew
+        std::lock_guard<std::mutex> lock(panelMutex);
+        for (const auto &id: taskReturn.ids) {
+            tilePanels.erase(id);
+        }
+    }
+    // answered even when empty, the server waits for it before asking again
+    connection->sendMessage(packMessage(MessageType::TaskReturn, taskReturn, wireFormat));
+    std::cout << "RabbitWorker::giveBackTasks - " << taskReturn.ids.size() << " tasks given back" << std::endl;
+}
+
+void RabbitWorker::cancelTasks(const std::vector<std::string> &ids) {
+    std::lock_guard<std::mutex> lock(schedulerMutex);
+    for (const auto &id: ids) {
+        auto it = std::find_if(waiting.begin(), waiting.end(), [&id](const struct TaskRequest &task) {
+            return task.id == id;
+        });
+        if (it != waiting.end()) {
+            waiting.erase(it);
+            std::lock_guard<std::mutex> panelLock(panelMutex);
+            tilePanels.erase(id);
+        } else if (running.count(id) != 0) {
+            cancelled.insert(id);
+        }
+    }
+    std::cout << "RabbitWorker::cancelTasks - " << ids.size() << " tasks cancelled" << std::endl;
+}
+
+void RabbitWorker::finishTask(const struct TaskRequest &task, struct TaskResult result) {
+    std::vector<struct TaskResult> results;
+    {
+        std::lock_guard<std::mutex> lock(schedulerMutex);
+        usedCores -= task.cores;
+        running.erase(task.id);
+        startWaiting();
+        if (cancelled.erase(task.id) == 0) {
+            outbox.push_back(std::move(result));
+        }
+        if (sending || outbox.empty()) {
+            // the thread that is sending takes this result with its next message
+            return;
+        }
+        sending = true;
+    }
+
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(schedulerMutex);
+            results.swap(outbox);
+            if (results.empty()) {
+                sending = false;
+                return;
+            }
+        }
+        sendResults(results);
+        std::cout << "RabbitWorker::finishTask - " << results.size() << " results sent" << std::endl;
+        results.clear();
+    }
+}
+
+void RabbitWorker::sendResults(const std::vector<struct TaskResult> &results) {
+    if (results.size() == 1) {
+        connection->sendMessage(packMessage(MessageType::TaskResult, results[0], wireFormat));
+        return;
+    }
+    struct TaskBatchResult batch{results};
+    connection->sendMessage(packMessage(MessageType::TaskBatchResult, batch, wireFormat));
 }
 
 // worker function implementations
@@ -157,34 +341,16 @@ void RabbitWorker::matrixMultiplication(const std::vector<std::vector<int>> &mat
     }
 }
 
-void RabbitWorker::simpleMathHandler(const std::string &request_id, json data, int taskCores) {
+std::string RabbitWorker::simpleMathHandler(const std::string &request_id, json data, int taskCores) {
     std::cout << "RabbitWorker::simpleMathHandler - Handling simpleMath for request_id: " << request_id << std::endl;
-    int a, b, result;
-    try {
-        a = data["a"];
-        b = data["b"];
-        result = simpleMath(a, b);
-    } catch (json::exception &e) {
-        std::cerr << "RabbitWorker::simpleMathHandler - Error parsing data: " << e.what() << std::endl;
-        return;
-    }
-
-    struct TaskResult taskResult = {
-            request_id,
-            json({{"result", result}}).dump(),
-            1
-    };
-
-    Message message = {
-            MessageType::TaskResult,
-            json(taskResult).dump()
-    };
+    int a = data["a"];
+    int b = data["b"];
+    int result = simpleMath(a, b);
 
-    connection->sendMessage(json(message).dump());
-    std::cout << "RabbitWorker::simpleMathHandler - Result sent for request_id: " << request_id << std::endl;
+    return json({{"result", result}}).dump();
 }
 
-void RabbitWorker::determinantHandler(const std::string &request_id, json data, int taskCores) {
+std::string RabbitWorker::determinantHandler(const std::string &request_id, json data, int taskCores) {
     std::cout << "RabbitWorker::determinantHandler - Handling determinant for request_id: " << id << std::endl;
     std::vector<std::thread> threads;
     threads.reserve(taskCores);
@@ -204,22 +370,11 @@ void RabbitWorker::determinantHandler(const std::string &request_id, json data,
         }
     }
 
-    struct TaskResult taskResult = {
-            request_id,
-            json(results).dump(),
-            1
-    };
-
-    Message message = {
-            MessageType::TaskResult,
-            json(taskResult).dump()
-    };
-
-    connection->sendMessage(json(message).dump());
-    std::cout << "RabbitWorker::determinantHandler - Results sent for request_id: " << request_id << std::endl;
+    std::cout << "RabbitWorker::determinantHandler - Done for request_id: " << request_id << std::endl;
+    return json(results).dump();
 }
 
-void RabbitWorker::matrixMultiplicationHandler(const std::string &request_id, json data, int taskCores) {
+std::string RabbitWorker::matrixMultiplicationHandler(const std::string &request_id, json data, int taskCores) {
     std::cout << "RabbitWorker::matrixMultiplicationHandler - Handling matrix multiplication for request_id: "
               << request_id << std::endl;
     std::vector<std::thread> threads;
@@ -232,9 +387,7 @@ void RabbitWorker::matrixMultiplicationHandler(const std::string &request_id, js
     std::vector<std::vector<int>> matrixB = matrices[1];
 
     if (matrixA[0].size() != matrixB.size()) {
-        std::cerr << "RabbitWorker::matrixMultiplicationHandler - Matrix dimensions do not match for multiplication"
-                  << std::endl;
-        return;
+        throw std::runtime_error("Matrix dimensions do not match for multiplication");
     }
 
     int rowsA = matrixA.size();
@@ -253,24 +406,85 @@ void RabbitWorker::matrixMultiplicationHandler(const std::string &request_id, js
         }
     }
 
-    struct TaskResult taskResult = {
-            request_id,
-            json(resultMatrix).dump(),
-            1
-    };
-
-    Message message = {
-            MessageType::TaskResult,
-            json(taskResult).dump()
-    };
-
-    connection->sendMessage(json(message).dump());
-    std::cout << "RabbitWorker::matrixMultiplicationHandler - Results sent for request_id: " << request_id << std::endl;
+    std::string result = json(resultMatrix).dump();
 
     // считаем время выполнения
     auto end = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> elapsed = end - start;
     std::cout << "RabbitWorker::matrixMultiplicationHandler - Execution time: " << elapsed.count() << "s" << std::endl;
+    return result;
 }
 
+void RabbitWorker::loadPanels(struct TaskRequest &task) {
+    json data;
+    try {
+        data = json::parse(task.data);
+    } catch (std::exception &e) {
+        // the handler reports it
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(panelMutex);
+    if (data.contains("panels")) {
+        for (auto &[key, panel]: data["panels"].items()) {
+            panels[key] = std::make_shared<const matrix_type>(panel.get<matrix_type>());
+        }
+    }
+    auto a = panels.find(data.value("a", ""));
+    auto b = panels.find(data.value("b", ""));
+    tilePanels[task.id] = {a == panels.end() ? nullptr : a->second, b == panels.end() ? nullptr : b->second};
+    if (data.contains("drop")) {
+        for (const auto &key: data["drop"]) {
+            panels.erase(key.get<std::string>());
+        }
+    }
+    std::cout << "RabbitWorker::loadPanels - " << panels.size() << " panels held" << std::endl;
 
+    // the panels are not parsed again by the handler
+    task.data = json({{"a", data.value("a", "")}, {"b", data.value("b", "")}}).dump();
+}
+
+std::string RabbitWorker::matrixTileHandler(const std::string &request_id, json data, int taskCores) {
+    std::shared_ptr<const matrix_type> rows, columns;
+    {
+        std::lock_guard<std::mutex> lock(panelMutex);
+        auto it = tilePanels.find(request_id);
+        if (it != tilePanels.end()) {
+            rows = std::move(it->second.first);
+            columns = std::move(it->second.second);
+            tilePanels.erase(it);
+        }
+    }
+    if (!rows || !columns) {
+        throw std::runtime_error("missing panel for tile " + request_id);
+    }
+    if (rows->empty() || columns->empty() || (*rows)[0].size() != (*columns)[0].size()) {
+        throw std::runtime_error("Panel dimensions do not match for multiplication");
+    }
+
+    // columns of B come as rows, every product walks two rows
+    matrix_type tile(rows->size(), std::vector<int>(columns->size(), 0));
+    auto multiplyRows = [&](size_t begin, size_t step) {
+        for (size_t r = begin; r < rows->size(); r += step) {
+            const std::vector<int> &row = (*rows)[r];
+            for (size_t c = 0; c < columns->size(); c++) {
+                const std::vector<int> &column = (*columns)[c];
+                int sum = 0;
+                for (size_t k = 0; k < row.size(); k++) {
+                    sum += row[k] * column[k];
+                }
+                tile[r][c] = sum;
+            }
+        }
+    };
+
+    size_t threadCount = std::min<size_t>(std::max(taskCores, 1), rows->size());
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount);
+    for (size_t t = 0; t < threadCount; t++) {
+        threads.emplace_back(multiplyRows, t, threadCount);
+    }
+    for (auto &t: threads) t.join();
+
+    return json(tile).dump();
+}
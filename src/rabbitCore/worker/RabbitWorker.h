@@ -4,22 +4,32 @@
 #include <boost/asio.hpp>
 #include "protocol/Connection.h"
 #include "client/STIPClient.h"
+#include "DataModel/Message.h"
 #include <nlohmann/json.hpp>
 #include <vector>
 #include <iostream>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <functional>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 using boost::asio::ip::udp;
 using json = nlohmann::json;
 
 class RabbitWorker;
 
-typedef void (RabbitWorker::*func_type)(const std::string &, json, int);
+// returns the result data, throws if the task can not be done
+typedef std::string (RabbitWorker::*func_type)(const std::string &, json, int);
 
 typedef std::map<std::string, func_type> func_map_type;
 
+typedef std::vector<std::vector<int>> matrix_type;
+
 class RabbitWorker {
 public:
     RabbitWorker(std::string id, std::string host, int port, int cores);
@@ -28,7 +38,26 @@ public:
 
     void startPolling();
 
+    // JSON messages are slower, but readable in a packet dump
+    void setWireFormat(WireFormat format);
+
+    // all results go in one message
+    void sendResults(const std::vector<struct TaskResult> &results);
+
+    // Tasks the server may send beyond the free cores. They wait here and start as soon as
+    // cores free up, without a round trip to the server. Must be set before init
+    void setPrefetch(int count);
+
+    // queues of the server this worker takes tasks from, the default one if none.
+    // Must be set before init
+    void setQueues(const std::vector<std::string> &names);
+
+    // the server drops a worker it has not heard from for its timeout, 0 - no heartbeats.
+    // Must be set before init
+    void setHeartbeat(std::chrono::milliseconds interval);
+
     ~RabbitWorker() {
+        stopHeartbeats();
         delete server_socket;
     }
 
@@ -47,6 +76,34 @@ private:
     STIP::Connection *connection{};
     boost::asio::io_context io_context;
 
+    WireFormat wireFormat = WireFormat::Binary;
+    int prefetch = 0;
+    std::vector<std::string> queues;
+
+    std::chrono::milliseconds heartbeatInterval{1000};
+    std::thread heartbeatThread;
+    std::mutex heartbeatMutex;
+    std::condition_variable heartbeatCv;
+    bool stopping = false;
+
+    // tasks wait until their cores are free, results that finish while a send is in
+    // progress go out together with the next send
+    std::mutex schedulerMutex;
+    std::deque<struct TaskRequest> waiting;
+    // ids of started tasks, and of those among them whose results are no longer needed
+    std::unordered_set<std::string> running;
+    std::unordered_set<std::string> cancelled;
+    int usedCores = 0;
+    std::vector<struct TaskResult> outbox;
+    bool sending = false;
+
+    // Panels of tiled products the server sent, kept until it says to drop them. A tile takes
+    // its panels when it arrives, a later drop does not affect it
+    std::mutex panelMutex;
+    std::unordered_map<std::string, std::shared_ptr<const matrix_type>> panels;
+    std::unordered_map<std::string, std::pair<std::shared_ptr<const matrix_type>, std::shared_ptr<const matrix_type>>>
+            tilePanels;
+
     // functions
 
     int simpleMath(int a, int b);
@@ -59,15 +116,40 @@ private:
 
     static void doWait(int seconds);
 
-    void simpleMathHandler(const std::string &request_id, json data, int taskCores);
+    std::string simpleMathHandler(const std::string &request_id, json data, int taskCores);
+
+    std::string determinantHandler(const std::string &id, json data, int taskCores);
 
-    void determinantHandler(const std::string &id, json data, int taskCores);
+    std::string matrixMultiplicationHandler(const std::string &id, json data, int taskCores);
 
-    void matrixMultiplicationHandler(const std::string &id, json data, int taskCores);
+    // one tile of a product tiled by the server, rows of A times columns of B
+    std::string matrixTileHandler(const std::string &id, json data, int taskCores);
+
+    // stores the panels a tile carries and drops the ones the server says, in arrival order
+    void loadPanels(struct TaskRequest &task);
 
     func_map_type mapping;
 
-    void handleTaskRequest(const std::string &request_id, const std::string &func, const json &data, int taskCores);
+    void handleTaskRequest(struct TaskRequest task);
+
+    // starts waiting tasks that fit the free cores, called with schedulerMutex held
+    void startWaiting();
+
+    // the result goes to the server unless the task was cancelled
+    void finishTask(const struct TaskRequest &task, struct TaskResult result);
+
+    // removes up to count tasks that have not started and tells the server they will not run here
+    void giveBackTasks(int count);
+
+    // waiting tasks are dropped, a running thread can not be stopped, its result is not sent
+    void cancelTasks(const std::vector<std::string> &ids);
+
+    void sendHeartbeats();
+
+    void stopHeartbeats();
+
+    // false if there is no such function or it failed, result then has the error
+    bool runTask(const struct TaskRequest &task, struct TaskResult &result);
 };
 
 
@@ -30,7 +30,8 @@ namespace STIP {
                     connection = new Connection(remote_endpoint, socket);
                     this->connectionManager->addConnection(remote_endpoint, connection);
                     response[0].header.command = Command::CONNECTION_SYN_ACK; // SYN-ACK
-                    response[0].header.size = sizeof(int); // We have to send only command
+                    response[0].header.session_id = connection->getPathToken(); // to join extra paths later
+                    response[0].header.size = sizeof(STIP_HEADER);
                     this->socket->send_to(boost::asio::buffer(response, response[0].header.size), remote_endpoint);
                     std::cout << "SYN-ACK sent" << std::endl;
                     break;
@@ -45,6 +46,19 @@ namespace STIP {
                     connection_exist->startProcessing();
                     return connection_exist;
 
+                case Command::CONNECTION_PATH_JOIN: // extra path of an existing connection
+                    connection_exist = this->connectionManager->findByPathToken(packet[0].header.session_id);
+                    if (connection_exist == nullptr ||
+                        !connection_exist->registerPath(packet[0].header.packet_id, socket, remote_endpoint)) {
+                        break;
+                    }
+                    this->connectionManager->addConnection(remote_endpoint, connection_exist);
+                    // timestamp is echoed back for the first rtt sample
+                    response[0] = packet[0];
+                    response[0].header.command = Command::CONNECTION_PATH_JOIN_ACK;
+                    this->socket->send_to(boost::asio::buffer(response, response[0].header.size), remote_endpoint);
+                    break;
+
                 default:
                     this->connectionManager->accept(remote_endpoint, packet[0]);
                     break;
@@ -52,6 +66,12 @@ namespace STIP {
         }
     }
 
+    void STIPServer::closeConnection(Connection *connection) {
+        connection->stopProcessing();
+        this->connectionManager->remove(connection->getEndpoint());
+        delete connection;
+    }
+
 }
 
 // TODO: Maybe rewrite to async read write from asio
@@ -16,6 +16,14 @@ namespace STIP {
 
         Connection *acceptConnection();
 
+        /// \brief Закрытие соединения
+        ///
+        /// Останавливает обработку пакетов, убирает соединение из ConnectionManager
+        /// вместе с его путями и удаляет его. Пакеты с его адресов больше не принимаются
+        ///
+        /// \param connection - соединение, полученное из acceptConnection
+        void closeConnection(Connection *connection);
+
     private:
         udp::socket *socket;
         ConnectionManager *connectionManager;
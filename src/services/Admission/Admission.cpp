@@ -0,0 +1,71 @@
+#include "Admission.h"
+
+#include <algorithm>
+#include <cmath>
+
+void Admission::configure(const AdmissionOptions &options) {
+    std::lock_guard<std::mutex> lock(mtx);
+    this->options = options;
+    buckets.clear();
+}
+
+double Admission::burst() const {
+    return options.burst > 0 ? options.burst : options.rate;
+}
+
+Admission::Decision Admission::admit(const std::string &client, size_t count) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto now = Clock::now();
+    auto inserted = buckets.try_emplace(client, Bucket{burst(), now});
+    Bucket &bucket = inserted.first->second;
+
+    if (options.maxOutstanding != 0) {
+        if (count > options.maxOutstanding) {
+            rejectedTasks += count;
+            return {false, -1, "more tasks than the outstanding quota"};
+        }
+        if (bucket.outstanding + count > options.maxOutstanding) {
+            rejectedTasks += count;
+            return {false, 0, "too many outstanding tasks"};
+        }
+    }
+
+    if (options.rate > 0) {
+        double elapsed = std::chrono::duration<double>(now - bucket.refilled).count();
+        bucket.tokens = std::min(burst(), bucket.tokens + elapsed * options.rate);
+        bucket.refilled = now;
+        if (static_cast<double>(count) > burst()) {
+            rejectedTasks += count;
+            return {false, -1, "batch larger than the burst"};
+        }
+        if (bucket.tokens < static_cast<double>(count)) {
+            rejectedTasks += count;
+            double wait = (static_cast<double>(count) - bucket.tokens) / options.rate;
+            return {false, static_cast<int>(std::ceil(wait * 1000)), "rate limit"};
+        }
+        bucket.tokens -= static_cast<double>(count);
+    }
+
+    bucket.outstanding += count;
+    return {true, 0, ""};
+}
+
+void Admission::release(const std::string &client, size_t count) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = buckets.find(client);
+    if (it == buckets.end()) {
+        return;
+    }
+    it->second.outstanding -= std::min(count, it->second.outstanding);
+}
+
+size_t Admission::outstanding(const std::string &client) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = buckets.find(client);
+    return it == buckets.end() ? 0 : it->second.outstanding;
+}
+
+uint64_t Admission::rejected() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return rejectedTasks;
+}
@@ -0,0 +1,61 @@
+#ifndef RABBIT_ADMISSION_H
+#define RABBIT_ADMISSION_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Limits of every client, zero disables a limit
+struct AdmissionOptions {
+    // tasks per second a client may submit on average
+    double rate = 0;
+    // tasks a client may submit at once after being idle, rate if 0
+    double burst = 0;
+    // tasks of a client that may be waiting for a result
+    size_t maxOutstanding = 0;
+};
+
+// Token bucket and outstanding task quota per client id. Checked before a task is created,
+// so a rejected request costs the broker no memory. Thread safe
+class Admission {
+public:
+    struct Decision {
+        bool admitted;
+        // when the client may try again: ms, 0 - once one of its results arrives, -1 - never
+        // (the batch is larger than the burst or the quota)
+        int retryAfter;
+        const char *reason;
+    };
+
+    void configure(const AdmissionOptions &options);
+
+    // takes count tasks of the client, all or none
+    Decision admit(const std::string &client, size_t count);
+
+    // a task of the client got its result or was given up on
+    void release(const std::string &client, size_t count = 1);
+
+    size_t outstanding(const std::string &client);
+
+    uint64_t rejected();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Bucket {
+        double tokens;
+        Clock::time_point refilled;
+        size_t outstanding = 0;
+    };
+
+    std::mutex mtx;
+    AdmissionOptions options;
+    std::unordered_map<std::string, Bucket> buckets;
+    uint64_t rejectedTasks = 0;
+
+    double burst() const;
+};
+
+#endif //RABBIT_ADMISSION_H
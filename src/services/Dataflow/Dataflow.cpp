@@ -0,0 +1,214 @@
+#include "Dataflow.h"
+
+#include <algorithm>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+static const json *referenceOf(const json &value) {
+    if (value.is_object() && value.size() == 1) {
+        auto it = value.find("$ref");
+        if (it != value.end() && it->is_string()) {
+            return &*it;
+        }
+    }
+    return nullptr;
+}
+
+static void collect(const json &value, std::vector<std::string> &ids) {
+    if (const json *ref = referenceOf(value)) {
+        ids.push_back(ref->get<std::string>());
+        return;
+    }
+    if (value.is_structured()) {
+        for (const auto &item: value) {
+            collect(item, ids);
+        }
+    }
+}
+
+static void substitute(json &value, const std::unordered_map<std::string, json> &outputs) {
+    if (const json *ref = referenceOf(value)) {
+        value = outputs.at(ref->get<std::string>());
+        return;
+    }
+    if (value.is_structured()) {
+        for (auto &item: value) {
+            substitute(item, outputs);
+        }
+    }
+}
+
+std::vector<std::string> Dataflow::references(const std::string &input) {
+    std::vector<std::string> ids;
+    json value = json::parse(input, nullptr, false);
+    if (value.is_discarded()) {
+        return ids;
+    }
+    collect(value, ids);
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+std::string Dataflow::add(const std::vector<Node> &nodes, std::vector<std::string> &ready) {
+    std::unordered_map<std::string, size_t> index;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].id.empty()) {
+            return "every task of a graph needs an id";
+        }
+        if (!index.emplace(nodes[i].id, i).second) {
+            return "task " + nodes[i].id + " is in the graph twice";
+        }
+    }
+
+    std::vector<std::vector<std::string>> refs(nodes.size());
+    std::vector<std::vector<size_t>> dependents(nodes.size());
+    std::vector<size_t> missing(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        refs[i] = references(nodes[i].input);
+        for (const auto &ref: refs[i]) {
+            auto it = index.find(ref);
+            if (it == index.end()) {
+                return "task " + nodes[i].id + " refers to " + ref + ", which is not in the graph";
+            }
+            dependents[it->second].push_back(i);
+        }
+        missing[i] = refs[i].size();
+    }
+
+    // every task must be reachable from the ones without references, or there is a cycle
+    std::vector<size_t> order;
+    order.reserve(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (missing[i] == 0) order.push_back(i);
+    }
+    std::vector<size_t> left = missing;
+    for (size_t at = 0; at < order.size(); at++) {
+        for (size_t dependent: dependents[order[at]]) {
+            if (--left[dependent] == 0) order.push_back(dependent);
+        }
+    }
+    if (order.size() != nodes.size()) {
+        return "the graph has a cycle";
+    }
+
+    std::lock_guard<std::mutex> lock(mtx);
+    for (const auto &node: nodes) {
+        if (entries.count(node.id) != 0) {
+            return "task " + node.id + " is in another graph";
+        }
+    }
+    for (size_t i = 0; i < nodes.size(); i++) {
+        Entry &entry = entries[nodes[i].id];
+        entry.refs = std::move(refs[i]);
+        entry.missing = missing[i];
+        entry.unwired = dependents[i].size();
+        for (size_t dependent: dependents[i]) {
+            entry.dependents.push_back(nodes[dependent].id);
+        }
+        if (missing[i] == 0) {
+            ready.push_back(nodes[i].id);
+        }
+    }
+    return "";
+}
+
+void Dataflow::forget(const std::vector<Node> &nodes) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (const auto &node: nodes) {
+        entries.erase(node.id);
+    }
+}
+
+Dataflow::Completion Dataflow::complete(const std::string &id, bool done, const char *data, size_t size) {
+    Completion completion;
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = entries.find(id);
+    if (it == entries.end() || it->second.finished) {
+        return completion;
+    }
+    Entry &entry = it->second;
+    completion.tracked = true;
+    completion.sink = entry.dependents.empty();
+    entry.failed = entry.failed || !done;
+
+    if (!entry.failed) {
+        if (!entry.dependents.empty()) {
+            entry.output.assign(data, size);
+        }
+        for (const auto &dependent: entry.dependents) {
+            Entry &waiting = entries.at(dependent);
+            if (!waiting.failed && --waiting.missing == 0) {
+                completion.released.push_back(dependent);
+            }
+        }
+    } else {
+        for (const auto &dependent: entry.dependents) {
+            Entry &blocked = entries.at(dependent);
+            if (blocked.failed) {
+                continue;
+            }
+            blocked.failed = true;
+            completion.blocked.push_back(dependent);
+            detach(blocked);
+        }
+        // a task that failed before it was released, by its deadline
+        detach(entry);
+    }
+    // only now, the entry must not go while its dependents are walked
+    entry.finished = true;
+    release(id);
+    return completion;
+}
+
+std::string Dataflow::wire(const std::string &id, const std::string &input) {
+    json value = json::parse(input, nullptr, false);
+    std::unordered_map<std::string, json> outputs;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = entries.find(id);
+        if (it == entries.end()) {
+            return input;
+        }
+        for (const auto &ref: it->second.refs) {
+            const Entry &producer = entries.at(ref);
+            json output = json::parse(producer.output, nullptr, false);
+            outputs[ref] = output.is_discarded() ? json(producer.output) : std::move(output);
+        }
+        detach(it->second);
+    }
+    if (value.is_discarded()) {
+        return input;
+    }
+    substitute(value, outputs);
+    return value.dump();
+}
+
+size_t Dataflow::waiting() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return std::count_if(entries.begin(), entries.end(), [](const auto &entry) {
+        return !entry.second.finished && !entry.second.failed && entry.second.missing != 0;
+    });
+}
+
+void Dataflow::release(const std::string &id) {
+    auto it = entries.find(id);
+    if (it != entries.end() && it->second.finished && it->second.unwired == 0) {
+        entries.erase(it);
+    }
+}
+
+void Dataflow::detach(Entry &entry) {
+    if (entry.detached) {
+        return;
+    }
+    entry.detached = true;
+    for (const auto &ref: entry.refs) {
+        auto producer = entries.find(ref);
+        if (producer != entries.end()) {
+            producer->second.unwired--;
+            release(ref);
+        }
+    }
+}
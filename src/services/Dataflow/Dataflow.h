@@ -0,0 +1,78 @@
+#ifndef RABBIT_DATAFLOW_H
+#define RABBIT_DATAFLOW_H
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Tasks of graphs that wait for the outputs of other tasks. A task is released once every task
+// it refers to is done, its references are then replaced with their outputs. Outputs are kept
+// until every task that refers to them is released. Thread safe
+class Dataflow {
+public:
+    struct Node {
+        std::string id;
+        // JSON, {"$ref": "id"} stands for the output of that task
+        std::string input;
+    };
+
+    struct Completion {
+        // a task of a graph
+        bool tracked = false;
+        // nothing refers to it, its result goes to the client
+        bool sink = false;
+        // tasks whose inputs are all there now
+        std::vector<std::string> released;
+        // tasks that can not run any more, the task failed
+        std::vector<std::string> blocked;
+    };
+
+    // Checks the graph: every task has an id of its own and refers only to tasks of the graph,
+    // without cycles. Returns the error, or an empty string and starts tracking the graph.
+    // ready gets the tasks that refer to nothing
+    std::string add(const std::vector<Node> &nodes, std::vector<std::string> &ready);
+
+    // the graph was not accepted after all, nothing of it is tracked
+    void forget(const std::vector<Node> &nodes);
+
+    Completion complete(const std::string &id, bool done, const char *data, size_t size);
+
+    // The input of a released task with its references replaced. An output that is not JSON
+    // is put in as a string
+    std::string wire(const std::string &id, const std::string &input);
+
+    // tasks waiting for their inputs
+    size_t waiting();
+
+    // the ids a JSON input refers to, each once. Empty if it is not JSON
+    static std::vector<std::string> references(const std::string &input);
+
+private:
+    struct Entry {
+        std::vector<std::string> refs;
+        // tasks it refers to that have no output yet
+        size_t missing = 0;
+        std::vector<std::string> dependents;
+        // dependents not wired yet, the output is needed until then
+        size_t unwired = 0;
+        bool finished = false;
+        // failed, or blocked by a task it refers to
+        bool failed = false;
+        // wired or failed, the outputs it refers to are no longer needed for it
+        bool detached = false;
+        std::string output;
+    };
+
+    std::mutex mtx;
+    std::unordered_map<std::string, Entry> entries;
+
+    // called with mtx held, drops the entry once nobody needs it
+    void release(const std::string &id);
+
+    // called with mtx held
+    void detach(Entry &entry);
+};
+
+#endif //RABBIT_DATAFLOW_H
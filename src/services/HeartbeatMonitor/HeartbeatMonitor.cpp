@@ -0,0 +1,67 @@
+#include "HeartbeatMonitor.h"
+
+#include <algorithm>
+#include <vector>
+
+void HeartbeatMonitor::start(std::chrono::milliseconds timeout, Dead dead) {
+    if (timeout.count() <= 0) {
+        return;
+    }
+    this->timeout = timeout;
+    this->dead = std::move(dead);
+    monitor = std::thread(&HeartbeatMonitor::run, this);
+}
+
+void HeartbeatMonitor::touch(const std::string &id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    lastSeen[id] = std::chrono::steady_clock::now();
+}
+
+void HeartbeatMonitor::forget(const std::string &id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    lastSeen.erase(id);
+}
+
+void HeartbeatMonitor::run() {
+    // a peer is declared dead at most a quarter of the timeout late
+    auto period = std::max(timeout / 4, std::chrono::milliseconds(1));
+    std::unique_lock<std::mutex> lock(mtx);
+    while (!stopping) {
+        monitorCv.wait_for(lock, period, [this] { return stopping; });
+        if (stopping) break;
+
+        auto deadline = std::chrono::steady_clock::now() - timeout;
+        std::vector<std::string> silent;
+        for (auto it = lastSeen.begin(); it != lastSeen.end();) {
+            if (it->second < deadline) {
+                silent.push_back(it->first);
+                it = lastSeen.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (silent.empty()) continue;
+
+        // the callback may touch or forget peers
+        lock.unlock();
+        for (const auto &id: silent) {
+            dead(id);
+        }
+        lock.lock();
+    }
+}
+
+void HeartbeatMonitor::close() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    monitorCv.notify_all();
+    if (monitor.joinable()) {
+        monitor.join();
+    }
+}
+
+HeartbeatMonitor::~HeartbeatMonitor() {
+    close();
+}
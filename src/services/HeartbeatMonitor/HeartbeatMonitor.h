@@ -0,0 +1,46 @@
+#ifndef RABBIT_HEARTBEATMONITOR_H
+#define RABBIT_HEARTBEATMONITOR_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// When every peer was heard from last. A peer silent for longer than the timeout is
+// reported once from the monitor thread and forgotten. Thread safe
+class HeartbeatMonitor {
+public:
+    using Dead = std::function<void(const std::string &id)>;
+
+    HeartbeatMonitor() = default;
+
+    // timeout 0 - peers are never declared dead
+    void start(std::chrono::milliseconds timeout, Dead dead);
+
+    // any message counts, the first one starts watching the peer
+    void touch(const std::string &id);
+
+    // the peer left on its own
+    void forget(const std::string &id);
+
+    void close();
+
+    ~HeartbeatMonitor();
+
+private:
+    std::mutex mtx;
+    std::unordered_map<std::string, std::chrono::steady_clock::time_point> lastSeen;
+    std::chrono::milliseconds timeout{0};
+    Dead dead;
+
+    bool stopping = false;
+    std::thread monitor;
+    std::condition_variable monitorCv;
+
+    void run();
+};
+
+#endif //RABBIT_HEARTBEATMONITOR_H
@@ -0,0 +1,153 @@
+#include "ResultBatcher.h"
+#include <iostream>
+
+void ResultBatcher::start(std::chrono::microseconds window, size_t maxBytes, WireFormat format, Deliver deliver,
+                          Post post) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (timer.joinable()) {
+        throw std::runtime_error("Result batcher is already started");
+    }
+    this->window = window;
+    this->maxBytes = maxBytes;
+    this->format = format;
+    this->deliver = std::move(deliver);
+    this->post = std::move(post);
+    if (window.count() > 0) {
+        timer = std::thread(&ResultBatcher::run, this);
+    }
+}
+
+void ResultBatcher::add(const std::string &clientId, std::shared_ptr<void> owner, const TaskResultHeader &result,
+                        const char *raw, size_t rawSize) {
+    std::vector<Item> full;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (window.count() == 0 || stopping) {
+            // no batching, nothing is kept after the call
+            full.push_back({std::move(owner), result, raw, rawSize});
+        } else {
+            Pending &batch = pending[clientId];
+            if (batch.items.empty()) {
+                batch.deadline = std::chrono::steady_clock::now() + window;
+                timerCv.notify_one();
+            }
+            batch.bytes += result.id.size() + result.dataSize + 12;
+            batch.items.push_back({std::move(owner), result, raw, rawSize});
+            if (batch.bytes < maxBytes || batch.sending) {
+                // a full batch behind one on the way waits for the timer
+                return;
+            }
+            full.swap(batch.items);
+            pending.erase(clientId);
+        }
+    }
+    send(clientId, full);
+}
+
+void ResultBatcher::sent(const std::string &clientId) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = pending.find(clientId);
+    if (it == pending.end()) {
+        return;
+    }
+    it->second.sending = false;
+    if (it->second.items.empty()) {
+        pending.erase(it);
+    } else {
+        // results added meanwhile may be due already
+        timerCv.notify_one();
+    }
+}
+
+void ResultBatcher::send(const std::string &clientId, std::vector<Item> &items) {
+    try {
+        if (items.size() == 1 && items[0].raw != nullptr) {
+            deliver(clientId, items[0].raw, items[0].rawSize);
+            return;
+        }
+        std::vector<TaskResultHeader> results;
+        results.reserve(items.size());
+        for (const auto &item: items) {
+            results.push_back(item.result);
+        }
+        std::string message = packResultBatch(results, format);
+        deliver(clientId, message.data(), message.size());
+    } catch (std::exception &e) {
+        std::cerr << "[!] Results for client " << clientId << " are lost: " << e.what() << std::endl;
+    }
+}
+
+void ResultBatcher::run() {
+    std::unique_lock<std::mutex> lock(mtx);
+    for (;;) {
+        auto now = std::chrono::steady_clock::now();
+        auto next = std::chrono::steady_clock::time_point::max();
+        std::vector<std::pair<std::string, std::vector<Item>>> due;
+        bool posted = post && !stopping;
+        for (auto it = pending.begin(); it != pending.end();) {
+            Pending &batch = it->second;
+            if (batch.items.empty() || (batch.sending && !stopping)) {
+                ++it;
+            } else if (stopping || batch.deadline <= now) {
+                due.emplace_back(it->first, std::move(batch.items));
+                batch.items.clear();
+                batch.bytes = 0;
+                if (posted) {
+                    batch.sending = true;
+                    ++it;
+                } else {
+                    it = pending.erase(it);
+                }
+            } else {
+                next = std::min(next, batch.deadline);
+                ++it;
+            }
+        }
+
+        if (!due.empty()) {
+            // sending waits for the network, adding must not
+            lock.unlock();
+            for (auto &batch: due) {
+                if (!posted) {
+                    send(batch.first, batch.second);
+                    continue;
+                }
+                auto items = std::make_shared<std::vector<Item>>(std::move(batch.second));
+                try {
+                    post([this, clientId = batch.first, items]() {
+                        send(clientId, *items);
+                        sent(clientId);
+                    });
+                } catch (std::exception &e) {
+                    // the pool no longer takes jobs, the results still go out
+                    std::cerr << "[!] ResultBatcher: " << e.what() << std::endl;
+                    send(batch.first, *items);
+                    sent(batch.first);
+                }
+            }
+            lock.lock();
+            continue;
+        }
+        if (stopping) {
+            return;
+        }
+        if (next == std::chrono::steady_clock::time_point::max()) {
+            timerCv.wait(lock);
+        } else {
+            timerCv.wait_until(lock, next);
+        }
+    }
+}
+
+void ResultBatcher::close() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    timerCv.notify_all();
+    if (timer.joinable()) timer.join();
+}
+
+ResultBatcher::~ResultBatcher() {
+    close();
+}
@@ -0,0 +1,79 @@
+#ifndef RABBIT_RESULTBATCHER_H
+#define RABBIT_RESULTBATCHER_H
+
+#include "DataModel/Message.h"
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Results going to one client within window are sent as one TaskBatchResult.
+// A batch is sent early once it holds maxBytes of data. A result that ends up alone
+// goes out in its original message, untouched. Due batches are sent through post, never
+// from the timer thread, and one client has at most one batch on the way: a slow client
+// collects its results meanwhile instead of holding up the others. Thread safe
+class ResultBatcher {
+public:
+    using Deliver = std::function<void(const std::string &clientId, const char *data, size_t size)>;
+    // runs the job on another thread
+    using Post = std::function<void(std::function<void()> job)>;
+
+    ResultBatcher() = default;
+
+    // window 0 delivers every result right away from the caller thread.
+    // Without post due batches are sent from the timer thread
+    void start(std::chrono::microseconds window, size_t maxBytes, WireFormat format, Deliver deliver,
+               Post post = nullptr);
+
+    // owner keeps result.data and raw alive until the result is delivered.
+    // raw - the whole message of a single result, nullptr if it came in a batch
+    void add(const std::string &clientId, std::shared_ptr<void> owner, const TaskResultHeader &result,
+             const char *raw = nullptr, size_t rawSize = 0);
+
+    // sends everything that is buffered and stops the timer thread
+    void close();
+
+    ~ResultBatcher();
+
+private:
+    struct Item {
+        std::shared_ptr<void> owner;
+        TaskResultHeader result;
+        const char *raw;
+        size_t rawSize;
+    };
+
+    struct Pending {
+        std::chrono::steady_clock::time_point deadline;
+        std::vector<Item> items;
+        size_t bytes = 0;
+        // a batch of the client is being sent
+        bool sending = false;
+    };
+
+    std::chrono::microseconds window{0};
+    size_t maxBytes = 0;
+    WireFormat format = WireFormat::Binary;
+    Deliver deliver;
+    Post post;
+
+    std::mutex mtx;
+    std::condition_variable timerCv;
+    std::unordered_map<std::string, Pending> pending;
+    bool stopping = false;
+    std::thread timer;
+
+    void send(const std::string &clientId, std::vector<Item> &items);
+
+    // the batch of the client that was being sent is out
+    void sent(const std::string &clientId);
+
+    void run();
+};
+
+#endif //RABBIT_RESULTBATCHER_H
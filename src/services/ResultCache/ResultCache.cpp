@@ -0,0 +1,162 @@
+#include "ResultCache.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+ResultCache::Key ResultCache::keyOf(const std::string &func, const char *data, size_t size) {
+    // the function name seeds the hashes of the input, nothing is concatenated
+    return {xxh64(data, size, xxh64(func.data(), func.size())),
+            xxh64(data, size, xxh64(func.data(), func.size(), CHECK_SEED)), size};
+}
+
+void ResultCache::configure(const ResultCacheOptions &options) {
+    std::lock_guard<std::mutex> lock(mtx);
+    this->options = options;
+    while (counters.bytes > options.maxBytes && makeRoom()) {}
+    report.touch();
+}
+
+bool ResultCache::enabled() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return options.maxBytes > 0;
+}
+
+const CachePolicy &ResultCache::policyOf(const std::string &func) const {
+    auto it = options.functions.find(func);
+    return it == options.functions.end() ? options.defaults : it->second;
+}
+
+bool ResultCache::cacheable(const std::string &func) {
+    std::lock_guard<std::mutex> lock(mtx);
+    return policyOf(func).cacheable;
+}
+
+bool ResultCache::lookup(Key key, size_t inputSize, std::string &output) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (options.maxBytes == 0) {
+        return false;
+    }
+    report.touch();
+    auto it = index.find(key);
+    if (it == index.end()) {
+        counters.misses++;
+        return false;
+    }
+    Entry &entry = slots[it->second];
+    if (entry.expires <= std::chrono::steady_clock::now()) {
+        erase(it->second);
+        counters.expired++;
+        counters.misses++;
+        return false;
+    }
+    entry.referenced = true;
+    output = entry.output;
+    counters.hits++;
+    counters.bytesSaved += inputSize + output.size();
+    return true;
+}
+
+void ResultCache::insert(Key key, const std::string &func, const std::string &output) {
+    std::lock_guard<std::mutex> lock(mtx);
+    const CachePolicy &policy = policyOf(func);
+    if (options.maxBytes == 0 || !policy.cacheable || index.count(key) != 0) {
+        return;
+    }
+    size_t size = output.size() + ENTRY_OVERHEAD;
+    if (size > options.maxBytes) {
+        return;
+    }
+    while (counters.bytes + size > options.maxBytes) {
+        if (!makeRoom()) return;
+    }
+
+    auto expires = policy.ttl.count() > 0 ? std::chrono::steady_clock::now() + policy.ttl
+                                          : std::chrono::steady_clock::time_point::max();
+    uint32_t slot;
+    if (freeSlots.empty()) {
+        slot = static_cast<uint32_t>(slots.size());
+        slots.emplace_back();
+    } else {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    // a new entry has to be hit once before it survives a pass of the hand
+    slots[slot] = {key, output, expires, false, true};
+    index[key] = slot;
+    counters.bytes += size;
+    counters.entries++;
+    report.touch();
+}
+
+void ResultCache::erase(uint32_t slot) {
+    Entry &entry = slots[slot];
+    index.erase(entry.key);
+    counters.bytes -= entry.output.size() + ENTRY_OVERHEAD;
+    counters.entries--;
+    entry.used = false;
+    std::string().swap(entry.output);
+    freeSlots.push_back(slot);
+}
+
+bool ResultCache::makeRoom() {
+    if (counters.entries == 0) {
+        return false;
+    }
+    auto now = std::chrono::steady_clock::now();
+    // two passes at most: the first one may only clear reference bits
+    for (size_t steps = 0; steps < 2 * slots.size(); steps++) {
+        if (hand >= slots.size()) hand = 0;
+        Entry &entry = slots[hand];
+        uint32_t slot = static_cast<uint32_t>(hand++);
+        if (!entry.used) continue;
+        if (entry.expires <= now) {
+            erase(slot);
+            counters.expired++;
+            return true;
+        }
+        if (entry.referenced) {
+            entry.referenced = false;
+            continue;
+        }
+        erase(slot);
+        counters.evictions++;
+        return true;
+    }
+    return false;
+}
+
+ResultCacheStats ResultCache::stats() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return counters;
+}
+
+void ResultCache::startReport(std::chrono::milliseconds interval) {
+    std::lock_guard<std::mutex> lock(mtx);
+    report.start(mtx, interval, [this] {
+        if (options.maxBytes > 0) {
+            saveStatsToFile("cache.md");
+        }
+    });
+}
+
+void ResultCache::saveStatsToFile(const std::string &filename) {
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        throw std::runtime_error("Unable to open file");
+    }
+
+    uint64_t lookups = counters.hits + counters.misses;
+    double hitRate = lookups == 0 ? 0 : 100.0 * counters.hits / lookups;
+    file << "| Hits | Misses | Hit rate | Bytes saved | Entries | Bytes | Budget | Evictions | Expired |\n";
+    file << "|------|--------|----------|-------------|---------|-------|--------|-----------|---------|\n";
+    file << "| " << counters.hits << " | " << counters.misses << " | " << std::fixed << std::setprecision(1)
+         << hitRate << "% | " << counters.bytesSaved << " | " << counters.entries << " | " << counters.bytes
+         << " | " << options.maxBytes << " | " << counters.evictions << " | " << counters.expired << " |\n";
+
+    file.close();
+}
+
+ResultCache::~ResultCache() {
+    report.stop();
+}
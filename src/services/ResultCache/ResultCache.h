@@ -0,0 +1,107 @@
+#ifndef RABBIT_RESULTCACHE_H
+#define RABBIT_RESULTCACHE_H
+
+#include "utils/Hash.h"
+#include "utils/PeriodicReport.h"
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct CachePolicy {
+    bool cacheable = true;
+    // 0 - results do not expire
+    std::chrono::seconds ttl{0};
+};
+
+struct ResultCacheOptions {
+    // memory for cached outputs, 0 disables the cache
+    size_t maxBytes = 0;
+    CachePolicy defaults;
+    // overrides defaults for single functions
+    std::unordered_map<std::string, CachePolicy> functions;
+};
+
+struct ResultCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t expired = 0;
+    // input not sent to workers and output not sent back by them
+    uint64_t bytesSaved = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+};
+
+// Outputs of finished tasks keyed by two 64 bit hashes of the function name and the input
+// and the input size, all of them have to match.
+// Entries are evicted with CLOCK once the memory budget is reached: a hit sets the
+// reference bit, the hand clears it and evicts entries that were not hit since its last pass.
+// Thread safe
+class ResultCache {
+public:
+    using Key = ContentKey;
+
+    ResultCache() = default;
+
+    static Key keyOf(const std::string &func, const char *data, size_t size);
+
+    void configure(const ResultCacheOptions &options);
+
+    bool enabled();
+
+    // results of the function may be reused, also by identical running tasks when the cache is off
+    bool cacheable(const std::string &func);
+
+    // Counts a hit or a miss. inputSize only goes to the statistics
+    bool lookup(Key key, size_t inputSize, std::string &output);
+
+    void insert(Key key, const std::string &func, const std::string &output);
+
+    ResultCacheStats stats();
+
+    // keeps the hit rate and memory use in cache.md up to date
+    void startReport(std::chrono::milliseconds interval);
+
+    ~ResultCache();
+
+private:
+    struct Entry {
+        Key key;
+        std::string output;
+        std::chrono::steady_clock::time_point expires;
+        bool referenced;
+        bool used;
+    };
+
+    // seed of the second hash of a key
+    static const uint64_t CHECK_SEED = 0x9E3779B97F4A7C15ULL;
+
+    // bookkeeping of an entry next to its output
+    static const size_t ENTRY_OVERHEAD = 64;
+
+    std::mutex mtx;
+    ResultCacheOptions options;
+    std::vector<Entry> slots;
+    std::vector<uint32_t> freeSlots;
+    std::unordered_map<Key, uint32_t, ContentKeyHash> index;
+    size_t hand = 0;
+    ResultCacheStats counters;
+
+    PeriodicReport report;
+
+    // called with mtx held
+    const CachePolicy &policyOf(const std::string &func) const;
+
+    void erase(uint32_t slot);
+
+    // evicts one entry, false if the cache is empty
+    bool makeRoom();
+
+
+    void saveStatsToFile(const std::string &filename);
+};
+
+#endif //RABBIT_RESULTCACHE_H
@@ -0,0 +1,175 @@
+#include "Router.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+const char *const Router::DEFAULT_QUEUE = "default";
+
+std::vector<std::string> TopicTrie::split(const std::string &key) {
+    std::vector<std::string> words;
+    size_t start = 0;
+    for (;;) {
+        size_t dot = key.find('.', start);
+        words.push_back(key.substr(start, dot - start));
+        if (dot == std::string::npos) break;
+        start = dot + 1;
+    }
+    return words;
+}
+
+void TopicTrie::bind(const std::string &pattern, int queue) {
+    int node = 0;
+    std::vector<std::string> words = split(pattern);
+    // # # matches what one # does
+    words.erase(std::unique(words.begin(), words.end(), [](const std::string &a, const std::string &b) {
+        return a == "#" && b == "#";
+    }), words.end());
+    for (const auto &word: words) {
+        int next;
+        if (word == "*") {
+            next = nodes[node].star;
+        } else if (word == "#") {
+            next = nodes[node].hash;
+        } else {
+            auto it = nodes[node].words.find(word);
+            next = it == nodes[node].words.end() ? -1 : it->second;
+        }
+        if (next == -1) {
+            next = static_cast<int>(nodes.size());
+            // the reference would not survive the growth
+            nodes.emplace_back();
+            if (word == "*") {
+                nodes[node].star = next;
+            } else if (word == "#") {
+                nodes[node].hash = next;
+            } else {
+                nodes[node].words.emplace(word, next);
+            }
+        }
+        node = next;
+    }
+    auto &queues = nodes[node].queues;
+    if (std::find(queues.begin(), queues.end(), queue) == queues.end()) {
+        queues.push_back(queue);
+    }
+}
+
+void TopicTrie::match(const std::string &key, std::vector<int> &queues) const {
+    std::unordered_set<uint64_t> visited;
+    walk(0, split(key), 0, queues, visited);
+    std::sort(queues.begin(), queues.end());
+    queues.erase(std::unique(queues.begin(), queues.end()), queues.end());
+}
+
+void TopicTrie::walk(int node, const std::vector<std::string> &words, size_t at, std::vector<int> &queues,
+                     std::unordered_set<uint64_t> &visited) const {
+    // wildcards reach the same node at the same word along many paths, it is walked from there once
+    if (!visited.insert(static_cast<uint64_t>(node) << 32 | at).second) {
+        return;
+    }
+    const Node &current = nodes[node];
+    // # takes any number of the remaining words, none included
+    if (current.hash != -1) {
+        for (size_t skip = at; skip <= words.size(); skip++) {
+            walk(current.hash, words, skip, queues, visited);
+        }
+    }
+    if (at == words.size()) {
+        queues.insert(queues.end(), current.queues.begin(), current.queues.end());
+        return;
+    }
+    auto it = current.words.find(words[at]);
+    if (it != current.words.end()) {
+        walk(it->second, words, at + 1, queues, visited);
+    }
+    if (current.star != -1) {
+        walk(current.star, words, at + 1, queues, visited);
+    }
+}
+
+Router::Router() {
+    names.emplace_back(DEFAULT_QUEUE);
+    indexes.emplace(DEFAULT_QUEUE, 0);
+}
+
+void Router::configure(const RoutingOptions &options) {
+    for (const auto &name: options.queues) {
+        if (indexes.emplace(name, static_cast<int>(names.size())).second) {
+            names.push_back(name);
+        }
+    }
+    for (const auto &exchange: options.exchanges) {
+        exchanges[exchange.name].type = exchange.type;
+    }
+    for (const auto &binding: options.bindings) {
+        auto exchange = exchanges.find(binding.exchange);
+        if (exchange == exchanges.end()) {
+            throw std::invalid_argument("Unknown exchange " + binding.exchange);
+        }
+        int queue = queueIndex(binding.queue);
+        if (queue == -1) {
+            throw std::invalid_argument("Unknown queue " + binding.queue);
+        }
+        switch (exchange->second.type) {
+            case ExchangeType::Direct:
+                exchange->second.direct[binding.key].push_back(queue);
+                break;
+            case ExchangeType::Fanout:
+                exchange->second.fanout.push_back(queue);
+                break;
+            case ExchangeType::Topic:
+                exchange->second.topic.bind(binding.key, queue);
+                break;
+        }
+    }
+    if (!options.entry.empty() && exchanges.count(options.entry) == 0) {
+        throw std::invalid_argument("Unknown exchange " + options.entry);
+    }
+    entry = options.entry;
+}
+
+const std::vector<std::string> &Router::queues() const {
+    return names;
+}
+
+int Router::queueIndex(const std::string &name) const {
+    auto it = indexes.find(name);
+    return it == indexes.end() ? -1 : it->second;
+}
+
+std::vector<int> Router::route(const std::string &exchange, const std::string &key) const {
+    std::vector<int> queues;
+    auto it = exchanges.find(exchange);
+    if (it == exchanges.end()) {
+        return queues;
+    }
+    switch (it->second.type) {
+        case ExchangeType::Direct: {
+            auto bound = it->second.direct.find(key);
+            if (bound != it->second.direct.end()) {
+                queues = bound->second;
+            }
+            break;
+        }
+        case ExchangeType::Fanout:
+            queues = it->second.fanout;
+            break;
+        case ExchangeType::Topic:
+            it->second.topic.match(key, queues);
+            return queues;
+    }
+    std::sort(queues.begin(), queues.end());
+    queues.erase(std::unique(queues.begin(), queues.end()), queues.end());
+    return queues;
+}
+
+std::vector<int> Router::route(const std::string &func) const {
+    std::vector<int> queues;
+    if (!entry.empty()) {
+        queues = route(entry, func);
+    }
+    if (queues.empty()) {
+        queues.push_back(0);
+    }
+    return queues;
+}
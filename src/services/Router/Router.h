@@ -0,0 +1,106 @@
+#ifndef RABBIT_ROUTER_H
+#define RABBIT_ROUTER_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+enum class ExchangeType {
+    // the routing key equals the binding key
+    Direct,
+    // every bound queue, the key is ignored
+    Fanout,
+    // dot separated words, * in a binding key stands for one word and # for zero or more
+    Topic,
+};
+
+struct ExchangeOptions {
+    std::string name;
+    ExchangeType type = ExchangeType::Direct;
+};
+
+struct BindingOptions {
+    std::string exchange;
+    std::string key;
+    std::string queue;
+};
+
+struct RoutingOptions {
+    // named queues besides the default one
+    std::vector<std::string> queues;
+    std::vector<ExchangeOptions> exchanges;
+    std::vector<BindingOptions> bindings;
+    // exchange every task is published to with its function as the routing key,
+    // empty - every task goes to the default queue
+    std::string entry;
+};
+
+// Binding keys of a topic exchange compiled into a trie of words. A key is matched by walking
+// its words down the trie, so the cost depends on the key and the wildcards on its path, not on
+// how many bindings there are. Each node is walked at most once per word of the key, so
+// patterns with many # stay polynomial
+class TopicTrie {
+public:
+    void bind(const std::string &pattern, int queue);
+
+    // queues whose binding keys match, each once, in ascending order
+    void match(const std::string &key, std::vector<int> &queues) const;
+
+private:
+    struct Node {
+        std::unordered_map<std::string, int> words;
+        int star = -1;
+        int hash = -1;
+        std::vector<int> queues;
+    };
+
+    std::vector<Node> nodes{1};
+
+    // visited - (node, at) pairs already walked
+    void walk(int node, const std::vector<std::string> &words, size_t at, std::vector<int> &queues,
+              std::unordered_set<uint64_t> &visited) const;
+
+    static std::vector<std::string> split(const std::string &key);
+};
+
+// Named queues and the exchanges that route tasks to them, as in AMQP. Configured once before the
+// server starts and read only after that, so routing takes no lock. A task no binding matches
+// goes to the default queue
+class Router {
+public:
+    static const char *const DEFAULT_QUEUE;
+
+    Router();
+
+    // throws std::invalid_argument for a binding to an unknown exchange or queue
+    void configure(const RoutingOptions &options);
+
+    // the default queue first, then the declared ones
+    const std::vector<std::string> &queues() const;
+
+    // -1 if the queue is not declared
+    int queueIndex(const std::string &name) const;
+
+    // indexes of the queues the exchange routes the key to, empty if none or no such exchange
+    std::vector<int> route(const std::string &exchange, const std::string &key) const;
+
+    // queues a task of the function may wait in, never empty
+    std::vector<int> route(const std::string &func) const;
+
+private:
+    struct Exchange {
+        ExchangeType type;
+        std::unordered_map<std::string, std::vector<int>> direct;
+        std::vector<int> fanout;
+        TopicTrie topic;
+    };
+
+    std::vector<std::string> names;
+    std::unordered_map<std::string, int> indexes;
+    std::unordered_map<std::string, Exchange> exchanges;
+    std::string entry;
+};
+
+#endif //RABBIT_ROUTER_H
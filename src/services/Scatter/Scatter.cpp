@@ -0,0 +1,209 @@
+#include "Scatter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+void Scatter::configure(const ScatterOptions &options) {
+    std::lock_guard<std::mutex> lock(mtx);
+    this->options = options;
+}
+
+bool Scatter::splittable(const std::string &func) {
+    std::lock_guard<std::mutex> lock(mtx);
+    return options.functions.count(func) != 0;
+}
+
+std::string Scatter::partID(const std::string &parent, size_t index) {
+    return parent + "#" + std::to_string(index);
+}
+
+std::vector<Scatter::Part> Scatter::split(const std::string &func, const std::string &input, size_t workers) {
+    size_t count;
+    double perElement = 0;
+    double target;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (options.functions.count(func) == 0 || workers < 2) {
+            return {};
+        }
+        count = workers * std::max<size_t>(options.partsPerWorker, 1);
+        auto cost = costs.find(func);
+        if (cost != costs.end()) {
+            perElement = cost->second;
+        }
+        target = std::chrono::duration<double, std::micro>(options.targetPart).count();
+    }
+
+    json array;
+    try {
+        array = json::parse(input);
+    } catch (json::exception &) {
+        return {};
+    }
+    if (!array.is_array()) {
+        return {};
+    }
+    size_t elements = array.size();
+    if (perElement > 0 && target > 0) {
+        // cheap elements are not worth a part each, parts of about target are
+        auto byCost = static_cast<size_t>(std::ceil(static_cast<double>(elements) * perElement / target));
+        count = std::min(count, std::max<size_t>(byCost, 1));
+    }
+    count = std::min(count, elements);
+    if (count < 2) {
+        return {};
+    }
+
+    std::vector<Part> result;
+    result.reserve(count);
+    size_t begin = 0;
+    for (size_t i = 0; i < count; i++) {
+        // the first elements % count parts take one element more
+        size_t size = elements / count + (i < elements % count ? 1 : 0);
+        json range(json::value_t::array);
+        for (size_t j = begin; j < begin + size; j++) {
+            range.push_back(std::move(array[j]));
+        }
+        result.push_back({range.dump(), size});
+        begin += size;
+    }
+    return result;
+}
+
+void Scatter::track(const std::string &parent, const std::string &func, const std::vector<std::string> &ids,
+                    const std::vector<Part> &parts) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Split &split = splits[parent];
+    split.func = func;
+    split.ids = ids;
+    split.outputs.assign(ids.size(), "");
+    split.finished.assign(ids.size(), false);
+    split.pending = ids.size();
+    auto now = Clock::now();
+    for (size_t i = 0; i < ids.size(); i++) {
+        this->parts[ids[i]] = {parent, i, parts[i].elements, now};
+    }
+}
+
+void Scatter::started(const std::string &id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = parts.find(id);
+    if (it != parts.end()) {
+        it->second.started = Clock::now();
+    }
+}
+
+Scatter::State Scatter::complete(const std::string &id, bool done, const char *data, size_t size,
+                                 Gathered &gathered) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = parts.find(id);
+    if (it == parts.end()) {
+        return abandoned.erase(id) != 0 ? State::Abandoned : State::NotPart;
+    }
+    PartState part = it->second;
+    parts.erase(it);
+    Split &split = splits.at(part.parent);
+    gathered.parent = part.parent;
+
+    if (!done) {
+        gathered.output.assign(data, size);
+        for (size_t i = 0; i < split.ids.size(); i++) {
+            if (!split.finished[i] && i != part.index) {
+                gathered.remaining.push_back(split.ids[i]);
+            }
+        }
+        forget(part.parent, split);
+        return State::Failed;
+    }
+
+    if (part.elements > 0) {
+        double perElement = std::chrono::duration<double, std::micro>(Clock::now() - part.started).count() /
+                            static_cast<double>(part.elements);
+        auto cost = costs.try_emplace(split.func, perElement);
+        if (!cost.second) {
+            cost.first->second = 0.8 * cost.first->second + 0.2 * perElement;
+        }
+    }
+    split.outputs[part.index].assign(data, size);
+    split.finished[part.index] = true;
+    if (--split.pending > 0) {
+        return State::Pending;
+    }
+
+    bool joined = gather(split.outputs, gathered.output);
+    splits.erase(part.parent);
+    if (!joined) {
+        gathered.output = "a part did not return a JSON array";
+        return State::Failed;
+    }
+    return State::Done;
+}
+
+std::vector<std::string> Scatter::abandon(const std::string &parent) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = splits.find(parent);
+    if (it == splits.end()) {
+        return {};
+    }
+    std::vector<std::string> remaining;
+    for (size_t i = 0; i < it->second.ids.size(); i++) {
+        if (!it->second.finished[i]) {
+            remaining.push_back(it->second.ids[i]);
+        }
+    }
+    forget(parent, it->second);
+    return remaining;
+}
+
+void Scatter::forget(const std::string &parent, const Split &split) {
+    for (size_t i = 0; i < split.ids.size(); i++) {
+        if (parts.erase(split.ids[i]) != 0) {
+            abandoned.insert(split.ids[i]);
+        }
+    }
+    splits.erase(parent);
+}
+
+void Scatter::settled(const std::string &id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    abandoned.erase(id);
+}
+
+std::chrono::microseconds Scatter::cost(const std::string &func) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = costs.find(func);
+    return std::chrono::microseconds(it == costs.end() ? 0 : static_cast<int64_t>(it->second));
+}
+
+bool Scatter::gather(const std::vector<std::string> &outputs, std::string &output) {
+    // the arrays are joined as text, the elements are not parsed
+    size_t size = 2;
+    for (const auto &part: outputs) {
+        size += part.size();
+    }
+    output.clear();
+    output.reserve(size);
+    output += '[';
+    bool empty = true;
+    for (const auto &part: outputs) {
+        size_t first = part.find_first_not_of(" \t\r\n");
+        size_t last = part.find_last_not_of(" \t\r\n");
+        if (first == std::string::npos || part[first] != '[' || part[last] != ']') {
+            return false;
+        }
+        size_t inner = part.find_first_not_of(" \t\r\n", first + 1);
+        if (inner == last) {
+            continue; // []
+        }
+        if (!empty) {
+            output += ',';
+        }
+        output.append(part, first + 1, last - first - 1);
+        empty = false;
+    }
+    output += ']';
+    return true;
+}
@@ -0,0 +1,113 @@
+#ifndef RABBIT_SCATTER_H
+#define RABBIT_SCATTER_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct ScatterOptions {
+    // functions whose input is a JSON array and whose output is a JSON array with one element
+    // per input element, so any range of the input can run on its own
+    std::unordered_set<std::string> functions;
+    // how long one part should run once the cost of an element is known
+    std::chrono::milliseconds targetPart{200};
+    // parts per worker at most, more than one evens out slow and fast workers
+    size_t partsPerWorker = 2;
+};
+
+// Splits tasks of splittable functions into parts by element range and gathers the outputs
+// of the parts, in order, into the output of the whole task. The number of parts follows the
+// worker count and the measured time per element of the function. Thread safe
+class Scatter {
+public:
+    struct Part {
+        std::string input;
+        size_t elements;
+    };
+
+    enum class State {
+        // not a part of a split task
+        NotPart,
+        // other parts are still running
+        Pending,
+        // every part is done, the gathered output is ready
+        Done,
+        // the part failed, so does the task, the remaining parts are no longer needed
+        Failed,
+        // a remaining part of a failed or abandoned task, its result is dropped
+        Abandoned,
+    };
+
+    struct Gathered {
+        std::string parent;
+        // the output of the task, or the error of the failed part
+        std::string output;
+        // parts without a result, when the task failed
+        std::vector<std::string> remaining;
+    };
+
+    void configure(const ScatterOptions &options);
+
+    bool splittable(const std::string &func);
+
+    // Parts of the input for the given number of workers, empty if the task is better run whole
+    std::vector<Part> split(const std::string &func, const std::string &input, size_t workers);
+
+    // the task was split into parts with these ids, in input order
+    void track(const std::string &parent, const std::string &func, const std::vector<std::string> &ids,
+               const std::vector<Part> &parts);
+
+    // the part was sent to a worker, its time per element is measured from now
+    void started(const std::string &id);
+
+    State complete(const std::string &id, bool done, const char *data, size_t size, Gathered &gathered);
+
+    // the task is given up, returns its parts without a result. Empty if it was not split
+    std::vector<std::string> abandon(const std::string &parent);
+
+    // A remaining part was finished by the caller, no result of it can be accepted any more.
+    // Until then a result that races in is reported as Abandoned
+    void settled(const std::string &id);
+
+    // measured time per element of the function, 0 until a part of it finished
+    std::chrono::microseconds cost(const std::string &func);
+
+    static std::string partID(const std::string &parent, size_t index);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Split {
+        std::string func;
+        std::vector<std::string> ids;
+        std::vector<std::string> outputs;
+        std::vector<bool> finished;
+        size_t pending;
+    };
+
+    struct PartState {
+        std::string parent;
+        size_t index;
+        size_t elements;
+        Clock::time_point started;
+    };
+
+    std::mutex mtx;
+    ScatterOptions options;
+    std::unordered_map<std::string, Split> splits;
+    std::unordered_map<std::string, PartState> parts;
+    std::unordered_set<std::string> abandoned;
+    // moving average of µs per element
+    std::unordered_map<std::string, double> costs;
+
+    // called with mtx held
+    void forget(const std::string &parent, const Split &split);
+
+    static bool gather(const std::vector<std::string> &outputs, std::string &output);
+};
+
+#endif //RABBIT_SCATTER_H
@@ -0,0 +1,32 @@
+#include "Singleflight.h"
+
+bool Singleflight::join(Key key, const std::string &id, const std::string &clientId) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = flights.find(key);
+    if (it == flights.end()) {
+        flights.emplace(key, Flight{key, id, {}});
+        leaders[id] = key;
+        return true;
+    }
+    it->second.waiters.push_back({id, clientId});
+    waiters++;
+    return false;
+}
+
+bool Singleflight::complete(const std::string &leader, Flight &flight) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = leaders.find(leader);
+    if (it == leaders.end()) {
+        return false;
+    }
+    auto node = flights.extract(it->second);
+    leaders.erase(it);
+    flight = std::move(node.mapped());
+    waiters -= flight.waiters.size();
+    return true;
+}
+
+size_t Singleflight::waiting() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return waiters;
+}
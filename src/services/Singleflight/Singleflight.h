@@ -0,0 +1,45 @@
+#ifndef RABBIT_SINGLEFLIGHT_H
+#define RABBIT_SINGLEFLIGHT_H
+
+#include "utils/Hash.h"
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Identical tasks that are queued or running at the same time. The first task with a key
+// leads, later ones wait for its result and are answered with it under their own ids.
+// Keys are equal only if both hashes and the input size are.
+// Thread safe
+class Singleflight {
+public:
+    using Key = ContentKey;
+
+    struct Waiter {
+        std::string id;
+        std::string clientId;
+    };
+
+    struct Flight {
+        Key key;
+        std::string leader;
+        std::vector<Waiter> waiters;
+    };
+
+    // true if the task leads the key, false if it waits for the leader
+    bool join(Key key, const std::string &id, const std::string &clientId);
+
+    // Forgets the flight the task leads, the next task with its key leads a new one.
+    // false if the task leads nothing
+    bool complete(const std::string &leader, Flight &flight);
+
+    size_t waiting();
+
+private:
+    std::mutex mtx;
+    std::unordered_map<Key, Flight, ContentKeyHash> flights;
+    std::unordered_map<std::string, Key> leaders;
+    size_t waiters = 0;
+};
+
+#endif //RABBIT_SINGLEFLIGHT_H
@@ -0,0 +1,549 @@
+#include "TaskLog.h"
+#include "protocol/Crc32c.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+    enum RecordType : uint8_t {
+        Put = 1,
+        Status = 2,
+        Remove = 3,
+        Assign = 4,
+        Result = 5,
+    };
+
+    const uint32_t SNAPSHOT_MAGIC = 0x53544252; // "RBTS"
+    const uint32_t SNAPSHOT_VERSION = 1;
+    // record header: payload size and its crc32c
+    const size_t RECORD_HEADER = 8;
+    const size_t MAX_RECORD = 1u << 30;
+    // the writer does not wait for the commit interval once this much is buffered
+    const size_t GROUP_BYTES = 1u << 20;
+
+    template<typename T>
+    void put(std::string &out, T value) {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    void putString(std::string &out, const std::string &value) {
+        put<uint32_t>(out, static_cast<uint32_t>(value.size()));
+        out.append(value);
+    }
+
+    void putTask(std::string &out, const Task &task) {
+        putString(out, task.id);
+        putString(out, task.func);
+        putString(out, task.input);
+        putString(out, task.output);
+        put<int32_t>(out, task.cores);
+        put<uint8_t>(out, static_cast<uint8_t>(task.status));
+        putString(out, task.worker_hash_id);
+        putString(out, task.client_hash_id);
+    }
+
+    struct Reader {
+        const char *p;
+        const char *end;
+        bool ok = true;
+
+        template<typename T>
+        T get() {
+            T value{};
+            if (end - p < static_cast<ptrdiff_t>(sizeof(T))) {
+                ok = false;
+                return value;
+            }
+            std::memcpy(&value, p, sizeof(T));
+            p += sizeof(T);
+            return value;
+        }
+
+        std::string getString() {
+            uint32_t size = get<uint32_t>();
+            if (!ok || static_cast<size_t>(end - p) < size) {
+                ok = false;
+                return {};
+            }
+            std::string value(p, size);
+            p += size;
+            return value;
+        }
+
+        Task getTask() {
+            Task task;
+            task.id = getString();
+            task.func = getString();
+            task.input = getString();
+            task.output = getString();
+            task.cores = get<int32_t>();
+            task.status = static_cast<TaskStatus>(get<uint8_t>());
+            task.worker_hash_id = getString();
+            task.client_hash_id = getString();
+            return task;
+        }
+    };
+
+    // tasks-<number>.wal
+    bool parseSegment(const fs::path &path, uint64_t &number) {
+        std::string name = path.filename().string();
+        if (name.size() <= 10 || name.compare(0, 6, "tasks-") != 0 || name.compare(name.size() - 4, 4, ".wal") != 0) {
+            return false;
+        }
+        std::string digits = name.substr(6, name.size() - 10);
+        if (!std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            return false;
+        }
+        number = std::stoull(digits);
+        return true;
+    }
+
+    std::string readFile(const std::string &path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Unable to open file " + path);
+        }
+        return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    }
+
+    // false if the data may not be on disk
+    bool syncFile(std::FILE *file) {
+        if (std::fflush(file) != 0) return false;
+#ifdef _WIN32
+        return _commit(_fileno(file)) == 0;
+#else
+        return fsync(fileno(file)) == 0;
+#endif
+    }
+
+    // table rebuilt during recovery, keeps the order tasks were added in.
+    // Removed tasks are left with an empty id until the end
+    struct Table {
+        std::vector<Task> tasks;
+        std::unordered_map<std::string, size_t> index;
+
+        void remove(const std::string &id) {
+            auto it = index.find(id);
+            if (it != index.end()) {
+                tasks[it->second].id.clear();
+                index.erase(it);
+            }
+        }
+
+        std::vector<Task> live() {
+            std::vector<Task> result;
+            result.reserve(index.size());
+            for (auto &task: tasks) {
+                if (!task.id.empty()) result.push_back(std::move(task));
+            }
+            return result;
+        }
+
+        void put(Task task) {
+            auto it = index.find(task.id);
+            if (it != index.end()) {
+                tasks[it->second] = std::move(task);
+                return;
+            }
+            index.emplace(task.id, tasks.size());
+            tasks.push_back(std::move(task));
+        }
+
+        void setStatus(const std::string &id, TaskStatus status) {
+            auto it = index.find(id);
+            if (it != index.end()) {
+                tasks[it->second].status = status;
+            }
+        }
+
+        void assign(const std::string &id, std::string worker) {
+            auto it = index.find(id);
+            if (it != index.end()) {
+                tasks[it->second].worker_hash_id = std::move(worker);
+                tasks[it->second].status = TaskStatus::SentToWorker;
+            }
+        }
+
+        void setResult(const std::string &id, TaskStatus status, std::string output) {
+            auto it = index.find(id);
+            if (it != index.end()) {
+                tasks[it->second].output = std::move(output);
+                tasks[it->second].status = status;
+            }
+        }
+    };
+}
+
+TaskLog::TaskLog(const TaskLogOptions &options) : options(options) {
+}
+
+std::string TaskLog::segmentPath(uint64_t number) const {
+    return (fs::path(options.directory) / ("tasks-" + std::to_string(number) + ".wal")).string();
+}
+
+std::string TaskLog::snapshotPath() const {
+    return (fs::path(options.directory) / "tasks.snap").string();
+}
+
+std::vector<Task> TaskLog::recover() {
+    if (opened) {
+        throw std::runtime_error("Task log is already opened");
+    }
+    fs::create_directories(options.directory);
+
+    Table table;
+    uint64_t lastLsn = 0;
+
+    if (fs::exists(snapshotPath())) {
+        std::string image = readFile(snapshotPath());
+        if (image.size() < sizeof(uint32_t) ||
+            STIP::crc32c(image.data(), image.size() - sizeof(uint32_t)) !=
+            Reader{image.data() + image.size() - sizeof(uint32_t), image.data() + image.size()}.get<uint32_t>()) {
+            throw std::runtime_error("Task snapshot is corrupted: " + snapshotPath());
+        }
+        Reader reader{image.data(), image.data() + image.size() - sizeof(uint32_t)};
+        if (reader.get<uint32_t>() != SNAPSHOT_MAGIC || reader.get<uint32_t>() != SNAPSHOT_VERSION) {
+            throw std::runtime_error("Unknown task snapshot format: " + snapshotPath());
+        }
+        lastLsn = reader.get<uint64_t>();
+        auto count = reader.get<uint64_t>();
+        for (uint64_t i = 0; i < count && reader.ok; i++) {
+            table.put(reader.getTask());
+        }
+        if (!reader.ok) {
+            throw std::runtime_error("Task snapshot is truncated: " + snapshotPath());
+        }
+    }
+
+    std::vector<uint64_t> segments;
+    for (auto &entry: fs::directory_iterator(options.directory)) {
+        uint64_t number;
+        if (parseSegment(entry.path(), number)) {
+            segments.push_back(number);
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+
+    bool torn = false;
+    for (uint64_t number: segments) {
+        segmentNumber = number;
+        if (torn) {
+            // written after a broken record, cannot be applied in order
+            std::cerr << "[!] TaskLog: dropping segment " << segmentPath(number) << std::endl;
+            fs::remove(segmentPath(number));
+            continue;
+        }
+
+        std::string data = readFile(segmentPath(number));
+        if (data.empty()) {
+            fs::remove(segmentPath(number));
+            continue;
+        }
+        size_t offset = 0;
+        while (offset < data.size()) {
+            Reader header{data.data() + offset, data.data() + data.size()};
+            auto size = header.get<uint32_t>();
+            auto crc = header.get<uint32_t>();
+            if (!header.ok || size > MAX_RECORD || data.size() - offset - RECORD_HEADER < size ||
+                STIP::crc32c(header.p, size) != crc) {
+                torn = true;
+                break;
+            }
+
+            Reader record{header.p, header.p + size};
+            auto lsn = record.get<uint64_t>();
+            auto type = record.get<uint8_t>();
+            if (type == Put) {
+                Task task = record.getTask();
+                if (record.ok && lsn > lastLsn) table.put(std::move(task));
+            } else if (type == Status) {
+                std::string id = record.getString();
+                auto status = static_cast<TaskStatus>(record.get<uint8_t>());
+                if (record.ok && lsn > lastLsn) table.setStatus(id, status);
+            } else if (type == Remove) {
+                std::string id = record.getString();
+                if (record.ok && lsn > lastLsn) table.remove(id);
+            } else if (type == Assign) {
+                std::string id = record.getString();
+                std::string worker = record.getString();
+                if (record.ok && lsn > lastLsn) table.assign(id, std::move(worker));
+            } else if (type == Result) {
+                std::string id = record.getString();
+                auto status = static_cast<TaskStatus>(record.get<uint8_t>());
+                std::string output = record.getString();
+                if (record.ok && lsn > lastLsn) table.setResult(id, status, std::move(output));
+            } else {
+                record.ok = false;
+            }
+            if (!record.ok) {
+                torn = true;
+                break;
+            }
+            lastLsn = std::max(lastLsn, lsn);
+            offset += RECORD_HEADER + size;
+        }
+
+        if (torn) {
+            std::cerr << "[!] TaskLog: " << segmentPath(number) << " is cut at " << offset << " of "
+                      << data.size() << " bytes" << std::endl;
+            fs::resize_file(segmentPath(number), offset);
+        }
+    }
+
+    nextLsn = lastLsn + 1;
+    durableLsn = lastLsn;
+    openSegment(segmentNumber + 1);
+    opened = true;
+    writer = std::thread(&TaskLog::run, this);
+
+    return table.live();
+}
+
+void TaskLog::openSegment(uint64_t number) {
+    // records keep going to the current segment if the next one can not be opened
+    std::FILE *next = std::fopen(segmentPath(number).c_str(), "ab");
+    if (next == nullptr) {
+        throw std::runtime_error("Unable to open file " + segmentPath(number));
+    }
+    if (segment != nullptr) {
+        std::fclose(segment);
+    }
+    segment = next;
+    segmentNumber = number;
+}
+
+uint64_t TaskLog::append(std::string &record) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!opened || stopping) {
+        throw std::runtime_error("Task log is not opened");
+    }
+    uint64_t lsn = nextLsn++;
+    // lsn is the first field of the payload
+    std::memcpy(&record[RECORD_HEADER], &lsn, sizeof(lsn));
+    auto size = static_cast<uint32_t>(record.size() - RECORD_HEADER);
+    uint32_t crc = STIP::crc32c(record.data() + RECORD_HEADER, size);
+    std::memcpy(&record[0], &size, sizeof(size));
+    std::memcpy(&record[sizeof(size)], &crc, sizeof(crc));
+
+    buffer += record;
+    sinceSnapshot++;
+    if (buffer.size() >= GROUP_BYTES) {
+        writeCv.notify_one();
+    }
+    return lsn;
+}
+
+uint64_t TaskLog::appendPut(const Task &task) {
+    std::string record(RECORD_HEADER + sizeof(uint64_t), '\0');
+    put<uint8_t>(record, Put);
+    putTask(record, task);
+    return append(record);
+}
+
+uint64_t TaskLog::appendStatus(const std::string &id, TaskStatus status) {
+    std::string record(RECORD_HEADER + sizeof(uint64_t), '\0');
+    put<uint8_t>(record, Status);
+    putString(record, id);
+    put<uint8_t>(record, static_cast<uint8_t>(status));
+    return append(record);
+}
+
+uint64_t TaskLog::appendRemove(const std::string &id) {
+    std::string record(RECORD_HEADER + sizeof(uint64_t), '\0');
+    put<uint8_t>(record, Remove);
+    putString(record, id);
+    return append(record);
+}
+
+uint64_t TaskLog::appendAssign(const std::string &id, const std::string &worker) {
+    std::string record(RECORD_HEADER + sizeof(uint64_t), '\0');
+    put<uint8_t>(record, Assign);
+    putString(record, id);
+    putString(record, worker);
+    return append(record);
+}
+
+uint64_t TaskLog::appendResult(const std::string &id, TaskStatus status, const std::string &output) {
+    std::string record(RECORD_HEADER + sizeof(uint64_t), '\0');
+    record.reserve(record.size() + id.size() + output.size() + 16);
+    put<uint8_t>(record, Result);
+    putString(record, id);
+    put<uint8_t>(record, static_cast<uint8_t>(status));
+    putString(record, output);
+    return append(record);
+}
+
+uint64_t TaskLog::durable() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return durableLsn;
+}
+
+bool TaskLog::failed() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return writeFailed;
+}
+
+size_t TaskLog::pendingRecords() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return sinceSnapshot;
+}
+
+uint64_t TaskLog::lastLsn() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return nextLsn - 1;
+}
+
+bool TaskLog::snapshotDue(size_t liveTasks) {
+    std::lock_guard<std::mutex> lock(mtx);
+    // rewriting the table after as many records as it has tasks keeps this O(1) per record
+    return sinceSnapshot >= std::max(liveTasks, options.minSnapshotRecords);
+}
+
+void TaskLog::snapshot(std::vector<Task> tasks) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!opened || stopping) {
+        throw std::runtime_error("Task log is not opened");
+    }
+    // everything appended so far stays in the current segment, the rest goes to the next one
+    sealed.push_back({std::move(buffer), nextLsn - 1,
+                      std::make_unique<Snapshot>(Snapshot{nextLsn - 1, std::move(tasks)})});
+    buffer.clear();
+    sinceSnapshot = 0;
+    writeCv.notify_one();
+}
+
+void TaskLog::write(const std::string &records) {
+    if (records.empty()) {
+        return;
+    }
+    if (std::fwrite(records.data(), 1, records.size(), segment) != records.size()) {
+        throw std::runtime_error("write to " + segmentPath(segmentNumber) + " failed");
+    }
+}
+
+void TaskLog::sync() {
+    if (!syncFile(segment)) {
+        throw std::runtime_error("sync of " + segmentPath(segmentNumber) + " failed");
+    }
+}
+
+void TaskLog::writeSnapshot(const Snapshot &snapshot) {
+    std::string image;
+    put<uint32_t>(image, SNAPSHOT_MAGIC);
+    put<uint32_t>(image, SNAPSHOT_VERSION);
+    put<uint64_t>(image, snapshot.lsn);
+    put<uint64_t>(image, snapshot.tasks.size());
+    for (auto &task: snapshot.tasks) {
+        putTask(image, task);
+    }
+    put<uint32_t>(image, STIP::crc32c(image.data(), image.size()));
+
+    std::string tmpPath = snapshotPath() + ".tmp";
+    std::FILE *file = std::fopen(tmpPath.c_str(), "wb");
+    if (file == nullptr) {
+        std::cerr << "[!] TaskLog: unable to open " << tmpPath << std::endl;
+        return;
+    }
+    bool written = std::fwrite(image.data(), 1, image.size(), file) == image.size();
+    written = syncFile(file) && written;
+    std::fclose(file);
+    if (!written) {
+        std::cerr << "[!] TaskLog: write to " << tmpPath << " failed" << std::endl;
+        return;
+    }
+    fs::rename(tmpPath, snapshotPath());
+
+    // the snapshot covers every segment before the current one
+    std::vector<fs::path> covered;
+    for (auto &entry: fs::directory_iterator(options.directory)) {
+        uint64_t number;
+        if (parseSegment(entry.path(), number) && number < segmentNumber) {
+            covered.push_back(entry.path());
+        }
+    }
+    for (auto &path: covered) {
+        fs::remove(path);
+    }
+}
+
+void TaskLog::run() {
+    std::unique_lock<std::mutex> lock(mtx);
+    for (;;) {
+        writeCv.wait_for(lock, options.commitInterval, [this] {
+            return stopping || !sealed.empty() || buffer.size() >= GROUP_BYTES;
+        });
+        if (buffer.empty() && sealed.empty()) {
+            if (stopping) break;
+            continue;
+        }
+
+        std::deque<Sealed> rotations = std::move(sealed);
+        sealed.clear();
+        std::string records = std::move(buffer);
+        buffer.clear();
+        uint64_t lastLsn = nextLsn - 1;
+        lock.unlock();
+
+        try {
+            for (auto &rotation: rotations) {
+                write(rotation.records);
+                sync();
+                try {
+                    openSegment(segmentNumber + 1);
+                } catch (std::exception &e) {
+                    // the records stay durable in the current segment, only the compaction is skipped
+                    std::cerr << "[!] TaskLog: " << e.what() << ", no snapshot taken" << std::endl;
+                    continue;
+                }
+                writeSnapshot(*rotation.snapshot);
+            }
+            write(records);
+            sync();
+            lock.lock();
+        } catch (std::exception &e) {
+            std::cerr << "[!] TaskLog: " << e.what() << std::endl;
+            lock.lock();
+            writeFailed = true;
+        }
+        if (!writeFailed) {
+            durableLsn = lastLsn;
+        }
+    }
+}
+
+void TaskLog::close() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!opened || stopping) {
+            return;
+        }
+        stopping = true;
+    }
+    writeCv.notify_one();
+    writer.join();
+
+    std::lock_guard<std::mutex> lock(mtx);
+    opened = false;
+    if (segment != nullptr) {
+        std::fclose(segment);
+        segment = nullptr;
+    }
+}
+
+TaskLog::~TaskLog() {
+    close();
+}
@@ -0,0 +1,122 @@
+#ifndef RABBIT_TASKLOG_H
+#define RABBIT_TASKLOG_H
+
+#include "DataModel/Task.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct TaskLogOptions {
+    std::string directory = ".";
+    // records appended within this window share one fsync. Nobody waits for it: a crash loses
+    // the records of the last window, tasks accepted in it are not recovered
+    std::chrono::milliseconds commitInterval{2};
+    // the log is compacted once it has more records than the table has tasks, but not below this
+    size_t minSnapshotRecords = 4096;
+};
+
+// Append-only write-ahead log of task transitions.
+// Records are binary and checksummed, a writer thread flushes them in groups.
+// A snapshot of the whole table is written next to the log, after that older log
+// segments are deleted. Recovery loads the snapshot and replays the records after it
+class TaskLog {
+public:
+    explicit TaskLog(const TaskLogOptions &options);
+
+    // Loads the last state, cuts a torn tail and starts a new segment for appending.
+    // Must be called once before anything is appended
+    std::vector<Task> recover();
+
+    // Both return the record number, appending never waits for the disk
+    uint64_t appendPut(const Task &task);
+
+    uint64_t appendStatus(const std::string &id, TaskStatus status);
+
+    uint64_t appendRemove(const std::string &id);
+
+    // the task was sent to a worker
+    uint64_t appendAssign(const std::string &id, const std::string &worker);
+
+    uint64_t appendResult(const std::string &id, TaskStatus status, const std::string &output);
+
+    // number of the last record known to be on disk
+    uint64_t durable();
+
+    // A write or fsync failed. Nothing appended since is counted as durable, later records may
+    // still reach the file but recovery stops at the first one that did not
+    bool failed();
+
+    // Records appended since the last snapshot
+    size_t pendingRecords();
+
+    // number of the last record appended, 0 if none
+    uint64_t lastLsn();
+
+    // The log has outgrown a table of liveTasks tasks and should be compacted
+    bool snapshotDue(size_t liveTasks);
+
+    // tasks must be the table state after every record appended so far.
+    // It is written by the writer thread
+    void snapshot(std::vector<Task> tasks);
+
+    void close();
+
+    ~TaskLog();
+
+private:
+    struct Snapshot {
+        uint64_t lsn;
+        std::vector<Task> tasks;
+    };
+
+    // records that go to the current segment before it is rotated for a snapshot
+    struct Sealed {
+        std::string records;
+        uint64_t lastLsn;
+        std::unique_ptr<Snapshot> snapshot;
+    };
+
+    TaskLogOptions options;
+
+    std::mutex mtx;
+    std::condition_variable writeCv;
+    std::string buffer;
+    std::deque<Sealed> sealed;
+    uint64_t nextLsn = 1;
+    uint64_t durableLsn = 0;
+    bool writeFailed = false;
+    size_t sinceSnapshot = 0;
+    bool stopping = false;
+    bool opened = false;
+
+    // used by the writer thread only
+    std::FILE *segment = nullptr;
+    uint64_t segmentNumber = 0;
+    std::thread writer;
+
+    std::string segmentPath(uint64_t number) const;
+
+    std::string snapshotPath() const;
+
+    uint64_t append(std::string &record);
+
+    void openSegment(uint64_t number);
+
+    // both throw if the records may not be on disk
+    void write(const std::string &records);
+
+    void sync();
+
+    void writeSnapshot(const Snapshot &snapshot);
+
+    void run();
+};
+
+#endif //RABBIT_TASKLOG_H
@@ -0,0 +1,252 @@
+#include "TaskQueue.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <tuple>
+
+const TaskQueue::Key TaskQueue::EMPTY = {UINT32_MAX, UINT64_MAX, UINT64_MAX};
+
+bool TaskQueue::Key::operator<(const Key &other) const {
+    return std::tie(rank, finish, seq) < std::tie(other.rank, other.finish, other.seq);
+}
+
+TaskQueue::TaskQueue() {
+    grow(64);
+}
+
+int TaskQueue::bucketOf(int cores) {
+    return std::max(cores, 1) - 1;
+}
+
+uint32_t TaskQueue::rankOf(int priority) {
+    return PRIORITIES - 1 - std::min(std::max(priority, 0), PRIORITIES - 1);
+}
+
+void TaskQueue::grow(size_t minBuckets) {
+    size_t newCapacity = std::max<size_t>(capacity, 1);
+    while (newCapacity < minBuckets) newCapacity *= 2;
+    if (newCapacity == capacity) return;
+
+    // the queue stays as it was if an allocation fails
+    buckets.resize(newCapacity);
+    tree.assign(2 * newCapacity, {EMPTY, -1});
+    capacity = newCapacity;
+    for (size_t i = 0; i < capacity; i++) {
+        if (!buckets[i].empty()) tree[capacity + i] = {buckets[i].begin()->first, static_cast<int>(i)};
+    }
+    for (size_t i = capacity - 1; i > 0; i--) {
+        tree[i] = tree[2 * i].key < tree[2 * i + 1].key ? tree[2 * i] : tree[2 * i + 1];
+    }
+}
+
+void TaskQueue::updateLeaf(int bucket) {
+    size_t i = capacity + bucket;
+    tree[i] = buckets[bucket].empty() ? Node{EMPTY, -1} : Node{buckets[bucket].begin()->first, bucket};
+    for (i /= 2; i > 0; i /= 2) {
+        tree[i] = tree[2 * i].key < tree[2 * i + 1].key ? tree[2 * i] : tree[2 * i + 1];
+    }
+}
+
+TaskQueue::Node TaskQueue::query(size_t limit) const {
+    Node best = {EMPTY, -1};
+    size_t l = capacity, r = capacity + std::min(limit, capacity);
+    while (l < r) {
+        if (l & 1) {
+            if (tree[l].key < best.key) best = tree[l];
+            l++;
+        }
+        if (r & 1) {
+            r--;
+            if (tree[r].key < best.key) best = tree[r];
+        }
+        l /= 2;
+        r /= 2;
+    }
+    return best;
+}
+
+void TaskQueue::enqueue(const Task &task) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    push(task);
+}
+
+void TaskQueue::enqueue(const std::vector<Task> &tasks) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    for (const auto &task: tasks) {
+        checkCores(task);
+    }
+    for (const auto &task: tasks) {
+        push(task);
+    }
+}
+
+void TaskQueue::checkCores(const Task &task) {
+    if (task.cores > MAX_CORES) {
+        throw std::invalid_argument("Task " + task.id + " needs " + std::to_string(task.cores) +
+                                    " cores, at most " + std::to_string(MAX_CORES) + " are allowed");
+    }
+}
+
+void TaskQueue::push(const Task &task) {
+    checkCores(task);
+    int bucket = bucketOf(task.cores);
+    grow(bucket + 1);
+
+    uint32_t rank = rankOf(task.priority);
+    Flow &flow = flows[task.client_hash_id];
+    // a client that was idle starts at the current virtual time, it gets no credit for the past
+    uint64_t start = std::max(virtualTime[rank], flow.lastFinish[rank]);
+    uint64_t finish = start + static_cast<uint64_t>(std::max(task.cores, 1)) * COST / flow.weight;
+    flow.lastFinish[rank] = finish;
+    flow.queued++;
+
+    Key key = {rank, finish, nextSeq++};
+    buckets[bucket].emplace(key, Entry{start, std::chrono::steady_clock::now(), task});
+    count++;
+    report.touch();
+    if (buckets[bucket].begin()->first.seq == key.seq) updateLeaf(bucket);
+}
+
+bool TaskQueue::isStarving(const Key &first, const Entry &entry) {
+    if (first.seq != starvingSeq) {
+        starvingSeq = first.seq;
+        bypassed = 0;
+    }
+    if (policy.maxBypass != 0 && bypassed >= policy.maxBypass) return true;
+    return policy.maxWait.count() != 0 &&
+           std::chrono::steady_clock::now() - entry.enqueued >= policy.maxWait;
+}
+
+Task TaskQueue::pop(int bucket) {
+    auto node = buckets[bucket].extract(buckets[bucket].begin());
+    Entry &entry = node.mapped();
+    uint32_t rank = node.key().rank;
+    virtualTime[rank] = std::max(virtualTime[rank], entry.start);
+
+    Flow &flow = flows[entry.task.client_hash_id];
+    int64_t wait = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - entry.enqueued).count();
+    flow.queued--;
+    flow.dequeued++;
+    flow.totalWait += wait;
+    flow.maxWait = std::max(flow.maxWait, wait);
+
+    count--;
+    report.touch();
+    updateLeaf(bucket);
+    return std::move(entry.task);
+}
+
+bool TaskQueue::tryDequeue(Task &task, int freeCores, const Claim &claim, int maxCores) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if (count == 0 || freeCores <= 0) return false;
+
+    Node first = tree[1];
+    Node fit = query(static_cast<size_t>(freeCores));
+    if (fit.bucket < 0) return false;
+
+    bool bypass = fit.key.seq != first.key.seq;
+    bool runnable = first.bucket < maxCores;
+    if (bypass && runnable && isStarving(first.key, buckets[first.bucket].begin()->second)) {
+        // cores are held back for the first task
+        return false;
+    }
+    if (claim && !claim(buckets[fit.bucket].begin()->second.task)) {
+        return false;
+    }
+    if (bypass) bypassed++;
+
+    task = pop(fit.bucket);
+    return true;
+}
+
+size_t TaskQueue::size() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return count;
+}
+
+void TaskQueue::setStarvationPolicy(const StarvationPolicy &policy) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    this->policy = policy;
+}
+
+void TaskQueue::setClientWeight(const std::string &client, int weight) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    flows[client].weight = std::max(weight, 1);
+}
+
+std::vector<ClientQueueStats> TaskQueue::clientStats() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return collectStats();
+}
+
+std::vector<ClientQueueStats> TaskQueue::collectStats() const {
+    std::vector<ClientQueueStats> stats;
+    stats.reserve(flows.size());
+    for (const auto &[client, flow]: flows) {
+        if (flow.queued == 0 && flow.dequeued == 0) continue;
+        int64_t average = flow.dequeued == 0 ? 0 : flow.totalWait / static_cast<int64_t>(flow.dequeued);
+        stats.push_back({client, flow.weight, flow.queued, flow.dequeued, std::chrono::microseconds(average),
+                         std::chrono::microseconds(flow.maxWait)});
+    }
+    std::sort(stats.begin(), stats.end(), [](const ClientQueueStats &a, const ClientQueueStats &b) {
+        return a.client < b.client;
+    });
+    return stats;
+}
+
+void TaskQueue::saveStateAsMarkdown(const std::string &filename) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    writeMarkdown(filename);
+}
+
+void TaskQueue::startReport(std::chrono::milliseconds interval, const std::string &filename) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    report.start(queueMutex, interval, [this, filename] { writeClientStats(filename); });
+}
+
+void TaskQueue::writeClientStats(const std::string &filename) {
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        throw std::runtime_error("Unable to open file");
+    }
+
+    file << "| Client | Weight | Queued | Dequeued | Average wait, ms | Max wait, ms |\n";
+    file << "|--------|--------|--------|----------|------------------|--------------|\n";
+    for (const auto &stats: collectStats()) {
+        file << "| " << stats.client << " | " << stats.weight << " | " << stats.queued << " | " << stats.dequeued
+             << " | " << stats.averageWait.count() / 1000 << " | " << stats.maxWait.count() / 1000 << " |\n";
+    }
+
+    file.close();
+}
+
+void TaskQueue::writeMarkdown(const std::string &filename) {
+    std::vector<std::pair<Key, const Entry *>> entries;
+    for (auto &bucket: buckets) {
+        for (auto &[key, entry]: bucket) entries.emplace_back(key, &entry);
+    }
+    std::sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        throw std::runtime_error("Unable to open file");
+    }
+
+    // Write the markdown table header, tasks in the order they would go out if all fit
+    file << "| Task ID | Cores Required | Description | Priority | Client |\n";
+    file << "|---------|----------------|-------------|----------|--------|\n";
+
+    for (const auto &[key, entry]: entries) {
+        file << "| " << entry->task.id << " | " << entry->task.cores << " | " << entry->task.func << " | "
+             << entry->task.priority << " | " << entry->task.client_hash_id << " |\n";
+    }
+
+    file.close();
+}
+
+TaskQueue::~TaskQueue() {
+    report.stop();
+}
@@ -1,66 +1,166 @@
 #ifndef RABBIT_TASKQUEUE_H
 #define RABBIT_TASKQUEUE_H
 
-#include "protocol/STIP.h"
-#include "server/STIPServer.h"
-#include "protocol/Connection.h"
-#include "DataModel/Message.h"
 #include "Task.h"
-#include <queue>
+#include "utils/PeriodicReport.h"
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <map>
 #include <mutex>
-#include <fstream>
-#include <sstream>
-#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
+// Big tasks are bypassed by smaller ones that fit a worker. Once the first pending task
+// has been bypassed maxBypass times or waited maxWait, only it can be dequeued and workers
+// keep their freed cores until one of them has enough. Zero disables the limit
+struct StarvationPolicy {
+    size_t maxBypass = 1000;
+    std::chrono::milliseconds maxWait{0};
+};
+
+// What the queue did for one client
+struct ClientQueueStats {
+    std::string client;
+    int weight;
+    // tasks waiting now
+    size_t queued;
+    uint64_t dequeued;
+    std::chrono::microseconds averageWait;
+    std::chrono::microseconds maxWait;
+};
+
+// Pending tasks bucketed by required cores. A higher priority class always goes first. Within
+// a class clients share the workers by weight: every task gets a virtual finish tag, its start
+// (the later of the class's virtual time and the client's previous finish) plus cores / weight,
+// and the smallest tag goes first, so a client with a million queued tasks does not hold back
+// one that just arrived. A segment tree over the buckets keeps the best key of each bucket head,
+// so the first task needing at most N cores is found in O(log C), C - the largest core count
+// seen, and taken from its bucket in O(log n)
 class TaskQueue {
 public:
-    void enqueue(const Task &task) {
-        std::lock_guard<std::mutex> lock(queueMutex);
-        taskQueue.push(task);
-        saveStateAsMarkdown("tasksQueue.md");
-    }
-
-    // Try to dequeue a task that meets the core requirement.
-    // Returns true and the task reference if successful,
-    // otherwise false and the task reference remains unchanged.
-    bool tryDequeue(Task &task, int requiredCores) {
-        std::lock_guard<std::mutex> lock(queueMutex);
-        if (!taskQueue.empty() && taskQueue.front().cores <= requiredCores) {
-            task = taskQueue.front();
-            taskQueue.pop();
-            saveStateAsMarkdown("tasksQueue.md");
-            return true;
-        }
-        return false;
-    }
-
-    void saveStateAsMarkdown(const std::string &filename) {
-//        std::lock_guard<std::mutex> lock(queueMutex);
-        std::ofstream file(filename);
-        if (!file.is_open()) {
-            throw std::runtime_error("Unable to open file");
-        }
-
-        // Write the markdown table header
-        file << "| Task ID | Cores Required | Description |\n";
-        file << "|---------|----------------|-------------|\n";
-
-        // Write each task as a row in the markdown table
-        std::queue<Task> tempQueue = taskQueue; // Copy the queue for iteration
-        while (!tempQueue.empty()) {
-            Task task = tempQueue.front();
-            tempQueue.pop();
-
-            // Assuming Task has getId(), getCores(), and getDescription() methods
-            file << "| " << task.id << " | " << task.cores << " | " << task.func << " |\n";
-        }
-
-        file.close();
-    }
+    // Task::priority is clamped to [0, PRIORITIES)
+    static const int PRIORITIES = 8;
+
+    // the most cores a task may need, there is a bucket for every count up to it
+    static const int MAX_CORES = 1 << 12;
+
+    TaskQueue();
+
+    // throws std::invalid_argument for a task needing more than MAX_CORES
+    void enqueue(const Task &task);
+
+    // all tasks become visible to dequeuers at once, in the given order. None is enqueued if
+    // one needs more than MAX_CORES
+    void enqueue(const std::vector<Task> &tasks);
+
+    // Called under the queue lock with the task about to be dequeued,
+    // returning false leaves it in the queue
+    using Claim = std::function<bool(const Task &)>;
+
+    // Dequeues the first task in fair order that needs at most freeCores. Cores are held back only
+    // for a starving task that needs at most maxCores, the most any worker has: a bigger one
+    // could never run and would block the queue for good.
+    // Returns false and leaves the task unchanged if nothing fits or the claim fails
+    bool tryDequeue(Task &task, int freeCores, const Claim &claim = nullptr, int maxCores = INT_MAX);
+
+    size_t size();
+
+    void setStarvationPolicy(const StarvationPolicy &policy);
+
+    // share of a client relative to others in the same class, 1 by default. Applies to tasks
+    // enqueued from now on
+    void setClientWeight(const std::string &client, int weight);
+
+    // clients that have queued a task, in id order
+    std::vector<ClientQueueStats> clientStats();
+
+    void saveStateAsMarkdown(const std::string &filename);
+
+    // keeps the client stats in filename up to date
+    void startReport(std::chrono::milliseconds interval, const std::string &filename = "queue.md");
+
+    ~TaskQueue();
 
 private:
-    std::queue<Task> taskQueue;
+    // lower goes first
+    struct Key {
+        uint32_t rank; // PRIORITIES - 1 - priority
+        uint64_t finish;
+        uint64_t seq;
+
+        bool operator<(const Key &other) const;
+    };
+
+    struct Entry {
+        uint64_t start;
+        std::chrono::steady_clock::time_point enqueued;
+        Task task;
+    };
+
+    struct Node {
+        Key key;
+        int bucket;
+    };
+
+    struct Flow {
+        int weight = 1;
+        uint64_t lastFinish[PRIORITIES] = {};
+        size_t queued = 0;
+        uint64_t dequeued = 0;
+        int64_t totalWait = 0; // µs
+        int64_t maxWait = 0;
+    };
+
+    // a task of one core and weight 1 advances the virtual time by COST
+    static const uint64_t COST = 1 << 16;
+    static const Key EMPTY;
+
     std::mutex queueMutex;
+    std::vector<std::map<Key, Entry>> buckets; // index - required cores - 1
+    std::vector<Node> tree;                    // leaves at [capacity, 2 * capacity)
+    size_t capacity = 0;
+    size_t count = 0;
+    uint64_t nextSeq = 0;
+
+    // start tag of the last task dequeued from each class
+    uint64_t virtualTime[PRIORITIES] = {};
+    std::unordered_map<std::string, Flow> flows;
+
+    StarvationPolicy policy;
+    uint64_t starvingSeq = UINT64_MAX; // first task the bypass counter belongs to
+    size_t bypassed = 0;
+
+    PeriodicReport report;
+
+    static int bucketOf(int cores);
+
+    static uint32_t rankOf(int priority);
+
+    void grow(size_t minBuckets);
+
+    static void checkCores(const Task &task);
+
+    void updateLeaf(int bucket);
+
+    // best head among buckets [0, limit)
+    Node query(size_t limit) const;
+
+    bool isStarving(const Key &first, const Entry &entry);
+
+    void push(const Task &task);
+
+    Task pop(int bucket);
+
+
+    void writeMarkdown(const std::string &filename);
+
+    void writeClientStats(const std::string &filename);
+
+    // called with queueMutex held
+    std::vector<ClientQueueStats> collectStats() const;
 };
 
 #endif //RABBIT_TASKQUEUE_H
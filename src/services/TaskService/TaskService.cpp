@@ -1,59 +1,420 @@
 #include "TaskService.h"
 #include <fstream>
+#include <iostream>
 #include <sstream>
+#include <unordered_set>
 
 
 TaskService::TaskService() {
-    tasks = std::vector<Task>();
     // storage.sync_schema(); -- remove DB for now
 }
 
-void TaskService::addTask(Task task) {
+std::vector<Task> TaskService::open(const TaskLogOptions &options, std::chrono::milliseconds reportInterval) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (log) {
+        throw std::runtime_error("Task service is already opened");
+    }
+    log = std::make_unique<TaskLog>(options);
+
+    std::vector<Task> unfinished;
+    for (auto &task: log->recover()) {
+        if (tasks.find(task.id) != TaskStore::NONE) continue;
+        tasks.insert(task);
+        if (task.status == TaskStatus::Queued || task.status == TaskStatus::SentToWorker) {
+            unfinished.push_back(task);
+        }
+    }
+
+    this->reportInterval = reportInterval;
+    if (reportInterval.count() > 0) {
+        writeMarkdown(tasks.headers(), "tasks.md");
+        reportedLsn = log->lastLsn();
+        reporter = std::thread(&TaskService::runReporter, this);
+    }
+    return unfinished;
+}
+
+std::string TaskService::addTask(Task task) {
+    std::lock_guard<std::mutex> lock(mtx);
     if (task.id.empty()) {
         task.id = newTaskID();
     }
+    if (tasks.find(task.id) != TaskStore::NONE) {
+        throw std::runtime_error("Task already exists: " + task.id);
+    }
     task.status = TaskStatus::Queued;
-    tasks.push_back(task);
-    saveTasksToFile("tasks.md");
+    tasks.insert(task);
+    if (log) {
+        log->appendPut(task);
+        checkSnapshot();
+    }
+    return task.id;
+}
+
+std::vector<std::string> TaskService::addTasks(std::vector<Task> batch) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::unordered_set<std::string> ids;
+    for (auto &task: batch) {
+        if (task.id.empty()) {
+            task.id = newTaskID();
+        }
+        if (tasks.find(task.id) != TaskStore::NONE || !ids.insert(task.id).second) {
+            throw std::runtime_error("Task already exists: " + task.id);
+        }
+    }
 
+    std::vector<std::string> added;
+    added.reserve(batch.size());
+    for (auto &task: batch) {
+        if (task.status != TaskStatus::Created) {
+            task.status = TaskStatus::Queued;
+        }
+        tasks.insert(task);
+        if (log) {
+            log->appendPut(task);
+        }
+        added.push_back(std::move(task.id));
+    }
+    if (log) {
+        checkSnapshot();
+    }
+    return added;
 }
 
-void TaskService::updateTask(const Task &task) {
-    for (auto &t: tasks) {
-        if (t.id == task.id) {
-            t = task;
-            saveTasksToFile("tasks.md");
-            return;
+uint32_t TaskService::findSlot(const std::string &id) const {
+    uint32_t slot = tasks.find(id);
+    if (slot == TaskStore::NONE) {
+        throw std::runtime_error("Task not found");
+    }
+    return slot;
+}
+
+void TaskService::assign(uint32_t slot, const std::string &workerId) {
+    tasks.setWorker(slot, workerId);
+    tasks.setStatus(slot, TaskStatus::SentToWorker);
+    if (log) {
+        log->appendAssign(tasks.id(slot), workerId);
+    }
+}
+
+void TaskService::assignTask(const std::string &id, const std::string &workerId) {
+    std::lock_guard<std::mutex> lock(mtx);
+    assign(findSlot(id), workerId);
+    if (log) {
+        checkSnapshot();
+    }
+}
+
+std::vector<Task> TaskService::assignTasks(std::vector<std::string> &ids, const std::string &workerId) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<Task> finished;
+    size_t kept = 0;
+    for (auto &id: ids) {
+        uint32_t slot = findSlot(id);
+        TaskStatus status = tasks.status(slot);
+        if (status == TaskStatus::Ready || status == TaskStatus::Failed) {
+            finished.push_back(tasks.header(slot));
+            continue;
         }
+        assign(slot, workerId);
+        if (&ids[kept] != &id) {
+            ids[kept] = std::move(id);
+        }
+        kept++;
+    }
+    ids.resize(kept);
+    if (log) {
+        checkSnapshot();
     }
-    throw std::runtime_error("Task not found");
+    return finished;
 }
 
-void TaskService::changeTaskStatus(const std::string &id, TaskStatus status) {
-    for (auto &task: tasks) {
-        if (task.id == id) {
-            task.status = status;
-            saveTasksToFile("tasks.md");
-            return;
+bool TaskService::finishTask(const std::string &id, TaskStatus status, std::string output, Task &task,
+                             const std::string &workerId) {
+    std::lock_guard<std::mutex> lock(mtx);
+    uint32_t slot = findSlot(id);
+    task = tasks.header(slot);
+    if (task.status == TaskStatus::Ready || task.status == TaskStatus::Failed) {
+        return false;
+    }
+    if (log) {
+        log->appendResult(id, status, output);
+    }
+    tasks.setOutput(slot, std::move(output));
+    tasks.setWorker(slot, workerId);
+    tasks.setStatus(slot, status);
+    task.status = status;
+    evictFinished();
+    if (log) {
+        checkSnapshot();
+    }
+    return true;
+}
+
+bool TaskService::unassignTask(const std::string &id, const std::string &workerId, Task &task) {
+    std::lock_guard<std::mutex> lock(mtx);
+    uint32_t slot = findSlot(id);
+    task = tasks.header(slot);
+    if (task.status != TaskStatus::SentToWorker || task.worker_hash_id != workerId) {
+        return false;
+    }
+    tasks.setWorker(slot, "");
+    tasks.setStatus(slot, TaskStatus::Queued);
+    task.worker_hash_id = "";
+    task.status = TaskStatus::Queued;
+    if (log) {
+        log->appendStatus(id, TaskStatus::Queued);
+        checkSnapshot();
+    }
+    return true;
+}
+
+std::vector<Task> TaskService::unassignWorker(const std::string &workerId) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<Task> requeued;
+    for (uint32_t slot = tasks.first(TaskStatus::SentToWorker); slot != TaskStore::NONE;) {
+        // the slot moves to the Queued list, so the next one is taken first
+        uint32_t next = tasks.next(slot);
+        Task task = tasks.header(slot);
+        if (task.worker_hash_id == workerId) {
+            tasks.setWorker(slot, "");
+            tasks.setStatus(slot, TaskStatus::Queued);
+            if (log) {
+                log->appendStatus(task.id, TaskStatus::Queued);
+            }
+            task.worker_hash_id = "";
+            task.status = TaskStatus::Queued;
+            requeued.push_back(std::move(task));
         }
+        slot = next;
+    }
+    if (log && !requeued.empty()) {
+        checkSnapshot();
+    }
+    return requeued;
+}
+
+std::string TaskService::packTaskRequest(const std::string &id, WireFormat format) {
+    std::lock_guard<std::mutex> lock(mtx);
+    uint32_t slot = findSlot(id);
+    Task header = tasks.header(slot);
+    if (format == WireFormat::Json) {
+        struct TaskRequest request = {id, header.func, tasks.input(slot), header.cores};
+        return packMessage(MessageType::TaskRequest, request, format);
+    }
+    return ::packTaskRequest(id, header.func, header.cores, tasks.input(slot));
+}
+
+std::string TaskService::packTaskBatch(const std::vector<std::string> &ids, WireFormat format) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<uint32_t> slots;
+    slots.reserve(ids.size());
+    for (const auto &id: ids) {
+        slots.push_back(findSlot(id));
+    }
+
+    if (format == WireFormat::Json) {
+        struct TaskBatchRequest batch;
+        for (uint32_t slot: slots) {
+            Task header = tasks.header(slot);
+            batch.tasks.push_back({header.id, header.func, tasks.input(slot), header.cores});
+        }
+        return packMessage(MessageType::TaskBatchRequest, batch, format);
+    }
+
+    size_t payloadSize = 4;
+    for (uint32_t slot: slots) {
+        payloadSize += encodedSize(tasks.id(slot), tasks.func(slot), tasks.input(slot).size());
+    }
+    wire::Writer writer(wire::ENVELOPE_SIZE + payloadSize);
+    writer.envelope(MessageType::TaskBatchRequest, payloadSize);
+    writer.u32(static_cast<uint32_t>(slots.size()));
+    for (uint32_t slot: slots) {
+        writer.str(tasks.id(slot));
+        writer.str(tasks.func(slot));
+        writer.i32(tasks.coreCount(slot));
+        writer.str(tasks.input(slot));
+    }
+    return std::move(writer.result());
+}
+
+void TaskService::updateTask(const Task &task) {
+    std::lock_guard<std::mutex> lock(mtx);
+    uint32_t slot = tasks.find(task.id);
+    if (slot == TaskStore::NONE) {
+        throw std::runtime_error("Task not found");
+    }
+    tasks.update(slot, task);
+    if (log) {
+        log->appendPut(task);
+    }
+    evictFinished();
+    if (log) {
+        checkSnapshot();
+    }
+}
+
+void TaskService::changeTaskStatus(const std::string &id, TaskStatus status) {
+    std::lock_guard<std::mutex> lock(mtx);
+    uint32_t slot = tasks.find(id);
+    if (slot == TaskStore::NONE) {
+        throw std::runtime_error("Task not found");
+    }
+    tasks.setStatus(slot, status);
+    if (log) {
+        log->appendStatus(id, status);
+    }
+    evictFinished();
+    if (log) {
+        checkSnapshot();
     }
-    throw std::runtime_error("Task not found");
 }
 
 std::string TaskService::newTaskID() {
-    return "task-" + std::to_string(tasks.size());
+    // ids of evicted tasks are not reused
+    std::string id;
+    do {
+        id = "task-" + std::to_string(nextID++);
+    } while (tasks.find(id) != TaskStore::NONE);
+    return id;
 }
 
 Task TaskService::findTaskByID(std::string id) {
-    for (auto &task: tasks) {
-        if (task.id == id) {
-            return task;
+    std::lock_guard<std::mutex> lock(mtx);
+    uint32_t slot = tasks.find(id);
+    if (slot == TaskStore::NONE) {
+        throw std::runtime_error("Task not found");
+    }
+    return tasks.get(slot);
+}
+
+bool TaskService::findTaskHeader(const std::string &id, Task &task) {
+    std::lock_guard<std::mutex> lock(mtx);
+    uint32_t slot = tasks.find(id);
+    if (slot == TaskStore::NONE) {
+        return false;
+    }
+    task = tasks.header(slot);
+    return true;
+}
+
+bool TaskService::removeTask(const std::string &id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    uint32_t slot = tasks.find(id);
+    if (slot == TaskStore::NONE) {
+        return false;
+    }
+    tasks.erase(slot);
+    if (log) {
+        log->appendRemove(id);
+        checkSnapshot();
+    }
+    return true;
+}
+
+size_t TaskService::size() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return tasks.size();
+}
+
+size_t TaskService::countByStatus(TaskStatus status) {
+    std::lock_guard<std::mutex> lock(mtx);
+    return tasks.count(status);
+}
+
+void TaskService::setRetentionPolicy(const RetentionPolicy &policy) {
+    std::lock_guard<std::mutex> lock(mtx);
+    retention = policy;
+    if (archive.is_open()) {
+        archive.close();
+    }
+    if (!retention.archiveFile.empty()) {
+        archive.open(retention.archiveFile, std::ios::app);
+        if (!archive.is_open()) {
+            throw std::runtime_error("Unable to open file " + retention.archiveFile);
         }
     }
-    throw std::runtime_error("Task not found");
+    evictFinished();
+}
+
+void TaskService::evict(uint32_t slot) {
+    if (archive.is_open()) {
+        archive << json(tasks.get(slot)).dump() << '\n';
+    }
+    if (log) {
+        log->appendRemove(tasks.id(slot));
+    }
+    tasks.erase(slot);
+}
+
+void TaskService::evictFinished() {
+    // both lists are ordered by finish time, the older head goes first
+    auto oldest = [this]() {
+        uint32_t ready = tasks.first(TaskStatus::Ready);
+        uint32_t failed = tasks.first(TaskStatus::Failed);
+        if (ready == TaskStore::NONE) return failed;
+        if (failed == TaskStore::NONE) return ready;
+        return tasks.since(failed) < tasks.since(ready) ? failed : ready;
+    };
+
+    if (retention.maxFinished != 0) {
+        while (tasks.count(TaskStatus::Ready) + tasks.count(TaskStatus::Failed) > retention.maxFinished) {
+            evict(oldest());
+        }
+    }
+    if (retention.maxAge.count() != 0) {
+        auto deadline = std::chrono::steady_clock::now() - retention.maxAge;
+        for (uint32_t slot = oldest(); slot != TaskStore::NONE && tasks.since(slot) < deadline; slot = oldest()) {
+            evict(slot);
+        }
+    }
+}
+
+void TaskService::checkSnapshot() {
+    if (log->snapshotDue(tasks.size())) {
+        log->snapshot(tasks.all());
+    }
+}
+
+void TaskService::runReporter() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (!stopping) {
+        reporterCv.wait_for(lock, reportInterval);
+        if (stopping) break;
+        evictFinished();
+        checkSnapshot();
+        if (!logFailed && log->failed()) {
+            logFailed = true;
+            std::cerr << "[!] Task log failed, tasks after record " << log->durable()
+                      << " are not recovered after a restart" << std::endl;
+        }
+        uint64_t lsn = log->lastLsn();
+        if (lsn == reportedLsn) continue;
+        reportedLsn = lsn;
+
+        // inputs and outputs are not shown, the file is written off the lock
+        std::vector<Task> headers = tasks.headers();
+        lock.unlock();
+        try {
+            writeMarkdown(headers, "tasks.md");
+        } catch (std::exception &e) {
+            std::cerr << "[!] " << e.what() << std::endl;
+        }
+        lock.lock();
+    }
+}
+
+std::vector<Task> TaskService::headers() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return tasks.headers();
 }
 
 void TaskService::saveTasksToFile(const std::string &filename) {
+    std::lock_guard<std::mutex> lock(mtx);
+    writeMarkdown(tasks.headers(), filename);
+}
+
+void TaskService::writeMarkdown(const std::vector<Task> &tasks, const std::string &filename) {
     std::ofstream file(filename);
     if (!file.is_open()) {
         throw std::runtime_error("Unable to open file");
@@ -70,3 +431,28 @@ void TaskService::saveTasksToFile(const std::string &filename) {
 
     file.close();
 }
+
+void TaskService::close() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (stopping) return;
+        stopping = true;
+    }
+    reporterCv.notify_all();
+    if (reporter.joinable()) reporter.join();
+
+    std::lock_guard<std::mutex> lock(mtx);
+    if (log) {
+        if (reportInterval.count() > 0) {
+            writeMarkdown(tasks.headers(), "tasks.md");
+        }
+        log->close();
+    }
+    if (archive.is_open()) {
+        archive.close();
+    }
+}
+
+TaskService::~TaskService() {
+    close();
+}
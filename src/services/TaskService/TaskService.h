@@ -2,27 +2,132 @@
 #define RABBIT_TASKSERVICE_H
 
 #include "DataModel/Task.h"
+#include "DataModel/Message.h"
+#include "services/TaskLog/TaskLog.h"
+#include "TaskStore.h"
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
+// Finished (ready or failed) tasks are evicted oldest first once there are more than
+// maxFinished of them or they finished maxAge ago. Zero disables the limit.
+// Evicted tasks are appended to archiveFile as json lines, if it is set
+struct RetentionPolicy {
+    size_t maxFinished = 0;
+    std::chrono::seconds maxAge{0};
+    std::string archiveFile;
+};
+
 class TaskService {
 public:
     TaskService();
 
-    void addTask(Task task);
+    // Recovers the table from the log in options.directory and logs every change after that.
+    // tasks.md is refreshed at most once per reportInterval, 0 disables it.
+    // Returns tasks that were queued or sent to a worker when the server stopped
+    std::vector<Task> open(const TaskLogOptions &options, std::chrono::milliseconds reportInterval);
+
+    // Returns the id, a new one is generated if the task has none
+    std::string addTask(Task task);
+
+    // All or none: throws without adding anything if one of the ids is taken. Tasks are queued,
+    // except Created ones, which wait to be queued with updateTask.
+    // Returns the ids in the order of the tasks
+    std::vector<std::string> addTasks(std::vector<Task> tasks);
+
+    // Records that the task was sent to the worker
+    void assignTask(const std::string &id, const std::string &workerId);
+
+    // Tasks that got a result in the meantime are removed from ids and returned without
+    // being assigned: a worker presumed dead may still answer for a task that was requeued
+    std::vector<Task> assignTasks(std::vector<std::string> &ids, const std::string &workerId);
+
+    // Stores the first result of the task, later ones are dropped and false is returned.
+    // task gets the task without input and output either way, with the worker it was assigned to.
+    // The first result also records workerId, the one that produced it (empty if no worker did):
+    // copies of the task elsewhere are cancelled then, their late results release nothing
+    bool finishTask(const std::string &id, TaskStatus status, std::string output, Task &task,
+                    const std::string &workerId = "");
+
+    // Puts the task back to Queued if it is still assigned to the worker and has no result
+    bool unassignTask(const std::string &id, const std::string &workerId, Task &task);
+
+    // Puts every task of the worker that has no result back to Queued and returns them
+    std::vector<Task> unassignWorker(const std::string &workerId);
+
+    // TaskRequest message for the task, built from the stored input without extra copies
+    std::string packTaskRequest(const std::string &id, WireFormat format);
+
+    // TaskBatchRequest message with every task
+    std::string packTaskBatch(const std::vector<std::string> &ids, WireFormat format);
 
     void changeTaskStatus(const std::string &id, TaskStatus status);
 
     void updateTask(const Task &task);
 
+    // Forgets the task, it is not archived. false if there is none
+    bool removeTask(const std::string &id);
+
     Task findTaskByID(std::string id);
 
+    // the task without its input and output, false if there is none
+    bool findTaskHeader(const std::string &id, Task &task);
+
+    // every task without its input and output
+    std::vector<Task> headers();
+
     void saveTasksToFile(const std::string &filename);
 
+    void setRetentionPolicy(const RetentionPolicy &policy);
+
+    size_t size();
+
+    size_t countByStatus(TaskStatus status);
+
+    void close();
+
+    ~TaskService();
+
 private:
-    std::vector<Task> tasks;
+    std::mutex mtx;
+    TaskStore tasks;
+    uint64_t nextID = 0;
+
+    std::unique_ptr<TaskLog> log;
+
+    RetentionPolicy retention;
+    std::ofstream archive;
+
+    std::chrono::milliseconds reportInterval{0};
+    // last log record tasks.md shows
+    uint64_t reportedLsn = 0;
+    bool logFailed = false;
+    std::thread reporter;
+    std::condition_variable reporterCv;
+    bool stopping = false;
 
     std::string newTaskID();
 
+    // called with mtx held
+    uint32_t findSlot(const std::string &id) const;
+
+    void assign(uint32_t slot, const std::string &workerId);
+
+    // compacts the log once it outgrows the table, called with mtx held
+    void checkSnapshot();
+
+    // called with mtx held
+    void evictFinished();
+
+    void evict(uint32_t slot);
+
+    void runReporter();
+
+    static void writeMarkdown(const std::vector<Task> &tasks, const std::string &filename);
 };
 
 
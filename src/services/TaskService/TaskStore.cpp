@@ -0,0 +1,251 @@
+#include "TaskStore.h"
+
+#include <functional>
+#include <stdexcept>
+
+namespace {
+    const uint8_t FREE = 0xFF;
+    const uint64_t EMPTY = UINT64_MAX;
+
+    uint64_t cell(uint32_t hash, uint32_t slot) {
+        return static_cast<uint64_t>(hash) << 32 | slot;
+    }
+
+    uint32_t cellHash(uint64_t cell) {
+        return static_cast<uint32_t>(cell >> 32);
+    }
+
+    uint32_t cellSlot(uint64_t cell) {
+        return static_cast<uint32_t>(cell);
+    }
+
+    int64_t now() {
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+    }
+}
+
+TaskStore::TaskStore() {
+    for (int i = 0; i < STATUSES; i++) {
+        heads[i] = NONE;
+        tails[i] = NONE;
+        counts[i] = 0;
+    }
+    rehash(1024);
+}
+
+uint32_t TaskStore::hashOf(const std::string &id) {
+    uint64_t hash = std::hash<std::string>()(id);
+    return static_cast<uint32_t>(hash ^ hash >> 32);
+}
+
+uint32_t TaskStore::find(const std::string &id) const {
+    uint32_t hash = hashOf(id);
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        uint64_t c = index[i];
+        if (c == EMPTY) return NONE;
+        if (cellHash(c) == hash && strings[cellSlot(c)].id == id) return cellSlot(c);
+    }
+}
+
+void TaskStore::rehash(size_t capacity) {
+    std::vector<uint64_t> old = std::move(index);
+    index.assign(capacity, EMPTY);
+    mask = capacity - 1;
+    for (uint64_t c: old) {
+        if (c == EMPTY) continue;
+        size_t i = cellHash(c) & mask;
+        while (index[i] != EMPTY) i = (i + 1) & mask;
+        index[i] = c;
+    }
+}
+
+void TaskStore::indexInsert(uint32_t slot) {
+    // load factor stays under 3/4
+    if ((live + 1) * 4 > index.size() * 3) {
+        rehash(index.size() * 2);
+    }
+    uint32_t hash = hashOf(strings[slot].id);
+    size_t i = hash & mask;
+    while (index[i] != EMPTY) i = (i + 1) & mask;
+    index[i] = cell(hash, slot);
+}
+
+void TaskStore::indexErase(uint32_t slot) {
+    uint32_t hash = hashOf(strings[slot].id);
+    size_t i = hash & mask;
+    while (cellSlot(index[i]) != slot) i = (i + 1) & mask;
+
+    // backward shift: move up every following cell that may live in the hole
+    for (size_t j = i;;) {
+        j = (j + 1) & mask;
+        if (index[j] == EMPTY) break;
+        size_t home = cellHash(index[j]) & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            index[i] = index[j];
+            i = j;
+        }
+    }
+    index[i] = EMPTY;
+}
+
+void TaskStore::link(uint32_t slot, TaskStatus status) {
+    statuses[slot] = static_cast<uint8_t>(status);
+    changed[slot] = now();
+    prev[slot] = tails[status];
+    nextSlot[slot] = NONE;
+    if (tails[status] != NONE) {
+        nextSlot[tails[status]] = slot;
+    } else {
+        heads[status] = slot;
+    }
+    tails[status] = slot;
+    counts[status]++;
+}
+
+void TaskStore::unlink(uint32_t slot) {
+    uint8_t status = statuses[slot];
+    if (prev[slot] != NONE) {
+        nextSlot[prev[slot]] = nextSlot[slot];
+    } else {
+        heads[status] = nextSlot[slot];
+    }
+    if (nextSlot[slot] != NONE) {
+        prev[nextSlot[slot]] = prev[slot];
+    } else {
+        tails[status] = prev[slot];
+    }
+    counts[status]--;
+}
+
+uint32_t TaskStore::insert(const Task &task) {
+    uint32_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        if (statuses.size() >= NONE) {
+            throw std::runtime_error("Task store is full");
+        }
+        slot = static_cast<uint32_t>(statuses.size());
+        statuses.push_back(FREE);
+        cores.push_back(0);
+        priorities.push_back(0);
+        prev.push_back(NONE);
+        nextSlot.push_back(NONE);
+        changed.push_back(0);
+        strings.emplace_back();
+    }
+
+    strings[slot] = {task.id, task.func, task.input, task.output, task.worker_hash_id, task.client_hash_id};
+    cores[slot] = task.cores;
+    priorities[slot] = task.priority;
+    indexInsert(slot);
+    live++;
+    link(slot, task.status);
+    return slot;
+}
+
+void TaskStore::update(uint32_t slot, const Task &task) {
+    Strings &s = strings[slot];
+    s.func = task.func;
+    s.input = task.input;
+    s.output = task.output;
+    s.worker_hash_id = task.worker_hash_id;
+    s.client_hash_id = task.client_hash_id;
+    cores[slot] = task.cores;
+    priorities[slot] = task.priority;
+    setStatus(slot, task.status);
+}
+
+void TaskStore::setStatus(uint32_t slot, TaskStatus status) {
+    if (statuses[slot] == status) return;
+    unlink(slot);
+    link(slot, status);
+}
+
+void TaskStore::setWorker(uint32_t slot, const std::string &worker) {
+    strings[slot].worker_hash_id = worker;
+}
+
+void TaskStore::setOutput(uint32_t slot, std::string output) {
+    strings[slot].output = std::move(output);
+}
+
+void TaskStore::erase(uint32_t slot) {
+    unlink(slot);
+    indexErase(slot);
+    statuses[slot] = FREE;
+    strings[slot] = {};
+    freeSlots.push_back(slot);
+    live--;
+}
+
+Task TaskStore::get(uint32_t slot) const {
+    const Strings &s = strings[slot];
+    return {s.id, s.func, s.input, s.output, cores[slot], static_cast<TaskStatus>(statuses[slot]),
+            s.worker_hash_id, s.client_hash_id, priorities[slot]};
+}
+
+int TaskStore::coreCount(uint32_t slot) const {
+    return cores[slot];
+}
+
+Task TaskStore::header(uint32_t slot) const {
+    const Strings &s = strings[slot];
+    return {s.id, s.func, "", "", cores[slot], static_cast<TaskStatus>(statuses[slot]),
+            s.worker_hash_id, s.client_hash_id, priorities[slot]};
+}
+
+const std::string &TaskStore::func(uint32_t slot) const {
+    return strings[slot].func;
+}
+
+const std::string &TaskStore::input(uint32_t slot) const {
+    return strings[slot].input;
+}
+
+const std::string &TaskStore::id(uint32_t slot) const {
+    return strings[slot].id;
+}
+
+TaskStatus TaskStore::status(uint32_t slot) const {
+    return static_cast<TaskStatus>(statuses[slot]);
+}
+
+std::chrono::steady_clock::time_point TaskStore::since(uint32_t slot) const {
+    return std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(changed[slot]));
+}
+
+size_t TaskStore::size() const {
+    return live;
+}
+
+size_t TaskStore::count(TaskStatus status) const {
+    return counts[status];
+}
+
+uint32_t TaskStore::first(TaskStatus status) const {
+    return heads[status];
+}
+
+uint32_t TaskStore::next(uint32_t slot) const {
+    return nextSlot[slot];
+}
+
+std::vector<Task> TaskStore::headers() const {
+    std::vector<Task> tasks;
+    tasks.reserve(live);
+    for (uint32_t slot = 0; slot < statuses.size(); slot++) {
+        if (statuses[slot] != FREE) tasks.push_back(header(slot));
+    }
+    return tasks;
+}
+
+std::vector<Task> TaskStore::all() const {
+    std::vector<Task> tasks;
+    tasks.reserve(live);
+    for (uint32_t slot = 0; slot < statuses.size(); slot++) {
+        if (statuses[slot] != FREE) tasks.push_back(get(slot));
+    }
+    return tasks;
+}
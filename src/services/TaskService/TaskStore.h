@@ -0,0 +1,117 @@
+#ifndef RABBIT_TASKSTORE_H
+#define RABBIT_TASKSTORE_H
+
+#include "DataModel/Task.h"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Task table addressed by slot. Fields read on every transition (status, cores, list links,
+// time of the last change) are kept in separate arrays, the strings live in a side array.
+// An open addressing index maps ids to slots, every status has its own list ordered by the
+// time tasks entered it, so the oldest finished task is always at the head of its list.
+// Not thread safe
+class TaskStore {
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+    static constexpr int STATUSES = TaskStatus::Failed + 1;
+
+    TaskStore();
+
+    // NONE if there is no such task
+    uint32_t find(const std::string &id) const;
+
+    // The id must not be in the store yet
+    uint32_t insert(const Task &task);
+
+    void update(uint32_t slot, const Task &task);
+
+    void setStatus(uint32_t slot, TaskStatus status);
+
+    void setWorker(uint32_t slot, const std::string &worker);
+
+    void setOutput(uint32_t slot, std::string output);
+
+    void erase(uint32_t slot);
+
+    Task get(uint32_t slot) const;
+
+    // the task without input and output
+    Task header(uint32_t slot) const;
+
+    const std::string &func(uint32_t slot) const;
+
+    const std::string &input(uint32_t slot) const;
+
+    const std::string &id(uint32_t slot) const;
+
+    TaskStatus status(uint32_t slot) const;
+
+    int coreCount(uint32_t slot) const;
+
+    // when the task got its current status
+    std::chrono::steady_clock::time_point since(uint32_t slot) const;
+
+    size_t size() const;
+
+    size_t count(TaskStatus status) const;
+
+    // oldest task with the status and the one that entered it after the given
+    uint32_t first(TaskStatus status) const;
+
+    uint32_t next(uint32_t slot) const;
+
+    // every task in slot order
+    std::vector<Task> all() const;
+
+    // every task without its input and output
+    std::vector<Task> headers() const;
+
+private:
+    struct Strings {
+        std::string id;
+        std::string func;
+        std::string input;
+        std::string output;
+        std::string worker_hash_id;
+        std::string client_hash_id;
+    };
+
+    // hot columns, one element per slot
+    std::vector<uint8_t> statuses;
+    std::vector<int32_t> cores;
+    std::vector<int32_t> priorities;
+    std::vector<uint32_t> prev;
+    std::vector<uint32_t> nextSlot;
+    std::vector<int64_t> changed;
+
+    // a deque does not copy the whole table when it grows
+    std::deque<Strings> strings;
+    std::vector<uint32_t> freeSlots;
+
+    uint32_t heads[STATUSES];
+    uint32_t tails[STATUSES];
+    size_t counts[STATUSES];
+    size_t live = 0;
+
+    // open addressing with linear probing. A cell keeps a 32 bit hash of the id next to
+    // the slot, so probing does not touch the strings until the hash matches
+    std::vector<uint64_t> index;
+    size_t mask = 0;
+
+    static uint32_t hashOf(const std::string &id);
+
+    void link(uint32_t slot, TaskStatus status);
+
+    void unlink(uint32_t slot);
+
+    void indexInsert(uint32_t slot);
+
+    void indexErase(uint32_t slot);
+
+    void rehash(size_t capacity);
+};
+
+#endif //RABBIT_TASKSTORE_H
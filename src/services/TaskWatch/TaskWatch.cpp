@@ -0,0 +1,279 @@
+#include "TaskWatch.h"
+
+#include <algorithm>
+
+void TaskWatch::start(const SpeculationPolicy &policy, Handler handler) {
+    std::lock_guard<std::mutex> lock(mtx);
+    this->policy = policy;
+    this->handler = std::move(handler);
+    watcher = std::thread(&TaskWatch::run, this);
+}
+
+bool TaskWatch::needed(Clock::time_point deadline, std::chrono::milliseconds timeout) {
+    std::lock_guard<std::mutex> lock(mtx);
+    return policy.percentile > 0 || deadline != Clock::time_point::max() || timeout.count() > 0;
+}
+
+void TaskWatch::watch(const std::string &id, const std::string &func, Clock::time_point deadline,
+                      std::chrono::milliseconds timeout) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = entries.find(id);
+    if (it != entries.end()) {
+        unschedule(id, it->second);
+    }
+    Entry &entry = entries[id];
+    entry = {func, deadline, timeout};
+    schedule(id, entry, Clock::now());
+}
+
+void TaskWatch::started(const std::string &id, const std::string &workerId) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = entries.find(id);
+    if (it == entries.end()) {
+        return;
+    }
+    Entry &entry = it->second;
+    unschedule(id, entry);
+    entry.primary = workerId;
+    entry.primaryStart = Clock::now();
+    // a new attempt may get a backup right away
+    entry.backupAfter = {};
+    entry.backoff = 1;
+    schedule(id, entry, entry.primaryStart);
+}
+
+bool TaskWatch::addBackup(const std::string &id, const std::string &workerId) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = entries.find(id);
+    if (it == entries.end() || !it->second.backup.empty()) {
+        return false;
+    }
+    Entry &entry = it->second;
+    unschedule(id, entry);
+    entry.backup = workerId;
+    entry.backupStart = Clock::now();
+    schedule(id, entry, entry.backupStart);
+    return true;
+}
+
+bool TaskWatch::dropBackup(const std::string &id, const std::string &workerId) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = entries.find(id);
+    if (it == entries.end() || it->second.backup != workerId) {
+        return false;
+    }
+    unschedule(id, it->second);
+    it->second.backup.clear();
+    schedule(id, it->second, Clock::now());
+    return true;
+}
+
+void TaskWatch::requeued(const std::string &id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = entries.find(id);
+    if (it != entries.end()) {
+        unschedule(id, it->second);
+        it->second.primary.clear();
+        schedule(id, it->second, Clock::now());
+    }
+}
+
+void TaskWatch::dropWorker(const std::string &workerId) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto now = Clock::now();
+    for (auto &[id, entry]: entries) {
+        if (entry.backup == workerId) {
+            unschedule(id, entry);
+            entry.backup.clear();
+            schedule(id, entry, now);
+        }
+    }
+}
+
+bool TaskWatch::finish(const std::string &id, const std::string &workerId, Copies &copies) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = entries.find(id);
+    if (it == entries.end()) {
+        return false;
+    }
+    Entry &entry = it->second;
+    unschedule(id, entry);
+    copies = {entry.primary, entry.backup};
+    auto now = Clock::now();
+    if (!workerId.empty() && workerId == entry.primary) {
+        record(entry.func, now - entry.primaryStart);
+    } else if (!workerId.empty() && workerId == entry.backup) {
+        record(entry.func, now - entry.backupStart);
+    }
+    entries.erase(it);
+    return true;
+}
+
+void TaskWatch::record(const std::string &func, Clock::duration duration) {
+    if (policy.percentile <= 0) {
+        return;
+    }
+    Durations &stats = durations[func];
+    int64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    if (stats.samples.size() < DURATIONS) {
+        stats.samples.push_back(micros);
+    } else {
+        stats.samples[stats.next] = micros;
+        stats.next = (stats.next + 1) % DURATIONS;
+    }
+    if (stats.samples.size() < policy.minSamples) {
+        return;
+    }
+    std::vector<int64_t> sorted = stats.samples;
+    size_t rank = std::min(sorted.size() - 1, static_cast<size_t>(sorted.size() * policy.percentile / 100));
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    stats.threshold = std::chrono::microseconds(sorted[rank]);
+}
+
+std::chrono::microseconds TaskWatch::threshold(const std::string &func) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = durations.find(func);
+    return it == durations.end() ? std::chrono::microseconds(0) : it->second.threshold;
+}
+
+bool TaskWatch::check(const Entry &entry, Clock::time_point now, Action &action) {
+    if (now >= entry.deadline) {
+        action = Action::Expire;
+        return true;
+    }
+    if (entry.primary.empty()) {
+        // still queued
+        return false;
+    }
+    bool timed = entry.timeout.count() > 0;
+    if (!entry.backup.empty()) {
+        if (timed && now - entry.backupStart > entry.timeout) {
+            action = Action::TimeOut;
+            return true;
+        }
+        return false;
+    }
+
+    auto running = now - entry.primaryStart;
+    if (timed && running > 2 * entry.timeout) {
+        action = Action::TimeOut;
+        return true;
+    }
+    if (now < entry.backupAfter) {
+        return false;
+    }
+    if (timed && running > entry.timeout) {
+        action = Action::Backup;
+        return true;
+    }
+    auto it = durations.find(entry.func);
+    if (it != durations.end() && it->second.threshold.count() > 0 && running > it->second.threshold) {
+        action = Action::Backup;
+        return true;
+    }
+    return false;
+}
+
+void TaskWatch::run() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (!stopping) {
+        watcherCv.wait_for(lock, policy.period, [this] { return stopping; });
+        if (stopping) break;
+
+        auto now = Clock::now();
+        std::vector<std::string> ids;
+        for (auto it = timers.begin(); it != timers.end() && it->first <= now; ++it) {
+            ids.push_back(it->second);
+        }
+        for (const auto &[func, tasks]: running) {
+            auto stats = durations.find(func);
+            if (stats == durations.end() || stats->second.threshold.count() == 0) continue;
+            for (const auto &[start, id]: tasks) {
+                if (now - start <= stats->second.threshold) break;
+                ids.push_back(id);
+            }
+        }
+        if (ids.empty()) continue;
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+        std::vector<std::pair<std::string, Action>> due;
+        for (const auto &id: ids) {
+            Entry &entry = entries.at(id);
+            unschedule(id, entry);
+            Action action;
+            if (check(entry, now, action)) {
+                due.emplace_back(id, action);
+                if (action == Action::Backup) {
+                    // asked again later if no copy starts
+                    entry.backupAfter = now + policy.period * entry.backoff;
+                    entry.backoff = std::min(entry.backoff * 2, MAX_BACKOFF);
+                }
+            }
+            schedule(id, entry, now);
+        }
+        if (due.empty()) continue;
+
+        // the handler calls back into the watch
+        lock.unlock();
+        for (const auto &[id, action]: due) {
+            handler(id, action);
+        }
+        lock.lock();
+    }
+}
+
+void TaskWatch::schedule(const std::string &id, Entry &entry, Clock::time_point now) {
+    Clock::time_point due = entry.deadline;
+    bool timed = entry.timeout.count() > 0;
+    if (!entry.primary.empty() && !entry.backup.empty()) {
+        if (timed) {
+            due = std::min(due, entry.backupStart + entry.timeout);
+        }
+    } else if (!entry.primary.empty()) {
+        if (timed) {
+            due = std::min({due, entry.primaryStart + 2 * entry.timeout,
+                            std::max(entry.primaryStart + entry.timeout, entry.backupAfter)});
+        }
+        if (policy.percentile > 0 && now < entry.backupAfter) {
+            due = std::min(due, entry.backupAfter);
+        } else if (policy.percentile > 0) {
+            running[entry.func].emplace(entry.primaryStart, id);
+            entry.slow = true;
+        }
+    }
+    if (due != Clock::time_point::max()) {
+        timers.emplace(due, id);
+        entry.due = due;
+    }
+}
+
+void TaskWatch::unschedule(const std::string &id, Entry &entry) {
+    if (entry.due != Clock::time_point::max()) {
+        timers.erase({entry.due, id});
+        entry.due = Clock::time_point::max();
+    }
+    if (entry.slow) {
+        auto it = running.find(entry.func);
+        it->second.erase({entry.primaryStart, id});
+        if (it->second.empty()) {
+            running.erase(it);
+        }
+        entry.slow = false;
+    }
+}
+
+void TaskWatch::close() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    watcherCv.notify_all();
+    if (watcher.joinable()) {
+        watcher.join();
+    }
+}
+
+TaskWatch::~TaskWatch() {
+    close();
+}
@@ -0,0 +1,150 @@
+#ifndef RABBIT_TASKWATCH_H
+#define RABBIT_TASKWATCH_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct SpeculationPolicy {
+    // a running task gets a backup copy once it runs longer than this percentile (0-100)
+    // of the recent durations of its function, 0 - never
+    double percentile = 0;
+    // durations a function needs before its percentile is trusted
+    size_t minSamples = 20;
+    // how often watched tasks are checked
+    std::chrono::milliseconds period{50};
+};
+
+// Tasks with a deadline or a timeout, and every running task while speculation is on.
+// A task gets one backup copy on another worker when its attempt runs past its timeout or
+// past the percentile of its function, the first result wins. A task expires when its
+// deadline passes, or times out when the backup runs past the timeout too (or no backup
+// could start within twice the timeout). A backup that did not start is asked for again
+// after a delay that doubles up to MAX_BACKOFF periods. Tasks are kept in order of the time
+// something may be due, so a check looks only at those. Thread safe
+class TaskWatch {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Action {
+        // start a copy on another worker
+        Backup,
+        Expire,
+        TimeOut,
+    };
+
+    using Handler = std::function<void(const std::string &id, Action action)>;
+
+    // workers that run the task, empty if none
+    struct Copies {
+        std::string primary;
+        std::string backup;
+    };
+
+    TaskWatch() = default;
+
+    // the handler is called from the watch thread
+    void start(const SpeculationPolicy &policy, Handler handler);
+
+    // false if a task without limits does not need to be watched
+    bool needed(Clock::time_point deadline, std::chrono::milliseconds timeout);
+
+    // deadline is Clock::time_point::max() if there is none, timeout 0 if there is none
+    void watch(const std::string &id, const std::string &func, Clock::time_point deadline,
+               std::chrono::milliseconds timeout);
+
+    // the task was sent to the worker, a new attempt starts
+    void started(const std::string &id, const std::string &workerId);
+
+    // false if the task is not watched any more, the copy must not be sent then
+    bool addBackup(const std::string &id, const std::string &workerId);
+
+    // the worker gave back the backup copy without running it
+    bool dropBackup(const std::string &id, const std::string &workerId);
+
+    // the task went back to the queue, a backup keeps running
+    void requeued(const std::string &id);
+
+    // the worker is gone with the backups it ran
+    void dropWorker(const std::string &workerId);
+
+    // The task got a result from workerId, empty if the broker gave up on it. It is no longer
+    // watched, copies gets who ran it. The duration of a winning copy is recorded for its function
+    bool finish(const std::string &id, const std::string &workerId, Copies &copies);
+
+    // the percentile of the function's recent durations, 0 while there are too few
+    std::chrono::microseconds threshold(const std::string &func);
+
+    void close();
+
+    ~TaskWatch();
+
+private:
+    struct Entry {
+        std::string func;
+        Clock::time_point deadline;
+        std::chrono::milliseconds timeout;
+        std::string primary;
+        Clock::time_point primaryStart;
+        std::string backup;
+        Clock::time_point backupStart;
+        // no backup is asked for before it
+        Clock::time_point backupAfter;
+        // periods to wait before asking for a backup again
+        int backoff = 1;
+        // key in timers, max if none
+        Clock::time_point due = Clock::time_point::max();
+        // in running[func], may get a backup once past the percentile of its function
+        bool slow = false;
+    };
+
+    using Timers = std::set<std::pair<Clock::time_point, std::string>>;
+
+    // periods between asking for a backup of the same attempt, at most
+    static const int MAX_BACKOFF = 64;
+
+    // the last DURATIONS durations of a function
+    static const size_t DURATIONS = 256;
+
+    struct Durations {
+        std::vector<int64_t> samples;
+        size_t next = 0;
+        std::chrono::microseconds threshold{0};
+    };
+
+    std::mutex mtx;
+    SpeculationPolicy policy;
+    Handler handler;
+    std::unordered_map<std::string, Entry> entries;
+    std::unordered_map<std::string, Durations> durations;
+    // every task by the earliest time its deadline, timeout or backoff is due
+    Timers timers;
+    // running tasks without a backup by function and start of the attempt
+    std::unordered_map<std::string, Timers> running;
+
+    bool stopping = false;
+    std::thread watcher;
+    std::condition_variable watcherCv;
+
+    // called with mtx held
+    void record(const std::string &func, Clock::duration duration);
+
+    // false if nothing has to be done about the task yet
+    bool check(const Entry &entry, Clock::time_point now, Action &action);
+
+    // called with mtx held after the entry changes, files it under its next due time
+    void schedule(const std::string &id, Entry &entry, Clock::time_point now);
+
+    void unschedule(const std::string &id, Entry &entry);
+
+    void run();
+};
+
+#endif //RABBIT_TASKWATCH_H
@@ -0,0 +1,365 @@
+#include "Tiling.h"
+
+#include <algorithm>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+const char *const Tiling::FUNCTION = "matrixTile";
+
+void Tiling::configure(const TilingOptions &options) {
+    std::lock_guard<std::mutex> lock(mtx);
+    this->options = options;
+}
+
+bool Tiling::tileable(const std::string &func) {
+    std::lock_guard<std::mutex> lock(mtx);
+    return options.tile > 0 && func == "matrixMultiplication";
+}
+
+std::string Tiling::tileID(const std::string &parent, size_t row, size_t col) {
+    return parent + "#" + std::to_string(row) + "." + std::to_string(col);
+}
+
+static bool isMatrix(const json &matrix) {
+    if (!matrix.is_array() || matrix.empty() || !matrix[0].is_array() || matrix[0].empty()) {
+        return false;
+    }
+    return std::all_of(matrix.begin(), matrix.end(), [&matrix](const json &row) {
+        return row.is_array() && row.size() == matrix[0].size();
+    });
+}
+
+std::vector<Tiling::Tile> Tiling::split(const std::string &parent, const std::string &input, int cores) {
+    int tile;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        tile = options.tile;
+    }
+    if (tile <= 0) {
+        return {};
+    }
+
+    json matrices;
+    try {
+        matrices = json::parse(input);
+    } catch (json::exception &) {
+        return {};
+    }
+    if (!matrices.is_array() || matrices.size() != 2 || !isMatrix(matrices[0]) || !isMatrix(matrices[1])) {
+        return {};
+    }
+    const json &a = matrices[0];
+    const json &b = matrices[1];
+    size_t rows = a.size(), inner = b.size(), cols = b[0].size();
+    if (a[0].size() != inner || (rows <= static_cast<size_t>(tile) && cols <= static_cast<size_t>(tile))) {
+        return {};
+    }
+
+    Job job;
+    job.cores = cores;
+    job.rows = rows;
+    job.cols = cols;
+    job.tile = tile;
+    for (size_t begin = 0; begin < rows; begin += tile) {
+        json panel(json::value_t::array);
+        for (size_t r = begin; r < std::min(rows, begin + tile); r++) {
+            panel.push_back(a[r]);
+        }
+        job.keysA.push_back(parent + "/a" + std::to_string(job.panelsA.size()));
+        job.panelsA.push_back(panel.dump());
+    }
+    for (size_t begin = 0; begin < cols; begin += tile) {
+        // columns are stored as rows, a tile then walks both panels in memory order
+        json panel(json::value_t::array);
+        for (size_t c = begin; c < std::min(cols, begin + tile); c++) {
+            json column(json::value_t::array);
+            for (size_t k = 0; k < inner; k++) {
+                column.push_back(b[k][c]);
+            }
+            panel.push_back(std::move(column));
+        }
+        job.keysB.push_back(parent + "/b" + std::to_string(job.panelsB.size()));
+        job.panelsB.push_back(panel.dump());
+    }
+    matrices = json();
+
+    size_t count = job.panelsA.size() * job.panelsB.size();
+    std::vector<Tile> result;
+    result.reserve(count);
+    job.waiting.assign(job.panelsA.size(), {});
+    for (size_t i = 0; i < job.panelsA.size(); i++) {
+        for (size_t j = 0; j < job.panelsB.size(); j++) {
+            job.waiting[i].push_back(j);
+            result.push_back({tileID(parent, i, j),
+                              json({{"a", job.keysA[i]}, {"b", job.keysB[j]}}).dump()});
+        }
+    }
+    job.waitingCount = count;
+    job.finished.assign(count, false);
+    job.remaining = count;
+    job.result.assign(rows * cols, 0);
+
+    std::lock_guard<std::mutex> lock(mtx);
+    if (jobs.count(parent) != 0) {
+        return {};
+    }
+    for (size_t i = 0; i < job.panelsA.size(); i++) {
+        for (size_t j = 0; j < job.panelsB.size(); j++) {
+            tiles[result[i * job.panelsB.size() + j].id] = {parent, i, j};
+        }
+    }
+    jobs.emplace(parent, std::move(job));
+    order.push_back(parent);
+    return result;
+}
+
+size_t Tiling::pending() {
+    std::lock_guard<std::mutex> lock(mtx);
+    size_t count = 0;
+    for (const auto &parent: order) {
+        count += jobs.at(parent).waitingCount;
+    }
+    return count;
+}
+
+bool Tiling::holds(const Holder &holder, const std::string &key) const {
+    return holder.panels.count(key) != 0 || holder.expected.count(key) != 0;
+}
+
+bool Tiling::take(const std::string &worker, int freeCores, const Claim &claim, std::string &id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Holder &holder = holders[worker];
+    for (const auto &parent: order) {
+        Job &job = jobs.at(parent);
+        if (job.waitingCount == 0 || job.cores > freeCores) {
+            continue;
+        }
+
+        std::vector<bool> heldB(job.keysB.size());
+        for (size_t j = 0; j < heldB.size(); j++) {
+            heldB[j] = holds(holder, job.keysB[j]);
+        }
+        // both panels held beats one beats none, then row order
+        int bestScore = -1;
+        size_t bestRow = 0, bestAt = 0;
+        for (size_t i = 0; i < job.waiting.size() && bestScore < 2; i++) {
+            int heldA = holds(holder, job.keysA[i]) ? 1 : 0;
+            for (size_t at = 0; at < job.waiting[i].size(); at++) {
+                int score = heldA + (heldB[job.waiting[i][at]] ? 1 : 0);
+                if (score > bestScore) {
+                    bestScore = score;
+                    bestRow = i;
+                    bestAt = at;
+                    if (score == 2) break;
+                }
+            }
+        }
+        if (bestScore < 0 || (claim && !claim(job.cores))) {
+            return false;
+        }
+
+        size_t col = job.waiting[bestRow][bestAt];
+        job.waiting[bestRow].erase(job.waiting[bestRow].begin() + static_cast<std::ptrdiff_t>(bestAt));
+        job.waitingCount--;
+        holder.expected[job.keysA[bestRow]]++;
+        holder.expected[job.keysB[col]]++;
+        id = tileID(parent, bestRow, col);
+        return true;
+    }
+    return false;
+}
+
+bool Tiling::isTile(const std::string &id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    return tiles.count(id) != 0;
+}
+
+std::shared_ptr<std::mutex> Tiling::sendLock(const std::string &worker) {
+    std::lock_guard<std::mutex> lock(mtx);
+    return holders[worker].sendLock;
+}
+
+bool Tiling::request(const std::string &id, const std::string &worker, struct TaskRequest &request) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = tiles.find(id);
+    if (it == tiles.end()) {
+        return false;
+    }
+    const Job &job = jobs.at(it->second.parent);
+    const std::string &keyA = job.keysA[it->second.row];
+    const std::string &keyB = job.keysB[it->second.col];
+    Holder &holder = holders[worker];
+
+    // the panels are JSON already, the request is put together as text
+    std::string data = "{\"a\":" + json(keyA).dump() + ",\"b\":" + json(keyB).dump() + ",\"panels\":{";
+    bool first = true;
+    for (const auto &[key, panel]: {std::make_pair(&keyA, &job.panelsA[it->second.row]),
+                                    std::make_pair(&keyB, &job.panelsB[it->second.col])}) {
+        auto expected = holder.expected.find(*key);
+        if (expected != holder.expected.end() && --expected->second == 0) {
+            holder.expected.erase(expected);
+        }
+        auto held = holder.panels.find(*key);
+        if (held != holder.panels.end()) {
+            holder.lru.splice(holder.lru.begin(), holder.lru, held->second.first);
+            continue;
+        }
+        if (!first) data += ',';
+        data += json(*key).dump() + ":" + *panel;
+        first = false;
+        holder.lru.push_front(*key);
+        holder.panels[*key] = {holder.lru.begin(), panel->size()};
+        holder.bytes += panel->size();
+    }
+    data += "},\"drop\":[";
+
+    first = true;
+    auto victim = holder.lru.end();
+    while ((holder.bytes > options.workerCacheBytes || !holder.stale.empty()) && victim != holder.lru.begin()) {
+        --victim;
+        if (*victim == keyA || *victim == keyB ||
+            (holder.bytes <= options.workerCacheBytes && holder.stale.count(*victim) == 0)) {
+            continue;
+        }
+        holder.stale.erase(*victim);
+        if (!first) data += ',';
+        data += json(*victim).dump();
+        first = false;
+        holder.bytes -= holder.panels.at(*victim).second;
+        holder.panels.erase(*victim);
+        victim = holder.lru.erase(victim);
+    }
+    data += "]}";
+
+    request = {id, FUNCTION, std::move(data), job.cores};
+    return true;
+}
+
+void Tiling::dropWorker(const std::string &worker) {
+    std::lock_guard<std::mutex> lock(mtx);
+    holders.erase(worker);
+}
+
+Scatter::State Tiling::complete(const std::string &id, bool done, const char *data, size_t size,
+                                Scatter::Gathered &gathered) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = tiles.find(id);
+    if (it == tiles.end()) {
+        return abandoned.erase(id) != 0 ? Scatter::State::Abandoned : Scatter::State::NotPart;
+    }
+    TileRef ref = it->second;
+    Job &job = jobs.at(ref.parent);
+    size_t index = ref.row * job.panelsB.size() + ref.col;
+    gathered.parent = ref.parent;
+
+    size_t rowBegin = ref.row * job.tile, rowEnd = std::min(job.rows, rowBegin + job.tile);
+    size_t colBegin = ref.col * job.tile, colEnd = std::min(job.cols, colBegin + job.tile);
+    json block;
+    if (done) {
+        try {
+            block = json::parse(data, data + size);
+        } catch (json::exception &) {
+        }
+        bool fits = block.is_array() && block.size() == rowEnd - rowBegin &&
+                    std::all_of(block.begin(), block.end(), [&](const json &row) {
+                        return row.is_array() && row.size() == colEnd - colBegin;
+                    });
+        if (!fits) {
+            done = false;
+            static const std::string wrongSize = "a tile has the wrong size";
+            data = wrongSize.data();
+            size = wrongSize.size();
+        }
+    }
+
+    if (!done) {
+        gathered.output.assign(data, size);
+        for (size_t i = 0; i < job.finished.size(); i++) {
+            if (!job.finished[i] && i != index) {
+                gathered.remaining.push_back(tileID(ref.parent, i / job.panelsB.size(), i % job.panelsB.size()));
+            }
+        }
+        tiles.erase(it);
+        forget(ref.parent, job);
+        return Scatter::State::Failed;
+    }
+
+    tiles.erase(it);
+    for (size_t r = rowBegin; r < rowEnd; r++) {
+        const json &row = block[r - rowBegin];
+        for (size_t c = colBegin; c < colEnd; c++) {
+            job.result[r * job.cols + c] = row[c - colBegin].get<int>();
+        }
+    }
+    job.finished[index] = true;
+    if (--job.remaining > 0) {
+        return Scatter::State::Pending;
+    }
+
+    gathered.output = output(job);
+    forget(ref.parent, job);
+    return Scatter::State::Done;
+}
+
+std::string Tiling::output(const Job &job) {
+    std::string text;
+    text.reserve(job.result.size() * 4 + job.rows * 2 + 2);
+    text += '[';
+    for (size_t r = 0; r < job.rows; r++) {
+        if (r != 0) text += ',';
+        text += '[';
+        for (size_t c = 0; c < job.cols; c++) {
+            if (c != 0) text += ',';
+            text += std::to_string(job.result[r * job.cols + c]);
+        }
+        text += ']';
+    }
+    text += ']';
+    return text;
+}
+
+std::vector<std::string> Tiling::abandon(const std::string &parent) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = jobs.find(parent);
+    if (it == jobs.end()) {
+        return {};
+    }
+    std::vector<std::string> remaining;
+    for (size_t i = 0; i < it->second.finished.size(); i++) {
+        if (!it->second.finished[i]) {
+            remaining.push_back(tileID(parent, i / it->second.panelsB.size(), i % it->second.panelsB.size()));
+        }
+    }
+    forget(parent, it->second);
+    return remaining;
+}
+
+void Tiling::forget(const std::string &parent, const Job &job) {
+    for (size_t i = 0; i < job.panelsA.size(); i++) {
+        for (size_t j = 0; j < job.panelsB.size(); j++) {
+            std::string id = tileID(parent, i, j);
+            if (tiles.erase(id) != 0) {
+                abandoned.insert(std::move(id));
+            }
+        }
+    }
+    // workers drop the panels of the job with the next tile they get
+    for (auto &[worker, holder]: holders) {
+        for (const auto *keys: {&job.keysA, &job.keysB}) {
+            for (const auto &key: *keys) {
+                holder.expected.erase(key);
+                if (holder.panels.count(key) != 0) {
+                    holder.stale.insert(key);
+                }
+            }
+        }
+    }
+    order.erase(std::find(order.begin(), order.end(), parent));
+    jobs.erase(parent);
+}
+
+void Tiling::settled(const std::string &id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    abandoned.erase(id);
+}
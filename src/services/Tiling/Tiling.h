@@ -0,0 +1,136 @@
+#ifndef RABBIT_TILING_H
+#define RABBIT_TILING_H
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "TaskRequest.h"
+#include "services/Scatter/Scatter.h"
+
+struct TilingOptions {
+    // rows of A and columns of B in one tile, 0 - products are not tiled
+    int tile = 0;
+    // panel bytes kept on one worker, the least recently used ones are dropped beyond it
+    size_t workerCacheBytes = 256u << 20;
+};
+
+// Splits a matrixMultiplication [A, B] into tiles of C = A×B. Tile (i, j) needs row panel i of A
+// and column panel j of B. The server keeps a model of the panels every worker holds: a tile
+// carries only the panels its worker does not have yet and tells it which ones to drop, and a
+// worker is given the tiles whose panels it holds first. Tile outputs are assembled into C.
+// Thread safe
+class Tiling {
+public:
+    // the worker function that computes one tile
+    static const char *const FUNCTION;
+
+    struct Tile {
+        std::string id;
+        // references to the panels, their data is added when the tile is sent
+        std::string input;
+    };
+
+    // takes the cores of a tile on the worker, false leaves the tile for later
+    using Claim = std::function<bool(int cores)>;
+
+    void configure(const TilingOptions &options);
+
+    bool tileable(const std::string &func);
+
+    // Tiles of the product, in row order, and starts tracking them. Empty if the input is not
+    // two matching matrices or the product is one tile, the task then runs whole
+    std::vector<Tile> split(const std::string &parent, const std::string &input, int cores);
+
+    // tiles that have not been handed out
+    size_t pending();
+
+    // Hands out a tile to the worker, one using panels it holds or is about to get if there is.
+    // false if there is none or the claim failed
+    bool take(const std::string &worker, int freeCores, const Claim &claim, std::string &id);
+
+    bool isTile(const std::string &id);
+
+    // Tiles sent to one worker in an order other than the one they were built in could refer to a
+    // panel before the message that carries it. Held while building and sending them
+    std::shared_ptr<std::mutex> sendLock(const std::string &worker);
+
+    // The request for the worker, with the panels it lacks. false if the tile is no longer needed
+    bool request(const std::string &id, const std::string &worker, struct TaskRequest &request);
+
+    // the worker is gone and so are its panels
+    void dropWorker(const std::string &worker);
+
+    // reported like a part of a split task
+    Scatter::State complete(const std::string &id, bool done, const char *data, size_t size,
+                            Scatter::Gathered &gathered);
+
+    // the product is given up, returns its tiles without a result. Empty if it was not tiled
+    std::vector<std::string> abandon(const std::string &parent);
+
+    // as Scatter::settled
+    void settled(const std::string &id);
+
+    static std::string tileID(const std::string &parent, size_t row, size_t col);
+
+private:
+    struct Job {
+        int cores;
+        size_t rows;
+        size_t cols;
+        int tile;
+        // JSON of the row panels of A and of the column panels of B, the latter transposed
+        std::vector<std::string> panelsA;
+        std::vector<std::string> panelsB;
+        std::vector<std::string> keysA;
+        std::vector<std::string> keysB;
+        // per row panel, column panels of the tiles not handed out
+        std::vector<std::vector<size_t>> waiting;
+        size_t waitingCount;
+        std::vector<bool> finished;
+        size_t remaining;
+        std::vector<int> result; // rows × cols
+    };
+
+    struct TileRef {
+        std::string parent;
+        size_t row;
+        size_t col;
+    };
+
+    struct Holder {
+        // most recently used first
+        std::list<std::string> lru;
+        std::unordered_map<std::string, std::pair<std::list<std::string>::iterator, size_t>> panels;
+        size_t bytes = 0;
+        // panels of tiles taken but not sent yet, they count as held when choosing a tile
+        std::unordered_map<std::string, int> expected;
+        // held panels of finished products, dropped first
+        std::unordered_set<std::string> stale;
+        std::shared_ptr<std::mutex> sendLock = std::make_shared<std::mutex>();
+    };
+
+    std::mutex mtx;
+    TilingOptions options;
+    std::unordered_map<std::string, Job> jobs;
+    // jobs in arrival order, the first ones get the workers first
+    std::vector<std::string> order;
+    std::unordered_map<std::string, TileRef> tiles;
+    std::unordered_set<std::string> abandoned;
+    std::unordered_map<std::string, Holder> holders;
+
+    // called with mtx held
+    void forget(const std::string &parent, const Job &job);
+
+    bool holds(const Holder &holder, const std::string &key) const;
+
+    static std::string output(const Job &job);
+};
+
+#endif //RABBIT_TILING_H
@@ -1,133 +1,333 @@
 #include "UserDBService.h"
 
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 
 
 void UserDBService::addClient(const Client &client) {
-    clients.push_back(client);
-    saveStateToFile("users.md");
+    std::lock_guard<std::mutex> lock(mtx);
+    clients[client.id] = client;
+    report.touch();
 };
 
 void UserDBService::addWorker(const Worker &worker) {
-    workers.push_back(worker);
-    saveStateToFile("users.md");
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = workers.find(worker.id);
+    if (it != workers.end()) {
+        unindex(it->second);
+        unenroll(it->second);
+    }
+    workers[worker.id] = worker;
+    index(worker);
+    enroll(worker);
+    report.touch();
 };
 
 void UserDBService::removeClient(const Client &client) {
-    for (auto it = clients.begin(); it != clients.end(); it++) {
-        if (it->id == client.id) {
-            clients.erase(it);
-            saveStateToFile("users.md");
-            return;
-        }
+    std::lock_guard<std::mutex> lock(mtx);
+    if (clients.erase(client.id) != 0) {
+        report.touch();
     }
 }
 
-void UserDBService::removeWorker(const Worker &worker) {
-    for (auto it = workers.begin(); it != workers.end(); it++) {
-        if (it->id == worker.id) {
-            workers.erase(it);
-            saveStateToFile("users.md");
-            return;
-        }
+bool UserDBService::removeWorker(const Worker &worker) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = workers.find(worker.id);
+    if (it == workers.end()) {
+        return false;
+    }
+    unindex(it->second);
+    unenroll(it->second);
+    workers.erase(it);
+    report.touch();
+    return true;
+}
+
+void UserDBService::index(const Worker &worker) {
+    all.byFreeCores.insert({worker.cores - worker.usedCores, worker.id});
+    all.byCredit.insert({worker.prefetch - worker.prefetched, worker.id});
+    for (const auto &queue: worker.queues) {
+        Pool &pool = pools[queue];
+        pool.byFreeCores.insert({worker.cores - worker.usedCores, worker.id});
+        pool.byCredit.insert({worker.prefetch - worker.prefetched, worker.id});
+    }
+}
+
+void UserDBService::unindex(const Worker &worker) {
+    all.byFreeCores.erase({worker.cores - worker.usedCores, worker.id});
+    all.byCredit.erase({worker.prefetch - worker.prefetched, worker.id});
+    for (const auto &queue: worker.queues) {
+        auto it = pools.find(queue);
+        if (it == pools.end()) continue;
+        it->second.byFreeCores.erase({worker.cores - worker.usedCores, worker.id});
+        it->second.byCredit.erase({worker.prefetch - worker.prefetched, worker.id});
     }
 }
 
-Worker UserDBService::findMostFreeWorker(int requiredCores) {
-    Worker mostFreeWorker;
-    int maxFreeCores = -1; // Start with -1 to ensure any valid worker with free cores will be considered.
+void UserDBService::enroll(const Worker &worker) {
+    all.sizes.insert(worker.cores);
+    for (const auto &queue: worker.queues) {
+        pools[queue].sizes.insert(worker.cores);
+    }
+}
 
-    for (auto &worker: workers) {
-        int freeCores = worker.cores - worker.usedCores;
-        if (freeCores >= requiredCores && freeCores > maxFreeCores) {
-            mostFreeWorker = worker;
-            maxFreeCores = freeCores;
+void UserDBService::unenroll(const Worker &worker) {
+    all.sizes.erase(all.sizes.find(worker.cores));
+    for (const auto &queue: worker.queues) {
+        auto it = pools.find(queue);
+        if (it != pools.end()) {
+            it->second.sizes.erase(it->second.sizes.find(worker.cores));
         }
     }
+}
+
+UserDBService::Pool *UserDBService::poolOf(const std::string &queue) {
+    if (queue.empty()) {
+        return &all;
+    }
+    auto it = pools.find(queue);
+    return it == pools.end() ? nullptr : &it->second;
+}
+
+void UserDBService::setLoad(Worker &worker, int usedCores, int prefetched) {
+    unindex(worker);
+    worker.usedCores = usedCores;
+    worker.prefetched = prefetched;
+    index(worker);
+    report.touch();
+}
+
+void UserDBService::setUsedCores(Worker &worker, int usedCores) {
+    setLoad(worker, usedCores, worker.prefetched);
+}
+
+Worker UserDBService::findMostFreeWorker(int requiredCores, const std::string &queue) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Pool *pool = poolOf(queue);
+    if (pool == nullptr || pool->byFreeCores.empty() || pool->byFreeCores.rbegin()->first < requiredCores) {
+        return {}; // Will return default Worker if no suitable worker is found.
+    }
+    return workers.at(pool->byFreeCores.rbegin()->second);
+}
+
+size_t UserDBService::workerCount(const std::string &queue) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Pool *pool = poolOf(queue);
+    return pool == nullptr ? 0 : pool->byFreeCores.size();
+}
 
-    return mostFreeWorker; // Will return default Worker if no suitable worker is found.
+int UserDBService::maxCores(const std::string &queue) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Pool *pool = poolOf(queue);
+    return pool == nullptr || pool->sizes.empty() ? 0 : *pool->sizes.rbegin();
 }
 
+Worker UserDBService::findWorkerWithCredit(const std::string &queue) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Pool *pool = poolOf(queue);
+    if (pool == nullptr || pool->byCredit.empty() || pool->byCredit.rbegin()->first <= 0) {
+        return {};
+    }
+    return workers.at(pool->byCredit.rbegin()->second);
+}
+
+Worker UserDBService::reserveCores(int cores, WorkerSelection selection, const std::string &queue) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Pool *pool = poolOf(queue);
+    if (pool == nullptr) {
+        return {};
+    }
+    if (!pool->byFreeCores.empty() && pool->byFreeCores.rbegin()->first >= cores) {
+        // a copy, setting the cores reindexes the pool
+        std::string id = selection == WorkerSelection::BestFit
+                         ? pool->byFreeCores.lower_bound({cores, std::string()})->second
+                         : pool->byFreeCores.rbegin()->second;
+        Worker &worker = workers.at(id);
+        setUsedCores(worker, worker.usedCores + cores);
+        return worker;
+    }
+
+    if (pool->byCredit.empty() || pool->byCredit.rbegin()->first <= 0) {
+        return {};
+    }
+    Worker &worker = workers.at(pool->byCredit.rbegin()->second);
+    if (worker.cores < cores) {
+        return {};
+    }
+    setLoad(worker, worker.usedCores + cores, worker.prefetched + 1);
+    return worker;
+}
+
+bool UserDBService::reserveCores(const std::string &id, int cores, bool prefetch) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = workers.find(id);
+    if (it == workers.end()) {
+        return false;
+    }
+    Worker &worker = it->second;
+    if (worker.cores - worker.usedCores >= cores) {
+        setUsedCores(worker, worker.usedCores + cores);
+        return true;
+    }
+    if (!prefetch || worker.prefetched >= worker.prefetch || worker.cores < cores) {
+        return false;
+    }
+    setLoad(worker, worker.usedCores + cores, worker.prefetched + 1);
+    return true;
+}
+
+Worker UserDBService::reserveSpareCores(int cores, const std::string &exclude, const std::string &queue) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Pool *pool = poolOf(queue);
+    if (pool == nullptr) {
+        return {};
+    }
+    for (auto it = pool->byFreeCores.rbegin(); it != pool->byFreeCores.rend() && it->first >= cores; ++it) {
+        if (it->second == exclude) continue;
+        Worker &worker = workers.at(it->second);
+        setUsedCores(worker, worker.usedCores + cores);
+        return worker;
+    }
+    return {};
+}
 
 Client UserDBService::findClientByID(const std::string &id) {
-    for (auto &client: clients) {
-        if (client.id == id) {
-            saveStateToFile("users.md");
-            return client;
-        }
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = clients.find(id);
+    if (it == clients.end()) {
+        throw std::runtime_error("Client not found");
     }
-    throw std::runtime_error("Client not found");
+    return it->second;
 }
 
 Worker UserDBService::findWorkerByID(const std::string &id) {
-    for (auto &worker: workers) {
-        if (worker.id == id) {
-            saveStateToFile("users.md");
-            return worker;
-        }
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = workers.find(id);
+    if (it == workers.end()) {
+        throw std::runtime_error("Worker not found");
     }
-    throw std::runtime_error("Worker not found");
+    return it->second;
 }
 
 void UserDBService::updateWorker(const Worker &worker) {
-    for (auto &w: workers) {
-        if (w.id == worker.id) {
-            w = worker;
-            saveStateToFile("users.md");
-
-            return;
-        }
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = workers.find(worker.id);
+    if (it == workers.end()) {
+        throw std::runtime_error("Worker not found");
     }
-    throw std::runtime_error("Worker not found");
+    unindex(it->second);
+    unenroll(it->second);
+    it->second = worker;
+    index(worker);
+    enroll(worker);
+    report.touch();
 }
 
 void UserDBService::modifyWorkerUsedCores(const std::string &id, int cores, bool increase) {
-    for (auto &worker: workers) {
-        if (worker.id == id) {
-            std::cout << "Update cores: Worker before has used cores: " << worker.usedCores << std::endl;
-            if (increase) {
-                worker.usedCores += cores;
-            } else {
-                worker.usedCores -= cores;
-            }
-            std::cout << "Update cores: Worker " << worker.id << " used cores: " << worker.usedCores << std::endl;
-            if (worker.usedCores < 0) {
-                std::cerr << "[!] Worker " << worker.id << " used cores is negative. Resetting to 0." << std::endl;
-                worker.usedCores = 0;
-            }
-            saveStateToFile("users.md");
-            return;
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = workers.find(id);
+    if (it == workers.end()) {
+        throw std::runtime_error("Worker not found");
+    }
+    Worker &worker = it->second;
+    int usedCores = increase ? worker.usedCores + cores : worker.usedCores - cores;
+    if (usedCores < 0) {
+        std::cerr << "[!] Worker " << worker.id << " used cores is negative. Resetting to 0." << std::endl;
+        usedCores = 0;
+    }
+    setUsedCores(worker, usedCores);
+}
+
+void UserDBService::releaseCores(const std::string &id, int cores, int tasks) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = workers.find(id);
+    if (it == workers.end()) {
+        throw std::runtime_error("Worker not found");
+    }
+    Worker &worker = it->second;
+    int usedCores = std::max(worker.usedCores - cores, 0);
+    // each finished task lets the worker start one it was holding. Once everything sent
+    // fits its cores, nothing is waiting there
+    int prefetched = usedCores <= worker.cores ? 0 : std::max(worker.prefetched - tasks, 0);
+    setLoad(worker, usedCores, prefetched);
+}
+
+Worker UserDBService::beginSteal(const std::string &thiefId) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto thief = workers.find(thiefId);
+    Worker *victim = nullptr;
+    for (auto &[id, worker]: workers) {
+        if (id == thiefId || worker.stealing || worker.prefetched == 0) continue;
+        if (thief != workers.end() && !thief->second.queues.empty() &&
+            std::find_first_of(worker.queues.begin(), worker.queues.end(), thief->second.queues.begin(),
+                               thief->second.queues.end()) == worker.queues.end()) {
+            // the thief could not take its tasks
+            continue;
+        }
+        if (victim == nullptr || worker.prefetched > victim->prefetched) {
+            victim = &worker;
         }
     }
-    throw std::runtime_error("Worker not found");
+    if (victim == nullptr) {
+        return {};
+    }
+    victim->stealing = true;
+    return *victim;
+}
+
+void UserDBService::endSteal(const std::string &id, int cores, int tasks) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = workers.find(id);
+    if (it == workers.end()) {
+        return;
+    }
+    Worker &worker = it->second;
+    worker.stealing = false;
+    worker.stolen += tasks;
+    setLoad(worker, std::max(worker.usedCores - cores, 0), std::max(worker.prefetched - tasks, 0));
 }
 
 void UserDBService::printLog() {
+    std::lock_guard<std::mutex> lock(mtx);
     // print clients, workers and worker used cores
     std::cout << "Clients: " << std::endl;
-    for (auto &client: clients) {
+    for (auto &[id, client]: clients) {
         std::cout << "Client: " << client.id << std::endl;
     }
 
     std::cout << "Workers: " << std::endl;
-    for (auto &worker: workers) {
+    for (auto &[id, worker]: workers) {
         std::cout << "Worker: " << worker.id << ", Cores: " << worker.cores << ", Used cores: " << worker.usedCores
                   << std::endl;
     }
 }
 
+void UserDBService::startReport(std::chrono::milliseconds interval) {
+    std::lock_guard<std::mutex> lock(mtx);
+    report.start(mtx, interval, [this] { saveStateToFile("users.md"); });
+}
+
 void UserDBService::saveStateToFile(const std::string &filename) {
     std::ofstream file(filename);
     if (!file.is_open()) {
         throw std::runtime_error("Unable to open file");
     }
 
-    file << "| ID | Cores | Used Cores |\n";
-    file << "|----|-------|------------|\n";
-    for (const auto &worker: workers) {
-        file << "| " << worker.id << " | " << worker.cores << " | " << worker.usedCores << " |\n";
+    file << "| ID | Cores | Used Cores | Prefetched | Stolen | Queues |\n";
+    file << "|----|-------|------------|------------|--------|--------|\n";
+    for (const auto &[id, worker]: workers) {
+        file << "| " << worker.id << " | " << worker.cores << " | " << worker.usedCores << " | "
+             << worker.prefetched << "/" << worker.prefetch << " | " << worker.stolen << " | ";
+        for (size_t i = 0; i < worker.queues.size(); i++) {
+            file << (i == 0 ? "" : ", ") << worker.queues[i];
+        }
+        file << " |\n";
     }
 
     file.close();
 }
+
+UserDBService::~UserDBService() {
+    report.stop();
+}
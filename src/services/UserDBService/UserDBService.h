@@ -3,13 +3,28 @@
 
 #include "DataModel/Client.h"
 #include "DataModel/Worker.h"
+#include "utils/PeriodicReport.h"
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <utility>
 
+enum class WorkerSelection {
+    // the worker with the most free cores, spreads the load
+    MostFree,
+    // the worker with the fewest free cores that still fit, keeps big workers free for big tasks
+    BestFit,
+};
+
+// Clients and workers by id. Workers are also ordered by free cores and by prefetch
+// credit, all of them and those of every queue they take tasks from, so selection is O(log n).
+// An empty queue name selects among all workers. Reserving cores checks and takes them under one lock.
+// When no worker has the cores free, a worker with credit left takes the task into its
+// local queue. Thread safe
 class UserDBService {
 public:
-    UserDBService() {
-        clients = std::vector<Client>();
-        workers = std::vector<Worker>();
-    };
+    UserDBService() = default;
 
     void addClient(const Client &client);
 
@@ -17,7 +32,8 @@ public:
 
     void removeClient(const Client &client);
 
-    void removeWorker(const Worker &worker);
+    // false if the worker was already removed
+    bool removeWorker(const Worker &worker);
 
     void updateWorker(const Worker &worker);
 
@@ -25,15 +41,84 @@ public:
 
     Worker findWorkerByID(const std::string &id);
 
-    Worker findMostFreeWorker(int cores);
+    Worker findMostFreeWorker(int cores, const std::string &queue = "");
+
+    size_t workerCount(const std::string &queue = "");
+
+    // cores of the biggest worker, 0 if there is none
+    int maxCores(const std::string &queue = "");
+
+    // the worker with the most prefetch credit left, empty id if no one has any
+    Worker findWorkerWithCredit(const std::string &queue = "");
+
+    // Picks a worker with at least cores free and takes them, or else prefetches the task
+    // to the worker with the most credit. Returns a worker with an empty id if neither works
+    Worker reserveCores(int cores, WorkerSelection selection, const std::string &queue = "");
+
+    // Takes cores of the given worker if it still has them free.
+    // With prefetch the task may also take the worker's credit
+    bool reserveCores(const std::string &id, int cores, bool prefetch = false);
+
+    // Takes cores of the worker other than exclude with the most free, never prefetches:
+    // a backup copy is only worth it if it starts right away. Empty id if none has them
+    Worker reserveSpareCores(int cores, const std::string &exclude, const std::string &queue = "");
 
     void modifyWorkerUsedCores(const std::string &id, int cores, bool increase);
 
+    // tasks taking cores in total have finished on the worker, their credit is returned
+    void releaseCores(const std::string &id, int cores, int tasks);
+
+    // Picks the worker other than thiefId that shares a queue with it, with the most prefetched
+    // tasks and no steal in progress, and marks it as being stolen from. O(n), runs only when a worker is idle.
+    // Returns a worker with an empty id if there is none
+    Worker beginSteal(const std::string &thiefId);
+
+    // the worker gave back tasks that took cores in total
+    void endSteal(const std::string &id, int cores, int tasks);
+
     void printLog();
 
+    // keeps the workers table in users.md up to date
+    void startReport(std::chrono::milliseconds interval);
+
+    ~UserDBService();
+
 private:
-    std::vector<Client> clients;
-    std::vector<Worker> workers;
+    std::mutex mtx;
+    std::unordered_map<std::string, Client> clients;
+    std::unordered_map<std::string, Worker> workers;
+
+    struct Pool {
+        // (free cores, id) of every worker
+        std::set<std::pair<int, std::string>> byFreeCores;
+        // (prefetch credit left, id) of every worker
+        std::set<std::pair<int, std::string>> byCredit;
+        // cores of every worker, they do not change with the load
+        std::multiset<int> sizes;
+    };
+
+    Pool all;
+    // workers of every queue
+    std::unordered_map<std::string, Pool> pools;
+
+    PeriodicReport report;
+
+    // called with mtx held
+    void setUsedCores(Worker &worker, int usedCores);
+
+    void setLoad(Worker &worker, int usedCores, int prefetched);
+
+    void index(const Worker &worker);
+
+    void unindex(const Worker &worker);
+
+    void enroll(const Worker &worker);
+
+    void unenroll(const Worker &worker);
+
+    // nullptr if no worker has taken tasks from the queue
+    Pool *poolOf(const std::string &queue);
+
 
     void saveStateToFile(const std::string &filename);
 };
@@ -0,0 +1,152 @@
+#include "Executor.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+    // index of the pool thread running this code, -1 outside the pool
+    thread_local long currentIndex = -1;
+    thread_local const Executor *currentExecutor = nullptr;
+}
+
+Executor::Executor(size_t threads, size_t capacity) {
+    if (threads == 0) {
+        threads = std::max(2u, std::thread::hardware_concurrency());
+    }
+    this->capacity = capacity;
+    for (size_t i = 0; i < threads; i++) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < threads; i++) {
+        this->threads.emplace_back(&Executor::run, this, i);
+    }
+}
+
+void Executor::submit(Job job) {
+    size_t index;
+    if (currentExecutor == this) {
+        // nested jobs skip the bound, a full pool waiting on itself would deadlock
+        index = currentIndex;
+        // counted before it is visible, a thief may run the job right away
+        queued++;
+    } else {
+        reserve();
+        index = nextQueue++ % queues.size();
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mtx);
+        queues[index]->jobs.push_back(std::move(job));
+    }
+    // idleMtx is only taken to wake a sleeping thread. A thread going to sleep counts itself
+    // before it checks queued, so one of the two sees the other
+    if (sleeping > 0) {
+        std::lock_guard<std::mutex> lock(idleMtx);
+        idleCv.notify_one();
+    }
+}
+
+void Executor::reserve() {
+    size_t count = queued;
+    for (;;) {
+        if (count < capacity) {
+            if (!queued.compare_exchange_weak(count, count + 1)) {
+                continue;
+            }
+            // checked after the job is counted: a thread only exits once it sees nothing queued
+            if (stopping) {
+                queued--;
+                throw std::runtime_error("Executor is stopped");
+            }
+            return;
+        }
+        std::unique_lock<std::mutex> lock(idleMtx);
+        waiting++;
+        spaceCv.wait(lock, [this] { return queued < capacity || stopping; });
+        waiting--;
+        if (stopping) {
+            throw std::runtime_error("Executor is stopped");
+        }
+        count = queued;
+    }
+}
+
+bool Executor::take(size_t index, Job &job) {
+    {
+        Queue &own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mtx);
+        if (!own.jobs.empty()) {
+            job = std::move(own.jobs.front());
+            own.jobs.pop_front();
+            return true;
+        }
+    }
+    // steal from the other end, the owner keeps its oldest jobs
+    for (size_t i = 1; i < queues.size(); i++) {
+        Queue &victim = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mtx);
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.back());
+            victim.jobs.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void Executor::run(size_t index) {
+    currentIndex = static_cast<long>(index);
+    currentExecutor = this;
+
+    for (;;) {
+        Job job;
+        if (take(index, job)) {
+            queued--;
+            if (waiting > 0) {
+                std::lock_guard<std::mutex> lock(idleMtx);
+                spaceCv.notify_one();
+            }
+            try {
+                job();
+            } catch (std::exception &e) {
+                std::cerr << "Executor job failed: " << e.what() << std::endl;
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(idleMtx);
+        if (queued == 0 && stopping) {
+            return;
+        }
+        sleeping++;
+        idleCv.wait(lock, [this] { return queued > 0 || stopping; });
+        sleeping--;
+    }
+}
+
+size_t Executor::pending() const {
+    return queued;
+}
+
+size_t Executor::threadCount() const {
+    return threads.size();
+}
+
+void Executor::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(idleMtx);
+        if (stopping) {
+            return;
+        }
+        stopping = true;
+    }
+    idleCv.notify_all();
+    spaceCv.notify_all();
+    for (auto &thread: threads) {
+        if (thread.joinable()) thread.join();
+    }
+}
+
+Executor::~Executor() {
+    shutdown();
+}
@@ -0,0 +1,64 @@
+#ifndef RABBIT_EXECUTOR_H
+#define RABBIT_EXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Пул потоков с собственной очередью у каждого потока.
+// Свободный поток сначала берет работу из своей очереди, потом ворует из чужих.
+// Очереди ограничены: внешний submit ждет, пока не освободится место
+class Executor {
+public:
+    using Job = std::function<void()>;
+
+    explicit Executor(size_t threads = 0, size_t capacity = 65536);
+
+    // From a pool thread the job goes to that thread's own queue and never blocks,
+    // otherwise queues are filled round robin
+    void submit(Job job);
+
+    size_t pending() const;
+
+    size_t threadCount() const;
+
+    // Runs everything already queued and joins the threads
+    void shutdown();
+
+    ~Executor();
+
+private:
+    struct Queue {
+        std::mutex mtx;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    size_t capacity;
+
+    std::atomic<size_t> queued{0};
+    std::atomic<size_t> nextQueue{0};
+    // потоки, ждущие работы, и submit, ждущие места. idleMtx берется только ради них
+    std::atomic<size_t> sleeping{0};
+    std::atomic<size_t> waiting{0};
+    std::mutex idleMtx;
+    std::condition_variable idleCv;
+    std::condition_variable spaceCv;
+    std::atomic<bool> stopping{false};
+
+    void run(size_t index);
+
+    // занимает место в очередях для внешнего submit, ждет, пока оно есть
+    void reserve();
+
+    bool take(size_t index, Job &job);
+};
+
+
+#endif //RABBIT_EXECUTOR_H
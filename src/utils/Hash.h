@@ -0,0 +1,33 @@
+#ifndef RABBIT_HASH_H
+#define RABBIT_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+// 64-битный XXH64: быстрый некриптографический хеш для ключей по содержимому.
+// Результат совпадает с эталонной реализацией xxHash
+uint64_t xxh64(const void *data, size_t size, uint64_t seed = 0);
+
+// Ключ по содержимому: два XXH64 с независимыми сидами и длина входа. Одинаковые ключи
+// считаются одинаковыми входами, совпадение 128 бит хеша при равной длине практически исключено
+struct ContentKey {
+    uint64_t hash;
+    uint64_t check;
+    uint64_t size;
+
+    bool operator==(const ContentKey &other) const {
+        return hash == other.hash && check == other.check && size == other.size;
+    }
+
+    bool operator!=(const ContentKey &other) const {
+        return !(*this == other);
+    }
+};
+
+struct ContentKeyHash {
+    size_t operator()(const ContentKey &key) const {
+        return static_cast<size_t>(key.hash);
+    }
+};
+
+#endif //RABBIT_HASH_H
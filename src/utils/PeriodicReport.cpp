@@ -0,0 +1,50 @@
+#include "PeriodicReport.h"
+
+#include <iostream>
+#include <stdexcept>
+
+void PeriodicReport::start(std::mutex &mtx, std::chrono::milliseconds interval, Write write) {
+    if (thread.joinable() || interval.count() <= 0) {
+        return;
+    }
+    this->mtx = &mtx;
+    this->interval = interval;
+    this->write = std::move(write);
+    dirty = true;
+    thread = std::thread(&PeriodicReport::run, this);
+}
+
+void PeriodicReport::touch() {
+    dirty = true;
+}
+
+void PeriodicReport::run() {
+    std::unique_lock<std::mutex> lock(*mtx);
+    while (!stopping) {
+        if (dirty) {
+            dirty = false;
+            try {
+                write();
+            } catch (std::exception &e) {
+                std::cerr << "[!] " << e.what() << std::endl;
+            }
+        }
+        cv.wait_for(lock, interval, [this] { return stopping; });
+    }
+}
+
+void PeriodicReport::stop() {
+    if (!thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(*mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    thread.join();
+}
+
+PeriodicReport::~PeriodicReport() {
+    stop();
+}
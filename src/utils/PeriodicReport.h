@@ -0,0 +1,42 @@
+#ifndef RABBIT_PERIODICREPORT_H
+#define RABBIT_PERIODICREPORT_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Отчет сервиса в файл: поток вызывает write не чаще раза в interval и только если
+// с прошлой записи что-то изменилось. Состояние защищено мьютексом владельца,
+// write вызывается под ним, ошибки записи печатаются и не останавливают поток
+class PeriodicReport {
+public:
+    using Write = std::function<void()>;
+
+    PeriodicReport() = default;
+
+    // Вызывается под mtx. Повторный запуск и interval <= 0 ничего не делают
+    void start(std::mutex &mtx, std::chrono::milliseconds interval, Write write);
+
+    // Вызывается под мьютексом владельца
+    void touch();
+
+    // Вызывается без мьютекса владельца, ждет завершения потока
+    void stop();
+
+    ~PeriodicReport();
+
+private:
+    std::mutex *mtx = nullptr;
+    std::chrono::milliseconds interval{0};
+    Write write;
+    bool dirty = false;
+    bool stopping = false;
+    std::thread thread;
+    std::condition_variable cv;
+
+    void run();
+};
+
+#endif //RABBIT_PERIODICREPORT_H
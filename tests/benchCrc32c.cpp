@@ -0,0 +1,56 @@
+// Cost of checksumming STIP packets while copying them, compared with the 10GbE line rate.
+// Usage: STIPBenchCrc32c [chunks], 4096 by default
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "protocol/Crc32c.h"
+#include "protocol/STIP.h"
+
+using namespace std;
+using namespace STIP;
+
+int main(int argc, char *argv[]) {
+    const size_t chunk = MAX_STIP_DATA_SIZE;
+    size_t chunks = argc > 1 ? stoull(argv[1]) : 4096;
+    vector<char> data(chunk * 16);
+    mt19937 rng(42);
+    for (auto &c: data) {
+        c = (char) rng();
+    }
+    vector<char> dst(chunk);
+
+    auto run = [&](bool withCrc) {
+        uint32_t sink = 0;
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < chunks; i++) {
+            const char *src = data.data() + (i % 16) * chunk;
+            if (withCrc) {
+                sink ^= crc32cCopy(dst.data(), src, chunk);
+            } else {
+                memcpy(dst.data(), src, chunk);
+                sink ^= (uint8_t) dst[i % chunk];
+            }
+        }
+        auto seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        volatile uint32_t keep = sink;
+        (void) keep;
+        return seconds;
+    };
+
+    run(true);
+    double copyTime = run(false);
+    double crcTime = run(true);
+    double bytes = (double) chunk * chunks;
+    // время передачи тех же данных по 10GbE
+    double lineTime = bytes * 8 / 10e9;
+    double overhead = (crcTime - copyTime) / lineTime * 100;
+
+    cout << "memcpy: " << bytes / copyTime / 1e9 << " GB/s, copy+crc32c: " << bytes / crcTime / 1e9
+         << " GB/s, hardware: " << crc32cHardwareSupported()
+         << ", overhead at 10GbE line rate: " << overhead << "%" << endl;
+    return 0;
+}
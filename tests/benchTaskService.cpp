@@ -0,0 +1,71 @@
+// Lookup and update cost of TaskService with a large table.
+// Usage: RabbitBenchTaskService [tasks], 10M by default
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "services/TaskService/TaskService.h"
+
+using namespace std;
+using namespace std::chrono;
+
+template<typename F>
+static void measure(const char *name, size_t operations, F f) {
+    auto start = steady_clock::now();
+    f();
+    double seconds = duration<double>(steady_clock::now() - start).count();
+    cout << name << ": " << operations << " ops, " << seconds << " s, "
+         << seconds * 1e9 / operations << " ns/op" << endl;
+}
+
+int main(int argc, char *argv[]) {
+    size_t count = argc > 1 ? stoull(argv[1]) : 10000000;
+    const size_t operations = 1000000;
+
+    TaskService service;
+    mt19937_64 rng(1);
+    vector<string> ids(operations);
+    for (auto &id: ids) {
+        id = "task-" + to_string(rng() % count);
+    }
+
+    measure("addTask", count, [&]() {
+        for (size_t i = 0; i < count; i++) {
+            service.addTask({"", "sum", "[1, 2]", "", 1, TaskStatus::Queued, "", "client"});
+        }
+    });
+
+    measure("findTaskByID", operations, [&]() {
+        size_t cores = 0;
+        for (auto &id: ids) {
+            cores += service.findTaskByID(id).cores;
+        }
+        if (cores != operations) cerr << "unexpected result" << endl;
+    });
+
+    measure("changeTaskStatus", operations, [&]() {
+        for (auto &id: ids) {
+            service.changeTaskStatus(id, TaskStatus::SentToWorker);
+        }
+    });
+
+    measure("updateTask", operations, [&]() {
+        for (auto &id: ids) {
+            Task task = service.findTaskByID(id);
+            task.status = TaskStatus::Ready;
+            task.output = "3";
+            service.updateTask(task);
+        }
+    });
+
+    RetentionPolicy policy;
+    policy.maxFinished = service.countByStatus(TaskStatus::Ready) / 2;
+    size_t evicted = service.countByStatus(TaskStatus::Ready) - policy.maxFinished;
+    measure("retention", evicted, [&]() {
+        service.setRetentionPolicy(policy);
+    });
+
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "services/Admission/Admission.h"
+#include "DataModel/Message.h"
+
+using namespace std;
+
+TEST(Admission, TokenBucket) {
+    AdmissionOptions options;
+    options.rate = 100;
+    options.burst = 10;
+    Admission admission;
+    admission.configure(options);
+
+    ASSERT_TRUE(admission.admit("a", 10).admitted);
+    auto decision = admission.admit("a", 5);
+    ASSERT_FALSE(decision.admitted);
+    // five tokens at 100 per second
+    ASSERT_GT(decision.retryAfter, 0);
+    ASSERT_LE(decision.retryAfter, 50);
+    // clients do not share a bucket
+    ASSERT_TRUE(admission.admit("b", 1).admitted);
+    ASSERT_EQ(admission.admit("a", 11).retryAfter, -1);
+
+    this_thread::sleep_for(chrono::milliseconds(60));
+    ASSERT_TRUE(admission.admit("a", 5).admitted);
+    ASSERT_EQ(admission.rejected(), 16u);
+}
+
+TEST(Admission, OutstandingQuota) {
+    AdmissionOptions options;
+    options.maxOutstanding = 3;
+    Admission admission;
+    admission.configure(options);
+
+    ASSERT_TRUE(admission.admit("a", 2).admitted);
+    ASSERT_TRUE(admission.admit("a", 1).admitted);
+    auto decision = admission.admit("a", 1);
+    ASSERT_FALSE(decision.admitted);
+    ASSERT_EQ(decision.retryAfter, 0);
+
+    admission.release("a");
+    ASSERT_EQ(admission.outstanding("a"), 2u);
+    ASSERT_TRUE(admission.admit("a", 1).admitted);
+}
+
+TEST(Admission, RejectMessage) {
+    for (auto format: {WireFormat::Binary, WireFormat::Json}) {
+        struct TaskReject reject = {{"t1", "t2"}, 250, "rate limit"};
+        string packed = packMessage(MessageType::TaskReject, reject, format);
+        Message message;
+        ASSERT_TRUE(unpackMessage(packed.data(), packed.size(), message));
+        ASSERT_EQ(message.action, MessageType::TaskReject);
+        struct TaskReject decoded;
+        ASSERT_TRUE(unpackPayload(message, decoded));
+        ASSERT_EQ(decoded.ids, reject.ids);
+        ASSERT_EQ(decoded.retryAfter, 250);
+        ASSERT_EQ(decoded.reason, "rate limit");
+    }
+}
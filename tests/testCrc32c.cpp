@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "protocol/Crc32c.h"
+#include "protocol/STIP.h"
+
+using namespace std;
+using namespace STIP;
+
+static vector<char> randomData(size_t size) {
+    vector<char> data(size);
+    mt19937 rng(42);
+    for (auto &c: data) {
+        c = (char) rng();
+    }
+    return data;
+}
+
+TEST(Crc32c, KnownVector) {
+    const char *check = "123456789";
+    ASSERT_EQ(crc32c(check, 9), 0xE3069283u);
+    ASSERT_EQ(crc32cSoftware(check, 9), 0xE3069283u);
+    ASSERT_EQ(crc32c(check, 0), 0u);
+}
+
+TEST(Crc32c, HardwareMatchesSoftware) {
+    auto data = randomData(100000);
+    // разные длины и невыровненные начала
+    for (size_t offset = 0; offset < 9; offset++) {
+        for (size_t size: {0, 1, 7, 8, 15, 64, 1000, 65000}) {
+            ASSERT_EQ(crc32c(data.data() + offset, size), crc32cSoftware(data.data() + offset, size));
+        }
+    }
+}
+
+TEST(Crc32c, Incremental) {
+    auto data = randomData(10000);
+    uint32_t crc = crc32c(data.data(), 3333);
+    crc = crc32c(data.data() + 3333, data.size() - 3333, crc);
+    ASSERT_EQ(crc, crc32c(data.data(), data.size()));
+}
+
+TEST(Crc32c, CopyMatches) {
+    auto data = randomData(MAX_STIP_DATA_SIZE);
+    vector<char> copy(data.size());
+    for (size_t offset = 0; offset < 9; offset++) {
+        size_t size = data.size() - offset;
+        uint32_t crc = crc32cCopy(copy.data(), data.data() + offset, size);
+        ASSERT_EQ(crc, crc32c(data.data() + offset, size));
+        ASSERT_EQ(memcmp(copy.data(), data.data() + offset, size), 0);
+    }
+}
+
+TEST(Crc32c, DetectsCorruption) {
+    auto data = randomData(MAX_STIP_DATA_SIZE);
+    uint32_t crc = crc32c(data.data(), data.size());
+    data[12345] ^= 1;
+    ASSERT_NE(crc, crc32c(data.data(), data.size()));
+}
@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "services/Dataflow/Dataflow.h"
+
+using namespace std;
+
+static Dataflow::Completion complete(Dataflow &dataflow, const string &id, bool done, const string &output) {
+    return dataflow.complete(id, done, output.data(), output.size());
+}
+
+TEST(Dataflow, ReleasesInDependencyOrder) {
+    Dataflow dataflow;
+    vector<string> ready;
+    // a and b run in parallel, c takes both, d takes c
+    ASSERT_EQ(dataflow.add({{"c", R"({"x": {"$ref": "a"}, "y": [{"$ref": "b"}, {"$ref": "a"}]})"},
+                            {"a", "[1, 2]"},
+                            {"b", "not json"},
+                            {"d", R"([{"$ref": "c"}])"}}, ready), "");
+    sort(ready.begin(), ready.end());
+    ASSERT_EQ(ready, (vector<string>{"a", "b"}));
+    ASSERT_EQ(dataflow.waiting(), 2u);
+
+    auto a = complete(dataflow, "a", true, "[3]");
+    ASSERT_TRUE(a.tracked);
+    ASSERT_FALSE(a.sink);
+    ASSERT_TRUE(a.released.empty());
+    auto b = complete(dataflow, "b", true, "plain text");
+    ASSERT_EQ(b.released, (vector<string>{"c"}));
+    ASSERT_EQ(dataflow.wire("c", R"({"x": {"$ref": "a"}, "y": [{"$ref": "b"}, {"$ref": "a"}]})"),
+              R"({"x":[3],"y":["plain text",[3]]})");
+
+    auto c = complete(dataflow, "c", true, "7");
+    ASSERT_EQ(c.released, (vector<string>{"d"}));
+    ASSERT_EQ(dataflow.wire("d", R"([{"$ref": "c"}])"), "[7]");
+    auto d = complete(dataflow, "d", true, "49");
+    ASSERT_TRUE(d.sink);
+    ASSERT_EQ(dataflow.waiting(), 0u);
+
+    // nothing of the graph is kept
+    ASSERT_FALSE(complete(dataflow, "a", true, "[3]").tracked);
+    ASSERT_FALSE(complete(dataflow, "other", true, "").tracked);
+}
+
+TEST(Dataflow, InvalidGraphsAreRefused) {
+    Dataflow dataflow;
+    vector<string> ready;
+    ASSERT_NE(dataflow.add({{"", "1"}}, ready), "");
+    ASSERT_NE(dataflow.add({{"a", "1"}, {"a", "2"}}, ready), "");
+    ASSERT_NE(dataflow.add({{"a", R"({"$ref": "z"})"}}, ready), "");
+    ASSERT_NE(dataflow.add({{"a", R"([{"$ref": "b"}])"}, {"b", R"([{"$ref": "a"}])"}, {"c", "1"}}, ready), "");
+    ASSERT_NE(dataflow.add({{"a", R"({"$ref": "a"})"}}, ready), "");
+    ASSERT_TRUE(ready.empty());
+
+    // an object with more than the reference is plain data
+    ASSERT_EQ(dataflow.add({{"a", R"({"$ref": "z", "other": 1})"}}, ready), "");
+    ASSERT_EQ(ready, (vector<string>{"a"}));
+    ASSERT_NE(dataflow.add({{"a", "1"}}, ready), "");
+}
+
+TEST(Dataflow, FailureBlocksDependents) {
+    Dataflow dataflow;
+    vector<string> ready;
+    ASSERT_EQ(dataflow.add({{"a", "1"},
+                            {"b", "2"},
+                            {"c", R"([{"$ref": "a"}, {"$ref": "b"}])"},
+                            {"d", R"([{"$ref": "c"}, {"$ref": "b"}])"},
+                            {"e", R"([{"$ref": "b"}])"}}, ready), "");
+
+    ASSERT_EQ(complete(dataflow, "b", true, "2").released, (vector<string>{"e"}));
+    auto a = complete(dataflow, "a", false, "error");
+    ASSERT_EQ(a.blocked, (vector<string>{"c"}));
+    // the server fails c, which blocks d in turn
+    auto c = complete(dataflow, "c", false, "task a it depends on failed");
+    ASSERT_EQ(c.blocked, (vector<string>{"d"}));
+    ASSERT_TRUE(complete(dataflow, "d", false, "task c it depends on failed").sink);
+
+    // the output of b is still there for e
+    ASSERT_EQ(dataflow.wire("e", R"([{"$ref": "b"}])"), "[2]");
+    ASSERT_TRUE(complete(dataflow, "e", true, "4").sink);
+    ASSERT_FALSE(complete(dataflow, "b", true, "2").tracked);
+}
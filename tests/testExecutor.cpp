@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "utils/Executor.h"
+
+using namespace std;
+
+// jobs wait on it until it is opened
+struct Gate {
+    mutex mtx;
+    condition_variable cv;
+    bool open = false;
+
+    void wait() {
+        unique_lock<mutex> lock(mtx);
+        cv.wait(lock, [this] { return open; });
+    }
+
+    void release() {
+        {
+            lock_guard<mutex> lock(mtx);
+            open = true;
+        }
+        cv.notify_all();
+    }
+};
+
+static bool waitFor(const atomic<int> &counter, int value) {
+    for (int i = 0; i < 1000 && counter < value; i++) {
+        this_thread::sleep_for(chrono::milliseconds(2));
+    }
+    return counter == value;
+}
+
+TEST(Executor, IdleThreadStealsJobs) {
+    Executor executor(2);
+    atomic<int> done{0};
+    atomic<bool> stolen{false};
+    executor.submit([&]() {
+        // nested jobs go to this thread's queue, which it does not get back to
+        for (int i = 0; i < 10; i++) {
+            executor.submit([&]() {
+                done++;
+            });
+        }
+        stolen = waitFor(done, 10);
+    });
+    executor.shutdown();
+    ASSERT_TRUE(stolen);
+}
+
+TEST(Executor, NestedSubmitsSkipTheBound) {
+    Executor executor(2, 1);
+    atomic<int> done{0};
+    executor.submit([&]() {
+        // far more than the capacity, a bounded submit here would wait on itself
+        for (int i = 0; i < 100; i++) {
+            executor.submit([&]() {
+                done++;
+            });
+        }
+    });
+    // outer submits wait for room meanwhile
+    for (int i = 0; i < 100; i++) {
+        executor.submit([&]() {
+            done++;
+        });
+    }
+    ASSERT_TRUE(waitFor(done, 200));
+    executor.shutdown();
+}
+
+TEST(Executor, SubmitWaitsForRoom) {
+    Executor executor(1, 2);
+    Gate gate;
+    atomic<bool> started{false};
+    executor.submit([&]() {
+        started = true;
+        gate.wait();
+    });
+    while (!started) {
+        this_thread::yield();
+    }
+    executor.submit([]() {});
+    executor.submit([]() {});
+    ASSERT_EQ(executor.pending(), 2u);
+
+    atomic<bool> submitted{false};
+    thread submitter([&]() {
+        executor.submit([]() {});
+        submitted = true;
+    });
+    this_thread::sleep_for(chrono::milliseconds(50));
+    ASSERT_FALSE(submitted);
+    ASSERT_EQ(executor.pending(), 2u);
+
+    gate.release();
+    submitter.join();
+    ASSERT_TRUE(submitted);
+    executor.shutdown();
+    ASSERT_EQ(executor.pending(), 0u);
+}
+
+TEST(Executor, ShutdownRunsQueuedJobs) {
+    Executor executor(4, 64);
+    atomic<int> done{0};
+    for (int i = 0; i < 1000; i++) {
+        executor.submit([&]() {
+            this_thread::sleep_for(chrono::microseconds(10));
+            done++;
+        });
+    }
+    executor.shutdown();
+    ASSERT_EQ(done, 1000);
+    ASSERT_THROW(executor.submit([]() {}), runtime_error);
+}
@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+
+#include "protocol/Connection.h"
+#include "server/STIPServer.h"
+#include "client/STIPClient.h"
+#include "services/HeartbeatMonitor/HeartbeatMonitor.h"
+#include "DataModel/Message.h"
+
+#include "util/UdpProxy.h"
+
+using namespace std;
+using namespace STIP;
+
+using boost::asio::ip::udp;
+
+#define DEF_PROXY_PORT 12236
+#define DEF_SERVER_PORT 12233
+#define DEF_CLIENT_PORT 12234
+
+TEST(HeartbeatMonitor, LostWorkerIsDropped) {
+    udp::endpoint server_endpoint = udp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), DEF_SERVER_PORT);
+    udp::endpoint client_endpoint = udp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), DEF_CLIENT_PORT);
+    udp::endpoint proxy_endpoint = udp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), DEF_PROXY_PORT);
+
+    UdpProxy proxy(DEF_CLIENT_PORT, DEF_SERVER_PORT, DEF_PROXY_PORT);
+    proxy.async_start();
+
+    boost::asio::io_context io_context_server;
+    udp::socket socket_server(io_context_server, server_endpoint);
+    STIPServer server(socket_server);
+
+    // the broker side: every message counts as a sign of life
+    HeartbeatMonitor monitor;
+    promise<Connection *> accepted;
+    shared_future<Connection *> workerConnection = accepted.get_future().share();
+    promise<string> dropped;
+    monitor.start(chrono::milliseconds(300), [&](const string &id) {
+        dropped.set_value(id);
+        workerConnection.get()->stopProcessing();
+    });
+
+    atomic<int> heartbeats{0};
+    thread processor;
+    thread serverThread([&] {
+        for (;;) {
+            Connection *connection = server.acceptConnection();
+            if (connection == nullptr) break;
+            accepted.set_value(connection);
+            processor = thread([&, connection] {
+                for (;;) {
+                    ReceiveMessageSession *received = connection->receiveMessage();
+                    if (received == nullptr) break;
+                    monitor.touch("worker-1");
+                    heartbeats++;
+                    delete received;
+                }
+                server.closeConnection(connection);
+            });
+        }
+    });
+
+    this_thread::sleep_for(chrono::milliseconds(200));
+
+    boost::asio::io_context io_context;
+    udp::socket socket(io_context);
+    socket.open(udp::v4());
+    socket.bind(client_endpoint);
+    STIPClient client(socket);
+    client.startListen();
+    Connection *connection = client.connect(proxy_endpoint);
+    ASSERT_NE(connection, nullptr);
+
+    atomic<bool> beating{true};
+    thread worker([&] {
+        struct Heartbeat heartbeat;
+        string message = packMessage(MessageType::Heartbeat, heartbeat);
+        while (beating) {
+            connection->sendMessage(message, Priority::CONTROL);
+            this_thread::sleep_for(chrono::milliseconds(50));
+        }
+    });
+
+    auto dead = dropped.get_future();
+    // regular heartbeats keep the worker alive well past the timeout
+    ASSERT_EQ(dead.wait_for(chrono::milliseconds(1000)), future_status::timeout);
+    ASSERT_GT(heartbeats.load(), 5);
+
+    // the link goes down, the worker's sends only time out from now on
+    proxy.setLossPercentage(100);
+    beating = false;
+    auto lost = chrono::steady_clock::now();
+    ASSERT_EQ(dead.wait_for(chrono::milliseconds(2000)), future_status::ready);
+    ASSERT_EQ(dead.get(), "worker-1");
+    ASSERT_LT(chrono::steady_clock::now() - lost, chrono::milliseconds(1000));
+
+    // the receiving thread is released instead of blocking forever
+    processor.join();
+    worker.join();
+
+    monitor.close();
+    socket_server.cancel();
+    serverThread.join();
+    socket_server.close();
+    client.stopListen();
+    proxy.async_stop();
+}
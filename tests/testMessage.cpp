@@ -0,0 +1,181 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "DataModel/Message.h"
+
+using namespace std;
+
+template<typename T>
+static T roundTrip(MessageType action, const T &value, WireFormat format) {
+    string packed = packMessage(action, value, format);
+    Message message;
+    EXPECT_TRUE(unpackMessage(packed.data(), packed.size(), message));
+    EXPECT_EQ(message.action, action);
+    EXPECT_EQ(message.format, format);
+    T result;
+    EXPECT_TRUE(unpackPayload(message, result));
+    return result;
+}
+
+TEST(Message, RoundTrip) {
+    for (auto format: {WireFormat::Binary, WireFormat::Json}) {
+        struct TaskRequest request = {"task-1", "determinant", "[[[1, 2], [3, 4]]]", 4};
+        struct TaskRequest request2 = roundTrip(MessageType::TaskRequest, request, format);
+        ASSERT_EQ(request2.id, request.id);
+        ASSERT_EQ(request2.func, request.func);
+        ASSERT_EQ(request2.data, request.data);
+        ASSERT_EQ(request2.cores, 4);
+
+        struct TaskResult result = {"task-1", "[-2]", 1};
+        struct TaskResult result2 = roundTrip(MessageType::TaskResult, result, format);
+        ASSERT_EQ(result2.id, result.id);
+        ASSERT_EQ(result2.data, result.data);
+        ASSERT_EQ(result2.status, 1);
+
+        Worker worker = {"worker-1", 16, 3, nullptr};
+        Worker worker2 = roundTrip(MessageType::RegisterWorker, worker, format);
+        ASSERT_EQ(worker2.id, worker.id);
+        ASSERT_EQ(worker2.cores, 16);
+        ASSERT_EQ(worker2.usedCores, 3);
+        ASSERT_TRUE(worker2.queues.empty());
+        worker.queues = {"heavy", "matrix"};
+        ASSERT_EQ(roundTrip(MessageType::RegisterWorker, worker, format).queues, worker.queues);
+
+        Client client = {"client-1", nullptr};
+        ASSERT_EQ(roundTrip(MessageType::RegisterClient, client, format).id, client.id);
+    }
+}
+
+TEST(Message, BinaryPayloadIsOpaque) {
+    // any bytes, including zeros and quotes, go through unchanged
+    string data("\0\"{}\xff\\", 7);
+    struct TaskRequest request = {"id", "f", data, 1};
+    ASSERT_EQ(roundTrip(MessageType::TaskRequest, request, WireFormat::Binary).data, data);
+}
+
+TEST(Message, MalformedIsRejected) {
+    struct TaskRequest request = {"task-1", "simpleMath", "{\"a\": 1, \"b\": 2}", 1};
+    string packed = packMessage(MessageType::TaskRequest, request);
+
+    Message message;
+    for (size_t size = 0; size < packed.size(); size++) {
+        struct TaskRequest decoded;
+        ASSERT_FALSE(unpackMessage(packed.data(), size, message) && unpackPayload(message, decoded));
+    }
+
+    string otherVersion = packed;
+    otherVersion[1] = wire::VERSION + 1;
+    ASSERT_FALSE(unpackMessage(otherVersion.data(), otherVersion.size(), message));
+
+    string garbage = "{not json";
+    ASSERT_FALSE(unpackMessage(garbage.data(), garbage.size(), message));
+}
+
+TEST(Message, ViewReadsInPlace) {
+    string data(1000, 'x');
+    struct TaskRequest request = {"task-1", "sum", data, 2};
+    string packed = packTaskRequest("task-1", "sum", 2, data);
+    ASSERT_EQ(packed, packMessage(MessageType::TaskRequest, request));
+
+    MessageView view;
+    ASSERT_TRUE(unpackMessage(packed.data(), packed.size(), view));
+    TaskRequestHeader header;
+    ASSERT_TRUE(unpackHeader(view, header));
+    ASSERT_EQ(header.id, "task-1");
+    ASSERT_EQ(header.cores, 2);
+    // the data is not copied out of the message
+    ASSERT_EQ(header.data, packed.data() + packed.size() - data.size());
+    ASSERT_EQ(header.dataSize, data.size());
+
+    // a JSON message is read through the same view
+    struct TaskResult result = {"task-1", "[3]", 1};
+    string json = packMessage(MessageType::TaskResult, result, WireFormat::Json);
+    ASSERT_TRUE(unpackMessage(json.data(), json.size(), view));
+    ASSERT_EQ(view.format, WireFormat::Json);
+    TaskResultHeader resultHeader;
+    ASSERT_TRUE(unpackHeader(view, resultHeader));
+    ASSERT_EQ(resultHeader.id, "task-1");
+    ASSERT_EQ(string(resultHeader.data, resultHeader.dataSize), "[3]");
+}
+
+TEST(Message, BatchHeaders) {
+    for (auto format: {WireFormat::Binary, WireFormat::Json}) {
+        struct TaskBatchRequest batch;
+        for (int i = 0; i < 100; i++) {
+            batch.tasks.push_back({"task-" + to_string(i), "sum", "[" + to_string(i) + "]", i % 3 + 1});
+        }
+        string packed = packMessage(MessageType::TaskBatchRequest, batch, format);
+
+        MessageView view;
+        ASSERT_TRUE(unpackMessage(packed.data(), packed.size(), view));
+        ASSERT_EQ(view.action, MessageType::TaskBatchRequest);
+        vector<TaskRequestHeader> headers;
+        ASSERT_TRUE(unpackHeaders(view, headers));
+        ASSERT_EQ(headers.size(), 100u);
+        ASSERT_EQ(headers[42].id, "task-42");
+        ASSERT_EQ(headers[42].cores, 1);
+        ASSERT_EQ(string(headers[42].data, headers[42].dataSize), "[42]");
+    }
+
+    // a graph is read like a batch
+    for (auto format: {WireFormat::Binary, WireFormat::Json}) {
+        struct TaskGraph graph;
+        graph.tasks.push_back({"a", "sum", "[1, 2]", 1});
+        graph.tasks.push_back({"b", "sum", "[{\"$ref\": \"a\"}, 3]", 2, 0, 0, 5});
+        string packed = packMessage(MessageType::TaskGraph, graph, format);
+
+        MessageView view;
+        ASSERT_TRUE(unpackMessage(packed.data(), packed.size(), view));
+        ASSERT_EQ(view.action, MessageType::TaskGraph);
+        vector<TaskRequestHeader> headers;
+        ASSERT_TRUE(unpackHeaders(view, headers));
+        ASSERT_EQ(headers.size(), 2u);
+        ASSERT_EQ(headers[1].id, "b");
+        ASSERT_EQ(headers[1].priority, 5);
+        ASSERT_EQ(string(headers[1].data, headers[1].dataSize), graph.tasks[1].data);
+    }
+
+    vector<TaskResultHeader> results = {{"a", 1, "1", 1}, {"b", 1, "22", 2}};
+    string packed = packResultBatch(results, WireFormat::Binary);
+    Message message;
+    struct TaskBatchResult batch;
+    ASSERT_TRUE(unpackMessage(packed.data(), packed.size(), message));
+    ASSERT_TRUE(unpackPayload(message, batch));
+    ASSERT_EQ(batch.results.size(), 2u);
+    ASSERT_EQ(batch.results[1].id, "b");
+    ASSERT_EQ(batch.results[1].data, "22");
+}
+
+TEST(Message, LimitsAreOptional) {
+    for (auto format: {WireFormat::Binary, WireFormat::Json}) {
+        struct TaskRequest request = {"task-1", "sum", "[1]", 1, 1700000000123, 250};
+        struct TaskRequest request2 = roundTrip(MessageType::TaskRequest, request, format);
+        ASSERT_EQ(request2.deadline, 1700000000123);
+        ASSERT_EQ(request2.timeout, 250);
+
+        // only some tasks of a batch have limits
+        struct TaskBatchRequest batch;
+        batch.tasks.push_back({"a", "sum", "[1]", 1});
+        batch.tasks.push_back({"b", "sum", "[2]", 2, 0, 500});
+        batch.tasks.push_back({"c", "sum", "[3]", 1, 0, 0, 7});
+        string packed = packMessage(MessageType::TaskBatchRequest, batch, format);
+        MessageView view;
+        ASSERT_TRUE(unpackMessage(packed.data(), packed.size(), view));
+        vector<TaskRequestHeader> headers;
+        ASSERT_TRUE(unpackHeaders(view, headers));
+        ASSERT_EQ(headers.size(), 3u);
+        ASSERT_EQ(headers[0].timeout, 0);
+        ASSERT_EQ(headers[1].timeout, 500);
+        ASSERT_EQ(headers[1].priority, 0);
+        ASSERT_EQ(headers[2].priority, 7);
+        ASSERT_EQ(string(headers[1].data, headers[1].dataSize), "[2]");
+    }
+
+    // a message without limits is as long as before they were added
+    struct TaskRequest plain = {"task-1", "sum", "[1]", 1};
+    struct TaskRequest limited = plain;
+    limited.timeout = 1;
+    ASSERT_EQ(packMessage(MessageType::TaskRequest, limited).size(),
+              packMessage(MessageType::TaskRequest, plain).size() + 12);
+}
@@ -353,6 +353,68 @@ TEST(Protocol, MessageTransferingWithProxyDropInitPackets) {
     proxy.async_stop();
 }
 
+TEST(Protocol, MessageTransferingWithProxyCorruptDataPackets) {
+    udp::endpoint server_endpoint = udp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), DEF_SERVER_PORT);
+    udp::endpoint client_endpoint = udp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), DEF_CLIENT_PORT);
+    udp::endpoint proxy_endpoint = udp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), DEF_PROXY_PORT);
+
+    UdpProxy proxy(DEF_CLIENT_PORT, DEF_SERVER_PORT, DEF_PROXY_PORT);
+    // portions of the data parts arrive damaged, receiver has to drop and re-request them
+    proxy.runTest_4(3);
+    proxy.async_start();
+
+    std::string test_string(300000, 'a');
+    for (size_t i = 0; i < test_string.size(); i++) {
+        test_string[i] = (char) ('a' + i % 26);
+    }
+
+    boost::asio::io_context io_context_server;
+
+    udp::socket socket_server(io_context_server, server_endpoint);
+    STIPServer server(socket_server);
+
+    std::vector<thread> threadsProcessors;
+    std::thread serverThread([&server, &test_string, &threadsProcessors] {
+        for (;;) {
+            Connection *serverconnection = server.acceptConnection();
+            if (serverconnection == nullptr) break;
+
+            threadsProcessors.emplace_back([serverconnection, &test_string] {
+                ReceiveMessageSession *received = serverconnection->receiveMessage();
+                std::string receivedMessage = received->getDataAsString();
+                std::cout << "[SERVER THREAD] Corrupted parts dropped: " << received->getCorruptedParts() << endl;
+                ASSERT_EQ(received->getCorruptedParts(), 3);
+                ASSERT_EQ(receivedMessage, test_string);
+                delete received;
+            });
+        }
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    boost::asio::io_context io_context;
+
+    udp::socket socket(io_context);
+    socket.open(udp::v4());
+    socket.bind(client_endpoint);
+
+    STIPClient client(socket);
+    client.startListen();
+
+    Connection *connection = client.connect(proxy_endpoint);
+
+    ASSERT_TRUE(connection->sendMessage(test_string));
+
+    for (auto &th : threadsProcessors) th.join();
+
+    socket_server.cancel();
+    serverThread.join();
+
+    socket_server.close();
+    client.stopListen();
+    proxy.async_stop();
+}
+
 
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "services/ResultBatcher/ResultBatcher.h"
+
+using namespace std;
+
+struct Delivered {
+    mutex mtx;
+    vector<pair<string, string>> messages;
+
+    ResultBatcher::Deliver callback() {
+        return [this](const string &client, const char *data, size_t size) {
+            lock_guard<mutex> lock(mtx);
+            messages.emplace_back(client, string(data, size));
+        };
+    }
+};
+
+static vector<struct TaskResult> resultsOf(const string &packed) {
+    Message message;
+    EXPECT_TRUE(unpackMessage(packed.data(), packed.size(), message));
+    struct TaskBatchResult batch;
+    if (message.action == MessageType::TaskResult) {
+        batch.results.emplace_back();
+        EXPECT_TRUE(unpackPayload(message, batch.results[0]));
+    } else {
+        EXPECT_TRUE(unpackPayload(message, batch));
+    }
+    return batch.results;
+}
+
+TEST(ResultBatcher, CoalescesPerClient) {
+    Delivered delivered;
+    ResultBatcher batcher;
+    batcher.start(chrono::milliseconds(50), 1 << 20, WireFormat::Binary, delivered.callback());
+
+    auto owner = make_shared<string>("output");
+    for (int i = 0; i < 100; i++) {
+        batcher.add(i % 2 ? "odd" : "even", owner, {to_string(i), 1, owner->data(), owner->size()});
+    }
+    // a result alone in its window is relayed in its original message
+    struct TaskResult single = {"alone", "1", 1};
+    auto raw = make_shared<string>(packMessage(MessageType::TaskResult, single));
+    batcher.add("third", raw, {"alone", 1, "1", 1}, raw->data(), raw->size());
+    batcher.close();
+
+    ASSERT_EQ(delivered.messages.size(), 3u);
+    for (auto &message: delivered.messages) {
+        if (message.first == "third") {
+            ASSERT_EQ(message.second, *raw);
+            continue;
+        }
+        auto results = resultsOf(message.second);
+        ASSERT_EQ(results.size(), 50u);
+        ASSERT_EQ(results[0].id, message.first == "even" ? "0" : "1");
+        ASSERT_EQ(results[49].data, "output");
+    }
+}
+
+TEST(ResultBatcher, FullBatchGoesOutEarly) {
+    Delivered delivered;
+    ResultBatcher batcher;
+    batcher.start(chrono::seconds(10), 10 * (1 + 100 + 12), WireFormat::Binary, delivered.callback());
+
+    auto owner = make_shared<string>(100, 'x');
+    for (int i = 0; i < 10; i++) {
+        batcher.add("client", owner, {to_string(i), 1, owner->data(), owner->size()});
+    }
+    // the tenth result fills the batch (id, data and 12 bytes of framing each), the window is not waited for
+    {
+        lock_guard<mutex> lock(delivered.mtx);
+        ASSERT_EQ(delivered.messages.size(), 1u);
+        ASSERT_EQ(resultsOf(delivered.messages[0].second).size(), 10u);
+    }
+    batcher.close();
+}
+
+TEST(ResultBatcher, SlowClientDoesNotHoldOthers) {
+    Delivered delivered;
+    ResultBatcher batcher;
+    mutex stalled;
+    unique_lock<mutex> stall(stalled);
+    vector<thread> senders;
+    mutex sendersMtx;
+    auto deliver = delivered.callback();
+    batcher.start(chrono::milliseconds(5), 1 << 20, WireFormat::Binary,
+                  [&](const string &client, const char *data, size_t size) {
+                      if (client == "slow") {
+                          // the network of this client hangs
+                          lock_guard<mutex> wait(stalled);
+                      }
+                      deliver(client, data, size);
+                  }, [&](function<void()> job) {
+                      lock_guard<mutex> lock(sendersMtx);
+                      senders.emplace_back(std::move(job));
+                  });
+
+    auto owner = make_shared<string>("output");
+    batcher.add("slow", owner, {"1", 1, owner->data(), owner->size()});
+    this_thread::sleep_for(chrono::milliseconds(20));
+    batcher.add("slow", owner, {"2", 1, owner->data(), owner->size()});
+    batcher.add("fast", owner, {"3", 1, owner->data(), owner->size()});
+    for (int i = 0; i < 200; i++) {
+        {
+            lock_guard<mutex> lock(delivered.mtx);
+            if (!delivered.messages.empty()) break;
+        }
+        this_thread::sleep_for(chrono::milliseconds(5));
+    }
+    {
+        lock_guard<mutex> lock(delivered.mtx);
+        ASSERT_EQ(delivered.messages.size(), 1u);
+        ASSERT_EQ(delivered.messages[0].first, "fast");
+    }
+    {
+        // one batch of the slow client is on the way, its second result waits behind it
+        lock_guard<mutex> lock(sendersMtx);
+        ASSERT_EQ(senders.size(), 2u);
+    }
+
+    stall.unlock();
+    batcher.close();
+    lock_guard<mutex> lock(sendersMtx);
+    for (auto &sender: senders) {
+        sender.join();
+    }
+    ASSERT_EQ(delivered.messages.size(), 3u);
+}
+
+TEST(ResultBatcher, RefusedPostSendsInline) {
+    Delivered delivered;
+    ResultBatcher batcher;
+    batcher.start(chrono::milliseconds(5), 1 << 20, WireFormat::Binary, delivered.callback(),
+                  [](function<void()>) {
+                      throw runtime_error("Executor is stopped");
+                  });
+
+    auto owner = make_shared<string>("output");
+    batcher.add("client", owner, {"1", 1, owner->data(), owner->size()});
+    this_thread::sleep_for(chrono::milliseconds(30));
+    {
+        lock_guard<mutex> lock(delivered.mtx);
+        ASSERT_EQ(delivered.messages.size(), 1u);
+    }
+    // the client is not left waiting for a batch that never went out
+    batcher.add("client", owner, {"2", 1, owner->data(), owner->size()});
+    batcher.close();
+    ASSERT_EQ(delivered.messages.size(), 2u);
+}
@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "services/ResultCache/ResultCache.h"
+#include "utils/Hash.h"
+
+using namespace std;
+
+static ResultCache::Key keyOf(uint64_t hash) {
+    return {hash, hash, 0};
+}
+
+static ResultCacheOptions withBudget(size_t maxBytes) {
+    ResultCacheOptions options;
+    options.maxBytes = maxBytes;
+    return options;
+}
+
+TEST(Hash, Xxh64Vectors) {
+    ASSERT_EQ(xxh64("", 0), 0xEF46DB3751D8E999ull);
+    ASSERT_EQ(xxh64("a", 1), 0xD24EC4F1A98C6E5Bull);
+    ASSERT_EQ(xxh64("abc", 3), 0x44BC2CF5AD770999ull);
+}
+
+TEST(ResultCache, HitAfterInsert) {
+    ResultCache cache;
+    cache.configure(withBudget(1 << 20));
+    string input = "[1, 2]";
+    auto key = ResultCache::keyOf("sum", input.data(), input.size());
+    // the same input to another function is another entry
+    ASSERT_NE(key, ResultCache::keyOf("mul", input.data(), input.size()));
+
+    string output;
+    ASSERT_FALSE(cache.lookup(key, input.size(), output));
+    cache.insert(key, "sum", "3");
+    ASSERT_TRUE(cache.lookup(key, input.size(), output));
+    ASSERT_EQ(output, "3");
+
+    auto stats = cache.stats();
+    ASSERT_EQ(stats.hits, 1u);
+    ASSERT_EQ(stats.misses, 1u);
+    ASSERT_EQ(stats.bytesSaved, input.size() + 1);
+}
+
+TEST(ResultCache, PolicyAndTtl) {
+    auto options = withBudget(1 << 20);
+    options.functions["random"].cacheable = false;
+    options.functions["clock"].ttl = chrono::seconds(1);
+    ResultCache cache;
+    cache.configure(options);
+    ASSERT_FALSE(cache.cacheable("random"));
+    ASSERT_TRUE(cache.cacheable("sum"));
+
+    cache.insert(keyOf(1), "random", "4");
+    cache.insert(keyOf(2), "clock", "12:00");
+    string output;
+    ASSERT_FALSE(cache.lookup(keyOf(1), 0, output));
+    ASSERT_TRUE(cache.lookup(keyOf(2), 0, output));
+
+    this_thread::sleep_for(chrono::milliseconds(1100));
+    ASSERT_FALSE(cache.lookup(keyOf(2), 0, output));
+    ASSERT_EQ(cache.stats().expired, 1u);
+}
+
+TEST(ResultCache, ClockKeepsHitEntries) {
+    // room for four outputs of 36 bytes
+    ResultCache cache;
+    cache.configure(withBudget(4 * 100));
+    string value(36, 'x');
+    for (uint64_t key = 0; key < 4; key++) {
+        cache.insert(keyOf(key), "f", value);
+    }
+    string output;
+    ASSERT_TRUE(cache.lookup(keyOf(0), 0, output));
+    ASSERT_TRUE(cache.lookup(keyOf(2), 0, output));
+
+    cache.insert(keyOf(4), "f", value);
+    cache.insert(keyOf(5), "f", value);
+    auto stats = cache.stats();
+    ASSERT_EQ(stats.evictions, 2u);
+    ASSERT_LE(stats.bytes, 400u);
+    ASSERT_TRUE(cache.lookup(keyOf(0), 0, output));
+    ASSERT_TRUE(cache.lookup(keyOf(2), 0, output));
+    ASSERT_FALSE(cache.lookup(keyOf(1), 0, output));
+    ASSERT_FALSE(cache.lookup(keyOf(3), 0, output));
+}
+
+TEST(ResultCache, KeyNeedsBothHashesAndSize) {
+    ResultCache cache;
+    cache.configure(withBudget(1 << 20));
+    string input = "[1, 2]";
+    auto key = ResultCache::keyOf("sum", input.data(), input.size());
+    ASSERT_EQ(key.size, input.size());
+    ASSERT_NE(key.hash, key.check);
+    cache.insert(key, "sum", "3");
+
+    // another input whose first hash collides is not answered with this output
+    string output;
+    ASSERT_FALSE(cache.lookup({key.hash, key.check + 1, key.size}, 0, output));
+    ASSERT_FALSE(cache.lookup({key.hash, key.check, key.size + 1}, 0, output));
+    cache.insert({key.hash, key.check + 1, key.size}, "sum", "4");
+    ASSERT_TRUE(cache.lookup(key, input.size(), output));
+    ASSERT_EQ(output, "3");
+    ASSERT_EQ(cache.stats().entries, 2u);
+}
@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "services/Router/Router.h"
+
+using namespace std;
+
+static vector<int> match(const TopicTrie &trie, const string &key) {
+    vector<int> queues;
+    trie.match(key, queues);
+    return queues;
+}
+
+TEST(Router, TopicWildcards) {
+    TopicTrie trie;
+    trie.bind("image.resize", 0);
+    trie.bind("image.*", 1);
+    trie.bind("#.matrix", 2);
+    trie.bind("#", 3);
+    trie.bind("a.#.b", 4);
+    trie.bind("*.*", 5);
+
+    ASSERT_EQ(match(trie, "image.resize"), (vector<int>{0, 1, 3, 5}));
+    ASSERT_EQ(match(trie, "image.crop"), (vector<int>{1, 3, 5}));
+    // * takes exactly one word, # none or any number
+    ASSERT_EQ(match(trie, "image"), (vector<int>{3}));
+    ASSERT_EQ(match(trie, "matrix"), (vector<int>{2, 3}));
+    ASSERT_EQ(match(trie, "big.dense.matrix"), (vector<int>{2, 3}));
+    ASSERT_EQ(match(trie, "a.b"), (vector<int>{3, 4, 5}));
+    ASSERT_EQ(match(trie, "a.x.y.b"), (vector<int>{3, 4}));
+
+    TopicTrie empty;
+    ASSERT_TRUE(match(empty, "image.resize").empty());
+}
+
+TEST(Router, ManyHashesStayFast) {
+    TopicTrie trie;
+    trie.bind("#.#.#.#.#.#.#.#.nomatch", 0);
+    trie.bind("#.*.#.*.#.*.#.*.#.*.#.*.#.*.nomatch", 1);
+    trie.bind("a.#.#.b", 2);
+    trie.bind("#.*.#.w30", 3);
+
+    string key = "w0";
+    for (int i = 1; i < 31; i++) {
+        key += ".w" + to_string(i);
+    }
+    // without remembering visited nodes this takes about 31^8 steps
+    ASSERT_EQ(match(trie, key), (vector<int>{3}));
+    ASSERT_EQ(match(trie, "a.b"), (vector<int>{2}));
+    ASSERT_EQ(match(trie, "x.y.nomatch"), (vector<int>{0}));
+    // every * takes a word
+    ASSERT_EQ(match(trie, "1.2.3.4.5.6.7.nomatch"), (vector<int>{0, 1}));
+    ASSERT_EQ(match(trie, "nomatch"), (vector<int>{0}));
+}
+
+TEST(Router, ExchangeTypes) {
+    Router router;
+    router.configure({{"heavy", "light", "audit"},
+                      {{"direct", ExchangeType::Direct}, {"fanout", ExchangeType::Fanout},
+                       {"topic", ExchangeType::Topic}},
+                      {{"direct", "matrixMultiplication", "heavy"},
+                       {"direct", "determinant", "heavy"},
+                       {"direct", "determinant", "light"},
+                       {"fanout", "ignored", "light"},
+                       {"fanout", "", "audit"},
+                       {"topic", "matrix.*", "heavy"},
+                       {"topic", "#", "audit"}},
+                      "direct"});
+
+    ASSERT_EQ(router.queues(), (vector<string>{Router::DEFAULT_QUEUE, "heavy", "light", "audit"}));
+    ASSERT_EQ(router.route("direct", "determinant"), (vector<int>{1, 2}));
+    ASSERT_TRUE(router.route("direct", "simpleMath").empty());
+    ASSERT_EQ(router.route("fanout", "anything"), (vector<int>{2, 3}));
+    ASSERT_EQ(router.route("topic", "matrix.multiply"), (vector<int>{1, 3}));
+    ASSERT_TRUE(router.route("missing", "key").empty());
+
+    // tasks go through the entry exchange by function, the default queue takes the rest
+    ASSERT_EQ(router.route("matrixMultiplication"), (vector<int>{1}));
+    ASSERT_EQ(router.route("simpleMath"), (vector<int>{0}));
+}
+
+TEST(Router, UnknownNames) {
+    Router router;
+    ASSERT_EQ(router.route("anything"), (vector<int>{0}));
+    ASSERT_EQ(router.queueIndex("heavy"), -1);
+
+    ASSERT_THROW(router.configure({{}, {}, {{"missing", "key", Router::DEFAULT_QUEUE}}}), invalid_argument);
+    Router unbound;
+    ASSERT_THROW(unbound.configure({{}, {{"direct", ExchangeType::Direct}}, {{"direct", "key", "missing"}}}),
+                 invalid_argument);
+    Router entry;
+    ASSERT_THROW(entry.configure({{}, {}, {}, "missing"}), invalid_argument);
+}
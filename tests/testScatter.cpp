@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "services/Scatter/Scatter.h"
+
+using namespace std;
+
+static vector<string> track(Scatter &scatter, const string &parent, const vector<Scatter::Part> &parts) {
+    vector<string> ids;
+    for (size_t i = 0; i < parts.size(); i++) {
+        ids.push_back(Scatter::partID(parent, i));
+    }
+    scatter.track(parent, "square", ids, parts);
+    return ids;
+}
+
+TEST(Scatter, SplitFollowsWorkersAndCost) {
+    ScatterOptions options;
+    options.functions = {"square"};
+    options.targetPart = chrono::milliseconds(20);
+    Scatter scatter;
+    scatter.configure(options);
+
+    ASSERT_TRUE(scatter.split("other", "[1,2,3]", 4).empty());
+    ASSERT_TRUE(scatter.split("square", "[1,2,3]", 1).empty());
+    ASSERT_TRUE(scatter.split("square", "{\"a\":1}", 4).empty());
+    ASSERT_TRUE(scatter.split("square", "[1]", 4).empty());
+
+    // two parts per worker, the first ones take the rest
+    auto parts = scatter.split("square", "[1,2,3,4,5,6,7,8,9,10]", 2);
+    ASSERT_EQ(parts.size(), 4u);
+    ASSERT_EQ(parts[0].input, "[1,2,3]");
+    ASSERT_EQ(parts[1].input, "[4,5,6]");
+    ASSERT_EQ(parts[2].input, "[7,8]");
+    ASSERT_EQ(parts[3].input, "[9,10]");
+    ASSERT_EQ(parts[3].elements, 2u);
+
+    // no more parts than elements
+    ASSERT_EQ(scatter.split("square", "[1,2,3]", 8).size(), 3u);
+
+    // an element takes about 5 ms, parts of 20 ms are four elements instead of 16 parts for 8 workers
+    auto ids = track(scatter, "t", parts);
+    for (auto &id: ids) scatter.started(id);
+    this_thread::sleep_for(chrono::milliseconds(10));
+    Scatter::Gathered gathered;
+    ASSERT_EQ(scatter.complete(ids[2], true, "[49,64]", 7, gathered), Scatter::State::Pending);
+    ASSERT_GE(scatter.cost("square").count(), 5000);
+    auto coarse = scatter.split("square", "[1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20]", 8);
+    ASSERT_GE(coarse.size(), 2u);
+    ASSERT_LT(coarse.size(), 10u);
+}
+
+TEST(Scatter, GatherInOrder) {
+    ScatterOptions options;
+    options.functions = {"square"};
+    Scatter scatter;
+    scatter.configure(options);
+
+    auto parts = scatter.split("square", "[1,2,3,4,5]", 2);
+    ASSERT_EQ(parts.size(), 4u);
+    auto ids = track(scatter, "t", parts);
+
+    // results come in any order
+    Scatter::Gathered gathered;
+    ASSERT_EQ(scatter.complete(ids[3], true, "[25]", 4, gathered), Scatter::State::Pending);
+    ASSERT_EQ(scatter.complete(ids[0], true, " [1, 4] ", 8, gathered), Scatter::State::Pending);
+    ASSERT_EQ(scatter.complete(ids[2], true, "[16]", 4, gathered), Scatter::State::Pending);
+    ASSERT_EQ(scatter.complete("other", true, "[]", 2, gathered), Scatter::State::NotPart);
+    ASSERT_EQ(scatter.complete(ids[1], true, "[9]", 3, gathered), Scatter::State::Done);
+    ASSERT_EQ(gathered.parent, "t");
+    ASSERT_EQ(gathered.output, "[1, 4,9,16,25]");
+
+    // a second result of a part is not a part any more
+    ASSERT_EQ(scatter.complete(ids[1], true, "[9]", 3, gathered), Scatter::State::NotPart);
+}
+
+TEST(Scatter, FailedPartFailsTask) {
+    ScatterOptions options;
+    options.functions = {"square"};
+    Scatter scatter;
+    scatter.configure(options);
+
+    auto ids = track(scatter, "t", scatter.split("square", "[1,2,3,4]", 2));
+    ASSERT_EQ(ids.size(), 4u);
+
+    Scatter::Gathered gathered;
+    ASSERT_EQ(scatter.complete(ids[0], true, "[1]", 3, gathered), Scatter::State::Pending);
+    ASSERT_EQ(scatter.complete(ids[2], false, "no such function", 16, gathered), Scatter::State::Failed);
+    ASSERT_EQ(gathered.parent, "t");
+    ASSERT_EQ(gathered.output, "no such function");
+    ASSERT_EQ(gathered.remaining, (vector<string>{ids[1], ids[3]}));
+
+    // a result racing in before the part is settled is dropped, after that it is unknown
+    Scatter::Gathered late;
+    ASSERT_EQ(scatter.complete(ids[1], true, "[4]", 3, late), Scatter::State::Abandoned);
+    scatter.settled(ids[3]);
+    ASSERT_EQ(scatter.complete(ids[3], true, "[16]", 4, late), Scatter::State::NotPart);
+
+    // an abandoned task returns the parts without a result
+    Scatter fresh;
+    fresh.configure(options);
+    auto other = track(fresh, "u", fresh.split("square", "[1,2,3]", 2));
+    ASSERT_EQ(other.size(), 3u);
+    ASSERT_EQ(fresh.complete(other[1], true, "[4]", 3, late), Scatter::State::Pending);
+    ASSERT_EQ(fresh.abandon("u"), (vector<string>{other[0], other[2]}));
+    ASSERT_TRUE(fresh.abandon("u").empty());
+}
@@ -0,0 +1,49 @@
+#include <gtest/gtest.h>
+#include <string>
+
+#include "services/Singleflight/Singleflight.h"
+
+using namespace std;
+
+static Singleflight::Key keyOf(uint64_t hash) {
+    return {hash, hash, 0};
+}
+
+TEST(Singleflight, WaitersGetLeaderResult) {
+    Singleflight flights;
+    ASSERT_TRUE(flights.join(keyOf(7), "a", "client-1"));
+    ASSERT_FALSE(flights.join(keyOf(7), "b", "client-2"));
+    ASSERT_FALSE(flights.join(keyOf(7), "c", "client-1"));
+    ASSERT_TRUE(flights.join(keyOf(8), "d", "client-2"));
+    ASSERT_EQ(flights.waiting(), 2u);
+
+    Singleflight::Flight flight;
+    // only a leader completes a flight
+    ASSERT_FALSE(flights.complete("b", flight));
+    ASSERT_TRUE(flights.complete("a", flight));
+    ASSERT_EQ(flight.key, keyOf(7));
+    ASSERT_EQ(flight.waiters.size(), 2u);
+    ASSERT_EQ(flight.waiters[0].id, "b");
+    ASSERT_EQ(flight.waiters[1].clientId, "client-1");
+    ASSERT_EQ(flights.waiting(), 0u);
+
+    // the key is free again
+    ASSERT_TRUE(flights.join(keyOf(7), "e", "client-1"));
+    ASSERT_FALSE(flights.complete("a", flight));
+}
+
+TEST(Singleflight, CollidingHashLeadsItsOwnFlight) {
+    Singleflight flights;
+    ASSERT_TRUE(flights.join({1, 2, 3}, "a", "client-1"));
+    // the first hash is the same, the input is not
+    ASSERT_TRUE(flights.join({1, 5, 3}, "b", "client-1"));
+    ASSERT_TRUE(flights.join({1, 2, 4}, "c", "client-1"));
+    ASSERT_FALSE(flights.join({1, 2, 3}, "d", "client-1"));
+    ASSERT_EQ(flights.waiting(), 1u);
+
+    Singleflight::Flight flight;
+    ASSERT_TRUE(flights.complete("b", flight));
+    ASSERT_TRUE(flight.waiters.empty());
+    ASSERT_TRUE(flights.complete("a", flight));
+    ASSERT_EQ(flight.waiters.size(), 1u);
+}
@@ -135,6 +135,266 @@ TEST(Protocol, MessageTransfering) {
     client.stopListen();
 }
 
+TEST(Protocol, StreamingReceive) {
+    // message of several parts, filled with position dependent bytes
+    std::string test_string(STIP::MAX_STIP_DATA_SIZE * 4 + 123, '\0');
+    for (size_t i = 0; i < test_string.size(); i++) {
+        test_string[i] = static_cast<char>(i * 31 % 251);
+    }
+
+    boost::asio::io_context io_context_server;
+
+    udp::socket socket_server(io_context_server, udp::endpoint(udp::v4(), 12228));
+    udp::socket::receive_buffer_size bigbufsize(INT_MAX);
+    socket_server.set_option(bigbufsize);
+    STIPServer server(socket_server);
+
+    std::string streamed;
+    size_t chunksCount = 0;
+    std::vector<thread> threadsProcessors;
+    std::thread serverThread([&server, &streamed, &chunksCount, &threadsProcessors] {
+        for (;;) {
+            Connection *serverconnection = server.acceptConnection();
+            if (serverconnection == nullptr) break;
+            serverconnection->setStreamingReceive(true);
+
+            threadsProcessors.emplace_back([serverconnection, &streamed, &chunksCount] {
+                ReceiveMessageSession *received = serverconnection->receiveMessage();
+                ASSERT_TRUE(received->isStreaming());
+
+                StreamChunk chunk;
+                while (received->nextChunk(chunk)) {
+                    ASSERT_EQ(chunk.offset, streamed.size());
+                    streamed.append(chunk.data, chunk.size);
+                    chunksCount++;
+                }
+                delete received;
+            });
+        }
+        cout << "Server thread finished" << endl;
+    });
+
+    // sleep 200ms
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    boost::asio::io_context io_context;
+
+    udp::resolver resolver(io_context);
+    udp::endpoint server_endpoint = *resolver.resolve(udp::v4(), "localhost", "12228");
+
+    udp::socket socket(io_context);
+    socket.open(udp::v4());
+
+    STIPClient client(socket);
+    client.startListen();
+
+    Connection *connection = client.connect(server_endpoint);
+    ASSERT_TRUE(connection->sendMessage(test_string));
+
+    for (auto &th : threadsProcessors) th.join();
+
+    ASSERT_EQ(chunksCount, 5);
+    ASSERT_EQ(streamed, test_string);
+
+    socket_server.cancel();
+    serverThread.join();
+    socket_server.close();
+
+    client.stopListen();
+}
+
+TEST(Protocol, PriorityOrder) {
+    std::string bulk_string(STIP::MAX_STIP_DATA_SIZE * 3, 'b');
+    std::string control_string = "heartbeat";
+
+    boost::asio::io_context io_context_server;
+
+    udp::socket socket_server(io_context_server, udp::endpoint(udp::v4(), 12229));
+    udp::socket::receive_buffer_size bigbufsize(INT_MAX);
+    socket_server.set_option(bigbufsize);
+    STIPServer server(socket_server);
+
+    std::atomic<Connection *> serverconnection = nullptr;
+    std::thread serverThread([&server, &serverconnection] {
+        for (;;) {
+            Connection *accepted = server.acceptConnection();
+            if (accepted == nullptr) break;
+            serverconnection = accepted;
+        }
+        cout << "Server thread finished" << endl;
+    });
+
+    // sleep 200ms
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    boost::asio::io_context io_context;
+
+    udp::resolver resolver(io_context);
+    udp::endpoint server_endpoint = *resolver.resolve(udp::v4(), "localhost", "12229");
+
+    udp::socket socket(io_context);
+    socket.open(udp::v4());
+
+    STIPClient client(socket);
+    client.startListen();
+
+    Connection *connection = client.connect(server_endpoint);
+
+    // both messages are fully received before the server reads anything
+    ASSERT_TRUE(connection->sendMessage(bulk_string, Priority::BULK));
+    ASSERT_TRUE(connection->sendMessage(control_string, Priority::CONTROL));
+
+    ReceiveMessageSession *first = serverconnection.load()->receiveMessage();
+    ReceiveMessageSession *second = serverconnection.load()->receiveMessage();
+    ASSERT_EQ(first->getPriority(), Priority::CONTROL);
+    ASSERT_EQ(first->getDataAsString(), control_string);
+    ASSERT_EQ(second->getPriority(), Priority::BULK);
+    ASSERT_EQ(second->getDataAsString(), bulk_string);
+    delete first;
+    delete second;
+
+    socket_server.cancel();
+    serverThread.join();
+    socket_server.close();
+
+    client.stopListen();
+}
+
+TEST(Protocol, ReceiveWindowBusy) {
+    std::string first_string(100 * 1024, 'a');
+    std::string second_string(100 * 1024, 'b');
+
+    boost::asio::io_context io_context_server;
+
+    udp::socket socket_server(io_context_server, udp::endpoint(udp::v4(), 12230));
+    udp::socket::receive_buffer_size bigbufsize(INT_MAX);
+    socket_server.set_option(bigbufsize);
+    STIPServer server(socket_server);
+
+    std::atomic<Connection *> serverconnection = nullptr;
+    std::thread serverThread([&server, &serverconnection] {
+        for (;;) {
+            Connection *accepted = server.acceptConnection();
+            if (accepted == nullptr) break;
+            // room for one message only
+            accepted->setReceiveWindow(150 * 1024);
+            serverconnection = accepted;
+        }
+        cout << "Server thread finished" << endl;
+    });
+
+    // sleep 200ms
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    boost::asio::io_context io_context;
+
+    udp::resolver resolver(io_context);
+    udp::endpoint server_endpoint = *resolver.resolve(udp::v4(), "localhost", "12230");
+
+    udp::socket socket(io_context);
+    socket.open(udp::v4());
+
+    STIPClient client(socket);
+    client.startListen();
+
+    Connection *connection = client.connect(server_endpoint);
+    while (serverconnection == nullptr) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    ASSERT_TRUE(connection->sendMessage(first_string));
+
+    std::atomic<bool> secondSent = false;
+    bool secondResult = false;
+    std::thread secondThread([&connection, &second_string, &secondSent, &secondResult] {
+        secondResult = connection->sendMessage(second_string);
+        secondSent = true;
+    });
+
+    // the first message still holds the window
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    ASSERT_FALSE(secondSent);
+
+    ReceiveMessageSession *first = serverconnection.load()->receiveMessage();
+    ASSERT_EQ(first->getDataAsString(), first_string);
+    delete first;
+
+    secondThread.join();
+    ASSERT_TRUE(secondResult);
+    ReceiveMessageSession *second = serverconnection.load()->receiveMessage();
+    ASSERT_EQ(second->getDataAsString(), second_string);
+    delete second;
+
+    socket_server.cancel();
+    serverThread.join();
+    socket_server.close();
+
+    client.stopListen();
+}
+
+TEST(Protocol, MultipathStriping) {
+    std::string test_string(4 * 1024 * 1024, 'x');
+    for (size_t i = 0; i < test_string.size(); i++) {
+        test_string[i] = (char) ('a' + i % 26);
+    }
+
+    boost::asio::io_context io_context_server;
+
+    udp::socket socket_server(io_context_server, udp::endpoint(udp::v4(), 12231));
+    udp::socket::receive_buffer_size bigbufsize(INT_MAX);
+    socket_server.set_option(bigbufsize);
+    STIPServer server(socket_server);
+
+    std::atomic<Connection *> serverconnection = nullptr;
+    std::thread serverThread([&server, &serverconnection] {
+        for (;;) {
+            Connection *accepted = server.acceptConnection();
+            if (accepted == nullptr) break;
+            serverconnection = accepted;
+        }
+        cout << "Server thread finished" << endl;
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    boost::asio::io_context io_context;
+
+    udp::resolver resolver(io_context);
+    udp::endpoint server_endpoint = *resolver.resolve(udp::v4(), "localhost", "12231");
+
+    udp::socket socket(io_context);
+    socket.open(udp::v4());
+
+    STIPClient client(socket);
+    client.startListen();
+
+    Connection *connection = client.connect(server_endpoint);
+    while (serverconnection == nullptr) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    // two more source ports, the receiver sees three flows of the same connection
+    ASSERT_EQ(connection->addPath(udp::endpoint(udp::v4(), 12232)), 1);
+    ASSERT_EQ(connection->addPath(udp::endpoint(udp::v4(), 12233)), 2);
+    ASSERT_EQ(connection->getPathCount(), 3);
+    ASSERT_GT(connection->getPathStats(1).rttMs, 0);
+
+    ASSERT_TRUE(connection->sendMessage(test_string));
+
+    ReceiveMessageSession *received = serverconnection.load()->receiveMessage();
+    ASSERT_EQ(received->getDataAsString(), test_string);
+    delete received;
+
+    for (size_t i = 0; i < 3; i++) {
+        PathStats stats = connection->getPathStats(i);
+        cout << "Path " << i << ": sent " << stats.sentParts << ", lost " << stats.lostParts
+             << ", rtt " << stats.rttMs << " ms" << endl;
+        ASSERT_GT(stats.sentParts, 0);
+    }
+
+    socket_server.cancel();
+    serverThread.join();
+    socket_server.close();
+
+    client.stopListen();
+}
+
 TEST(Protocol, CatchException) {
     // sleep
 
@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "services/TaskLog/TaskLog.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static TaskLogOptions freshDirectory(const string &name) {
+    TaskLogOptions options;
+    options.directory = (fs::temp_directory_path() / name).string();
+    fs::remove_all(options.directory);
+    options.minSnapshotRecords = 16;
+    return options;
+}
+
+static Task makeTask(int i) {
+    return {"task-" + to_string(i), "sum", "[1, 2]", "", i % 4 + 1, TaskStatus::Queued, "", "client"};
+}
+
+TEST(TaskLog, RecoverAfterRestart) {
+    auto options = freshDirectory("rabbit-tasklog-recover");
+    {
+        TaskLog log(options);
+        ASSERT_TRUE(log.recover().empty());
+        for (int i = 0; i < 10; i++) {
+            log.appendPut(makeTask(i));
+        }
+        Task done = makeTask(3);
+        done.status = TaskStatus::Ready;
+        done.output = "3";
+        log.appendPut(done);
+        log.appendStatus("task-5", TaskStatus::SentToWorker);
+        log.appendAssign("task-6", "worker-1");
+        uint64_t last = log.appendResult("task-7", TaskStatus::Ready, "7");
+        // closing writes whatever the last group commit has not
+        log.close();
+        ASSERT_FALSE(log.failed());
+        ASSERT_EQ(log.durable(), last);
+    }
+
+    TaskLog log(options);
+    auto tasks = log.recover();
+    ASSERT_EQ(tasks.size(), 10u);
+    ASSERT_EQ(tasks[3].status, TaskStatus::Ready);
+    ASSERT_EQ(tasks[3].output, "3");
+    ASSERT_EQ(tasks[5].status, TaskStatus::SentToWorker);
+    ASSERT_EQ(tasks[6].worker_hash_id, "worker-1");
+    ASSERT_EQ(tasks[6].status, TaskStatus::SentToWorker);
+    ASSERT_EQ(tasks[7].output, "7");
+    ASSERT_EQ(tasks[7].input, "[1, 2]");
+    ASSERT_EQ(tasks[9].cores, 2);
+}
+
+TEST(TaskLog, TornTailIsCut) {
+    auto options = freshDirectory("rabbit-tasklog-torn");
+    {
+        TaskLog log(options);
+        log.recover();
+        for (int i = 0; i < 5; i++) {
+            log.appendPut(makeTask(i));
+        }
+    }
+
+    // simulate a crash in the middle of the last record
+    fs::path segment;
+    for (auto &entry: fs::directory_iterator(options.directory)) {
+        if (fs::file_size(entry.path()) > 0) segment = entry.path();
+    }
+    ASSERT_FALSE(segment.empty());
+    fs::resize_file(segment, fs::file_size(segment) - 3);
+
+    {
+        TaskLog log(options);
+        auto tasks = log.recover();
+        ASSERT_EQ(tasks.size(), 4u);
+        log.appendPut(makeTask(7));
+    }
+
+    TaskLog log(options);
+    auto tasks = log.recover();
+    ASSERT_EQ(tasks.size(), 5u);
+    ASSERT_EQ(tasks.back().id, "task-7");
+}
+
+TEST(TaskLog, SnapshotCompactsLog) {
+    auto options = freshDirectory("rabbit-tasklog-snapshot");
+    vector<Task> table;
+    {
+        TaskLog log(options);
+        log.recover();
+        for (int i = 0; i < 100; i++) {
+            Task task = makeTask(i % 8);
+            task.output = to_string(i);
+            if (table.size() < 8) {
+                table.push_back(task);
+            } else {
+                table[i % 8] = task;
+            }
+            log.appendPut(task);
+            if (log.snapshotDue(table.size())) {
+                log.snapshot(table);
+            }
+        }
+        ASSERT_LT(log.pendingRecords(), 16u);
+    }
+
+    size_t segments = 0;
+    for (auto &entry: fs::directory_iterator(options.directory)) {
+        if (entry.path().extension() == ".wal") segments++;
+    }
+    // segments covered by the snapshot are deleted
+    ASSERT_EQ(segments, 1u);
+
+    TaskLog log(options);
+    auto tasks = log.recover();
+    ASSERT_EQ(tasks.size(), 8u);
+    ASSERT_EQ(tasks[3].output, "99");
+    ASSERT_EQ(tasks[0].output, "96");
+}
+
+TEST(TaskLog, FailedRotationKeepsSegment) {
+    auto options = freshDirectory("rabbit-tasklog-rotation");
+    vector<Task> table;
+    {
+        TaskLog log(options);
+        log.recover();
+        // the next segment can not be opened
+        fs::create_directory(fs::path(options.directory) / "tasks-2.wal");
+        uint64_t last = 0;
+        for (int i = 0; i < 40; i++) {
+            table.push_back(makeTask(i));
+            last = log.appendPut(table.back());
+            if (log.snapshotDue(0)) {
+                log.snapshot(table);
+            }
+        }
+        log.close();
+        // only the snapshot is lost, the records are written
+        ASSERT_FALSE(log.failed());
+        ASSERT_EQ(log.durable(), last);
+    }
+    fs::remove(fs::path(options.directory) / "tasks-2.wal");
+
+    // the records went on to the segment that was open
+    TaskLog log(options);
+    auto tasks = log.recover();
+    ASSERT_EQ(tasks.size(), 40u);
+    ASSERT_EQ(tasks.back().id, "task-39");
+}
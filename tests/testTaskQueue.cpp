@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+#include <climits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "services/TaskQueue/TaskQueue.h"
+
+using namespace std;
+
+static Task taskOf(const string &id, const string &client, int cores = 1, int priority = 0) {
+    return {id, "f", "", "", cores, TaskStatus::Queued, "", client, priority};
+}
+
+TEST(TaskQueue, NewClientIsNotStuckBehindBulk) {
+    TaskQueue queue;
+    vector<Task> bulk;
+    for (int i = 0; i < 100000; i++) {
+        bulk.push_back(taskOf("bulk-" + to_string(i), "bulk"));
+    }
+    queue.enqueue(bulk);
+
+    Task task;
+    for (int i = 0; i < 10; i++) {
+        ASSERT_TRUE(queue.tryDequeue(task, 1));
+    }
+    queue.enqueue(taskOf("late", "interactive"));
+    // at most one more bulk task goes first
+    ASSERT_TRUE(queue.tryDequeue(task, 1));
+    if (task.id != "late") {
+        ASSERT_TRUE(queue.tryDequeue(task, 1));
+    }
+    ASSERT_EQ(task.id, "late");
+}
+
+TEST(TaskQueue, WeightsShareTheQueue) {
+    TaskQueue queue;
+    queue.setClientWeight("a", 3);
+    for (int i = 0; i < 400; i++) {
+        queue.enqueue(taskOf("a-" + to_string(i), "a"));
+        queue.enqueue(taskOf("b-" + to_string(i), "b"));
+    }
+    int fromA = 0;
+    Task task;
+    for (int i = 0; i < 400; i++) {
+        ASSERT_TRUE(queue.tryDequeue(task, 1));
+        if (task.client_hash_id == "a") fromA++;
+    }
+    ASSERT_NEAR(fromA, 300, 2);
+
+    auto stats = queue.clientStats();
+    ASSERT_EQ(stats.size(), 2u);
+    ASSERT_EQ(stats[0].client, "a");
+    ASSERT_EQ(stats[0].weight, 3);
+    ASSERT_EQ(stats[0].queued + stats[0].dequeued, 400u);
+    ASSERT_EQ(stats[1].dequeued, static_cast<uint64_t>(400 - fromA));
+}
+
+TEST(TaskQueue, PriorityGoesFirst) {
+    TaskQueue queue;
+    queue.enqueue(taskOf("low", "a"));
+    queue.enqueue(taskOf("big-high", "b", 4, 5));
+    queue.enqueue(taskOf("high", "b", 1, 5));
+
+    Task task;
+    // the big task does not fit, the small one of the same class goes
+    ASSERT_TRUE(queue.tryDequeue(task, 2));
+    ASSERT_EQ(task.id, "high");
+    ASSERT_TRUE(queue.tryDequeue(task, 4));
+    ASSERT_EQ(task.id, "big-high");
+    ASSERT_EQ(task.priority, 5);
+    ASSERT_TRUE(queue.tryDequeue(task, 4));
+    ASSERT_EQ(task.id, "low");
+    ASSERT_EQ(queue.size(), 0u);
+}
+
+TEST(TaskQueue, StarvingTaskHoldsCores) {
+    TaskQueue queue;
+    StarvationPolicy policy;
+    policy.maxBypass = 1;
+    queue.setStarvationPolicy(policy);
+    queue.enqueue(taskOf("big", "a", 4));
+    for (int i = 0; i < 5; i++) {
+        queue.enqueue(taskOf("small-" + to_string(i), "b"));
+    }
+    Task task;
+    // the big task costs four small ones, three of them are due before it
+    for (int i = 0; i < 3; i++) {
+        ASSERT_TRUE(queue.tryDequeue(task, 1));
+    }
+    // then one may bypass it
+    ASSERT_TRUE(queue.tryDequeue(task, 1));
+    ASSERT_FALSE(queue.tryDequeue(task, 1));
+    ASSERT_TRUE(queue.tryDequeue(task, 4));
+    ASSERT_EQ(task.id, "big");
+}
+
+TEST(TaskQueue, TaskBiggerThanEveryWorkerDoesNotBlock) {
+    TaskQueue queue;
+    queue.enqueue(taskOf("huge", "a", 64));
+    for (int i = 0; i < 1100; i++) {
+        queue.enqueue(taskOf("small-" + to_string(i), "b"));
+    }
+    Task task;
+    // no worker has 64 cores, holding cores back for it would stop the queue after maxBypass
+    for (int i = 0; i < 1100; i++) {
+        ASSERT_TRUE(queue.tryDequeue(task, 4, nullptr, 4));
+    }
+    ASSERT_EQ(queue.size(), 1u);
+    ASSERT_FALSE(queue.tryDequeue(task, 4, nullptr, 4));
+}
+
+TEST(TaskQueue, TooManyCoresAreRefused) {
+    TaskQueue queue;
+    queue.enqueue(taskOf("a", "a"));
+    ASSERT_THROW(queue.enqueue(taskOf("huge", "a", INT_MAX)), std::invalid_argument);
+    // a batch is refused as a whole
+    ASSERT_THROW(queue.enqueue(vector<Task>{taskOf("b", "a"), taskOf("huge", "a", TaskQueue::MAX_CORES + 1)}),
+                 std::invalid_argument);
+    ASSERT_EQ(queue.size(), 1u);
+
+    queue.enqueue(taskOf("max", "a", TaskQueue::MAX_CORES));
+    Task task;
+    ASSERT_TRUE(queue.tryDequeue(task, 1));
+    ASSERT_EQ(task.id, "a");
+    ASSERT_TRUE(queue.tryDequeue(task, TaskQueue::MAX_CORES));
+    ASSERT_EQ(task.id, "max");
+}
@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <unordered_map>
+
+#include "services/TaskService/TaskStore.h"
+#include "services/TaskService/TaskService.h"
+
+using namespace std;
+
+static Task makeTask(const string &id, TaskStatus status = TaskStatus::Queued) {
+    return {id, "sum", "[1, 2]", "", 1, status, "", "client"};
+}
+
+TEST(TaskStore, IndexMatchesMap) {
+    TaskStore store;
+    unordered_map<string, uint32_t> expected;
+    mt19937 rng(7);
+
+    // enough inserts and erases to rehash several times and shift probe chains
+    for (int i = 0; i < 200000; i++) {
+        string id = "task-" + to_string(rng() % 20000);
+        auto it = expected.find(id);
+        if (it == expected.end()) {
+            expected[id] = store.insert(makeTask(id));
+        } else if (rng() % 2) {
+            store.erase(it->second);
+            expected.erase(it);
+        }
+        if (i % 1000 == 0) {
+            for (auto &[key, slot]: expected) {
+                ASSERT_EQ(store.find(key), slot);
+            }
+        }
+    }
+    ASSERT_EQ(store.size(), expected.size());
+    ASSERT_EQ(store.find("missing"), TaskStore::NONE);
+}
+
+TEST(TaskStore, StatusLists) {
+    TaskStore store;
+    for (int i = 0; i < 10; i++) {
+        store.insert(makeTask("task-" + to_string(i)));
+    }
+    store.setStatus(store.find("task-4"), TaskStatus::Ready);
+    store.setStatus(store.find("task-2"), TaskStatus::Ready);
+    store.setStatus(store.find("task-7"), TaskStatus::SentToWorker);
+
+    ASSERT_EQ(store.count(TaskStatus::Queued), 7u);
+    ASSERT_EQ(store.count(TaskStatus::Ready), 2u);
+    // ordered by the time the status was set
+    uint32_t slot = store.first(TaskStatus::Ready);
+    ASSERT_EQ(store.id(slot), "task-4");
+    ASSERT_EQ(store.id(store.next(slot)), "task-2");
+    ASSERT_EQ(store.next(store.next(slot)), TaskStore::NONE);
+
+    store.erase(store.find("task-4"));
+    ASSERT_EQ(store.id(store.first(TaskStatus::Ready)), "task-2");
+    ASSERT_EQ(store.get(store.find("task-7")).status, TaskStatus::SentToWorker);
+}
+
+TEST(TaskService, RetentionEvictsOldestFinished) {
+    TaskService service;
+    RetentionPolicy policy;
+    policy.maxFinished = 3;
+    service.setRetentionPolicy(policy);
+
+    for (int i = 0; i < 10; i++) {
+        service.addTask(makeTask("task-" + to_string(i)));
+    }
+    for (int i = 0; i < 6; i++) {
+        service.changeTaskStatus("task-" + to_string(i), TaskStatus::Ready);
+    }
+
+    ASSERT_EQ(service.countByStatus(TaskStatus::Ready), 3u);
+    ASSERT_EQ(service.size(), 7u);
+    ASSERT_THROW(service.findTaskByID("task-2"), std::runtime_error);
+    ASSERT_EQ(service.findTaskByID("task-3").status, TaskStatus::Ready);
+
+    // generated ids skip the ones still in use
+    service.addTask(makeTask(""));
+    ASSERT_EQ(service.size(), 8u);
+}
+
+TEST(TaskService, FirstResultWins) {
+    TaskService service;
+    service.addTask(makeTask("task"));
+    service.assignTask("task", "worker-1");
+
+    // a task taken back from a worker goes to another one
+    Task task;
+    ASSERT_FALSE(service.unassignTask("task", "worker-2", task));
+    ASSERT_TRUE(service.unassignTask("task", "worker-1", task));
+    ASSERT_EQ(task.status, TaskStatus::Queued);
+    service.assignTask("task", "worker-2");
+
+    ASSERT_TRUE(service.finishTask("task", TaskStatus::Ready, "first", task));
+    ASSERT_EQ(task.worker_hash_id, "worker-2");
+    ASSERT_FALSE(service.finishTask("task", TaskStatus::Ready, "second", task));
+    ASSERT_FALSE(service.unassignTask("task", "worker-2", task));
+    ASSERT_EQ(service.findTaskByID("task").output, "first");
+}
+
+TEST(TaskService, DeadWorkerTasksRequeued) {
+    TaskService service;
+    for (int i = 0; i < 4; i++) {
+        service.addTask(makeTask("task-" + to_string(i)));
+    }
+    vector<string> ids = {"task-0", "task-1", "task-2"};
+    ASSERT_TRUE(service.assignTasks(ids, "worker-1").empty());
+    service.assignTask("task-3", "worker-2");
+
+    Task task;
+    ASSERT_TRUE(service.finishTask("task-0", TaskStatus::Ready, "done", task));
+    auto requeued = service.unassignWorker("worker-1");
+    ASSERT_EQ(requeued.size(), 2u);
+    ASSERT_EQ(service.findTaskByID("task-1").status, TaskStatus::Queued);
+    ASSERT_EQ(service.findTaskByID("task-3").worker_hash_id, "worker-2");
+
+    // a late result of the dead worker arrives before the task is sent again
+    ASSERT_TRUE(service.finishTask("task-1", TaskStatus::Ready, "late", task));
+    ids = {"task-1", "task-2"};
+    auto answered = service.assignTasks(ids, "worker-3");
+    ASSERT_EQ(answered.size(), 1u);
+    ASSERT_EQ(answered[0].id, "task-1");
+    ASSERT_EQ(ids, vector<string>{"task-2"});
+    ASSERT_EQ(service.findTaskByID("task-1").output, "late");
+}
+
+TEST(TaskService, RemovedIdCanBeReused) {
+    TaskService service;
+    service.addTask(makeTask("parent#0"));
+    service.changeTaskStatus("parent#0", TaskStatus::Ready);
+
+    ASSERT_EQ(service.headers().size(), 1u);
+    ASSERT_TRUE(service.headers()[0].input.empty());
+    ASSERT_TRUE(service.removeTask("parent#0"));
+    ASSERT_FALSE(service.removeTask("parent#0"));
+    // a part of a task split again gets the id of the old one
+    ASSERT_NO_THROW(service.addTasks({makeTask("parent#0")}));
+    ASSERT_EQ(service.size(), 1u);
+}
+
+TEST(TaskService, HeaderHasNoInput) {
+    TaskService service;
+    service.addTask(makeTask("t1"));
+    Task task;
+    ASSERT_TRUE(service.findTaskHeader("t1", task));
+    ASSERT_EQ(task.func, "sum");
+    ASSERT_EQ(task.status, TaskStatus::Queued);
+    ASSERT_TRUE(task.input.empty());
+    ASSERT_FALSE(service.findTaskHeader("t2", task));
+}
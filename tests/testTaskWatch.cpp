@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "services/TaskWatch/TaskWatch.h"
+
+using namespace std;
+
+using Action = TaskWatch::Action;
+
+// every action the watch asks for, in order
+struct Recorder {
+    mutex mtx;
+    vector<pair<string, Action>> actions;
+
+    TaskWatch::Handler handler() {
+        return [this](const string &id, Action action) {
+            lock_guard<mutex> lock(mtx);
+            actions.emplace_back(id, action);
+        };
+    }
+
+    vector<pair<string, Action>> get() {
+        lock_guard<mutex> lock(mtx);
+        return actions;
+    }
+};
+
+static SpeculationPolicy fastPolicy(double percentile) {
+    SpeculationPolicy policy;
+    policy.percentile = percentile;
+    policy.minSamples = 5;
+    policy.period = chrono::milliseconds(5);
+    return policy;
+}
+
+TEST(TaskWatch, DeadlineExpiresQueuedTask) {
+    Recorder recorder;
+    TaskWatch watch;
+    watch.start(fastPolicy(0), recorder.handler());
+
+    auto none = TaskWatch::Clock::time_point::max();
+    ASSERT_FALSE(watch.needed(none, chrono::milliseconds(0)));
+    auto deadline = TaskWatch::Clock::now() + chrono::milliseconds(50);
+    ASSERT_TRUE(watch.needed(deadline, chrono::milliseconds(0)));
+    watch.watch("t1", "sum", deadline, chrono::milliseconds(0));
+
+    this_thread::sleep_for(chrono::milliseconds(100));
+    auto actions = recorder.get();
+    ASSERT_FALSE(actions.empty());
+    ASSERT_EQ(actions[0].first, "t1");
+    ASSERT_EQ(actions[0].second, Action::Expire);
+
+    TaskWatch::Copies copies;
+    ASSERT_TRUE(watch.finish("t1", "", copies));
+    ASSERT_FALSE(watch.finish("t1", "", copies));
+    watch.close();
+}
+
+TEST(TaskWatch, TimeoutStartsOneBackup) {
+    Recorder recorder;
+    TaskWatch watch;
+    watch.start(fastPolicy(0), recorder.handler());
+
+    watch.watch("t1", "sum", TaskWatch::Clock::time_point::max(), chrono::milliseconds(40));
+    watch.started("t1", "w1");
+    this_thread::sleep_for(chrono::milliseconds(60));
+    auto actions = recorder.get();
+    ASSERT_FALSE(actions.empty());
+    ASSERT_EQ(actions.back().second, Action::Backup);
+
+    ASSERT_TRUE(watch.addBackup("t1", "w2"));
+    ASSERT_FALSE(watch.addBackup("t1", "w3"));
+    size_t before = recorder.get().size();
+    this_thread::sleep_for(chrono::milliseconds(20));
+    // the backup runs, nothing to do until it is late as well
+    ASSERT_EQ(recorder.get().size(), before);
+
+    this_thread::sleep_for(chrono::milliseconds(40));
+    ASSERT_EQ(recorder.get().back().second, Action::TimeOut);
+
+    TaskWatch::Copies copies;
+    ASSERT_TRUE(watch.finish("t1", "w2", copies));
+    ASSERT_EQ(copies.primary, "w1");
+    ASSERT_EQ(copies.backup, "w2");
+    watch.close();
+}
+
+TEST(TaskWatch, SlowTaskPastPercentile) {
+    Recorder recorder;
+    TaskWatch watch;
+    watch.start(fastPolicy(90), recorder.handler());
+
+    TaskWatch::Copies copies;
+    for (int i = 0; i < 5; i++) {
+        string id = "fast-" + to_string(i);
+        watch.watch(id, "sum", TaskWatch::Clock::time_point::max(), chrono::milliseconds(0));
+        watch.started(id, "w1");
+        this_thread::sleep_for(chrono::milliseconds(10));
+        ASSERT_TRUE(watch.finish(id, "w1", copies));
+    }
+    auto threshold = watch.threshold("sum");
+    ASSERT_GE(threshold, chrono::milliseconds(10));
+    ASSERT_LT(threshold, chrono::milliseconds(100));
+    // no history for another function
+    ASSERT_EQ(watch.threshold("mul").count(), 0);
+    ASSERT_TRUE(recorder.get().empty());
+
+    watch.watch("slow", "sum", TaskWatch::Clock::time_point::max(), chrono::milliseconds(0));
+    watch.started("slow", "w1");
+    this_thread::sleep_for(threshold + chrono::milliseconds(50));
+    auto actions = recorder.get();
+    ASSERT_FALSE(actions.empty());
+    ASSERT_EQ(actions[0].first, "slow");
+    ASSERT_EQ(actions[0].second, Action::Backup);
+    watch.close();
+}
+
+TEST(TaskWatch, BackupThatDidNotStartIsAskedForLessOften) {
+    Recorder recorder;
+    TaskWatch watch;
+    watch.start(fastPolicy(0), recorder.handler());
+
+    watch.watch("t1", "sum", TaskWatch::Clock::time_point::max(), chrono::milliseconds(30));
+    watch.started("t1", "w1");
+    // no copy is added, the attempt times out at 60 ms
+    this_thread::sleep_for(chrono::milliseconds(55));
+    size_t backups = 0;
+    for (const auto &[id, action]: recorder.get()) {
+        backups += action == Action::Backup;
+    }
+    // asked at 30, 35 and 45 ms rather than every 5 ms
+    ASSERT_GE(backups, 1u);
+    ASSERT_LE(backups, 3u);
+
+    this_thread::sleep_for(chrono::milliseconds(30));
+    ASSERT_EQ(recorder.get().back().second, Action::TimeOut);
+    watch.close();
+}
+
+TEST(TaskWatch, ManyWatchedTasks) {
+    Recorder recorder;
+    TaskWatch watch;
+    watch.start(fastPolicy(90), recorder.handler());
+
+    TaskWatch::Copies copies;
+    for (int i = 0; i < 5; i++) {
+        string id = "fast-" + to_string(i);
+        watch.watch(id, "sum", TaskWatch::Clock::time_point::max(), chrono::milliseconds(0));
+        watch.started(id, "w1");
+        this_thread::sleep_for(chrono::milliseconds(2));
+        ASSERT_TRUE(watch.finish(id, "w1", copies));
+    }
+    auto never = TaskWatch::Clock::time_point::max();
+    auto soon = TaskWatch::Clock::now() + chrono::milliseconds(20);
+    for (int i = 0; i < 10000; i++) {
+        watch.watch("queued-" + to_string(i), "sum", i == 0 ? soon : never, chrono::milliseconds(0));
+    }
+    watch.watch("slow", "sum", never, chrono::milliseconds(0));
+    watch.started("slow", "w1");
+    this_thread::sleep_for(chrono::milliseconds(60));
+
+    auto actions = recorder.get();
+    bool expired = false, backup = false;
+    for (const auto &[id, action]: actions) {
+        expired |= id == "queued-0" && action == Action::Expire;
+        backup |= id == "slow" && action == Action::Backup;
+        // tasks that wait in the queue without a deadline are never due
+        ASSERT_TRUE(id == "queued-0" || id == "slow") << id;
+    }
+    ASSERT_TRUE(expired);
+    ASSERT_TRUE(backup);
+    watch.close();
+}
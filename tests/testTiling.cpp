@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "services/Tiling/Tiling.h"
+#include <nlohmann/json.hpp>
+
+using namespace std;
+using json = nlohmann::json;
+
+typedef vector<vector<int>> Matrix;
+
+static Matrix numbers(size_t rows, size_t cols, int seed) {
+    Matrix matrix(rows, vector<int>(cols));
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t c = 0; c < cols; c++) {
+            matrix[r][c] = static_cast<int>((r * 7 + c * 3 + seed) % 11) - 5;
+        }
+    }
+    return matrix;
+}
+
+// what a worker does with the request: panels by key, rows of A times columns of B
+static string runTile(map<string, Matrix> &held, const string &data) {
+    json request = json::parse(data);
+    for (auto &[key, panel]: request["panels"].items()) {
+        held[key] = panel.get<Matrix>();
+    }
+    const Matrix &rows = held.at(request["a"]);
+    const Matrix &columns = held.at(request["b"]);
+    Matrix tile(rows.size(), vector<int>(columns.size(), 0));
+    for (size_t r = 0; r < rows.size(); r++) {
+        for (size_t c = 0; c < columns.size(); c++) {
+            for (size_t k = 0; k < rows[r].size(); k++) tile[r][c] += rows[r][k] * columns[c][k];
+        }
+    }
+    for (const auto &key: request["drop"]) {
+        held.erase(key.get<string>());
+    }
+    return json(tile).dump();
+}
+
+TEST(Tiling, ProductOfTiles) {
+    TilingOptions options;
+    options.tile = 4;
+    Tiling tiling;
+    tiling.configure(options);
+
+    Matrix a = numbers(10, 7, 1), b = numbers(7, 9, 2);
+    ASSERT_TRUE(tiling.split("small", json({numbers(4, 7, 1), numbers(7, 4, 2)}).dump(), 1).empty());
+    ASSERT_TRUE(tiling.split("bad", json({numbers(10, 7, 1), numbers(6, 9, 2)}).dump(), 1).empty());
+
+    auto tiles = tiling.split("t", json({a, b}).dump(), 1);
+    // 3 row panels × 3 column panels
+    ASSERT_EQ(tiles.size(), 9u);
+    ASSERT_EQ(tiles[5].id, "t#1.2");
+    ASSERT_EQ(tiling.pending(), 9u);
+
+    map<string, Matrix> held;
+    string id;
+    Scatter::Gathered gathered;
+    Scatter::State state = Scatter::State::Pending;
+    while (tiling.take("w", 1, nullptr, id)) {
+        struct TaskRequest request;
+        ASSERT_TRUE(tiling.request(id, "w", request));
+        ASSERT_EQ(request.func, Tiling::FUNCTION);
+        string output = runTile(held, request.data);
+        state = tiling.complete(id, true, output.data(), output.size(), gathered);
+    }
+    ASSERT_EQ(state, Scatter::State::Done);
+    ASSERT_EQ(gathered.parent, "t");
+
+    Matrix product(10, vector<int>(9, 0));
+    for (size_t r = 0; r < 10; r++) {
+        for (size_t c = 0; c < 9; c++) {
+            for (size_t k = 0; k < 7; k++) product[r][c] += a[r][k] * b[k][c];
+        }
+    }
+    ASSERT_EQ(json::parse(gathered.output).get<Matrix>(), product);
+    ASSERT_FALSE(tiling.isTile("t#0.0"));
+}
+
+TEST(Tiling, PanelsAreSentOnceAndKeptWithinCache) {
+    TilingOptions options;
+    options.tile = 2;
+    Tiling tiling;
+    tiling.configure(options);
+    auto tiles = tiling.split("t", json({numbers(8, 3, 1), numbers(3, 8, 2)}).dump(), 1);
+    ASSERT_EQ(tiles.size(), 16u);
+
+    // a worker gets the tiles of the panels it holds or is about to get first
+    string first, second, third;
+    ASSERT_TRUE(tiling.take("w", 1, nullptr, first));
+    ASSERT_TRUE(tiling.take("w", 1, nullptr, second));
+    ASSERT_TRUE(tiling.take("v", 1, nullptr, third));
+    ASSERT_EQ(first, "t#0.0");
+    ASSERT_EQ(second, "t#0.1");
+    // another worker holds nothing, it starts where the row order is
+    ASSERT_EQ(third, "t#0.2");
+
+    struct TaskRequest request;
+    ASSERT_TRUE(tiling.request(first, "w", request));
+    json data = json::parse(request.data);
+    ASSERT_EQ(data["panels"].size(), 2u);
+    ASSERT_TRUE(tiling.request(second, "w", request));
+    data = json::parse(request.data);
+    // row panel 0 is held already
+    ASSERT_EQ(data["panels"].size(), 1u);
+    ASSERT_TRUE(data["panels"].contains("t/b1"));
+
+    // with room for three panels the least recently used one goes
+    options.workerCacheBytes = 3 * data["panels"]["t/b1"].dump().size();
+    tiling.configure(options);
+    ASSERT_TRUE(tiling.request("t#1.1", "w", request));
+    data = json::parse(request.data);
+    ASSERT_EQ(data["panels"].size(), 1u);
+    ASSERT_EQ(data["drop"], json({"t/b0"}));
+
+    // a claim that fails leaves the tile
+    string id;
+    ASSERT_FALSE(tiling.take("w", 1, [](int) { return false; }, id));
+    ASSERT_FALSE(tiling.take("w", 0, nullptr, id));
+}
+
+TEST(Tiling, FailedTileFailsProduct) {
+    TilingOptions options;
+    options.tile = 2;
+    Tiling tiling;
+    tiling.configure(options);
+    auto tiles = tiling.split("t", json({numbers(4, 2, 1), numbers(2, 4, 2)}).dump(), 1);
+    ASSERT_EQ(tiles.size(), 4u);
+
+    Scatter::Gathered gathered;
+    // the wrong size fails the product like an error
+    ASSERT_EQ(tiling.complete("t#0.0", true, "[[1]]", 5, gathered), Scatter::State::Failed);
+    ASSERT_EQ(gathered.output, "a tile has the wrong size");
+    ASSERT_EQ(gathered.remaining, (vector<string>{"t#0.1", "t#1.0", "t#1.1"}));
+    ASSERT_EQ(tiling.pending(), 0u);
+
+    Scatter::Gathered late;
+    ASSERT_EQ(tiling.complete("t#0.1", true, "[[1,1],[1,1]]", 13, late), Scatter::State::Abandoned);
+    tiling.settled("t#1.0");
+    ASSERT_EQ(tiling.complete("t#1.0", true, "[[1,1],[1,1]]", 13, late), Scatter::State::NotPart);
+    ASSERT_TRUE(tiling.abandon("t").empty());
+}
@@ -0,0 +1,211 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "services/UserDBService/UserDBService.h"
+
+using namespace std;
+
+TEST(UserDBService, PrefetchCredit) {
+    UserDBService db;
+    db.addWorker({"worker", 4, 0, nullptr, 2});
+
+    for (int i = 0; i < 4; i++) {
+        ASSERT_EQ(db.reserveCores(1, WorkerSelection::MostFree).prefetched, 0);
+    }
+    // the cores are busy, the next tasks take the credit
+    ASSERT_EQ(db.reserveCores(1, WorkerSelection::MostFree).prefetched, 1);
+    ASSERT_TRUE(db.reserveCores("worker", 1, true));
+    ASSERT_TRUE(db.reserveCores(1, WorkerSelection::MostFree).id.empty());
+    ASSERT_FALSE(db.reserveCores("worker", 1, true));
+    ASSERT_TRUE(db.findWorkerWithCredit().id.empty());
+
+    // a finished task starts a prefetched one and returns its credit
+    db.releaseCores("worker", 1, 1);
+    Worker worker = db.findWorkerByID("worker");
+    ASSERT_EQ(worker.usedCores, 5);
+    ASSERT_EQ(worker.prefetched, 1);
+    ASSERT_EQ(db.findWorkerWithCredit().id, "worker");
+
+    db.releaseCores("worker", 2, 2);
+    worker = db.findWorkerByID("worker");
+    ASSERT_EQ(worker.usedCores, 3);
+    ASSERT_EQ(worker.prefetched, 0);
+}
+
+TEST(UserDBService, FreeCoresBeforeCredit) {
+    UserDBService db;
+    db.addWorker({"busy", 2, 2, nullptr, 4});
+    db.addWorker({"free", 2, 0, nullptr, 0});
+
+    ASSERT_EQ(db.reserveCores(2, WorkerSelection::MostFree).id, "free");
+    ASSERT_EQ(db.reserveCores(2, WorkerSelection::MostFree).id, "busy");
+    // a task bigger than the worker is never prefetched to it
+    ASSERT_TRUE(db.reserveCores(3, WorkerSelection::MostFree).id.empty());
+}
+
+TEST(UserDBService, StealFromMostPrefetched) {
+    UserDBService db;
+    db.addWorker({"idle", 4, 0, nullptr, 2});
+    db.addWorker({"loaded", 2, 5, nullptr, 4, 3});
+    db.addWorker({"light", 2, 3, nullptr, 4, 1});
+
+    Worker victim = db.beginSteal("idle");
+    ASSERT_EQ(victim.id, "loaded");
+    // one steal at a time per victim
+    ASSERT_EQ(db.beginSteal("idle").id, "light");
+    ASSERT_TRUE(db.beginSteal("idle").id.empty());
+
+    db.endSteal("loaded", 2, 2);
+    Worker loaded = db.findWorkerByID("loaded");
+    ASSERT_EQ(loaded.usedCores, 3);
+    ASSERT_EQ(loaded.prefetched, 1);
+    ASSERT_EQ(loaded.stolen, 2);
+    ASSERT_FALSE(loaded.stealing);
+}
+
+TEST(UserDBService, WorkersOfQueue) {
+    UserDBService db;
+    Worker heavy = {"heavy", 8, 0, nullptr, 0};
+    heavy.queues = {"heavy"};
+    Worker light = {"light", 2, 0, nullptr, 0};
+    light.queues = {"default"};
+    db.addWorker(heavy);
+    db.addWorker(light);
+
+    ASSERT_EQ(db.workerCount(), 2u);
+    ASSERT_EQ(db.workerCount("heavy"), 1u);
+    ASSERT_EQ(db.workerCount("none"), 0u);
+    ASSERT_EQ(db.maxCores(), 8);
+    ASSERT_EQ(db.maxCores("default"), 2);
+    ASSERT_EQ(db.maxCores("none"), 0);
+    ASSERT_EQ(db.reserveCores(8, WorkerSelection::MostFree, "heavy").id, "heavy");
+    // the light worker is not asked although it is the only one with the cores left
+    ASSERT_TRUE(db.reserveCores(1, WorkerSelection::MostFree, "heavy").id.empty());
+    ASSERT_EQ(db.findMostFreeWorker(2, "default").id, "light");
+    ASSERT_EQ(db.findMostFreeWorker(2).id, "light");
+    ASSERT_TRUE(db.reserveSpareCores(1, "", "none").id.empty());
+
+    db.removeWorker(heavy);
+    ASSERT_EQ(db.maxCores(), 2);
+    ASSERT_EQ(db.maxCores("heavy"), 0);
+}
+
+TEST(UserDBService, ConcurrentReservesNeverOverbook) {
+    UserDBService db;
+    db.addWorker({"worker", 8, 0, nullptr, 0});
+
+    atomic<bool> overbooked{false};
+    vector<thread> threads;
+    for (int t = 0; t < 8; t++) {
+        threads.emplace_back([&db, &overbooked, t]() {
+            for (int i = 0; i < 2000; i++) {
+                bool reserved = t % 2 == 0 ? db.reserveCores("worker", 1)
+                                           : !db.reserveCores(1, WorkerSelection::MostFree).id.empty();
+                if (!reserved) continue;
+                if (db.findWorkerByID("worker").usedCores > 8) {
+                    overbooked = true;
+                }
+                db.releaseCores("worker", 1, 0);
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    ASSERT_FALSE(overbooked);
+    ASSERT_EQ(db.findWorkerByID("worker").usedCores, 0);
+
+    // every thread wants all cores, only as many reserves as there are cores succeed
+    atomic<int> reserved{0};
+    threads.clear();
+    for (int t = 0; t < 8; t++) {
+        threads.emplace_back([&db, &reserved]() {
+            for (int i = 0; i < 8; i++) {
+                reserved += db.reserveCores("worker", 1);
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    ASSERT_EQ(reserved, 8);
+    ASSERT_EQ(db.findWorkerByID("worker").usedCores, 8);
+}
+
+TEST(UserDBService, IndexFollowsChanges) {
+    UserDBService db;
+    mt19937 rng(11);
+    const vector<string> queues = {"", "a", "b"};
+    map<string, bool> live;
+
+    for (int step = 0; step < 5000; step++) {
+        string id = "w" + to_string(rng() % 8);
+        switch (rng() % 5) {
+            case 0:
+            case 1: {
+                Worker worker = {id, 1 + static_cast<int>(rng() % 8), static_cast<int>(rng() % 4), nullptr,
+                                 static_cast<int>(rng() % 3)};
+                worker.queues = {rng() % 2 == 0 ? "a" : "b"};
+                if (rng() % 3 == 0) worker.queues.push_back("b");
+                if (live[id] && rng() % 2 == 0) {
+                    db.updateWorker(worker);
+                } else {
+                    db.addWorker(worker);
+                }
+                live[id] = true;
+                break;
+            }
+            case 2:
+                ASSERT_EQ(db.removeWorker({id, 0, 0, nullptr}), live[id]);
+                live[id] = false;
+                break;
+            case 3:
+                db.reserveCores(id, 1 + static_cast<int>(rng() % 3), rng() % 2 == 0);
+                break;
+            case 4:
+                if (live[id]) db.releaseCores(id, static_cast<int>(rng() % 4), static_cast<int>(rng() % 2));
+                break;
+        }
+
+        for (const auto &queue: queues) {
+            int mostFree = INT_MIN, mostCredit = INT_MIN, biggest = 0;
+            size_t count = 0;
+            for (const auto &[workerId, alive]: live) {
+                if (!alive) continue;
+                Worker worker = db.findWorkerByID(workerId);
+                if (!queue.empty() && find(worker.queues.begin(), worker.queues.end(), queue) == worker.queues.end()) {
+                    continue;
+                }
+                count++;
+                mostFree = max(mostFree, worker.cores - worker.usedCores);
+                mostCredit = max(mostCredit, worker.prefetch - worker.prefetched);
+                biggest = max(biggest, worker.cores);
+            }
+            ASSERT_EQ(db.workerCount(queue), count) << "step " << step << " queue " << queue;
+            ASSERT_EQ(db.maxCores(queue), biggest) << "step " << step << " queue " << queue;
+
+            Worker free = db.findMostFreeWorker(INT_MIN, queue);
+            if (count == 0) {
+                ASSERT_TRUE(free.id.empty());
+                continue;
+            }
+            ASSERT_TRUE(live[free.id]) << "step " << step;
+            ASSERT_EQ(free.cores - free.usedCores, mostFree) << "step " << step << " queue " << queue;
+
+            Worker credit = db.findWorkerWithCredit(queue);
+            if (mostCredit <= 0) {
+                ASSERT_TRUE(credit.id.empty()) << "step " << step << " queue " << queue;
+            } else {
+                ASSERT_TRUE(live[credit.id]) << "step " << step;
+                ASSERT_EQ(credit.prefetch - credit.prefetched, mostCredit) << "step " << step << " queue " << queue;
+            }
+        }
+    }
+}
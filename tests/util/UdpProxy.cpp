@@ -75,6 +75,18 @@ void UdpProxy::start() {
                 }
             }
 
+            if (test_4_corrupt_command__3) {
+                if (test_skip_counter < test_skip_target_count) {
+                    if (command == 3 && len > 0) {
+                        std::cout << "[Proxy] Corrupt command: " << command << std::endl;
+                        recv_buffer_[len - 1] ^= 0x5A;
+                        test_skip_counter++;
+                    }
+                } else {
+                    test_4_corrupt_command__3 = false;
+                }
+            }
+
             if (remote_endpoint == client_endpoint_) {
                 socket_.send_to(boost::asio::buffer(recv_buffer_, len), server_endpoint_, 0, error);
                 if (error) {
@@ -153,6 +165,18 @@ void UdpProxy::stopTest_3() {
     test_skip_target_count = 0;
 }
 
+void UdpProxy::runTest_4(int target_count) {
+    test_4_corrupt_command__3 = true;
+    test_skip_counter = 0;
+    test_skip_target_count = target_count;
+}
+
+void UdpProxy::stopTest_4() {
+    test_4_corrupt_command__3 = false;
+    test_skip_counter = 0;
+    test_skip_target_count = 0;
+}
+
 UdpProxy::~UdpProxy() {
     async_stop();
 }
@@ -28,6 +28,8 @@ public:
     void stopTest_2();
     void runTest_3(int target_count);
     void stopTest_3();
+    void runTest_4(int target_count);
+    void stopTest_4();
     ~UdpProxy();
 
 private:
@@ -49,6 +51,7 @@ private:
     int test_skip_target_count;
     bool test_2_skip_command__4 = false;
     bool test_3_skip_command__0 = false;
+    bool test_4_corrupt_command__3 = false;
 };
 
 #endif // UDPPROXY_HPP